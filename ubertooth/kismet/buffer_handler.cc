@@ -20,6 +20,8 @@
 
 #include <stdlib.h>
 
+#include <chrono>
+
 #include "util.h"
 #include "buffer_handler.h"
 
@@ -29,6 +31,8 @@ BufferHandlerGeneric::BufferHandlerGeneric() {
 
     rbuf_notify = NULL;
     wbuf_notify = NULL;
+
+    read_pause_until = 0;
 }
 
 BufferHandlerGeneric::~BufferHandlerGeneric() {
@@ -87,6 +91,19 @@ ssize_t BufferHandlerGeneric::GetWriteBufferAvailable() {
     return 0;
 }
 
+static uint64_t read_pause_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BufferHandlerGeneric::PauseRead(unsigned int in_ms) {
+    read_pause_until = read_pause_now_ms() + in_ms;
+}
+
+bool BufferHandlerGeneric::GetReadPaused() {
+    return read_pause_until != 0 && read_pause_now_ms() < read_pause_until;
+}
+
 ssize_t BufferHandlerGeneric::PeekReadBufferData(void **in_ptr, size_t in_sz) {
     if (in_ptr == NULL)
         return 0;
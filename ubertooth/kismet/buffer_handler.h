@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <atomic>
 #include <string>
 #include <functional>
 #include <streambuf>
@@ -290,6 +291,12 @@ public:
     // a shutdown of the line connections
     virtual void SetProtocolErrorCb(std::function<void (void)> in_cb);
 
+    // Ask the line driver to stop reading into the read buffer for up to in_ms,
+    // so the sender blocks instead of us queueing more data; drivers check
+    // GetReadPaused before selecting for reads
+    virtual void PauseRead(unsigned int in_ms);
+    virtual bool GetReadPaused();
+
 protected:
     // Generic buffers
     CommonBuffer *read_buffer;
@@ -305,6 +312,9 @@ protected:
 
     std::function<void (size_t)> readbuf_drain_cb;
     std::function<void (size_t)> writebuf_drain_cb;
+
+    // Steady clock time, in ms, until which reads are paused
+    std::atomic<uint64_t> read_pause_until;
 };
 
 template<class B> 
@@ -338,6 +338,13 @@ kis_capture_handler_t *cf_handler_init(const char *in_type) {
     ch->gps_fixed_alt = 0;
     ch->gps_name = NULL;
 
+    /* No batching until the server asks for it */
+    ch->batch_max = 0;
+    ch->batch_buf = NULL;
+    ch->batch_len = 0;
+    ch->batch_start.tv_sec = 0;
+    ch->batch_start.tv_usec = 0;
+
     /* Allocate a smaller incoming ringbuffer since most of our traffic is
      * on the outgoing channel */
     ch->in_ringbuf = kis_simple_ringbuf_create(1024 * 16);
@@ -368,6 +375,7 @@ kis_capture_handler_t *cf_handler_init(const char *in_type) {
     ch->spindown = 0;
 
     pthread_mutex_init(&(ch->handler_lock), &mutexattr);
+    pthread_mutex_init(&(ch->batch_lock), NULL);
 
     ch->listdevices_cb = NULL;
     ch->probe_cb = NULL;
@@ -463,8 +471,12 @@ void cf_handler_free(kis_capture_handler_t *caph) {
         caph->hopping_running = 0;
     }
 
+    if (caph->batch_buf != NULL)
+        free(caph->batch_buf);
+
     pthread_mutex_destroy(&(caph->out_ringbuf_lock));
     pthread_mutex_destroy(&(caph->handler_lock));
+    pthread_mutex_destroy(&(caph->batch_lock));
 }
 
 cf_params_interface_t *cf_params_interface_new() {
@@ -1410,6 +1422,14 @@ int cf_handle_rx_data(kis_capture_handler_t *caph) {
                 goto finish;
             }
             
+            /* Newer servers take batched data reports */
+            pthread_mutex_lock(&(caph->batch_lock));
+            if (open_cmd->has_max_batch_bytes)
+                caph->batch_max = open_cmd->max_batch_bytes;
+            else
+                caph->batch_max = 0;
+            pthread_mutex_unlock(&(caph->batch_lock));
+
             msgstr[0] = 0;
             cbret = (*(caph->open_cb))(caph,
                     kds_cmd->seqno, open_cmd->definition,
@@ -1809,6 +1829,13 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
 
         pthread_mutex_unlock(&(caph->handler_lock));
 
+        /* Push out any batch which has waited long enough, or everything if
+         * we're spinning down */
+        if (cf_flush_data(caph, spindown) < 0) {
+            rv = -1;
+            break;
+        }
+
         max_fd = 0;
 
         /* Only set read sets if we're not spinning down */
@@ -1836,6 +1863,12 @@ int cf_handler_loop(kis_capture_handler_t *caph) {
         tm.tv_sec = 0;
         tm.tv_usec = 500000;
 
+        /* Wake up in time to send a pending batch */
+        pthread_mutex_lock(&(caph->batch_lock));
+        if (caph->batch_len != 0)
+            tm.tv_usec = CF_BATCH_MS * 1000;
+        pthread_mutex_unlock(&(caph->batch_lock));
+
         if ((ret = select(max_fd + 1, &rset, &wset, NULL, &tm)) < 0) {
             if (errno != EINTR && errno != EAGAIN) {
                 fprintf(stderr, "FATAL:  Error during select(): %s\n", strerror(errno));
@@ -2000,7 +2033,8 @@ int cf_send_raw_bytes(kis_capture_handler_t *caph, uint8_t *data, size_t len) {
     return 1;
 }
 
-int cf_send_packet(kis_capture_handler_t *caph, const char *packtype,
+/* Frame and queue a command without taking ownership of the data */
+static int cf_frame_packet(kis_capture_handler_t *caph, const char *packtype,
         uint8_t *data, size_t len) {
     uint32_t seqno;
     KismetExternal__Command cmd;
@@ -2026,7 +2060,8 @@ int cf_send_packet(kis_capture_handler_t *caph, const char *packtype,
     pthread_mutex_unlock(&(caph->handler_lock));
 
     cmd.seqno = seqno;
-    cmd.command = strdup(packtype);
+    /* Only read by the packer, no need to copy it */
+    cmd.command = (char *) packtype;
     cmd.content.data = data;
     cmd.content.len = len;
    
@@ -2035,8 +2070,6 @@ int cf_send_packet(kis_capture_handler_t *caph, const char *packtype,
 
     if (send_buffer == NULL) {
         fprintf(stderr, "FATAL:  Unable to allocate the buffer for writing a packet");
-        free(cmd.command);
-        free(data);
         return -1;
     }
 
@@ -2059,8 +2092,17 @@ int cf_send_packet(kis_capture_handler_t *caph, const char *packtype,
     r = cf_send_raw_bytes(caph, send_buffer, data_sz + sizeof(kismet_external_frame_t));
 
     free(send_buffer);
+
+    return r;
+}
+
+int cf_send_packet(kis_capture_handler_t *caph, const char *packtype,
+        uint8_t *data, size_t len) {
+    int r;
+
+    r = cf_frame_packet(caph, packtype, data, len);
+
     free(data);
-    free(cmd.command);
 
     return r;
 }
@@ -2465,6 +2507,114 @@ int cf_send_openresp(kis_capture_handler_t *caph, uint32_t seq, unsigned int suc
     return cf_send_packet(caph, "KDSOPENSOURCEREPORT", buf, buf_len);
 }
 
+/* Milliseconds since the first packet in the batch was queued; call with 
+ * batch_lock held */
+static long cf_batch_age_ms(kis_capture_handler_t *caph) {
+    struct timeval now;
+
+    if (caph->batch_len == 0)
+        return 0;
+
+    gettimeofday(&now, NULL);
+
+    return (now.tv_sec - caph->batch_start.tv_sec) * 1000 +
+        (now.tv_usec - caph->batch_start.tv_usec) / 1000;
+}
+
+/* Send the current batch as a single frame; call with batch_lock held.  The
+ * batch is kept if there's no room in the write buffer so it can be retried. */
+static int cf_send_batch(kis_capture_handler_t *caph) {
+    int r;
+
+    if (caph->batch_len == 0)
+        return 1;
+
+    r = cf_frame_packet(caph, "KDSDATABATCHREPORT", caph->batch_buf, caph->batch_len);
+
+    if (r > 0)
+        caph->batch_len = 0;
+
+    return r;
+}
+
+/* Append a packed data report to the batch as a repeated DataBatchReport
+ * field.  Returns 2 if the report should be sent on its own instead, because
+ * batching is off or it doesn't fit in a batch at all. */
+static int cf_batch_data(kis_capture_handler_t *caph, 
+        KismetDatasource__DataReport *kedata, size_t report_len) {
+    size_t budget, need, v;
+    uint8_t *pos;
+    int r;
+
+    pthread_mutex_lock(&(caph->batch_lock));
+
+    if (caph->batch_max == 0) {
+        pthread_mutex_unlock(&(caph->batch_lock));
+        return 2;
+    }
+
+    budget = CF_BATCH_BYTES;
+    if (budget > caph->batch_max)
+        budget = caph->batch_max;
+
+    /* Field tag, varint length, report */
+    need = 1 + 1 + report_len;
+    for (v = report_len; v >= 0x80; v >>= 7)
+        need++;
+
+    if (need > budget) {
+        /* Keep the order of the stream; anything already batched goes first */
+        r = cf_send_batch(caph);
+        pthread_mutex_unlock(&(caph->batch_lock));
+        return r > 0 ? 2 : r;
+    }
+
+    if (caph->batch_buf == NULL) {
+        caph->batch_buf = (uint8_t *) malloc(CF_BATCH_BYTES);
+
+        if (caph->batch_buf == NULL) {
+            pthread_mutex_unlock(&(caph->batch_lock));
+            return -1;
+        }
+    }
+
+    /* Make room by sending what we have */
+    if (caph->batch_len + need > budget) {
+        if ((r = cf_send_batch(caph)) <= 0) {
+            pthread_mutex_unlock(&(caph->batch_lock));
+            return r;
+        }
+    }
+
+    if (caph->batch_len == 0)
+        gettimeofday(&(caph->batch_start), NULL);
+
+    pos = caph->batch_buf + caph->batch_len;
+
+    /* DataBatchReport.report, field 1, length delimited */
+    *pos++ = (1 << 3) | 2;
+    for (v = report_len; v >= 0x80; v >>= 7)
+        *pos++ = (v & 0x7F) | 0x80;
+    *pos++ = v;
+
+    kismet_datasource__data_report__pack(kedata, pos);
+
+    caph->batch_len += need;
+
+    /* Send it now if it's full or old; if the write buffer is full it stays
+     * queued and goes out on a later flush */
+    if (caph->batch_len + 64 > budget || cf_batch_age_ms(caph) >= CF_BATCH_MS) {
+        if (cf_send_batch(caph) < 0) {
+            pthread_mutex_unlock(&(caph->batch_lock));
+            return -1;
+        }
+    }
+
+    pthread_mutex_unlock(&(caph->batch_lock));
+
+    return 1;
+}
+
 int cf_send_data(kis_capture_handler_t *caph,
         KismetExternal__MsgbusMessage *kv_message,
         KismetDatasource__SubSignal *kv_signal,
@@ -2519,22 +2669,45 @@ int cf_send_data(kis_capture_handler_t *caph,
 
     uint8_t *buf;
     size_t buf_len;
+    int r;
 
     buf_len = kismet_datasource__data_report__get_packed_size(&kedata);
-    buf = (uint8_t *) malloc(buf_len);
 
-    if (buf == NULL) {
-        return -1;
-    }
+    /* Queue it in the current batch if the server takes them */
+    r = cf_batch_data(caph, &kedata, buf_len);
+
+    if (r == 2) {
+        buf = (uint8_t *) malloc(buf_len);
 
-    kismet_datasource__data_report__pack(&kedata, buf);
+        if (buf == NULL) {
+            r = -1;
+        } else {
+            kismet_datasource__data_report__pack(&kedata, buf);
+            r = cf_send_packet(caph, "KDSDATAREPORT", buf, buf_len);
+        }
+    }
 
     if (kegps.name != NULL)
         free(kegps.name);
     if (kegps.type != NULL)
         free(kegps.type);
 
-    return cf_send_packet(caph, "KDSDATAREPORT", buf, buf_len);
+    return r;
+}
+
+int cf_flush_data(kis_capture_handler_t *caph, int force) {
+    int r;
+
+    pthread_mutex_lock(&(caph->batch_lock));
+
+    if (force || cf_batch_age_ms(caph) >= CF_BATCH_MS)
+        r = cf_send_batch(caph);
+    else
+        r = 1;
+
+    pthread_mutex_unlock(&(caph->batch_lock));
+
+    return r;
 }
 
 
@@ -230,6 +230,10 @@ typedef int (*cf_callback_spectrumconfig)(kis_capture_handler_t *, uint32_t seqn
     unsigned int amp, uint64_t if_amp, uint64_t baseband_amp, 
     KismetExternal__Command *command);
 
+/* Size and latency budgets for batched data reports */
+#define CF_BATCH_BYTES      16384
+#define CF_BATCH_MS         25
+
 struct kis_capture_handler {
     /* Capture source type */
     char *capsource_type;
@@ -335,6 +339,14 @@ struct kis_capture_handler {
 
     /* Fixed GPS name */
     char *gps_name;
+
+    /* Batched data reports; batch_max is 0 until Kismet tells us it takes 
+     * batches, and until then every packet is sent as its own frame */
+    pthread_mutex_t batch_lock;
+    size_t batch_max;
+    uint8_t *batch_buf;
+    size_t batch_len;
+    struct timeval batch_start;
 };
 
 
@@ -744,6 +756,21 @@ int cf_send_data(kis_capture_handler_t *caph,
         KismetDatasource__SubGps *kv_gps,
         struct timeval ts, uint32_t dlt, uint32_t packet_sz, uint8_t *pack);
 
+/* Send any batched DATA reports
+ * Can be called from any thread
+ *
+ * When Kismet accepts batched reports, cf_send_data queues packets and sends
+ * them as one frame once CF_BATCH_BYTES are queued or the oldest has waited
+ * CF_BATCH_MS; the select loop flushes late batches on its own.  Capture tools
+ * can force the batch out early, for instance when the device goes idle.
+ *
+ * Returns:
+ * -1   An error occurred
+ *  0   Insufficient space in buffer
+ *  1   Success, or nothing to send
+ */
+int cf_flush_data(kis_capture_handler_t *caph, int force);
+
 /* Send a CONFIGRESP with only a success and optional message
  *
  * Returns:
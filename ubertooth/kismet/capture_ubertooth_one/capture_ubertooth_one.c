@@ -0,0 +1,929 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Ubertooth One capture binary
+ *
+ * Talks to the stock ubertooth firmware over libusb and streams either
+ * BTLE link-layer packets (DLT_BLUETOOTH_LE_LL_WITH_PHDR) or BR/EDR
+ * access codes found by libbtbb (DLT_BLUETOOTH_BREDR_BB) to the Kismet
+ * server.
+ *
+ * Sources are defined as:
+ *  ubertooth
+ *  ubertooth-bus#-dev#
+ * with an optional 'mode=btle' (default) or 'mode=bredr' flag.
+ */
+
+#include "../config.h"
+
+#include "ubertooth_one.h"
+
+#include <libusb-1.0/libusb.h>
+#include <btbb.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <endian.h>
+
+#include "../capture_framework.h"
+
+/* USB command timeout */
+#define UBERTOOTH_USB_TIMEOUT       1000
+
+/* Bulk read timeout; the firmware sends a keep-alive at least every 400ms so
+ * this only expires if the device has gone away */
+#define UBERTOOTH_BULK_TIMEOUT      2000
+
+#define UBERTOOTH_MODE_BTLE         0
+#define UBERTOOTH_MODE_BREDR        1
+
+/* Access code errors tolerated when searching for BR/EDR packets */
+#define UBERTOOTH_MAX_AC_ERRORS     2
+
+/* Symbols in one usb_pkt_rx block, and the length of the access code
+ * libbtbb matches on */
+#define UBERTOOTH_BLOCK_SYMS        (UBERTOOTH_SYM_LEN * 8)
+#define UBERTOOTH_AC_SYMS           72
+
+/* Default hop rate, in channels per second */
+#define UBERTOOTH_HOP_RATE          5
+
+/* Largest record we generate from a single block */
+#define UBERTOOTH_MAX_RECORD \
+    (sizeof(ubertooth_bredr_bb_header_t) + UBERTOOTH_SYM_LEN)
+
+/* Unique instance data passed around by capframework */
+typedef struct {
+    libusb_context *libusb_ctx;
+    libusb_device_handle *ubertooth_handle;
+
+    unsigned int devno, busno;
+
+    pthread_mutex_t usb_mutex;
+
+    int mode;
+
+    /* we don't want to do a channel query every data response, we just want to
+     * remember the last channel used */
+    unsigned int channel;
+
+    /* BR/EDR packets can straddle two blocks, so keep the previous block
+     * around; the access code search runs over the older block with the newer
+     * one as lookahead */
+    ubertooth_usb_pkt_rx_t br_prev;
+    int br_have_prev;
+    char br_symbols[UBERTOOTH_BLOCK_SYMS * 2];
+
+    kis_capture_handler_t *caph;
+} local_ubertooth_t;
+
+/* Channels are LE channel indexes in btle mode and 1MHz channels in bredr
+ * mode; both are stored as a frequency */
+typedef struct {
+    unsigned int channel;
+    unsigned int freq_mhz;
+} local_channel_t;
+
+/* One decoded record, queued until the whole bulk read has been processed */
+typedef struct {
+    uint32_t dlt;
+    uint32_t len;
+    uint8_t data[UBERTOOTH_MAX_RECORD];
+} local_record_t;
+
+/* Map an LE channel index to a frequency */
+unsigned int ubertooth_btle_freq(unsigned int channel) {
+    if (channel == 37)
+        return 2402;
+    if (channel == 38)
+        return 2426;
+    if (channel == 39)
+        return 2480;
+    if (channel < 11)
+        return 2404 + channel * 2;
+    return 2428 + (channel - 11) * 2;
+}
+
+/* Models the cc2400 datasheet figure 22 for 1M as piece-wise linear, the same
+ * as the ubertooth host tools */
+int8_t ubertooth_rssi_to_dbm(int8_t rssi) {
+    if (rssi < -48)
+        return -120;
+    else if (rssi <= -45)
+        return 6 * (rssi + 28);
+    else if (rssi <= 30)
+        return (int8_t) ((99 * ((int) rssi - 62)) / 110);
+    else if (rssi <= 35)
+        return (int8_t) ((60 * ((int) rssi - 35)) / 11);
+
+    return 0;
+}
+
+int ubertooth_usb_match(struct libusb_device_descriptor *dev) {
+    return dev->idVendor == UBERTOOTH_USB_VENDOR &&
+        (dev->idProduct == UBERTOOTH_ONE_USB_PRODUCT ||
+         dev->idProduct == UBERTOOTH_ZERO_USB_PRODUCT);
+}
+
+int ubertooth_send_command(kis_capture_handler_t *caph, uint8_t request, uint16_t value,
+        uint8_t *data, size_t len) {
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+    int r;
+
+    pthread_mutex_lock(&(localuber->usb_mutex));
+
+    r = libusb_control_transfer(localuber->ubertooth_handle,
+            LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT,
+            request, value, 0, data, len, UBERTOOTH_USB_TIMEOUT);
+
+    pthread_mutex_unlock(&(localuber->usb_mutex));
+
+    return r;
+}
+
+int ubertooth_set_channel(kis_capture_handler_t *caph, uint16_t freq_mhz) {
+    return ubertooth_send_command(caph, UBERTOOTH_SET_CHANNEL, freq_mhz, NULL, 0);
+}
+
+/* Put the radio in the capture mode for this source */
+int ubertooth_start(kis_capture_handler_t *caph, uint16_t freq_mhz) {
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+    int r;
+
+    if ((r = ubertooth_send_command(caph, UBERTOOTH_STOP, 0, NULL, 0)) < 0)
+        return r;
+
+    if (localuber->mode == UBERTOOTH_MODE_BTLE) {
+        if ((r = ubertooth_send_command(caph, UBERTOOTH_SET_MOD,
+                        UBERTOOTH_MOD_BT_LOW_ENERGY, NULL, 0)) < 0)
+            return r;
+
+        if ((r = ubertooth_set_channel(caph, freq_mhz)) < 0)
+            return r;
+
+        return ubertooth_send_command(caph, UBERTOOTH_BTLE_SNIFFING, 2, NULL, 0);
+    }
+
+    if ((r = ubertooth_send_command(caph, UBERTOOTH_SET_MOD,
+                    UBERTOOTH_MOD_BT_BASIC_RATE, NULL, 0)) < 0)
+        return r;
+
+    if ((r = ubertooth_set_channel(caph, freq_mhz)) < 0)
+        return r;
+
+    return ubertooth_send_command(caph, UBERTOOTH_RX_SYMBOLS, 0, NULL, 0);
+}
+
+/* Parse the mode flag out of a source definition */
+int ubertooth_parse_mode(char *definition, char *msg) {
+    char *placeholder = NULL;
+    int placeholder_len;
+
+    if ((placeholder_len = cf_find_flag(&placeholder, "mode", definition)) > 0) {
+        if (strncasecmp(placeholder, "btle", placeholder_len) == 0)
+            return UBERTOOTH_MODE_BTLE;
+
+        if (strncasecmp(placeholder, "bredr", placeholder_len) == 0)
+            return UBERTOOTH_MODE_BREDR;
+
+        snprintf(msg, STATUS_MAX, "Unknown ubertooth mode '%.*s', expected 'btle' or "
+                "'bredr'", placeholder_len, placeholder);
+        return -1;
+    }
+
+    return UBERTOOTH_MODE_BTLE;
+}
+
+/* Channels we report to the server; in btle mode we default to the advertising
+ * channels, any data channel can still be requested explicitly */
+void ubertooth_fill_channels(int mode, cf_params_interface_t *interface) {
+    unsigned int i;
+    char chstr[4];
+
+    if (mode == UBERTOOTH_MODE_BTLE) {
+        interface->channels = (char **) malloc(sizeof(char *) * 3);
+        for (i = 0; i < 3; i++) {
+            snprintf(chstr, 4, "%u", 37 + i);
+            interface->channels[i] = strdup(chstr);
+        }
+        interface->channels_len = 3;
+    } else {
+        interface->channels = (char **) malloc(sizeof(char *) * 79);
+        for (i = 0; i < 79; i++) {
+            snprintf(chstr, 4, "%u", i);
+            interface->channels[i] = strdup(chstr);
+        }
+        interface->channels_len = 79;
+    }
+}
+
+/* Find an ubertooth by bus and device, or the first one if busno is negative */
+libusb_device *ubertooth_find_device(libusb_device **libusb_devs, ssize_t libusb_devices_cnt,
+        int *busno, int *devno) {
+    int r;
+
+    for (ssize_t i = 0; i < libusb_devices_cnt; i++) {
+        struct libusb_device_descriptor dev;
+
+        r = libusb_get_device_descriptor(libusb_devs[i], &dev);
+
+        if (r < 0) {
+            continue;
+        }
+
+        if (!ubertooth_usb_match(&dev))
+            continue;
+
+        if (*busno >= 0) {
+            if (*busno == libusb_get_bus_number(libusb_devs[i]) &&
+                    *devno == libusb_get_device_address(libusb_devs[i])) {
+                return libusb_devs[i];
+            }
+        } else {
+            *busno = libusb_get_bus_number(libusb_devs[i]);
+            *devno = libusb_get_device_address(libusb_devs[i]);
+            return libusb_devs[i];
+        }
+    }
+
+    return NULL;
+}
+
+int probe_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
+        char *msg, char **uuid, KismetExternal__Command *frame,
+        cf_params_interface_t **ret_interface,
+        cf_params_spectrum_t **ret_spectrum) {
+
+    char *placeholder = NULL;
+    int placeholder_len;
+    char *interface;
+    char errstr[STATUS_MAX];
+
+    *ret_spectrum = NULL;
+    *ret_interface = cf_params_interface_new();
+
+    int x, mode;
+    int busno = -1, devno = -1;
+
+    libusb_device **libusb_devs = NULL;
+    ssize_t libusb_devices_cnt = 0;
+
+    int matched_device = 0;
+
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+
+    if ((placeholder_len = cf_parse_interface(&placeholder, definition)) <= 0) {
+        snprintf(msg, STATUS_MAX, "Unable to find interface in definition");
+        return 0;
+    }
+
+    interface = strndup(placeholder, placeholder_len);
+
+    /* Look for the interface type */
+    if (strstr(interface, "ubertooth") != interface) {
+        free(interface);
+        return 0;
+    }
+
+    /* Look for interface-bus-dev */
+    x = sscanf(interface, "ubertooth-%d-%d", &busno, &devno);
+
+    free(interface);
+
+    /* If we don't have a valid busno/devno or malformed interface name */
+    if (x != -1 && x != 2) {
+        return 0;
+    }
+
+    if ((mode = ubertooth_parse_mode(definition, msg)) < 0)
+        return 0;
+
+    libusb_devices_cnt = libusb_get_device_list(localuber->libusb_ctx, &libusb_devs);
+
+    if (libusb_devices_cnt < 0) {
+        return 0;
+    }
+
+    matched_device = ubertooth_find_device(libusb_devs, libusb_devices_cnt,
+            &busno, &devno) != NULL;
+
+    libusb_free_device_list(libusb_devs, 1);
+
+    if (!matched_device)
+        return 0;
+
+    /* Make a spoofed, but consistent, UUID based on the adler32 of the interface name
+     * and the location in the bus */
+    snprintf(errstr, STATUS_MAX, "%08X-0000-0000-0000-%06X%06X",
+            adler32_csum((unsigned char *) "kismet_cap_ubertooth_one",
+                strlen("kismet_cap_ubertooth_one")) & 0xFFFFFFFF,
+            busno, devno);
+    *uuid = strdup(errstr);
+
+    ubertooth_fill_channels(mode, *ret_interface);
+
+    return 1;
+}
+
+int list_callback(kis_capture_handler_t *caph, uint32_t seqno,
+        char *msg, cf_params_list_interface_t ***interfaces) {
+    /* Basic list of devices */
+    typedef struct uber_list {
+        char *device;
+        struct uber_list *next;
+    } uber_list_t;
+
+    uber_list_t *devs = NULL;
+    size_t num_devs = 0;
+
+    libusb_device **libusb_devs = NULL;
+    ssize_t libusb_devices_cnt = 0;
+    int r;
+
+    char devname[32];
+
+    unsigned int i;
+
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+
+    libusb_devices_cnt = libusb_get_device_list(localuber->libusb_ctx, &libusb_devs);
+
+    if (libusb_devices_cnt < 0) {
+        return 0;
+    }
+
+    for (ssize_t i = 0; i < libusb_devices_cnt; i++) {
+        struct libusb_device_descriptor dev;
+
+        r = libusb_get_device_descriptor(libusb_devs[i], &dev);
+
+        if (r < 0) {
+            continue;
+        }
+
+        if (ubertooth_usb_match(&dev)) {
+            snprintf(devname, 32, "ubertooth-%u-%u",
+                libusb_get_bus_number(libusb_devs[i]),
+                libusb_get_device_address(libusb_devs[i]));
+
+            uber_list_t *d = (uber_list_t *) malloc(sizeof(uber_list_t));
+            num_devs++;
+            d->device = strdup(devname);
+            d->next = devs;
+            devs = d;
+        }
+    }
+    libusb_free_device_list(libusb_devs, 1);
+
+    if (num_devs == 0) {
+        *interfaces = NULL;
+        return 0;
+    }
+
+    *interfaces =
+        (cf_params_list_interface_t **) malloc(sizeof(cf_params_list_interface_t *) * num_devs);
+
+    i = 0;
+
+    while (devs != NULL) {
+        uber_list_t *td = devs->next;
+        (*interfaces)[i] = (cf_params_list_interface_t *) malloc(sizeof(cf_params_list_interface_t));
+        memset((*interfaces)[i], 0, sizeof(cf_params_list_interface_t));
+
+        (*interfaces)[i]->interface = devs->device;
+        (*interfaces)[i]->flags = NULL;
+        (*interfaces)[i]->hardware = strdup("ubertooth_one");
+
+        free(devs);
+        devs = td;
+
+        i++;
+    }
+
+    return num_devs;
+}
+
+void *chantranslate_callback(kis_capture_handler_t *caph, char *chanstr) {
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+    local_channel_t *ret_localchan;
+    unsigned int parsechan;
+    unsigned int maxchan;
+    char errstr[STATUS_MAX];
+
+    maxchan = localuber->mode == UBERTOOTH_MODE_BTLE ? 39 : 78;
+
+    if (sscanf(chanstr, "%u", &parsechan) != 1 || parsechan > maxchan) {
+        snprintf(errstr, STATUS_MAX, "unable to parse requested channel '%s'; ubertooth "
+                "%s channels are from 0 to %u", chanstr,
+                localuber->mode == UBERTOOTH_MODE_BTLE ? "btle" : "bredr", maxchan);
+        cf_send_message(caph, errstr, MSGFLAG_INFO);
+        return NULL;
+    }
+
+    ret_localchan = (local_channel_t *) malloc(sizeof(local_channel_t));
+    ret_localchan->channel = parsechan;
+
+    if (localuber->mode == UBERTOOTH_MODE_BTLE)
+        ret_localchan->freq_mhz = ubertooth_btle_freq(parsechan);
+    else
+        ret_localchan->freq_mhz = 2402 + parsechan;
+
+    return ret_localchan;
+}
+
+int chancontrol_callback(kis_capture_handler_t *caph, uint32_t seqno, void *privchan,
+        char *msg) {
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+    local_channel_t *channel = (local_channel_t *) privchan;
+
+    int r;
+
+    if (privchan == NULL) {
+        return 0;
+    }
+
+    r = ubertooth_set_channel(caph, channel->freq_mhz);
+
+    if (r < 0) {
+        snprintf(msg, STATUS_MAX, "Unable to set ubertooth channel %u: %s",
+                channel->channel, libusb_strerror((enum libusb_error) r));
+        return -1;
+    }
+
+    localuber->channel = channel->channel;
+
+    /* Symbols from the previous channel can't be joined to the new one */
+    localuber->br_have_prev = 0;
+
+    return 1;
+}
+
+int open_callback(kis_capture_handler_t *caph, uint32_t seqno, char *definition,
+        char *msg, uint32_t *dlt, char **uuid, KismetExternal__Command *frame,
+        cf_params_interface_t **ret_interface,
+        cf_params_spectrum_t **ret_spectrum) {
+
+    char *placeholder = NULL;
+    int placeholder_len;
+    char *interface;
+    char errstr[STATUS_MAX];
+
+    *ret_spectrum = NULL;
+    *ret_interface = cf_params_interface_new();
+
+    int x;
+    int busno = -1, devno = -1;
+
+    libusb_device **libusb_devs = NULL;
+    libusb_device *matched_dev = NULL;
+    ssize_t libusb_devices_cnt = 0;
+    int r;
+
+    char cap_if[32];
+
+    char **hop_chans;
+    void **hop_privs;
+    size_t hop_sz, i;
+
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+
+    if ((placeholder_len = cf_parse_interface(&placeholder, definition)) <= 0) {
+        snprintf(msg, STATUS_MAX, "Unable to find interface in definition");
+        return 0;
+    }
+
+    interface = strndup(placeholder, placeholder_len);
+
+    /* Look for the interface type */
+    if (strstr(interface, "ubertooth") != interface) {
+        snprintf(msg, STATUS_MAX, "Unable to find ubertooth interface");
+        free(interface);
+        return -1;
+    }
+
+    /* Look for interface-bus-dev */
+    x = sscanf(interface, "ubertooth-%d-%d", &busno, &devno);
+
+    free(interface);
+
+    /* If we don't have a valid busno/devno or malformed interface name */
+    if (x != -1 && x != 2) {
+        snprintf(msg, STATUS_MAX, "Malformed ubertooth interface, expected 'ubertooth' or "
+                "'ubertooth-bus#-dev#'");
+        return -1;
+    }
+
+    if ((localuber->mode = ubertooth_parse_mode(definition, msg)) < 0)
+        return -1;
+
+    libusb_devices_cnt = libusb_get_device_list(localuber->libusb_ctx, &libusb_devs);
+
+    if (libusb_devices_cnt < 0) {
+        snprintf(msg, STATUS_MAX, "Unable to iterate USB devices");
+        return -1;
+    }
+
+    matched_dev = ubertooth_find_device(libusb_devs, libusb_devices_cnt,
+            &busno, &devno);
+
+    if (matched_dev == NULL) {
+        libusb_free_device_list(libusb_devs, 1);
+        snprintf(msg, STATUS_MAX, "Unable to find ubertooth USB device");
+        return -1;
+    }
+
+    snprintf(cap_if, 32, "ubertooth-%u-%u", busno, devno);
+
+    localuber->devno = devno;
+    localuber->busno = busno;
+
+    /* Make a spoofed, but consistent, UUID based on the adler32 of the interface name
+     * and the location in the bus */
+    snprintf(errstr, STATUS_MAX, "%08X-0000-0000-0000-%06X%06X",
+            adler32_csum((unsigned char *) "kismet_cap_ubertooth_one",
+                strlen("kismet_cap_ubertooth_one")) & 0xFFFFFFFF,
+            busno, devno);
+    *uuid = strdup(errstr);
+
+    (*ret_interface)->capif = strdup(cap_if);
+    (*ret_interface)->hardware = strdup("ubertooth_one");
+
+    ubertooth_fill_channels(localuber->mode, *ret_interface);
+
+    /* Packets carry their own DLT since a source can produce either */
+    *dlt = localuber->mode == UBERTOOTH_MODE_BTLE ?
+        UBERTOOTH_DLT_LE_LL_WITH_PHDR : UBERTOOTH_DLT_BREDR_BB;
+
+    /* Try to open it */
+    r = libusb_open(matched_dev, &localuber->ubertooth_handle);
+
+    libusb_free_device_list(libusb_devs, 1);
+
+    if (r < 0) {
+        snprintf(msg, STATUS_MAX, "Unable to open ubertooth USB interface: %s",
+                libusb_strerror((enum libusb_error) r));
+        return -1;
+    }
+
+    /* Try to claim it */
+    r = libusb_claim_interface(localuber->ubertooth_handle, 0);
+    if (r < 0) {
+        if (r == LIBUSB_ERROR_BUSY) {
+            /* Try to detach the kernel driver */
+            r = libusb_detach_kernel_driver(localuber->ubertooth_handle, 0);
+            if (r < 0) {
+                snprintf(msg, STATUS_MAX, "Unable to open ubertooth USB interface, and unable "
+                        "to disconnect existing driver: %s",
+                        libusb_strerror((enum libusb_error) r));
+                return -1;
+            }
+
+            /* And claim it now that it's free */
+            r = libusb_claim_interface(localuber->ubertooth_handle, 0);
+            if (r < 0) {
+                snprintf(msg, STATUS_MAX, "Unable to open ubertooth USB interface after "
+                        "disconnecting existing driver: %s",
+                        libusb_strerror((enum libusb_error) r));
+                return -1;
+            }
+        } else {
+            snprintf(msg, STATUS_MAX, "Unable to open ubertooth USB interface: %s",
+                    libusb_strerror((enum libusb_error) r));
+            return -1;
+        }
+    }
+
+    if (localuber->mode == UBERTOOTH_MODE_BTLE)
+        localuber->channel = 37;
+    else
+        localuber->channel = 0;
+
+    r = ubertooth_start(caph, localuber->mode == UBERTOOTH_MODE_BTLE ?
+            ubertooth_btle_freq(localuber->channel) : 2402 + localuber->channel);
+
+    if (r < 0) {
+        snprintf(msg, STATUS_MAX, "Unable to start ubertooth capture: %s",
+                libusb_strerror((enum libusb_error) r));
+        return -1;
+    }
+
+    /* Start hopping the default channels right away; the server replaces this
+     * list with its own configuration, and a fixed channel cancels it */
+    hop_sz = (*ret_interface)->channels_len;
+    hop_chans = (char **) malloc(sizeof(char *) * hop_sz);
+    hop_privs = (void **) malloc(sizeof(void *) * hop_sz);
+
+    for (i = 0; i < hop_sz; i++) {
+        hop_chans[i] = strdup((*ret_interface)->channels[i]);
+        hop_privs[i] = chantranslate_callback(caph, hop_chans[i]);
+    }
+
+    cf_handler_assign_hop_channels(caph, hop_chans, hop_privs, hop_sz,
+            UBERTOOTH_HOP_RATE, 0, 0, 0);
+
+    return 1;
+}
+
+/* Build a DLT_BLUETOOTH_LE_LL_WITH_PHDR record from a LE_PACKET block.  The
+ * firmware has already found the access address and dewhitened the PDU. */
+int ubertooth_decode_btle(ubertooth_usb_pkt_rx_t *rx, local_record_t *rec) {
+    ubertooth_le_ll_header_t *hdr = (ubertooth_le_ll_header_t *) rec->data;
+    uint32_t aa;
+    uint16_t flags;
+    int8_t sig, noise;
+    int len;
+
+    if (rx->pkt_type != UBERTOOTH_LE_PACKET)
+        return 0;
+
+    /* AA, 2 byte header, payload, CRC */
+    len = (rx->data[5] & 0x3f) + 4 + 2 + 3;
+    if (len > UBERTOOTH_SYM_LEN)
+        len = UBERTOOTH_SYM_LEN;
+
+    aa = rx->data[0] | (rx->data[1] << 8) | (rx->data[2] << 16) |
+        ((uint32_t) rx->data[3] << 24);
+
+    sig = ubertooth_rssi_to_dbm(rx->rssi_max);
+    noise = ubertooth_rssi_to_dbm(rx->rssi_avg);
+
+    flags = LE_DEWHITENED | LE_SIGPOWER_VALID;
+    if (noise < sig)
+        flags |= LE_NOISEPOWER_VALID;
+    if (aa == LE_ADV_ACCESS_ADDRESS)
+        flags |= LE_REF_AA_VALID;
+
+    hdr->rf_channel = rx->channel / 2;
+    hdr->signal_power = sig;
+    hdr->noise_power = noise;
+    hdr->access_address_offenses = 0;
+    hdr->ref_access_address = htole32(aa == LE_ADV_ACCESS_ADDRESS ? aa : 0);
+    hdr->flags = htole16(flags);
+
+    memcpy(rec->data + sizeof(ubertooth_le_ll_header_t), rx->data, len);
+
+    rec->dlt = UBERTOOTH_DLT_LE_LL_WITH_PHDR;
+    rec->len = sizeof(ubertooth_le_ll_header_t) + len;
+
+    return 1;
+}
+
+/* Search a block of BR/EDR symbols for access codes; each one found becomes a
+ * DLT_BLUETOOTH_BREDR_BB record with no payload.  Returns the number of
+ * records written, up to max_rec. */
+int ubertooth_decode_bredr(local_ubertooth_t *localuber, ubertooth_usb_pkt_rx_t *rx,
+        local_record_t *rec, int max_rec) {
+    ubertooth_usb_pkt_rx_t *prev = &(localuber->br_prev);
+    ubertooth_bredr_bb_header_t *hdr;
+    btbb_packet *pkt;
+    int i, j, offset, start, nrec = 0;
+    uint16_t flags;
+    int8_t sig, noise;
+
+    if (rx->pkt_type != UBERTOOTH_BR_PACKET)
+        return 0;
+
+    /* Unpack the new block behind the previous one */
+    for (i = 0; i < UBERTOOTH_SYM_LEN; i++) {
+        for (j = 0; j < 8; j++) {
+            localuber->br_symbols[UBERTOOTH_BLOCK_SYMS + i * 8 + j] =
+                (rx->data[i] >> (7 - j)) & 0x01;
+        }
+    }
+
+    if (localuber->br_have_prev && prev->channel == rx->channel) {
+        sig = ubertooth_rssi_to_dbm(prev->rssi_max > rx->rssi_max ?
+                prev->rssi_max : rx->rssi_max);
+        noise = ubertooth_rssi_to_dbm(prev->rssi_avg);
+
+        flags = BREDR_SIGPOWER_VALID;
+        if (noise < sig)
+            flags |= BREDR_NOISEPOWER_VALID;
+
+        start = 0;
+        while (nrec < max_rec && start < UBERTOOTH_BLOCK_SYMS) {
+            pkt = NULL;
+
+            offset = btbb_find_ac(localuber->br_symbols + start,
+                    UBERTOOTH_BLOCK_SYMS - start, LAP_ANY,
+                    UBERTOOTH_MAX_AC_ERRORS, &pkt);
+
+            if (offset < 0)
+                break;
+
+            hdr = (ubertooth_bredr_bb_header_t *) rec[nrec].data;
+            memset(hdr, 0, sizeof(ubertooth_bredr_bb_header_t));
+
+            hdr->rf_channel = prev->channel;
+            hdr->signal_power = sig;
+            hdr->noise_power = noise;
+            hdr->access_code_offenses = btbb_packet_get_ac_errors(pkt);
+            hdr->payload_transport_rate = (BTBB_TRANSPORT_ANY << 4) | BTBB_MOD_GFSK;
+            hdr->lap = htole32(btbb_packet_get_lap(pkt));
+            hdr->flags = htole16(flags);
+
+            rec[nrec].dlt = UBERTOOTH_DLT_BREDR_BB;
+            rec[nrec].len = sizeof(ubertooth_bredr_bb_header_t);
+            nrec++;
+
+            btbb_packet_unref(pkt);
+
+            start += offset + UBERTOOTH_AC_SYMS;
+        }
+    }
+
+    /* Slide the new block down to become the previous one */
+    memcpy(localuber->br_symbols, localuber->br_symbols + UBERTOOTH_BLOCK_SYMS,
+            UBERTOOTH_BLOCK_SYMS);
+    memcpy(prev, rx, sizeof(ubertooth_usb_pkt_rx_t));
+    localuber->br_have_prev = 1;
+
+    return nrec;
+}
+
+void capture_thread(kis_capture_handler_t *caph) {
+    local_ubertooth_t *localuber = (local_ubertooth_t *) caph->userdata;
+
+    char errstr[STATUS_MAX];
+
+    uint8_t usb_buf[UBERTOOTH_PKT_LEN * UBERTOOTH_PKTS_PER_XFER];
+
+    /* A BR/EDR block can hold a couple of access codes */
+    local_record_t records[UBERTOOTH_PKTS_PER_XFER * 4];
+    int num_records;
+
+    int buf_rx_len, r, b, i;
+
+    while (1) {
+        if (caph->spindown) {
+            /* close usb */
+            if (localuber->ubertooth_handle) {
+                ubertooth_send_command(caph, UBERTOOTH_STOP, 0, NULL, 0);
+                libusb_close(localuber->ubertooth_handle);
+                localuber->ubertooth_handle = NULL;
+            }
+
+            break;
+        }
+
+        /* Pull as many blocks as the device has ready in one bulk read; a
+         * short read (or a keep-alive) ends the transfer early */
+        r = libusb_bulk_transfer(localuber->ubertooth_handle, UBERTOOTH_USB_ENDPOINT_IN,
+                usb_buf, sizeof(usb_buf), &buf_rx_len, UBERTOOTH_BULK_TIMEOUT);
+
+        if (r < 0 && r != LIBUSB_ERROR_TIMEOUT) {
+            snprintf(errstr, STATUS_MAX, "ubertooth interface 'ubertooth-%u-%u' closed "
+                    "unexpectedly", localuber->busno, localuber->devno);
+            cf_send_error(caph, 0, errstr);
+            cf_handler_spindown(caph);
+            break;
+        }
+
+        /* Decode the whole read before talking to the server */
+        num_records = 0;
+
+        for (b = 0; b + UBERTOOTH_PKT_LEN <= buf_rx_len; b += UBERTOOTH_PKT_LEN) {
+            ubertooth_usb_pkt_rx_t *rx = (ubertooth_usb_pkt_rx_t *) (usb_buf + b);
+
+            if (localuber->mode == UBERTOOTH_MODE_BTLE) {
+                num_records += ubertooth_decode_btle(rx, &records[num_records]);
+            } else {
+                num_records += ubertooth_decode_bredr(localuber, rx, &records[num_records],
+                        4);
+            }
+        }
+
+        if (num_records == 0) {
+            /* The device has gone quiet; don't leave a partial batch of
+             * reports waiting on the latency budget */
+            if (r == LIBUSB_ERROR_TIMEOUT && cf_flush_data(caph, 1) < 0) {
+                cf_send_error(caph, 0, "unable to send DATA frame");
+                cf_handler_spindown(caph);
+                break;
+            }
+
+            continue;
+        }
+
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        for (i = 0; i < num_records; i++) {
+            while (1) {
+                if ((r = cf_send_data(caph,
+                                NULL, NULL, NULL,
+                                tv,
+                                records[i].dlt,
+                                records[i].len, records[i].data)) < 0) {
+                    cf_send_error(caph, 0, "unable to send DATA frame");
+                    cf_handler_spindown(caph);
+                    break;
+                } else if (r == 0) {
+                    cf_handler_wait_ringbuffer(caph);
+                    continue;
+                } else {
+                    break;
+                }
+            }
+
+            if (r < 0)
+                break;
+        }
+    }
+
+    cf_handler_spindown(caph);
+}
+
+int main(int argc, char *argv[]) {
+    local_ubertooth_t localuber = {
+        .libusb_ctx = NULL,
+        .ubertooth_handle = NULL,
+        .mode = UBERTOOTH_MODE_BTLE,
+        .br_have_prev = 0,
+        .caph = NULL,
+    };
+
+    pthread_mutex_init(&(localuber.usb_mutex), NULL);
+
+    kis_capture_handler_t *caph = cf_handler_init("ubertooth_one");
+    int r;
+
+    if (caph == NULL) {
+        fprintf(stderr, "FATAL: Could not allocate basic handler data, your system "
+                "is very low on RAM or something is wrong.\n");
+        return -1;
+    }
+
+    r = libusb_init(&localuber.libusb_ctx);
+    if (r < 0) {
+        return -1;
+    }
+
+    /* Only needed for bredr mode, but cheap at this error limit */
+    if (btbb_init(UBERTOOTH_MAX_AC_ERRORS) < 0) {
+        fprintf(stderr, "FATAL: Could not initialize libbtbb\n");
+        return -1;
+    }
+
+    localuber.caph = caph;
+
+    /* Set the local data ptr */
+    cf_handler_set_userdata(caph, &localuber);
+
+    /* Set the callback for opening  */
+    cf_handler_set_open_cb(caph, open_callback);
+
+    /* Set the callback for probing an interface */
+    cf_handler_set_probe_cb(caph, probe_callback);
+
+    /* Set the list callback */
+    cf_handler_set_listdevices_cb(caph, list_callback);
+
+    /* Channel callbacks */
+    cf_handler_set_chantranslate_cb(caph, chantranslate_callback);
+    cf_handler_set_chancontrol_cb(caph, chancontrol_callback);
+
+    /* Set the capture thread */
+    cf_handler_set_capture_cb(caph, capture_thread);
+
+    if (cf_handler_parse_opts(caph, argc, argv) < 1) {
+        cf_print_help(caph, argv[0]);
+        return -1;
+    }
+
+    /* Support remote capture by launching the remote loop */
+    cf_handler_remote_capture(caph);
+
+    /* Jail our ns */
+    cf_jail_filesystem(caph);
+
+    /* Strip our privs */
+    cf_drop_most_caps(caph);
+
+    cf_handler_loop(caph);
+
+    libusb_exit(localuber.libusb_ctx);
+
+    return 0;
+}
+
@@ -0,0 +1,110 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "../config.h"
+
+#ifndef __UBERTOOTH_ONE_H__
+#define __UBERTOOTH_ONE_H__
+
+#include <stdint.h>
+
+#define UBERTOOTH_USB_VENDOR            0x1d50
+#define UBERTOOTH_ONE_USB_PRODUCT       0x6002
+#define UBERTOOTH_ZERO_USB_PRODUCT      0x6000
+
+/* Vendor control requests, from the ubertooth firmware interface */
+#define UBERTOOTH_RX_SYMBOLS            1
+#define UBERTOOTH_SET_CHANNEL           12
+#define UBERTOOTH_STOP                  21
+#define UBERTOOTH_SET_MOD               23
+#define UBERTOOTH_BTLE_SNIFFING         42
+#define UBERTOOTH_SET_ACCESS_ADDRESS    44
+
+#define UBERTOOTH_MOD_BT_BASIC_RATE     0
+#define UBERTOOTH_MOD_BT_LOW_ENERGY     1
+
+/* Packet types the firmware puts in usb_pkt_rx.pkt_type */
+#define UBERTOOTH_BR_PACKET             0
+#define UBERTOOTH_LE_PACKET             1
+
+/* Bulk data endpoint; the firmware streams 64 byte usb_pkt_rx blocks */
+#define UBERTOOTH_USB_ENDPOINT_IN       0x82
+#define UBERTOOTH_PKT_LEN               64
+#define UBERTOOTH_SYM_LEN               50
+
+/* Blocks per bulk read; every block in a read is decoded and queued for
+ * the server (batched, when the server supports it) before the next read
+ * is issued */
+#define UBERTOOTH_PKTS_PER_XFER         8
+
+typedef struct __attribute__((packed)) {
+    uint8_t pkt_type;
+    uint8_t status;
+    /* MHz above 2402 */
+    uint8_t channel;
+    uint8_t clkn_high;
+    uint32_t clk100ns;
+    int8_t rssi_max;
+    int8_t rssi_min;
+    int8_t rssi_avg;
+    uint8_t rssi_count;
+    uint8_t reserved[2];
+    uint8_t data[UBERTOOTH_SYM_LEN];
+} ubertooth_usb_pkt_rx_t;
+
+/* DLT_BLUETOOTH_BREDR_BB pseudo-header */
+#define UBERTOOTH_DLT_BREDR_BB          255
+
+typedef struct __attribute__((packed)) {
+    uint8_t rf_channel;
+    int8_t signal_power;
+    int8_t noise_power;
+    uint8_t access_code_offenses;
+    uint8_t payload_transport_rate;
+    uint8_t corrected_header_bits;
+    int16_t corrected_payload_bits;
+    uint32_t lap;
+    uint32_t ref_lap_uap;
+    uint32_t bt_header;
+    uint16_t flags;
+} ubertooth_bredr_bb_header_t;
+
+#define BREDR_SIGPOWER_VALID            0x0002
+#define BREDR_NOISEPOWER_VALID          0x0004
+
+/* DLT_BLUETOOTH_LE_LL_WITH_PHDR pseudo-header */
+#define UBERTOOTH_DLT_LE_LL_WITH_PHDR   256
+
+typedef struct __attribute__((packed)) {
+    uint8_t rf_channel;
+    int8_t signal_power;
+    int8_t noise_power;
+    uint8_t access_address_offenses;
+    uint32_t ref_access_address;
+    uint16_t flags;
+} ubertooth_le_ll_header_t;
+
+#define LE_DEWHITENED                   0x0001
+#define LE_SIGPOWER_VALID               0x0002
+#define LE_NOISEPOWER_VALID             0x0004
+#define LE_REF_AA_VALID                 0x0010
+
+#define LE_ADV_ACCESS_ADDRESS           0x8e89bed6
+
+#endif
+
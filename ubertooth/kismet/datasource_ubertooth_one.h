@@ -0,0 +1,95 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __DATASOURCE_UBERTOOTH_ONE_H__
+#define __DATASOURCE_UBERTOOTH_ONE_H__
+
+#include "config.h"
+
+#define HAVE_UBERTOOTH_ONE_DATASOURCE
+
+#include "kis_datasource.h"
+
+class KisDatasourceUbertoothOne;
+typedef std::shared_ptr<KisDatasourceUbertoothOne> SharedDatasourceUbertoothOne;
+
+class KisDatasourceUbertoothOne : public KisDatasource {
+public:
+    KisDatasourceUbertoothOne(SharedDatasourceBuilder in_builder) :
+        KisDatasource(in_builder) {
+
+        // Set the capture binary
+        set_int_source_ipc_binary("kismet_cap_ubertooth_one");
+
+        // No linktype override; the capture binary tags each packet as
+        // BTLE (DLT 256) or BR/EDR (DLT 255)
+    }
+
+    virtual ~KisDatasourceUbertoothOne() { };
+};
+
+
+class DatasourceUbertoothOneBuilder : public KisDatasourceBuilder {
+public:
+    DatasourceUbertoothOneBuilder(int in_id) :
+        KisDatasourceBuilder(in_id) {
+
+        register_fields();
+        reserve_fields(NULL);
+        initialize();
+    }
+
+    DatasourceUbertoothOneBuilder(int in_id, std::shared_ptr<TrackerElementMap> e) :
+        KisDatasourceBuilder(in_id, e) {
+
+        register_fields();
+        reserve_fields(e);
+        initialize();
+    }
+
+    DatasourceUbertoothOneBuilder() :
+        KisDatasourceBuilder() {
+
+        register_fields();
+        reserve_fields(NULL);
+        initialize();
+    }
+
+    virtual ~DatasourceUbertoothOneBuilder() { }
+
+    virtual SharedDatasource build_datasource(SharedDatasourceBuilder in_sh_this) {
+        return SharedDatasourceUbertoothOne(new KisDatasourceUbertoothOne(in_sh_this));
+    }
+
+    virtual void initialize() {
+        // Set up our basic parameters for the ubertooth driver
+        
+        set_source_type("ubertooth_one");
+        set_source_description("Ubertooth One BTLE and BR/EDR");
+
+        set_probe_capable(true);
+        set_list_capable(true);
+        set_local_capable(true);
+        set_remote_capable(true);
+        set_passive_capable(false);
+        set_tune_capable(true);
+    }
+};
+
+#endif
+
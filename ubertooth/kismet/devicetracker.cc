@@ -70,6 +70,9 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
     // Create the pcap httpd
     httpd_pcap = std::make_shared<Devicetracker_Httpd_Pcap>();
 
+    // Create the device change stream
+    httpd_subscribe = std::make_shared<Devicetracker_Httpd_Subscribe>();
+
     entrytracker =
         Globalreg::FetchMandatoryGlobalAs<EntryTracker>("ENTRYTRACKER");
 
@@ -105,6 +108,10 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
         entrytracker->RegisterField("kismet.devicelist.timestamp",
                 TrackerElementFactory<TrackerElementUInt64>(),
                 "device list timestamp");
+    device_update_seq_id =
+        entrytracker->RegisterField("kismet.devicelist.sequence",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "device list change sequence");
 
     // These need unique IDs to be put in the map for serialization.
     // They also need unique field names, we can rename them with setlocalname
@@ -232,7 +239,7 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 
                             // Run the device storage in its own thread
                             std::thread t([this] {
-                                store_devices(immutable_tracked_vec);
+                                store_all_devices();
 
                                 {
                                     local_locker l(&storing_mutex);
@@ -326,7 +333,6 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
     unsigned int preload_sz = 
         globalreg->kismet_config->FetchOptUInt("tracker_device_presize", 1000);
 
-    tracked_vec.reserve(preload_sz);
     immutable_tracked_vec->reserve(preload_sz);
 
     // Set up the device timeout
@@ -369,6 +375,16 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 
     full_refresh_time = globalreg->timestamp.tv_sec;
 
+    // The thread running a match works on it too, so by default use one helper
+    // less than the number of cores
+    unsigned int ncores = std::max(std::thread::hardware_concurrency(), 1U);
+    match_threads_max =
+        globalreg->kismet_config->FetchOptUInt("tracker_match_threads", ncores - 1);
+    match_chunk_size =
+        std::max(globalreg->kismet_config->FetchOptUInt("tracker_match_chunk", 1024), 1U);
+    match_idle = 0;
+    match_shutdown = false;
+
     track_history_cloud =
         globalreg->kismet_config->FetchOptBoolean("keep_location_cloud_history", true);
 
@@ -408,6 +424,8 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 }
 
 Devicetracker::~Devicetracker() {
+    stop_match_pool();
+
     local_locker lock(&devicelist_mutex);
 
     if (statestore != NULL) {
@@ -443,9 +461,14 @@ Devicetracker::~Devicetracker() {
         delete p->second;
     }
 
-    tracked_vec.clear();
     immutable_tracked_vec->clear();
-    tracked_mac_multimap.clear();
+    free_device_ids.clear();
+    idle_heap.clear();
+    evict_heap.clear();
+    tracked_table.clear();
+    seen_index.clear();
+    sort_cache.clear();
+    std::atomic_store(&tracked_snapshot, device_snapshot_t());
 }
 
 Kis_Phy_Handler *Devicetracker::FetchPhyHandler(int in_phy) {
@@ -481,9 +504,7 @@ std::string Devicetracker::FetchPhyName(int in_phy) {
 }
 
 int Devicetracker::FetchNumDevices() {
-    local_locker lock(&devicelist_mutex);
-
-    return tracked_map.size();
+    return tracked_table.size();
 }
 
 int Devicetracker::FetchNumPackets() {
@@ -514,19 +535,39 @@ void Devicetracker::UpdateFullRefresh() {
 }
 
 std::shared_ptr<kis_tracked_device_base> Devicetracker::FetchDevice(device_key in_key) {
+    return tracked_table.find(in_key);
+}
+
+Devicetracker::device_snapshot_t Devicetracker::FetchDeviceSnapshot() {
+    auto snap = std::atomic_load(&tracked_snapshot);
+
+    if (snap != nullptr)
+        return snap;
+
     local_locker lock(&devicelist_mutex);
 
-	device_itr i = tracked_map.find(in_key);
+    // Someone else may have rebuilt it while we waited
+    snap = std::atomic_load(&tracked_snapshot);
+
+    if (snap == nullptr) {
+        auto live = std::make_shared<std::vector<std::shared_ptr<kis_tracked_device_base>>>();
+        live->reserve(tracked_table.size());
 
-	if (i != tracked_map.end())
-		return i->second;
+        for (auto i : *immutable_tracked_vec) {
+            if (i != nullptr)
+                live->push_back(std::static_pointer_cast<kis_tracked_device_base>(i));
+        }
+
+        snap = live;
+        std::atomic_store(&tracked_snapshot, snap);
+    }
 
-	return NULL;
+    return snap;
 }
 
 int Devicetracker::CommonTracker(kis_packet *in_pack) {
-    local_locker lock(&devicelist_mutex);
-
+    // Only counters are updated here; the phy maps are populated when the phys
+    // are registered and never change shape after that
 	if (in_pack->error) {
 		// and bail
 		num_errorpackets++;
@@ -536,8 +577,10 @@ int Devicetracker::CommonTracker(kis_packet *in_pack) {
 	kis_common_info *pack_common =
         (kis_common_info *) in_pack->fetch(pack_comp_common);
 
-    if (!ram_no_rrd)
+    if (!ram_no_rrd) {
+        local_locker lock(&packets_rrd_mutex);
         packets_rrd->add_sample(1, globalreg->timestamp.tv_sec);
+    }
 
     num_packets++;
 
@@ -599,8 +642,9 @@ std::shared_ptr<kis_tracked_device_base>
             mac_addr in_mac, Kis_Phy_Handler *in_phy, kis_packet *in_pack, 
             unsigned int in_flags, std::string in_basic_type) {
 
-    // We must protect the device list to determine if the device is 'new'
-    local_locker list_locker(&devicelist_mutex);
+    // Only creating a device needs the device list; existing devices are found in
+    // the sharded table and updated under their own lock
+    local_demand_locker list_locker(&devicelist_mutex);
 
     std::stringstream sstr;
 
@@ -622,12 +666,17 @@ std::shared_ptr<kis_tracked_device_base>
         if (in_flags & UCD_UPDATE_EXISTING_ONLY)
             return NULL;
 
+        // Hold the list until the new device is populated and inserted, and check
+        // again in case another thread created it while we waited for the lock
+        list_locker.lock();
+        device = FetchDevice(key);
+    }
+
+    if (device == NULL) {
         device =
             std::make_shared<kis_tracked_device_base>(device_base_id);
-        // Device ID is the size of the vector so a new device always gets put
-        // in it's numbered slot
-        device->set_kis_internal_id(immutable_tracked_vec->size());
 
+        // The device ID is assigned when it's inserted into the list
         device->set_key(key);
         device->set_macaddr(in_mac);
         device->set_phyname(in_phy->FetchPhyName());
@@ -666,9 +715,15 @@ std::shared_ptr<kis_tracked_device_base>
     // Update the mod data
     device->update_modtime();
 
+    httpd_subscribe->device_changed(device);
+
     if (device->get_last_time() < in_pack->ts.tv_sec)
         device->set_last_time(in_pack->ts.tv_sec);
 
+    // The index decides whether a device seen again within the same second needs
+    // a new sequence
+    seen_index.update(device, in_pack->ts.tv_sec);
+
     if (in_flags & UCD_UPDATE_PACKETS) {
         device->inc_packets();
 
@@ -795,13 +850,7 @@ std::shared_ptr<kis_tracked_device_base>
 
     // Add the new device at the end once we've populated it
     if (new_device) {
-        tracked_map[key] = device;
-
-        tracked_vec.push_back(device);
-        immutable_tracked_vec->push_back(device);
-
-        auto mm_pair = std::make_pair(in_mac, device);
-        tracked_mac_multimap.insert(mm_pair);
+        insert_device(device);
 
         new_view_device(device);
     }
@@ -828,31 +877,169 @@ void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> wo
 
 }
 
-void Devicetracker::MatchOnDevicesRaw(std::shared_ptr<DevicetrackerFilterWorker> worker, 
-        std::shared_ptr<TrackerElementVector> vec, bool batch) {
+template<typename V>
+void Devicetracker::match_chunked(std::shared_ptr<DevicetrackerFilterWorker> worker,
+        V& vec, bool batch) {
+
+    size_t nchunks = (vec.size() + match_chunk_size - 1) / match_chunk_size;
+
+    worker->PrepareChunks(nchunks);
+
+    // Devices matched by each chunk, merged in source order once all the chunks 
+    // are done so the results don't depend on which thread matched what
+    std::vector<std::vector<std::shared_ptr<kis_tracked_device_base>>> chunk_matches(nchunks);
+
+    auto match_chunk = [this, worker, &vec, &chunk_matches](size_t chunk) {
+        if (worker->Cancelled())
+            return;
+
+        size_t end = std::min(vec.size(), (chunk + 1) * match_chunk_size);
+
+        for (size_t i = chunk * match_chunk_size; i < end; i++) {
+            if (vec[i] == nullptr)
+                continue;
+
+            auto v = std::static_pointer_cast<kis_tracked_device_base>(vec[i]);
+
+            bool m;
+
+            // Lock the device itself inside the worker op
+            {
+                local_locker devlocker(&v->device_mutex);
+                m = worker->MatchDeviceChunk(this, v, chunk);
+            }
+
+            if (m)
+                chunk_matches[chunk].push_back(v);
+        }
+    };
+
+    if (batch && nchunks > 1 && match_threads_max > 0 && worker->ConcurrentMatch()) {
+        struct match_state {
+            std::atomic<size_t> next_chunk;
+            std::mutex mutex;
+            std::condition_variable cv;
+            size_t done;
+            std::exception_ptr error;
+        };
+
+        auto state = std::make_shared<match_state>();
+        state->next_chunk = 0;
+        state->done = 0;
+
+        // Claim chunks until there are none left.  Helpers which only get a thread
+        // after every chunk has been claimed return without touching the chunks,
+        // so they can safely outlive this call.
+        auto run_chunks = [state, worker, match_chunk, nchunks]() {
+            size_t chunk;
+
+            while ((chunk = state->next_chunk++) < nchunks) {
+                // Whatever a chunk throws goes to the caller; nothing above a
+                // helper thread could catch it, and the caller still has to be
+                // released
+                try {
+                    match_chunk(chunk);
+                } catch (...) {
+                    worker->Cancel();
+
+                    std::lock_guard<std::mutex> lk(state->mutex);
+                    if (state->error == nullptr)
+                        state->error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lk(state->mutex);
+                if (++state->done == nchunks)
+                    state->cv.notify_all();
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> lk(match_mutex);
+
+            if (!match_shutdown) {
+                size_t nhelpers = std::min<size_t>(nchunks - 1, match_threads_max);
+                unsigned int idle = match_idle;
 
-    kismet__for_each(vec->begin(), vec->end(), [&](SharedTrackerElement val) {
-           if (val == nullptr)
-               return;
+                for (size_t h = 0; h < nhelpers; h++) {
+                    match_queue.push_back(run_chunks);
+
+                    if (idle > 0) {
+                        idle--;
+                        match_cv.notify_one();
+                    } else if (match_threads.size() < match_threads_max) {
+                        match_threads.push_back(std::thread([this]() { match_worker(); }));
+                    }
+                }
+            }
+        }
 
-           std::shared_ptr<kis_tracked_device_base> v = 
-               std::static_pointer_cast<kis_tracked_device_base>(val);
+        run_chunks();
 
-           bool m;
+        {
+            std::unique_lock<std::mutex> lk(state->mutex);
+            state->cv.wait(lk, [state, nchunks]() { return state->done == nchunks; });
+        }
 
-           // Lock the device itself inside the worker op
-           {
-               local_locker devlocker(&(v->device_mutex));
-               m = worker->MatchDevice(this, v);
-           }
+        if (state->error != nullptr)
+            std::rethrow_exception(state->error);
+    } else {
+        for (size_t c = 0; c < nchunks; c++)
+            match_chunk(c);
+    }
 
-           if (m) 
-               worker->MatchedDevice(v);
-       });
+    for (const auto& cm : chunk_matches) {
+        for (const auto& d : cm)
+            worker->MatchedDevice(d);
+    }
 
     worker->Finalize(this);
 }
 
+void Devicetracker::match_worker() {
+    std::unique_lock<std::mutex> lk(match_mutex);
+
+    while (1) {
+        if (match_queue.size() == 0) {
+            if (match_shutdown)
+                return;
+
+            match_idle++;
+            match_cv.wait(lk);
+            match_idle--;
+            continue;
+        }
+
+        auto job = match_queue.front();
+        match_queue.pop_front();
+
+        lk.unlock();
+        job();
+        lk.lock();
+    }
+}
+
+void Devicetracker::stop_match_pool() {
+    {
+        std::lock_guard<std::mutex> lk(match_mutex);
+        match_shutdown = true;
+
+        // Any match still running works through its own chunks
+        match_queue.clear();
+        match_cv.notify_all();
+    }
+
+    for (auto& t : match_threads)
+        if (t.joinable())
+            t.join();
+
+    match_threads.clear();
+}
+
+void Devicetracker::MatchOnDevicesRaw(std::shared_ptr<DevicetrackerFilterWorker> worker, 
+        std::shared_ptr<TrackerElementVector> vec, bool batch) {
+    match_chunked(worker, *vec, batch);
+}
+
 void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker,
         const std::vector<std::shared_ptr<kis_tracked_device_base>>& vec, bool batch) {
 
@@ -866,142 +1053,183 @@ void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> wo
 
 void Devicetracker::MatchOnDevicesRaw(std::shared_ptr<DevicetrackerFilterWorker> worker,
         const std::vector<std::shared_ptr<kis_tracked_device_base>>& vec, bool batch) {
+    match_chunked(worker, vec, batch);
+}
 
-    kismet__for_each(vec.begin(), vec.end(), [&](SharedTrackerElement val) {
-            if (val == nullptr)
-                return;
+void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, bool batch) {
+    // The snapshot is never modified, so there's no need to copy it again
+    auto snap = FetchDeviceSnapshot();
+    MatchOnDevicesRaw(worker, *snap, batch);
+}
+
+int Devicetracker::timetracker_event(int eventid) {
+    if (eventid == device_idle_timer) {
+        local_locker lock(&devicelist_mutex);
 
-            auto v = std::static_pointer_cast<kis_tracked_device_base>(val);
+        if (expire_idle_devices(globalreg->timestamp.tv_sec))
+            UpdateFullRefresh();
 
-            bool m;
+    } else if (eventid == max_devices_timer) {
+		local_locker lock(&devicelist_mutex);
 
-            {
-                local_locker devlocker(&v->device_mutex);
-                m = worker->MatchDevice(this, v);
-            }
+		// Do nothing if we don't care
+		if (max_num_devices <= 0)
+			return 1;
 
-            if (m)
-                worker->MatchedDevice(v);
-        });
+		// Do nothing if the number of devices is less than the max
+		if (tracked_table.size() <= max_num_devices)
+			return 1;
 
-    worker->Finalize(this);
+        // Do an update since we're trimming something
+        UpdateFullRefresh();
+
+        evict_devices();
+	}
+
+    // Loop
+    return 1;
 }
 
-void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, bool batch) {
-    MatchOnDevices(worker, immutable_tracked_vec, batch);
+void Devicetracker::push_expiry(std::vector<device_expiry_entry>& heap,
+        std::shared_ptr<kis_tracked_device_base> device, time_t last_time) {
+    heap.push_back(device_expiry_entry{last_time, device});
+    std::push_heap(heap.begin(), heap.end(), std::greater<device_expiry_entry>());
 }
 
-// Simple std::sort comparison function to order by the least frequently
-// seen devices
-bool devicetracker_sort_lastseen(std::shared_ptr<kis_tracked_device_base> a,
-	std::shared_ptr<kis_tracked_device_base> b) {
+void Devicetracker::rebuild_expiry(std::vector<device_expiry_entry>& heap) {
+    heap.clear();
+
+    for (auto i : *immutable_tracked_vec) {
+        if (i == nullptr)
+            continue;
+
+        auto d = std::static_pointer_cast<kis_tracked_device_base>(i);
 
-	return a->get_last_time() < b->get_last_time();
+        local_locker devlocker(&(d->device_mutex));
+        heap.push_back(device_expiry_entry{d->get_last_time(), d});
+    }
+
+    std::make_heap(heap.begin(), heap.end(), std::greater<device_expiry_entry>());
 }
 
-int Devicetracker::timetracker_event(int eventid) {
-    if (eventid == device_idle_timer) {
-        local_locker lock(&devicelist_mutex);
+bool Devicetracker::device_in_list(std::shared_ptr<kis_tracked_device_base> device) {
+    auto id = device->get_kis_internal_id();
 
-        time_t ts_now = globalreg->timestamp.tv_sec;
-        bool purged = false;
+    return id < immutable_tracked_vec->size() && (*immutable_tracked_vec)[id] == device;
+}
 
-        // Find all eligible devices, remove them from the tracked vec
-        tracked_vec.erase(std::remove_if(tracked_vec.begin(), tracked_vec.end(),
-                [&](std::shared_ptr<kis_tracked_device_base> d) {
-                    // Lock the device itself
-                    local_locker devlocker(&(d->device_mutex));
+bool Devicetracker::expire_idle_devices(time_t ts_now) {
+    bool purged = false;
 
-                    if (ts_now - d->get_last_time() > device_idle_expiration &&
-                            (d->get_packets() < device_idle_min_packets || 
-                             device_idle_min_packets <= 0)) {
-                        device_itr mi = tracked_map.find(d->get_key());
+    while (idle_heap.size() > 0) {
+        if (ts_now - idle_heap.front().last_time <= device_idle_expiration)
+            break;
 
-                        if (mi != tracked_map.end())
-                            tracked_map.erase(mi);
+        std::pop_heap(idle_heap.begin(), idle_heap.end(), std::greater<device_expiry_entry>());
+        auto d = idle_heap.back().device.lock();
+        idle_heap.pop_back();
 
-                        // Erase it from the multimap
-                        auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        // Already removed some other way
+        if (d == nullptr || !device_in_list(d))
+            continue;
 
-                        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                            if (mmpi->second->get_key() == d->get_key()) {
-                                tracked_mac_multimap.erase(mmpi);
-                                break;
-                            }
-                        }
+        local_locker devlocker(&(d->device_mutex));
 
-                        // Forget it from any views
-                        remove_view_device(d);
+        // Packet counts only go up, so once a device has enough packets it can
+        // never be idle-expired and doesn't need to be tracked here
+        if (device_idle_min_packets > 0 && d->get_packets() >= device_idle_min_packets)
+            continue;
 
-                        // Forget it from the immutable vec, but keep its 
-                        // position; we need to have vecpos = devid
-                        auto iti = immutable_tracked_vec->begin() + d->get_kis_internal_id();
-                        (*iti).reset();
+        if (ts_now - d->get_last_time() > device_idle_expiration) {
+            purge_device(d);
+            purged = true;
+        } else {
+            push_expiry(idle_heap, d, d->get_last_time());
+        }
+    }
 
-                        purged = true;
+    // Entries for devices removed by the max device limit stay in the heap until
+    // they age out; don't let them pile up
+    if (idle_heap.size() > 2 * tracked_table.size() + 1024)
+        rebuild_expiry(idle_heap);
 
-                        return true;
-                    }
+    return purged;
+}
 
-                    return false;
-         
-                    }), tracked_vec.end());
+bool Devicetracker::evict_devices() {
+    bool purged = false;
 
-        if (purged)
-            UpdateFullRefresh();
+    // Heap entries never have a newer time than the device they point to, so the
+    // first current entry off the top is the oldest device
+    while (tracked_table.size() > max_num_devices && evict_heap.size() > 0) {
+        std::pop_heap(evict_heap.begin(), evict_heap.end(), std::greater<device_expiry_entry>());
+        auto e = evict_heap.back();
+        evict_heap.pop_back();
 
-    } else if (eventid == max_devices_timer) {
-		local_locker lock(&devicelist_mutex);
+        auto d = e.device.lock();
 
-		// Do nothing if we don't care
-		if (max_num_devices <= 0)
-			return 1;
+        if (d == nullptr || !device_in_list(d))
+            continue;
 
-		// Do nothing if the number of devices is less than the max
-		if (tracked_vec.size() <= max_num_devices)
-			return 1;
+        local_locker devlocker(&(d->device_mutex));
 
-        // Do an update since we're trimming something
-        UpdateFullRefresh();
+        if (d->get_last_time() > e.last_time) {
+            push_expiry(evict_heap, d, d->get_last_time());
+            continue;
+        }
 
-		// Now things start getting expensive.  Start by sorting the
-		// vector of devices - anything else that has to sort the entire list
-        // has to sort it themselves
-		kismet__stable_sort(tracked_vec.begin(), tracked_vec.end(), 
-                devicetracker_sort_lastseen);
+        purge_device(d);
+        purged = true;
+    }
 
-        tracked_vec.erase(std::remove_if(tracked_vec.begin() + max_num_devices, tracked_vec.end(),
-                [&](std::shared_ptr<kis_tracked_device_base> d) {
-                    // Lock the device itself
-                    local_locker devlocker(&(d->device_mutex));
+    // Same for devices removed by idle expiry
+    if (evict_heap.size() > 2 * tracked_table.size() + 1024)
+        rebuild_expiry(evict_heap);
 
-                    device_itr mi = tracked_map.find(d->get_key());
+    return purged;
+}
 
-                    if (mi != tracked_map.end())
-                        tracked_map.erase(mi);
+void Devicetracker::insert_device(std::shared_ptr<kis_tracked_device_base> device) {
+    // Device ID is its slot in the immutable vec; reuse a slot freed by a
+    // removed device before growing it
+    if (free_device_ids.size() > 0) {
+        auto id = free_device_ids.back();
+        free_device_ids.pop_back();
 
-                    // Erase it from the multimap
-                    auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        device->set_kis_internal_id(id);
+        (*immutable_tracked_vec)[id] = device;
+    } else {
+        device->set_kis_internal_id(immutable_tracked_vec->size());
+        immutable_tracked_vec->push_back(device);
+    }
 
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                        if (mmpi->second->get_key() == d->get_key()) {
-                            tracked_mac_multimap.erase(mmpi);
-                            break;
-                        }
-                    }
+    tracked_table.insert(device);
+    seen_index.insert(device, device->get_last_time());
+    sort_cache.add(device);
 
-                    // Forget it from the immutable vec, but keep its 
-                    // position; we need to have vecpos = devid
-                    auto iti = immutable_tracked_vec->begin() + d->get_kis_internal_id();
-                    (*iti).reset();
+    if (device_idle_expiration != 0)
+        push_expiry(idle_heap, device, device->get_last_time());
 
-                    return true;
-         
-                    }), tracked_vec.end());
-	}
+    if (max_num_devices > 0)
+        push_expiry(evict_heap, device, device->get_last_time());
 
-    // Loop
-    return 1;
+    std::atomic_store(&tracked_snapshot, device_snapshot_t());
+}
+
+void Devicetracker::purge_device(std::shared_ptr<kis_tracked_device_base> device) {
+    tracked_table.remove(device);
+    seen_index.remove(device);
+    sort_cache.remove(device);
+
+    // Forget it from any views
+    remove_view_device(device);
+
+    // Free its slot in the immutable vec for the next new device
+    auto id = device->get_kis_internal_id();
+    (*immutable_tracked_vec)[id].reset();
+    free_device_ids.push_back(id);
+
+    std::atomic_store(&tracked_snapshot, device_snapshot_t());
 }
 
 void Devicetracker::usage(const char *name __attribute__((unused))) {
@@ -1113,16 +1341,7 @@ void Devicetracker::AddDevice(std::shared_ptr<kis_tracked_device_base> device) {
         return;
     }
 
-    // Device ID is the size of the vector so a new device always gets put
-    // in it's numbered slot
-    device->set_kis_internal_id(immutable_tracked_vec->size());
-
-    tracked_map[device->get_key()] = device;
-    tracked_vec.push_back(device);
-    immutable_tracked_vec->push_back(device);
-
-    auto mm_pair = std::make_pair(device->get_macaddr(), device);
-    tracked_mac_multimap.emplace(mm_pair);
+    insert_device(device);
 }
 
 bool Devicetracker::add_view(std::shared_ptr<DevicetrackerView> in_view) {
@@ -1136,10 +1355,8 @@ bool Devicetracker::add_view(std::shared_ptr<DevicetrackerView> in_view) {
 
     view_vec->push_back(in_view);
 
-    for (auto i : *immutable_tracked_vec) {
-        auto di = std::static_pointer_cast<kis_tracked_device_base>(i);
+    for (auto di : *FetchDeviceSnapshot())
         in_view->newDevice(di);
-    }
 
     return true;
 }
@@ -1157,6 +1374,8 @@ void Devicetracker::remove_view(const std::string& in_id) {
 }
 
 void Devicetracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    httpd_subscribe->device_changed(in_device);
+
     local_locker l(&view_mutex);
 
     for (auto i : *view_vec) {
@@ -1166,6 +1385,8 @@ void Devicetracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in_
 }
 
 void Devicetracker::update_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    httpd_subscribe->device_changed(in_device);
+
     local_locker l(&view_mutex);
 
     for (auto i : *view_vec) {
@@ -1175,6 +1396,8 @@ void Devicetracker::update_view_device(std::shared_ptr<kis_tracked_device_base>
 }
 
 void Devicetracker::remove_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    httpd_subscribe->device_removed(in_device);
+
     local_locker l(&view_mutex);
 
     for (auto i : *view_vec) {
@@ -1185,16 +1408,11 @@ void Devicetracker::remove_view_device(std::shared_ptr<kis_tracked_device_base>
 
 int Devicetracker::store_devices() {
     auto devs = std::make_shared<TrackerElementVector>();
-    auto immutable_copy = std::make_shared<TrackerElementVector>(immutable_tracked_vec);
 
     // Find anything that has changed
-    for (auto v : *immutable_copy) {
-        if (v == NULL)
-            continue;
-
-        auto kdb = std::static_pointer_cast<kis_tracked_device_base>(v);
+    for (auto kdb : *FetchDeviceSnapshot()) {
         if (kdb->get_mod_time() > last_database_logged)
-            devs->push_back(v);
+            devs->push_back(kdb);
     }
 
     last_devicelist_saved = time(0);
@@ -1203,10 +1421,14 @@ int Devicetracker::store_devices() {
 }
 
 int Devicetracker::store_all_devices() {
-    auto immutable_copy = std::make_shared<TrackerElementVector>(immutable_tracked_vec);
+    auto devs = std::make_shared<TrackerElementVector>();
+
+    for (auto kdb : *FetchDeviceSnapshot())
+        devs->push_back(kdb);
+
     last_devicelist_saved = time(0);
 
-    return store_devices(immutable_copy);
+    return store_devices(devs);
 }
 
 int Devicetracker::store_devices(std::shared_ptr<TrackerElementVector> devices) {
@@ -1236,6 +1458,8 @@ void Devicetracker::databaselog_write_devices() {
                 return false;
         }, nullptr);
 
+    fw->set_concurrent(true);
+
     MatchOnDevices(fw);
 
     last_database_logged = time(0);
@@ -1925,7 +2149,7 @@ int DevicetrackerStateStore::store_devices(std::shared_ptr<TrackerElementVector>
 
                 // Pack a storage formatted blob
                 {
-                    local_locker lock(&(devicetracker->devicelist_mutex));
+                    local_locker lock(&(kdb->device_mutex));
                     StorageJsonAdapter::Pack(*serialstream, d, NULL);
                 }
 
@@ -22,6 +22,10 @@
 #include "config.h"
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <stdio.h>
 #include <time.h>
 #include <list>
@@ -53,7 +57,9 @@
 #include "kis_net_microhttpd.h"
 #include "structured.h"
 #include "devicetracker_httpd_pcap.h"
+#include "devicetracker_httpd_subscribe.h"
 #include "devicetracker_view.h"
+#include "devicetracker_table.h"
 #include "devicetracker_workers.h"
 #include "kis_database.h"
 
@@ -140,9 +146,10 @@ public:
 
     // Perform a device filter.  Pass a subclassed filter instance.
     //
-    // If "batch" is true, Kismet will sort the devices based on the internal ID 
-    // and batch this processing in several groups to allow other threads time 
-    // to operate.
+    // If "batch" is true and the worker can match concurrently, the devices are 
+    // split into chunks which are matched in parallel by the match pool and the
+    // calling thread; otherwise they're matched in order by the calling thread.
+    // Either way, matching stops between chunks if the worker is cancelled.
     //
     // Typically used to build a subset of devices for serialization
     void MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, bool batch = true);
@@ -171,9 +178,16 @@ public:
             const std::vector<std::shared_ptr<kis_tracked_device_base>>& source_vec,
             bool batch = true);
 
-    using device_map_t = std::map<device_key, std::shared_ptr<kis_tracked_device_base>>;
-    using device_itr = device_map_t::iterator;
-    using const_device_itr = device_map_t::const_iterator;
+    // Snapshot of all live devices.  The snapshot is never modified once it has been
+    // handed out, so it can be iterated without holding any tracker locks; it is
+    // rebuilt on demand after devices are added or removed.
+    using device_snapshot_t = std::shared_ptr<const std::vector<std::shared_ptr<kis_tracked_device_base>>>;
+    device_snapshot_t FetchDeviceSnapshot();
+
+    // Devices ordered by last seen time; views use it to keep their sort orders current
+    device_seen_index& FetchSeenIndex() {
+        return seen_index;
+    }
 
 	static void Usage(char *argv);
 
@@ -294,6 +308,7 @@ protected:
     int device_list_base_id, device_base_id, phy_base_id, phy_entry_id;
     int device_summary_base_id;
     int device_update_required_id, device_update_timestamp_id;
+    int device_update_seq_id;
 
     int dt_length_id, dt_filter_id, dt_draw_id;
 
@@ -304,13 +319,14 @@ protected:
 	std::atomic<int> num_filterpackets;
 
 	// Per-phy #s of packets
-    std::map<int, int> phy_packets;
-	std::map<int, int> phy_datapackets;
-	std::map<int, int> phy_errorpackets;
-	std::map<int, int> phy_filterpackets;
+    std::map<int, std::atomic<int>> phy_packets;
+	std::map<int, std::atomic<int>> phy_datapackets;
+	std::map<int, std::atomic<int>> phy_errorpackets;
+	std::map<int, std::atomic<int>> phy_filterpackets;
 
     // Total packet history
     std::shared_ptr<kis_tracked_rrd<> > packets_rrd;
+    kis_recursive_timed_mutex packets_rrd_mutex;
 
     // Timeout of idle devices
     int device_idle_expiration;
@@ -341,19 +357,41 @@ protected:
 	int pack_comp_device, pack_comp_common, pack_comp_basicdata,
 		pack_comp_radiodata, pack_comp_gps, pack_comp_datasrc;
 
-	// Tracked devices
-    device_map_t tracked_map;
-	// Vector of tracked devices so we can iterate them quickly
-    std::vector<std::shared_ptr<kis_tracked_device_base> > tracked_vec;
-    // MAC address lookups are incredibly expensive from the webui if we don't
-    // track by map; in theory multiple objects in different PHYs could have the
-    // same MAC so it's not a simple 1:1 map
-    std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base> > tracked_mac_multimap;
+	// Tracked devices, indexed by key and by mac; the table does its own per-shard
+    // locking so lookups don't need the devicelist lock
+    device_table tracked_table;
+
+    // Devices ordered by last seen time, for the last-time and last-seq endpoints
+    device_seen_index seen_index;
+
+    // Sort orders of the whole device list for the datatables summary
+    device_sort_cache sort_cache;
 
     // Immutable vector, one entry per device; may never be sorted.  Devices
     // which are removed are set to 'null'.  Each position corresponds to the
-    // device ID.
+    // device ID; IDs of removed devices are handed out again to new devices
+    // so the vector only grows to the peak number of devices.
     std::shared_ptr<TrackerElementVector> immutable_tracked_vec;
+    std::vector<uint64_t> free_device_ids;
+
+    // Read-only copy of the live devices; reset whenever the device list changes
+    device_snapshot_t tracked_snapshot;
+
+    // Min-heaps of devices by last-seen time, used for idle expiry and for 
+    // evicting the oldest devices past the maximum.  Entries are only added when
+    // a device is created; when one reaches the top it is checked against the
+    // device and pushed back with the current time if the device has been seen
+    // since, so each sweep only looks at the devices it might remove.
+    struct device_expiry_entry {
+        time_t last_time;
+        std::weak_ptr<kis_tracked_device_base> device;
+
+        bool operator>(const device_expiry_entry& e) const {
+            return last_time > e.last_time;
+        }
+    };
+    std::vector<device_expiry_entry> idle_heap;
+    std::vector<device_expiry_entry> evict_heap;
 
     // List of views using new API as we transition the rest to the new API
     kis_recursive_timed_mutex view_mutex;
@@ -370,10 +408,35 @@ protected:
 	int next_phy_id;
     std::map<int, Kis_Phy_Handler *> phy_handler_map;
 
+    // Protects immutable_tracked_vec and the expiry heaps, and serializes creating
+    // and removing devices.  Updating an existing device only needs the device lock.
     kis_recursive_timed_mutex devicelist_mutex;
 
     std::shared_ptr<Devicetracker_Httpd_Pcap> httpd_pcap;
 
+    // Device change subscriptions
+    std::shared_ptr<Devicetracker_Httpd_Subscribe> httpd_subscribe;
+
+    // Match the devices of a source vector in chunks, spreading them over the 
+    // match pool when allowed
+    template<typename V>
+    void match_chunked(std::shared_ptr<DevicetrackerFilterWorker> worker, V& vec,
+            bool batch);
+
+    // Pool of threads which help match chunks of large device lists; workers are
+    // started as they're needed, up to the max.  The thread running a match always
+    // works through the chunks too, so a match never waits on a busy pool.
+    void match_worker();
+    void stop_match_pool();
+
+    std::mutex match_mutex;
+    std::condition_variable match_cv;
+    std::deque<std::function<void ()>> match_queue;
+    std::vector<std::thread> match_threads;
+    unsigned int match_threads_max, match_idle;
+    size_t match_chunk_size;
+    bool match_shutdown;
+
     // Timestamp of the last time we wrote the device list, if we're storing state
     std::atomic<time_t> last_devicelist_saved;
 
@@ -410,6 +473,24 @@ protected:
     // Insert a device directly into the records
     void AddDevice(std::shared_ptr<kis_tracked_device_base> device);
 
+    // Add a populated device to the table, list, and expiry heaps; call with
+    // devicelist_mutex held
+    void insert_device(std::shared_ptr<kis_tracked_device_base> device);
+
+    // Remove a device and release its ID; call with devicelist_mutex and the
+    // device lock held
+    void purge_device(std::shared_ptr<kis_tracked_device_base> device);
+
+    // Is this device still in the list (and not removed and replaced)
+    bool device_in_list(std::shared_ptr<kis_tracked_device_base> device);
+
+    // Expiry heap helpers; call with devicelist_mutex held
+    void push_expiry(std::vector<device_expiry_entry>& heap, 
+            std::shared_ptr<kis_tracked_device_base> device, time_t last_time);
+    void rebuild_expiry(std::vector<device_expiry_entry>& heap);
+    bool expire_idle_devices(time_t ts_now);
+    bool evict_devices();
+
     // Load a specific device
     virtual std::shared_ptr<kis_tracked_device_base> load_device(Kis_Phy_Handler *phy, 
             mac_addr mac);
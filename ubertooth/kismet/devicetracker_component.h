@@ -123,7 +123,8 @@ public:
     __ProxyGet(encodingset, uint64_t, uint64_t, encodingset);
     __ProxyGet(carrierset, uint64_t, uint64_t, carrierset);
 
-    typedef kis_tracked_minute_rrd<kis_tracked_rrd_peak_signal_aggregator> msig_rrd;
+    // Signal levels fit easily in 16 bits
+    typedef kis_tracked_minute_rrd<kis_tracked_rrd_peak_signal_aggregator, int16_t> msig_rrd;
     __ProxyDynamicTrackable(signal_min_rrd, msig_rrd, signal_min_rrd, signal_min_rrd_id);
 
     __ProxyDynamicTrackable(peak_loc, kis_tracked_location_triplet, peak_loc, peak_loc_id);
@@ -152,7 +153,7 @@ protected:
     // Signal record over the past minute, either rssi or dbm.  Devices
     // should not mix rssi and dbm signal reporting.
     int signal_min_rrd_id;
-    std::shared_ptr<kis_tracked_minute_rrd<kis_tracked_rrd_peak_signal_aggregator> > signal_min_rrd;
+    std::shared_ptr<msig_rrd> signal_min_rrd;
 
     int sig_type;
 };
@@ -376,15 +377,17 @@ public:
     __Proxy(datasize, uint64_t, uint64_t, uint64_t, datasize);
     __ProxyIncDec(datasize, uint64_t, uint64_t, datasize);
 
-    typedef kis_tracked_rrd<> rrdt;
+    // Packet counts per second fit in 32 bits; data sizes keep the full width
+    typedef kis_tracked_rrd<kis_tracked_rrd_default_aggregator, int32_t> rrdt;
+    typedef kis_tracked_rrd<> drrdt;
     __ProxyDynamicTrackable(packets_rrd, rrdt, packets_rrd, packets_rrd_id);
 
     __ProxyDynamicTrackable(location, kis_tracked_location, location, location_id);
-    __ProxyDynamicTrackable(data_rrd, rrdt, data_rrd, data_rrd_id);
+    __ProxyDynamicTrackable(data_rrd, drrdt, data_rrd, data_rrd_id);
     __ProxyDynamicTrackable(location_cloud, kis_location_history, location_cloud, 
             location_cloud_id);
 
-    typedef kis_tracked_minute_rrd<> mrrdt;
+    typedef kis_tracked_minute_rrd<kis_tracked_rrd_default_aggregator, int32_t> mrrdt;
     __ProxyDynamicTrackable(packet_rrd_bin_250, mrrdt, packet_rrd_bin_250, 
             packet_rrd_bin_250_id);
     __ProxyDynamicTrackable(packet_rrd_bin_500, mrrdt, packet_rrd_bin_500,
@@ -509,22 +512,22 @@ protected:
 
     // Packets and data RRDs
     int packets_rrd_id;
-    std::shared_ptr<kis_tracked_rrd<>> packets_rrd;
+    std::shared_ptr<rrdt> packets_rrd;
 
     int data_rrd_id;
-    std::shared_ptr<kis_tracked_rrd<>> data_rrd;
+    std::shared_ptr<drrdt> data_rrd;
 
     // Data bins divided by size we track, named by max size
     int packet_rrd_bin_250_id;
-    std::shared_ptr<kis_tracked_minute_rrd<>> packet_rrd_bin_250;
+    std::shared_ptr<mrrdt> packet_rrd_bin_250;
     int packet_rrd_bin_500_id;
-    std::shared_ptr<kis_tracked_minute_rrd<>> packet_rrd_bin_500;
+    std::shared_ptr<mrrdt> packet_rrd_bin_500;
     int packet_rrd_bin_1000_id;
-    std::shared_ptr<kis_tracked_minute_rrd<>> packet_rrd_bin_1000;
+    std::shared_ptr<mrrdt> packet_rrd_bin_1000;
     int packet_rrd_bin_1500_id;
-    std::shared_ptr<kis_tracked_minute_rrd<>> packet_rrd_bin_1500;
+    std::shared_ptr<mrrdt> packet_rrd_bin_1500;
     int packet_rrd_bin_jumbo_id;
-    std::shared_ptr<kis_tracked_minute_rrd<>> packet_rrd_bin_jumbo;
+    std::shared_ptr<mrrdt> packet_rrd_bin_jumbo;
 
 	// Channel and frequency as per PHY type
     std::shared_ptr<TrackerElementString> channel;
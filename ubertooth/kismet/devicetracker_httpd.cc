@@ -127,14 +127,7 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                     return false;
                 }
 
-                { 
-                    local_shared_locker devlock(&devicelist_mutex);
-
-                    if (tracked_mac_multimap.count(mac) > 0)
-                        return true;
-                }
-
-                return false;
+                return tracked_table.has_mac(mac);
             } else if (tokenurl[2] == "last-time") {
                 if (tokenurl.size() < 5) {
                     return false;
@@ -149,6 +142,17 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                 if (tokenurl[4] == "devices.ekjson")
                     return true;
 
+                return Httpd_CanSerialize(tokenurl[4]);
+            } else if (tokenurl[2] == "last-seq") {
+                if (tokenurl.size() < 5) {
+                    return false;
+                }
+
+                unsigned long long lastseq;
+                if (sscanf(tokenurl[3].c_str(), "%llu", &lastseq) != 1) {
+                    return false;
+                }
+
                 return Httpd_CanSerialize(tokenurl[4]);
             }
         }
@@ -218,13 +222,7 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                     return false;
                 }
 
-                {
-                    local_shared_locker listlocker(&devicelist_mutex);
-                    if (tracked_mac_multimap.count(mac) > 0)
-                        return true;
-                }
-
-                return false;
+                return tracked_table.has_mac(mac);
             } else if (tokenurl[2] == "by-phy") {
                 if (tokenurl.size() < 5)
                     return false;
@@ -323,6 +321,9 @@ int Devicetracker::Httpd_CreateStreamResponse(
                     return false;
                 }, nullptr);
 
+        // Stop serializing if the client goes away
+        fw->SetCancelCheck([saux]() { return saux->get_in_error(); });
+
         MatchOnDevices(fw);
         return MHD_YES;
     }
@@ -399,8 +400,6 @@ int Devicetracker::Httpd_CreateStreamResponse(
             if (!Httpd_CanSerialize(tokenurl[4]))
                 return MHD_YES;
 
-            local_shared_locker lock(&devicelist_mutex);
-
             mac_addr mac = mac_addr(tokenurl[3]);
 
             if (mac.error) {
@@ -409,10 +408,8 @@ int Devicetracker::Httpd_CreateStreamResponse(
 
             auto devvec = std::make_shared<TrackerElementVector>();
 
-            const auto& mmp = tracked_mac_multimap.equal_range(mac);
-            for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                devvec->push_back(mmpi->second);
-            }
+            for (auto d : tracked_table.find_mac(mac))
+                devvec->push_back(d);
 
             Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, devvec, NULL);
 
@@ -435,21 +432,41 @@ int Devicetracker::Httpd_CreateStreamResponse(
             if (!Httpd_CanSerialize(tokenurl[4]))
                 return MHD_YES;
 
-            std::shared_ptr<TrackerElementVector> devvec;
-
-            auto fw = std::make_shared<devicetracker_function_worker>(
-                    [devvec, lastts](Devicetracker *, 
-                        std::shared_ptr<kis_tracked_device_base> d) -> bool {
-                        if (d->get_last_time() <= lastts)
-                            return false;
+            auto devvec = std::make_shared<TrackerElementVector>();
 
-                        return true;
-                    }, nullptr);
-            MatchOnDevices(fw);
-            devvec = fw->GetMatchedDevices();
+            for (const auto& d : seen_index.seen_since(lastts))
+                devvec->push_back(d);
 
             Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, devvec, NULL);
 
+            return MHD_YES;
+        } else if (tokenurl[2] == "last-seq") {
+            if (tokenurl.size() < 5)
+                return MHD_YES;
+
+            unsigned long long lastseq;
+            if (sscanf(tokenurl[3].c_str(), "%llu", &lastseq) != 1)
+                return MHD_YES;
+
+            if (!Httpd_CanSerialize(tokenurl[4]))
+                return MHD_YES;
+
+            // Devices seen since the sequence, and the sequence to ask for next time
+            std::vector<std::shared_ptr<kis_tracked_device_base>> changed;
+            auto curseq = seen_index.changed_since(lastseq, changed);
+
+            auto wrapper = std::make_shared<TrackerElementMap>();
+            auto devvec = std::make_shared<TrackerElementVector>(device_list_base_id);
+
+            for (const auto& d : changed)
+                devvec->push_back(d);
+
+            wrapper->insert(std::make_shared<TrackerElementUInt64>(device_update_seq_id, curseq));
+            wrapper->insert(devvec);
+
+            Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, 
+                    wrapper, NULL);
+
             return MHD_YES;
         }
 
@@ -577,8 +594,6 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     return MHD_YES;
                 }
 
-                local_demand_locker lock(&devicelist_mutex);
-
                 if (!Httpd_CanSerialize(tokenurl[4])) {
                     stream << "Invalid request: Cannot find serializer for file type\n";
                     concls->httpcode = 400;
@@ -594,25 +609,21 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     return MHD_YES;
                 }
 
-                lock.lock();
-                if (tracked_mac_multimap.count(mac) == 0) {
+                auto macdevs = tracked_table.find_mac(mac);
+
+                if (macdevs.size() == 0) {
                     stream << "Invalid request: Could not find device by MAC\n";
                     concls->httpcode = 400;
                     return MHD_YES;
                 }
-                lock.unlock();
 
                 std::string target = Httpd_StripSuffix(tokenurl[4]);
 
                 if (target == "devices") {
                     auto devvec = std::make_shared<TrackerElementVector>();
 
-                    lock.lock();
-                    auto mmp = tracked_mac_multimap.equal_range(mac);
-                    lock.unlock();
-
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) 
-                        devvec->push_back(SummarizeSingleTrackerElement(mmpi->second, summary_vec, rename_map));
+                    for (auto d : macdevs) 
+                        devvec->push_back(SummarizeSingleTrackerElement(d, summary_vec, rename_map));
 
                     Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, 
                             devvec, rename_map);
@@ -827,11 +838,8 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     wrapper->insert(draw_elem);
 
                     // Make the length and filter elements
-                    {
-                        local_shared_locker lock(&devicelist_mutex);
-                        dt_length_elem = 
-                            std::make_shared<TrackerElementUInt64>(dt_length_id, tracked_vec.size());
-                    }
+                    dt_length_elem = 
+                        std::make_shared<TrackerElementUInt64>(dt_length_id, tracked_table.size());
                     dt_length_elem->set_local_name("recordsTotal");
                     wrapper->insert(dt_length_elem);
 
@@ -846,6 +854,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     // If we're doing a basic regex outside of devicetables
                     // shenanigans...
                     auto worker = std::make_shared<devicetracker_pcre_worker>(regexdata);
+                    worker->SetCancelCheck([saux]() { return saux->get_in_error(); });
                     MatchOnDevices(worker);
 
                     auto pcredevs = worker->GetMatchedDevices();
@@ -920,6 +929,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
 
                     auto worker = 
                         std::make_shared<devicetracker_stringmatch_worker>(dt_search, dt_search_paths);
+                    worker->SetCancelCheck([saux]() { return saux->get_in_error(); });
                     MatchOnDevices(worker);
 
                     auto matchvec = worker->GetMatchedDevices();
@@ -985,72 +995,47 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                         outdevs->push_back(SummarizeSingleTrackerElement(*i, summary_vec, rename_map));
 
                 } else {
-                    // Only lock while copying the vector
-                    local_demand_locker listlock(&devicelist_mutex);
-                    
-                    listlock.lock();
-                    auto tracked_vec_copy = tracked_vec;
-                    listlock.unlock();
+                    // Sorted pages come from the cached sort order, which is kept up to
+                    // date incrementally; unsorted pages come straight from the snapshot.
+                    // Neither is modified, so there's no need to copy the device list.
+                    Devicetracker::device_snapshot_t devlist;
+
+                    bool sorted = dt_order_col >= 0 && dt_order_fields.size() > 0;
+
+                    if (sorted)
+                        devlist = sort_cache.sorted(dt_order_fields[0], seen_index);
+                    else
+                        devlist = FetchDeviceSnapshot();
 
                     // Check DT ranges
-                    if (dt_start >= tracked_vec_copy.size())
+                    if (dt_start >= devlist->size())
                         dt_start = 0;
 
                     if (dt_filter_elem != NULL)
-                        SetTrackerValue<uint64_t>(dt_filter_elem, tracked_vec_copy.size());
+                        SetTrackerValue<uint64_t>(dt_filter_elem, devlist->size());
 
-                    std::vector<std::shared_ptr<kis_tracked_device_base> >::iterator vi =
-                        tracked_vec_copy.begin() + dt_start;
-                    std::vector<std::shared_ptr<kis_tracked_device_base> >::iterator ei;
+                    size_t dt_end;
 
-                    // Set the iterator endpoint for our length
-                    if (dt_length == 0 || dt_length + dt_start >= tracked_vec_copy.size())
-                        ei = tracked_vec_copy.end();
+                    // Set the endpoint for our length
+                    if (dt_length == 0 || dt_length + dt_start >= devlist->size())
+                        dt_end = devlist->size();
                     else
-                        ei = tracked_vec_copy.begin() + dt_start + dt_length;
+                        dt_end = dt_start + dt_length;
 
+                    size_t unset = 0;
 
-                    if (dt_order_col >= 0 && dt_order_fields.size() > 0) {
-                        kismet__partial_sort(vi, ei, tracked_vec_copy.end(), 
-                                [&](SharedTrackerElement a, SharedTrackerElement b) -> bool {
-                                SharedTrackerElement fa;
-                                SharedTrackerElement fb;
+                    if (sorted)
+                        unset = device_sort_cache::unset_start(devlist, dt_order_fields[0]);
 
-                                // Only sort on the first field; make sure we have any fields
-                                
-                                if (dt_order_fields.size() == 0)
-                                    return false;
-
-                                const auto& ofi = dt_order_fields[0];
+                    for (size_t i = dt_start; i < dt_end; i++) {
+                        // Direction 0 is ascending with unset fields first, 1 is
+                        // descending with them last
+                        const auto& d = sorted ?
+                            (*devlist)[device_sort_cache::position(devlist->size(), unset, i, 
+                                    dt_order_dir == 1)] : (*devlist)[i];
 
-                                fa = GetTrackerElementPath(ofi, a);
-                                fb = GetTrackerElementPath(ofi, b);
-
-                                if (fa == nullptr) {
-                                    if (dt_order_dir == 0) {
-                                        return true;
-                                    } else {
-                                        return false;
-                                    }
-                                }
-
-                                if (fb == nullptr) {
-                                    if (dt_order_dir == 0) {
-                                        return false;
-                                    } else {
-                                        return true;
-                                    }
-                                }
-
-                                if (dt_order_dir == 0)
-                                    return FastSortTrackerElementLess(fa, fb);
-
-                                return FastSortTrackerElementLess(fb, fa);
-                            });
+                        outdevs->push_back(SummarizeSingleTrackerElement(d, summary_vec, rename_map));
                     }
-
-                    for (auto i = vi; i != ei; ++i) 
-                        outdevs->push_back(SummarizeSingleTrackerElement(*i, summary_vec, rename_map));
                 }
 
                 // Apply wrapper if we haven't applied it already
@@ -1095,24 +1080,17 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                 auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
 
                 // List of devices that pass the timestamp filter
-                std::shared_ptr<TrackerElementVector> timedevs;
+                auto timedevs = std::make_shared<TrackerElementVector>();
 
                 //  List of devices that pass the regex filter
                 auto regexdevs = std::make_shared<TrackerElementVector>();
 
-                auto tw = std::make_shared<devicetracker_function_worker>(
-                        [lastts](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
-
-                        if (d->get_last_time() <= lastts)
-                            return false;
-
-                        return true;
-                        }, nullptr);
-                MatchOnDevices(tw);
-                timedevs = tw->GetMatchedDevices();
+                for (const auto& d : seen_index.seen_since(lastts))
+                    timedevs->push_back(d);
 
                 if (regexdata != NULL) {
                     auto worker = std::make_shared<devicetracker_pcre_worker>(regexdata);
+                    worker->SetCancelCheck([saux]() { return saux->get_in_error(); });
                     MatchOnDevices(worker, timedevs);
                     regexdevs = worker->GetMatchedDevices();
                 } else {
@@ -1161,16 +1139,6 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                 //  List of devices that pass the regex filter
                 std::shared_ptr<TrackerElementVector> regexdevs;
 
-                // Filter by time first, it's fast
-                auto tw = std::make_shared<devicetracker_function_worker>(
-                        [post_ts](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
-
-                        if (d->get_last_time() <= post_ts)
-                            return false;
-
-                        return true;
-                        }, nullptr);
-
                 auto pw = std::make_shared<devicetracker_function_worker>(
                         [phydevs, phy](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
                         if (d->get_phyname() != phy->FetchPhyName())
@@ -1179,10 +1147,16 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                         return true;
                         }, nullptr);
 
+                pw->set_concurrent(true);
+                pw->SetCancelCheck([saux]() { return saux->get_in_error(); });
+
                 if (post_ts != 0) {
-                    // time-match then phy-match then pass to regex
-                    MatchOnDevices(tw);
-                    timedevs = tw->GetMatchedDevices();
+                    // time-match from the seen index, then phy-match, then pass to regex
+                    timedevs = std::make_shared<TrackerElementVector>();
+
+                    for (const auto& d : seen_index.seen_since(post_ts))
+                        timedevs->push_back(d);
+
                     MatchOnDevices(pw, timedevs);
                     phydevs = pw->GetMatchedDevices();
                 }  else {
@@ -1193,6 +1167,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
 
                 if (regexdata != NULL) {
                     auto worker = std::make_shared<devicetracker_pcre_worker>(regexdata);
+                    worker->SetCancelCheck([saux]() { return saux->get_in_error(); });
                     MatchOnDevices(worker, phydevs);
                     regexdevs = worker->GetMatchedDevices();
                 } else {
@@ -1248,19 +1223,11 @@ unsigned int Devicetracker::multimac_endp_handler(std::ostream& stream, const st
             macs.push_back(ma);
         }
 
-        // Duplicate the mac index so that we're 'immune' to things changing it under us; because we
-        // may have quite a number of devices in our query list, this is safest.
-        local_demand_locker l(&devicelist_mutex);
-        l.lock();
-        auto immutable_copy = 
-            std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base>>{tracked_mac_multimap};
-        l.unlock();
-
-        // Pull all the devices out of the list
+        // Pull all the devices out of the table; each lookup only locks the shard
+        // holding that mac
         for (auto m : macs) {
-            const auto& mi = immutable_copy.equal_range(m);
-            for (auto msi = mi.first; msi != mi.second; ++msi)
-                ret_devices->push_back(msi->second);
+            for (auto d : tracked_table.find_mac(m))
+                ret_devices->push_back(d);
         }
 
         // Summarize it all at once
@@ -0,0 +1,375 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <algorithm>
+
+#include "configfile.h"
+#include "devicetracker.h"
+#include "devicetracker_httpd_subscribe.h"
+#include "entrytracker.h"
+#include "json_adapter.h"
+#include "kis_net_microhttpd.h"
+#include "kismet_json.h"
+#include "timetracker.h"
+#include "xxhash.h"
+
+void device_subscription::device_changed(const device_t& in_device) {
+    std::lock_guard<std::mutex> lk(pending_mutex);
+
+    pending[in_device->get_key()] = in_device;
+}
+
+void device_subscription::device_removed(const device_t& in_device) {
+    std::lock_guard<std::mutex> lk(pending_mutex);
+
+    pending.erase(in_device->get_key());
+    pending_removed.insert(in_device->get_key());
+}
+
+bool device_subscription::device_record(const device_t& in_device, std::string& out,
+        std::vector<std::pair<uint64_t, uint64_t>>& out_hashes) {
+    auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
+
+    std::string fieldname, fieldjson, fields;
+
+    auto key = in_device->get_key();
+    auto si = sent.find(key);
+    bool full = si == sent.end();
+
+    out_hashes.clear();
+
+    {
+        // Packet handling updates the device under its lock while we summarize it
+        local_shared_locker lock(&in_device->device_mutex);
+
+        SerializerScope s(in_device, nullptr);
+
+        auto summarized = SummarizeSingleTrackerElement(in_device, summary, rename_map);
+
+        for (const auto& f : *std::static_pointer_cast<TrackerElementMap>(summarized)) {
+            if (f.second == nullptr)
+                continue;
+
+            // Named the same way the serializers name them
+            auto nmi = rename_map->find(f.second);
+
+            if (nmi != rename_map->end() && nmi->second->rename.length() != 0)
+                fieldname = nmi->second->rename;
+            else if ((fieldname = f.second->get_local_name()) == "")
+                fieldname = Globalreg::globalreg->entrytracker->GetFieldName(f.first);
+
+            fieldname = JsonAdapter::SanitizeString(fieldname);
+
+            fieldjson.clear();
+            JsonAdapter::Pack(fieldjson, f.second, rename_map);
+
+            uint64_t name_h = XXH64(fieldname.data(), fieldname.length(), 0);
+            uint64_t field_h = XXH64(fieldjson.data(), fieldjson.length(), 0);
+
+            out_hashes.push_back(std::make_pair(name_h, field_h));
+
+            if (!full) {
+                auto old_h = std::lower_bound(si->second.begin(), si->second.end(),
+                        std::make_pair(name_h, (uint64_t) 0));
+
+                if (old_h != si->second.end() && old_h->first == name_h &&
+                        old_h->second == field_h)
+                    continue;
+            }
+
+            if (fields.length() > 0)
+                fields += ",";
+            fields += "\"" + fieldname + "\":" + fieldjson;
+        }
+    }
+
+    std::sort(out_hashes.begin(), out_hashes.end());
+
+    // Fields are only ever added to a device, and a summary always has the same
+    // fields, so anything which hasn't changed can simply be left out
+    if (!full && fields.length() == 0)
+        return false;
+
+    out += "{\"kismet.device.subscription.event\":\"";
+    out += full ? "new" : "update";
+    out += "\",\"kismet.device.base.key\":\"" + key.as_string() + "\",";
+    out += "\"kismet.device.subscription.device\":{" + fields + "}}\n";
+
+    return true;
+}
+
+void device_subscription::flush() {
+    std::lock_guard<std::mutex> flk(flush_mutex);
+
+    std::unordered_map<device_key, device_t, device_key_hash> work;
+    std::unordered_set<device_key, device_key_hash> removed;
+
+    {
+        std::lock_guard<std::mutex> lk(pending_mutex);
+        work.swap(pending);
+        removed.swap(pending_removed);
+    }
+
+    std::string record;
+    std::vector<std::pair<uint64_t, uint64_t>> hashes;
+    bool blocked = false;
+
+    // Removals go first, so a device removed and re-created with the same key is
+    // sent as new
+    for (auto ri = removed.begin(); ri != removed.end(); ) {
+        auto si = sent.find(*ri);
+
+        // Never sent, nothing to remove
+        if (si == sent.end()) {
+            ri = removed.erase(ri);
+            continue;
+        }
+
+        record = "{\"kismet.device.subscription.event\":\"remove\","
+            "\"kismet.device.base.key\":\"" + ri->as_string() + "\"}\n";
+
+        if (!buffer->PutWriteBufferData(record)) {
+            blocked = true;
+            break;
+        }
+
+        sent.erase(si);
+        ri = removed.erase(ri);
+    }
+
+    for (auto wi = work.begin(); !blocked && wi != work.end(); ) {
+        record.clear();
+
+        if (!device_record(wi->second, record, hashes)) {
+            wi = work.erase(wi);
+            continue;
+        }
+
+        // Only remember what the client has actually been sent; a record which
+        // doesn't fit is rebuilt once there's room
+        if (!buffer->PutWriteBufferData(record)) {
+            blocked = true;
+            break;
+        }
+
+        sent[wi->first].swap(hashes);
+        wi = work.erase(wi);
+    }
+
+    if (work.size() == 0 && removed.size() == 0)
+        return;
+
+    // Put back anything the client didn't have room for.  Devices removed since we
+    // started are dropped, and anything which changed again since we started is
+    // already pending.
+    std::lock_guard<std::mutex> lk(pending_mutex);
+
+    for (const auto& w : work) {
+        if (pending_removed.find(w.first) == pending_removed.end())
+            pending.emplace(w.first, w.second);
+    }
+
+    for (const auto& r : removed)
+        pending_removed.insert(r);
+}
+
+Devicetracker_Httpd_Subscribe::Devicetracker_Httpd_Subscribe() :
+    Kis_Net_Httpd_Ringbuf_Stream_Handler(),
+    subscriptions {std::make_shared<subscription_vec_t>()},
+    num_subscriptions {0} {
+
+    // Each client gets a buffer this size; once it's full, changes wait for the
+    // client to catch up
+    Httpd_Set_Buffer_Size(1024 *
+            Globalreg::globalreg->kismet_config->FetchOptUInt("httpd_subscription_buffer_kb", 512));
+
+    auto rate_ms =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("httpd_subscription_rate_ms", 1000);
+
+    auto timetracker = Globalreg::FetchMandatoryGlobalAs<Timetracker>("TIMETRACKER");
+
+    flush_timer =
+        timetracker->RegisterTimer(std::max(1U, rate_ms * SERVER_TIMESLICES_SEC / 1000),
+                NULL, 1, [this](int) -> int {
+                    if (num_subscriptions == 0)
+                        return 1;
+
+                    auto subs = std::atomic_load(&subscriptions);
+
+                    for (const auto& s : *subs)
+                        s->flush();
+
+                    return 1;
+                });
+
+    Bind_Httpd_Server();
+}
+
+Devicetracker_Httpd_Subscribe::~Devicetracker_Httpd_Subscribe() {
+    auto timetracker = Globalreg::FetchGlobalAs<Timetracker>("TIMETRACKER");
+
+    if (timetracker != nullptr)
+        timetracker->RemoveTimer(flush_timer);
+}
+
+bool Devicetracker_Httpd_Subscribe::Httpd_VerifyPath(const char *path, const char *method) {
+    if (strcmp(method, "GET") != 0 && strcmp(method, "POST") != 0)
+        return false;
+
+    return strcmp(path, "/devices/subscribe/devices.ekjson") == 0;
+}
+
+int Devicetracker_Httpd_Subscribe::Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
+        const char *url, const char *method, const char *upload_data,
+        size_t *upload_data_size) {
+
+    if (strcmp(method, "GET") != 0)
+        return MHD_YES;
+
+    if (!httpd->HasValidSession(connection)) {
+        connection->httpcode = 503;
+        return MHD_YES;
+    }
+
+    return subscribe(connection, nullptr);
+}
+
+int Devicetracker_Httpd_Subscribe::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
+    if (!httpd->HasValidSession(concls, true)) {
+        concls->httpcode = 503;
+        return MHD_YES;
+    }
+
+    SharedStructured structdata;
+
+    try {
+        if (concls->variable_cache.find("json") != concls->variable_cache.end())
+            structdata =
+                std::make_shared<StructuredJson>(concls->variable_cache["json"]->str());
+    } catch (const StructuredDataException& e) {
+        auto saux = (Kis_Net_Httpd_Buffer_Stream_Aux *) concls->custom_extension;
+        saux->get_rbhandler()->PutWriteBufferData("Invalid request: " + std::string(e.what()));
+        concls->httpcode = 400;
+        return MHD_YES;
+    }
+
+    return subscribe(concls, structdata);
+}
+
+int Devicetracker_Httpd_Subscribe::subscribe(Kis_Net_Httpd_Connection *connection,
+        SharedStructured in_structured) {
+    auto saux = (Kis_Net_Httpd_Buffer_Stream_Aux *) connection->custom_extension;
+
+    std::vector<SharedElementSummary> summary_vec;
+    bool snapshot = true;
+
+    try {
+        if (in_structured != nullptr) {
+            if (in_structured->hasKey("fields")) {
+                auto fvec = in_structured->getStructuredByKey("fields")->getStructuredArray();
+
+                for (const auto& i : fvec) {
+                    if (i->isString()) {
+                        summary_vec.push_back(std::make_shared<TrackerElementSummary>(i->getString()));
+                    } else if (i->isArray()) {
+                        auto mapvec = i->getStringVec();
+
+                        if (mapvec.size() != 2)
+                            throw StructuredDataException("Invalid field mapping, expected "
+                                    "[field, rename]");
+
+                        summary_vec.push_back(std::make_shared<TrackerElementSummary>(mapvec[0],
+                                    mapvec[1]));
+                    } else {
+                        throw StructuredDataException("Invalid field mapping, expected "
+                                "field or [field,rename]");
+                    }
+                }
+            }
+
+            snapshot = in_structured->getKeyAsBool("snapshot", true);
+        }
+    } catch (const StructuredDataException& e) {
+        saux->get_rbhandler()->PutWriteBufferData("Invalid request: " + std::string(e.what()));
+        connection->httpcode = 400;
+        return MHD_YES;
+    }
+
+    auto sub = std::make_shared<device_subscription>(saux->get_rbhandler(), summary_vec);
+
+    // Start the client off with every device we know about
+    if (snapshot) {
+        auto devicetracker = Globalreg::FetchMandatoryGlobalAs<Devicetracker>();
+
+        for (const auto& d : *devicetracker->FetchDeviceSnapshot())
+            sub->device_changed(d);
+    }
+
+    saux->set_aux(nullptr,
+            [this, sub](Kis_Net_Httpd_Buffer_Stream_Aux *) {
+                remove_subscription(sub);
+            });
+
+    add_subscription(sub);
+
+    return MHD_NO;
+}
+
+void Devicetracker_Httpd_Subscribe::add_subscription(std::shared_ptr<device_subscription> in_sub) {
+    std::lock_guard<std::mutex> lk(subscription_mutex);
+
+    auto subs = std::make_shared<subscription_vec_t>(*subscriptions);
+    subs->push_back(in_sub);
+
+    std::atomic_store(&subscriptions, std::shared_ptr<const subscription_vec_t>(subs));
+    num_subscriptions = subs->size();
+}
+
+void Devicetracker_Httpd_Subscribe::remove_subscription(std::shared_ptr<device_subscription> in_sub) {
+    std::lock_guard<std::mutex> lk(subscription_mutex);
+
+    auto subs = std::make_shared<subscription_vec_t>(*subscriptions);
+    subs->erase(std::remove(subs->begin(), subs->end(), in_sub), subs->end());
+
+    std::atomic_store(&subscriptions, std::shared_ptr<const subscription_vec_t>(subs));
+    num_subscriptions = subs->size();
+}
+
+void Devicetracker_Httpd_Subscribe::device_changed(const std::shared_ptr<kis_tracked_device_base>& in_device) {
+    if (num_subscriptions == 0)
+        return;
+
+    auto subs = std::atomic_load(&subscriptions);
+
+    for (const auto& s : *subs)
+        s->device_changed(in_device);
+}
+
+void Devicetracker_Httpd_Subscribe::device_removed(const std::shared_ptr<kis_tracked_device_base>& in_device) {
+    if (num_subscriptions == 0)
+        return;
+
+    auto subs = std::atomic_load(&subscriptions);
+
+    for (const auto& s : *subs)
+        s->device_removed(in_device);
+}
+
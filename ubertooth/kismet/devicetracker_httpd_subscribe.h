@@ -0,0 +1,130 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __DEVICETRACKER_HTTPD_SUBSCRIBE__
+#define __DEVICETRACKER_HTTPD_SUBSCRIBE__
+
+#include "config.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "devicetracker_table.h"
+#include "kis_net_microhttpd.h"
+#include "structured.h"
+#include "trackedelement.h"
+
+class kis_tracked_device_base;
+
+/* Streams device changes to subscribed clients, instead of clients polling the
+ * device list for changes.
+ *
+ * A client subscribes with an optional field summary, the same as the device list
+ * endpoints, and receives one json record per line: the summarized device the
+ * first time it's sent, then only the summarized fields which have changed, and a
+ * record when the device is removed.
+ *
+ * Changes are collected per device and written on a timer, so a device which
+ * changes many times between writes is only sent once.  A client which isn't
+ * reading fast enough to keep up isn't written to until its buffer has drained;
+ * its changes continue to be collected in the meantime. */
+
+class device_subscription {
+public:
+    using device_t = std::shared_ptr<kis_tracked_device_base>;
+
+    device_subscription(std::shared_ptr<BufferHandlerGeneric> in_buffer,
+            const std::vector<SharedElementSummary>& in_summary) :
+        buffer {in_buffer},
+        summary {in_summary} { }
+
+    void device_changed(const device_t& in_device);
+    void device_removed(const device_t& in_device);
+
+    // Write as many of the pending changes as fit in the client buffer
+    void flush();
+
+protected:
+    // Summarize the device and append a record to the output if anything has
+    // changed since it was last sent; returns false if there was nothing to send.
+    // The field hashes to remember once the record is sent are returned in
+    // out_hashes.
+    bool device_record(const device_t& in_device, std::string& out,
+            std::vector<std::pair<uint64_t, uint64_t>>& out_hashes);
+
+    std::shared_ptr<BufferHandlerGeneric> buffer;
+    std::vector<SharedElementSummary> summary;
+
+    // Changes since the last flush; held only to record and collect changes, never
+    // while serializing
+    std::mutex pending_mutex;
+    std::unordered_map<device_key, device_t, device_key_hash> pending;
+    std::unordered_set<device_key, device_key_hash> pending_removed;
+
+    // Hashes of the name and content of each field last sent for each device,
+    // ordered by name hash; only used under the flush lock
+    std::mutex flush_mutex;
+    std::unordered_map<device_key, std::vector<std::pair<uint64_t, uint64_t>>,
+        device_key_hash> sent;
+};
+
+class Devicetracker_Httpd_Subscribe : public Kis_Net_Httpd_Ringbuf_Stream_Handler {
+public:
+    Devicetracker_Httpd_Subscribe();
+    virtual ~Devicetracker_Httpd_Subscribe();
+
+    virtual bool Httpd_VerifyPath(const char *path, const char *method) override;
+
+    virtual int Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection,
+            const char *url, const char *method, const char *upload_data,
+            size_t *upload_data_size) override;
+
+    virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) override;
+
+    // Called by the devicetracker as devices are created, change, and are removed;
+    // cheap when nobody is subscribed
+    void device_changed(const std::shared_ptr<kis_tracked_device_base>& in_device);
+    void device_removed(const std::shared_ptr<kis_tracked_device_base>& in_device);
+
+protected:
+    using subscription_vec_t = std::vector<std::shared_ptr<device_subscription>>;
+
+    // Attach a subscription to the stream of the connection; returns MHD_NO to keep
+    // the stream open
+    int subscribe(Kis_Net_Httpd_Connection *connection, SharedStructured in_structured);
+
+    void add_subscription(std::shared_ptr<device_subscription> in_sub);
+    void remove_subscription(std::shared_ptr<device_subscription> in_sub);
+
+    // Held to change the subscription list; the list itself is replaced, never
+    // modified, so notifiers only need to load it
+    std::mutex subscription_mutex;
+    std::shared_ptr<const subscription_vec_t> subscriptions;
+    std::atomic<unsigned int> num_subscriptions;
+
+    int flush_timer;
+};
+
+#endif
+
@@ -0,0 +1,516 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <algorithm>
+
+#include "devicetracker_table.h"
+#include "devicetracker_component.h"
+#include "kismet_algorithm.h"
+
+device_table::device_table() :
+    num_devices {0} { }
+
+device_table::device_t device_table::find(const device_key& in_key) {
+    auto& s = shard_for(in_key.get_dkey());
+    local_locker lock(&s.mutex);
+
+    auto i = s.key_map.find(in_key);
+
+    if (i != s.key_map.end())
+        return i->second;
+
+    return nullptr;
+}
+
+bool device_table::insert(device_t in_device) {
+    auto key = in_device->get_key();
+    auto mac = in_device->get_macaddr();
+
+    {
+        auto& s = shard_for(key.get_dkey());
+        local_locker lock(&s.mutex);
+
+        if (!s.key_map.emplace(key, in_device).second)
+            return false;
+    }
+
+    // The key and mac normally pick the same shard, but devices restored from
+    // storage aren't guaranteed to have a mac-based key
+    {
+        auto& s = shard_for(mac.longmac);
+        local_locker lock(&s.mutex);
+
+        s.mac_map.emplace(mac.longmac, in_device);
+    }
+
+    num_devices++;
+
+    return true;
+}
+
+bool device_table::remove(device_t in_device) {
+    auto key = in_device->get_key();
+    auto mac = in_device->get_macaddr();
+
+    {
+        auto& s = shard_for(key.get_dkey());
+        local_locker lock(&s.mutex);
+
+        auto i = s.key_map.find(key);
+
+        if (i == s.key_map.end() || i->second != in_device)
+            return false;
+
+        s.key_map.erase(i);
+    }
+
+    {
+        auto& s = shard_for(mac.longmac);
+        local_locker lock(&s.mutex);
+
+        auto mmp = s.mac_map.equal_range(mac.longmac);
+
+        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
+            if (mmpi->second == in_device) {
+                s.mac_map.erase(mmpi);
+                break;
+            }
+        }
+    }
+
+    num_devices--;
+
+    return true;
+}
+
+std::vector<device_table::device_t> device_table::find_mac(const mac_addr& in_mac) {
+    std::vector<device_t> ret;
+
+    if (in_mac.longmask == (uint64_t) -1) {
+        auto& s = shard_for(in_mac.longmac);
+        local_locker lock(&s.mutex);
+
+        auto mmp = s.mac_map.equal_range(in_mac.longmac);
+
+        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi)
+            ret.push_back(mmpi->second);
+
+        return ret;
+    }
+
+    for (auto& s : shards) {
+        local_locker lock(&s.mutex);
+
+        for (const auto& mi : s.mac_map) {
+            if ((mi.first & in_mac.longmask) == (in_mac.longmac & in_mac.longmask))
+                ret.push_back(mi.second);
+        }
+    }
+
+    return ret;
+}
+
+bool device_table::has_mac(const mac_addr& in_mac) {
+    if (in_mac.longmask == (uint64_t) -1) {
+        auto& s = shard_for(in_mac.longmac);
+        local_locker lock(&s.mutex);
+
+        return s.mac_map.find(in_mac.longmac) != s.mac_map.end();
+    }
+
+    return find_mac(in_mac).size() > 0;
+}
+
+void device_table::clear() {
+    for (auto& s : shards) {
+        local_locker lock(&s.mutex);
+
+        num_devices -= s.key_map.size();
+
+        s.key_map.clear();
+        s.mac_map.clear();
+    }
+}
+
+void device_seen_index::place(entry& e, time_t in_time) {
+    e.time_pos = by_time.emplace(in_time, &e);
+    e.seq = ++seq;
+    by_seq.emplace(e.seq, &e);
+}
+
+void device_seen_index::insert(const device_t& in_device, time_t in_time) {
+    local_locker lock(&mutex);
+
+    auto ei = entries.emplace(in_device.get(), entry());
+
+    if (!ei.second)
+        return;
+
+    ei.first->second.device = in_device;
+    place(ei.first->second, in_time);
+}
+
+void device_seen_index::update(const device_t& in_device, time_t in_time) {
+    local_locker lock(&mutex);
+
+    auto ei = entries.find(in_device.get());
+
+    if (ei == entries.end())
+        return;
+
+    if (ei->second.time_pos->first >= in_time) {
+        // Same second, or an older packet; only take a new sequence if someone
+        // may have already resumed past this one
+        if (ei->second.seq > served_seq)
+            return;
+
+        by_seq.erase(ei->second.seq);
+        ei->second.seq = ++seq;
+        by_seq.emplace(ei->second.seq, &ei->second);
+        return;
+    }
+
+    by_time.erase(ei->second.time_pos);
+    by_seq.erase(ei->second.seq);
+
+    place(ei->second, in_time);
+}
+
+void device_seen_index::remove(const device_t& in_device) {
+    local_locker lock(&mutex);
+
+    auto ei = entries.find(in_device.get());
+
+    if (ei == entries.end())
+        return;
+
+    by_time.erase(ei->second.time_pos);
+    by_seq.erase(ei->second.seq);
+    entries.erase(ei);
+}
+
+std::vector<device_seen_index::device_t> device_seen_index::seen_since(time_t in_time) {
+    local_locker lock(&mutex);
+
+    std::vector<device_t> ret;
+
+    for (auto ti = by_time.upper_bound(in_time); ti != by_time.end(); ++ti)
+        ret.push_back(ti->second->device);
+
+    return ret;
+}
+
+uint64_t device_seen_index::changed_since(uint64_t in_seq, std::vector<device_t>& ret) {
+    local_locker lock(&mutex);
+
+    for (auto si = by_seq.upper_bound(in_seq); si != by_seq.end(); ++si)
+        ret.push_back(si->second->device);
+
+    served_seq = seq;
+    return seq;
+}
+
+uint64_t device_seen_index::sequence() {
+    local_locker lock(&mutex);
+    served_seq = seq;
+    return seq;
+}
+
+void device_seen_index::clear() {
+    local_locker lock(&mutex);
+
+    entries.clear();
+    by_time.clear();
+    by_seq.clear();
+}
+
+namespace {
+    using keyed_device_t = std::pair<SharedTrackerElement, device_sort_cache::device_t>;
+
+    // Ascending, with devices missing the field last
+    bool sort_key_less(const SharedTrackerElement& a, const SharedTrackerElement& b) {
+        if (a == nullptr)
+            return false;
+
+        if (b == nullptr)
+            return true;
+
+        return FastSortTrackerElementLess(a, b);
+    }
+
+    bool keyed_less(const keyed_device_t& a, const keyed_device_t& b) {
+        return sort_key_less(a.first, b.first);
+    }
+}
+
+void device_sort_cache::add(const device_t& in_device) {
+    local_locker lock(&member_mutex);
+
+    members[in_device.get()] = in_device;
+
+    if (logging) {
+        member_log.emplace_back(++member_seq, in_device.get());
+
+        if (member_log.size() > DEVICE_SORT_CACHE_LOG)
+            member_log.pop_front();
+    }
+}
+
+void device_sort_cache::remove(const device_t& in_device) {
+    local_locker lock(&member_mutex);
+
+    auto mi = members.find(in_device.get());
+
+    if (mi == members.end() || mi->second != in_device)
+        return;
+
+    members.erase(mi);
+
+    if (logging) {
+        member_log.emplace_back(++member_seq, in_device.get());
+
+        if (member_log.size() > DEVICE_SORT_CACHE_LOG)
+            member_log.pop_front();
+    }
+}
+
+device_sort_cache::sorted_t device_sort_cache::sorted(const std::vector<int>& in_path,
+        device_seen_index& in_index) {
+    local_locker lock(&order_mutex);
+
+    auto now = time(0);
+
+    // Let go of orders nobody has asked for in a while, and the devices they hold
+    orders.erase(std::remove_if(orders.begin(), orders.end(), 
+                [now](const order& o) -> bool {
+                    return now - o.used > DEVICE_SORT_CACHE_IDLE;
+                }), orders.end());
+
+    auto oi = std::find_if(orders.begin(), orders.end(),
+            [&in_path](const order& o) -> bool {
+                return o.path == in_path;
+            });
+
+    if (oi == orders.end()) {
+        if (orders.size() >= DEVICE_SORT_CACHE_ORDERS) {
+            oi = std::min_element(orders.begin(), orders.end(),
+                    [](const order& a, const order& b) -> bool {
+                        return a.used < b.used;
+                    });
+        } else {
+            orders.push_back(order());
+            oi = orders.end() - 1;
+        }
+
+        oi->path = in_path;
+        rebuild(*oi, in_index, now);
+    } else if (now - oi->built > DEVICE_SORT_CACHE_REFRESH || !update(*oi, in_index)) {
+        rebuild(*oi, in_index, now);
+    }
+
+    oi->used = now;
+
+    trim_log();
+
+    return oi->devices;
+}
+
+size_t device_sort_cache::unset_start(const sorted_t& in_sorted, const std::vector<int>& in_path) {
+    auto ui = std::partition_point(in_sorted->begin(), in_sorted->end(),
+            [&in_path](const device_t& d) -> bool {
+                return GetTrackerElementPath(in_path, d) != nullptr;
+            });
+
+    return ui - in_sorted->begin();
+}
+
+size_t device_sort_cache::position(size_t in_size, size_t in_unset, size_t in_pos, bool in_descending) {
+    if (in_descending) {
+        if (in_pos < in_unset)
+            return in_unset - 1 - in_pos;
+
+        return in_pos;
+    }
+
+    if (in_pos < in_size - in_unset)
+        return in_unset + in_pos;
+
+    return in_pos - (in_size - in_unset);
+}
+
+void device_sort_cache::rebuild(order& o, device_seen_index& in_index, time_t now) {
+    // Take the seen sequence before copying the members; anything seen in between
+    // is just re-placed again on the next request
+    o.seen_seq = in_index.sequence();
+
+    std::vector<keyed_device_t> keyed;
+
+    {
+        local_locker lock(&member_mutex);
+
+        logging = true;
+        o.member_seq = member_seq;
+
+        keyed.reserve(members.size());
+
+        for (const auto& mi : members)
+            keyed.emplace_back(nullptr, mi.second);
+    }
+
+    // Resolve the field once per device instead of on every comparison
+    for (auto& ki : keyed)
+        ki.first = GetTrackerElementPath(o.path, ki.second);
+
+    kismet__sort(keyed.begin(), keyed.end(), keyed_less);
+
+    auto devices = std::make_shared<std::vector<device_t>>();
+    devices->reserve(keyed.size());
+
+    for (auto& ki : keyed)
+        devices->push_back(std::move(ki.second));
+
+    o.devices = devices;
+    o.built = now;
+}
+
+bool device_sort_cache::update(order& o, device_seen_index& in_index) {
+    std::vector<device_t> seen;
+    auto seen_seq = in_index.changed_since(o.seen_seq, seen);
+
+    // Devices to re-place, or null for devices which have left the list
+    std::unordered_map<kis_tracked_device_base *, device_t> touched;
+    uint64_t log_seq;
+
+    {
+        local_locker lock(&member_mutex);
+
+        // The log no longer reaches back to this order
+        if (o.member_seq != member_seq &&
+                (member_log.empty() || member_log.front().first > o.member_seq + 1))
+            return false;
+
+        for (auto li = member_log.rbegin(); li != member_log.rend() && li->first > o.member_seq; ++li) {
+            auto mi = members.find(li->second);
+
+            if (mi != members.end())
+                touched[li->second] = mi->second;
+            else
+                touched[li->second] = nullptr;
+        }
+
+        // The seen index covers every device, only re-place the ones in this list
+        for (const auto& d : seen) {
+            auto mi = members.find(d.get());
+
+            if (mi != members.end() && mi->second == d)
+                touched[d.get()] = d;
+        }
+
+        log_seq = member_seq;
+    }
+
+    o.seen_seq = seen_seq;
+    o.member_seq = log_seq;
+
+    // Nothing moved, but a field may have changed in place
+    if (touched.size() == 0) {
+        SharedTrackerElement last_key;
+
+        for (size_t i = 0; i < o.devices->size(); i++) {
+            auto key = GetTrackerElementPath(o.path, (*o.devices)[i]);
+
+            if (i > 0 && sort_key_less(key, last_key))
+                return false;
+
+            last_key = key;
+        }
+
+        return true;
+    }
+
+    // Re-placing is only cheaper than sorting while a small part of the list moved
+    if (touched.size() > o.devices->size() / 4)
+        return false;
+
+    // Resolve the field of every device staying put; one which changed without
+    // moving in the seen index may no longer fit between its neighbours, and 
+    // then the list has to be sorted again
+    std::vector<keyed_device_t> kept;
+    kept.reserve(o.devices->size());
+
+    for (const auto& d : *o.devices) {
+        if (touched.find(d.get()) != touched.end())
+            continue;
+
+        kept.emplace_back(GetTrackerElementPath(o.path, d), d);
+
+        if (kept.size() > 1 && keyed_less(kept.back(), kept[kept.size() - 2]))
+            return false;
+    }
+
+    std::vector<keyed_device_t> placed;
+
+    for (const auto& ti : touched) {
+        if (ti.second != nullptr)
+            placed.emplace_back(GetTrackerElementPath(o.path, ti.second), ti.second);
+    }
+
+    std::sort(placed.begin(), placed.end(), keyed_less);
+
+    // Placed devices go after kept devices with the same value
+    std::vector<keyed_device_t> merged;
+    merged.reserve(kept.size() + placed.size());
+
+    std::merge(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()),
+            std::make_move_iterator(placed.begin()), std::make_move_iterator(placed.end()),
+            std::back_inserter(merged), keyed_less);
+
+    auto devices = std::make_shared<std::vector<device_t>>();
+    devices->reserve(merged.size());
+
+    for (auto& mi : merged)
+        devices->push_back(std::move(mi.second));
+
+    o.devices = devices;
+
+    return true;
+}
+
+void device_sort_cache::trim_log() {
+    local_locker lock(&member_mutex);
+
+    uint64_t oldest = member_seq;
+
+    for (const auto& o : orders)
+        oldest = std::min(oldest, o.member_seq);
+
+    while (!member_log.empty() && member_log.front().first <= oldest)
+        member_log.pop_front();
+}
+
+void device_sort_cache::clear() {
+    local_locker olock(&order_mutex);
+    local_locker mlock(&member_mutex);
+
+    orders.clear();
+    members.clear();
+    member_log.clear();
+    logging = false;
+}
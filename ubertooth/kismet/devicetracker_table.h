@@ -0,0 +1,231 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __DEVICE_TRACKER_TABLE_H__
+#define __DEVICE_TRACKER_TABLE_H__
+
+#include "config.h"
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "kis_mutex.h"
+#include "macaddr.h"
+#include "trackedelement.h"
+
+// Must be a power of two
+#define DEVICE_TABLE_SHARDS     64
+
+// Sort orders kept per list, how often (in seconds) they're rebuilt from scratch,
+// how long an unused order is kept, and how many membership changes are kept
+// for replaying into orders before they fall back to a rebuild
+#define DEVICE_SORT_CACHE_ORDERS    4
+#define DEVICE_SORT_CACHE_REFRESH   30
+#define DEVICE_SORT_CACHE_IDLE      300
+#define DEVICE_SORT_CACHE_LOG       65536
+
+class kis_tracked_device_base;
+
+struct device_key_hash {
+    size_t operator()(const device_key& k) const {
+        return (size_t) ((k.get_spkey() * 0x9E3779B97F4A7C15ULL) ^ k.get_dkey());
+    }
+};
+
+// Hash table of all tracked devices, split into independently locked shards.
+//
+// Devices are placed by the device component of their key, which is the mac
+// address, so every device sharing a mac lands in the same shard and the mac
+// index can live alongside the key index.  Shard locks are only held for the
+// table operation itself and no other lock is taken under them, so they can
+// be used from inside the devicelist lock or a device lock.
+class device_table {
+public:
+    using device_t = std::shared_ptr<kis_tracked_device_base>;
+
+    device_table();
+
+    device_t find(const device_key& in_key);
+
+    // Returns false if a device with the same key is already present
+    bool insert(device_t in_device);
+
+    // Returns false if the device was not in the table
+    bool remove(device_t in_device);
+
+    // All devices with a given mac, across all phys.  Masked macs fall back to
+    // checking every shard.
+    std::vector<device_t> find_mac(const mac_addr& in_mac);
+    bool has_mac(const mac_addr& in_mac);
+
+    size_t size() const {
+        return num_devices.load(std::memory_order_relaxed);
+    }
+
+    void clear();
+
+protected:
+    struct shard {
+        kis_recursive_timed_mutex mutex;
+        std::unordered_map<device_key, device_t, device_key_hash> key_map;
+        std::unordered_multimap<uint64_t, device_t> mac_map;
+    };
+
+    shard& shard_for(uint64_t in_mac) {
+        return shards[((in_mac * 0x9E3779B97F4A7C15ULL) >> 40) & (DEVICE_TABLE_SHARDS - 1)];
+    }
+
+    shard shards[DEVICE_TABLE_SHARDS];
+    std::atomic<size_t> num_devices;
+};
+
+// Devices ordered by the last time they were seen, so "what changed since T"
+// only touches the devices which changed.  Every move also takes the next value
+// of a change sequence, which clients can resume from instead of a timestamp
+// and which doesn't suffer from clock skew between packet sources.
+//
+// A device seen again within the same second keeps its place in time, but once a
+// client has been handed a sequence past its entry it takes a new sequence, so
+// resuming from that sequence still returns it.  Devices which haven't been handed
+// out yet don't need to move, which keeps repeat updates cheap.
+//
+// Devices enter the index when they're added to the device list and leave when
+// they're removed from it; updates for devices which aren't indexed are ignored,
+// so a packet thread finishing with an already-removed device can't re-add it.
+// Like the table shards, the index lock is a leaf lock.
+class device_seen_index {
+public:
+    using device_t = std::shared_ptr<kis_tracked_device_base>;
+
+    device_seen_index() :
+        seq {0},
+        served_seq {0} { }
+
+    void insert(const device_t& in_device, time_t in_time);
+    void update(const device_t& in_device, time_t in_time);
+    void remove(const device_t& in_device);
+
+    // Devices last seen after in_time
+    std::vector<device_t> seen_since(time_t in_time);
+
+    // Devices which have moved since in_seq; returns the current sequence to
+    // resume from
+    uint64_t changed_since(uint64_t in_seq, std::vector<device_t>& ret);
+
+    uint64_t sequence();
+
+    void clear();
+
+protected:
+    struct entry;
+
+    using time_map_t = std::multimap<time_t, entry *>;
+
+    struct entry {
+        device_t device;
+        time_map_t::iterator time_pos;
+        uint64_t seq;
+    };
+
+    void place(entry& e, time_t in_time);
+
+    kis_recursive_timed_mutex mutex;
+
+    // Entries don't move once inserted, so the ordered maps can point at them
+    std::unordered_map<kis_tracked_device_base *, entry> entries;
+    time_map_t by_time;
+    std::map<uint64_t, entry *> by_seq;
+    uint64_t seq;
+
+    // Highest sequence handed out to a caller
+    uint64_t served_seq;
+};
+
+// Device list kept sorted by one field, so datatables can page through a large
+// list without copying and sorting every device on every request.
+//
+// The owner of the list reports devices entering and leaving it.  Each sort
+// order remembers the seen index sequence and the membership log position it was
+// built at, and on the next request re-places only the devices which have been
+// seen, added, or removed since; a request with no changes returns the same list.
+// Sorted lists are never modified once they're handed out.
+//
+// Orders are always ascending with unset fields last; position() maps a page
+// position onto them so ascending pages lead with the unset fields and descending
+// pages walk the set fields backwards and end with them.
+//
+// A field can change without the device moving in the seen index (a change made
+// outside of packet handling), so the devices which stay put are checked against
+// their neighbours on every update, and an order they no longer fit is rebuilt.
+// Each order is also rebuilt periodically.
+class device_sort_cache {
+public:
+    using device_t = std::shared_ptr<kis_tracked_device_base>;
+    using sorted_t = std::shared_ptr<const std::vector<device_t>>;
+
+    device_sort_cache() :
+        member_seq {0},
+        logging {false} { }
+
+    void add(const device_t& in_device);
+    void remove(const device_t& in_device);
+
+    sorted_t sorted(const std::vector<int>& in_path, device_seen_index& in_index);
+
+    // Index of the first device with an unset field in a sorted order
+    static size_t unset_start(const sorted_t& in_sorted, const std::vector<int>& in_path);
+
+    // Index in a sorted order of the device at in_pos of a page
+    static size_t position(size_t in_size, size_t in_unset, size_t in_pos, bool in_descending);
+
+    void clear();
+
+protected:
+    struct order {
+        std::vector<int> path;
+        sorted_t devices;
+        uint64_t seen_seq;
+        uint64_t member_seq;
+        time_t built;
+        time_t used;
+    };
+
+    void rebuild(order& o, device_seen_index& in_index, time_t now);
+    bool update(order& o, device_seen_index& in_index);
+    void trim_log();
+
+    // Held while sorting so requests for the same order share one sort
+    kis_recursive_timed_mutex order_mutex;
+    std::vector<order> orders;
+
+    // Held only to record and collect membership changes; never held while sorting
+    kis_recursive_timed_mutex member_mutex;
+    std::unordered_map<kis_tracked_device_base *, device_t> members;
+    std::deque<std::pair<uint64_t, kis_tracked_device_base *>> member_log;
+    uint64_t member_seq;
+
+    // Membership is only logged while there are orders to replay it into
+    bool logging;
+};
+
+#endif
+
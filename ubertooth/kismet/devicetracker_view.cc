@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include "devicetracker.h"
 #include "devicetracker_view.h"
 #include "devicetracker_component.h"
 #include "util.h"
@@ -99,9 +100,13 @@ std::shared_ptr<TrackerElementVector> DevicetrackerView::doDeviceWork(Devicetrac
 void DevicetrackerView::newDevice(std::shared_ptr<kis_tracked_device_base> device) {
     local_locker l(&mutex);
 
-    if (new_cb != nullptr)
-        if (new_cb(device))
+    if (new_cb != nullptr) {
+        if (new_cb(device)) {
             device_list->push_back(device);
+            device_presence_map[device->get_key()] = true;
+            sort_cache.add(device);
+        }
+    }
 }
 
 void DevicetrackerView::updateDevice(std::shared_ptr<kis_tracked_device_base> device) {
@@ -118,6 +123,7 @@ void DevicetrackerView::updateDevice(std::shared_ptr<kis_tracked_device_base> de
     if (retain && dpmi == device_presence_map.end()) {
         device_list->push_back(device);
         device_presence_map[device->get_key()] = true;
+        sort_cache.add(device);
     }
 
     // if we're removing the device, find it in the vector and remove it, and remove
@@ -130,6 +136,7 @@ void DevicetrackerView::updateDevice(std::shared_ptr<kis_tracked_device_base> de
             }
         }
         device_presence_map.erase(dpmi);
+        sort_cache.remove(device);
     }
 }
 
@@ -140,6 +147,7 @@ void DevicetrackerView::removeDevice(std::shared_ptr<kis_tracked_device_base> de
 
     if (di != device_presence_map.end()) {
         device_presence_map.erase(di);
+        sort_cache.remove(device);
 
         for (auto vi = device_list->begin(); vi != device_list->end(); ++vi) {
             if (*vi == device) {
@@ -376,6 +384,47 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
         return 400;
     }
 
+    // Without any filters, sorted pages come from the cached sort order and don't
+    // need a copy of the device list at all
+    if (timestamp_min <= 0 && search_term.length() == 0 && regex == nullptr &&
+            in_order_column_num >= 0 && order_field.size() > 0) {
+        auto devtracker = Globalreg::FetchMandatoryGlobalAs<Devicetracker>();
+        auto sorted = sort_cache.sorted(order_field, devtracker->FetchSeenIndex());
+
+        total_sz_elem->set(sorted->size());
+        filtered_sz_elem->set(sorted->size());
+
+        if (in_window_start >= sorted->size())
+            in_window_start = 0;
+
+        start_elem->set(in_window_start);
+
+        size_t window_end;
+
+        if (in_window_len + in_window_start >= sorted->size() || in_window_len == 0)
+            window_end = sorted->size();
+        else
+            window_end = in_window_start + in_window_len;
+
+        length_elem->set(window_end - in_window_start);
+
+        // Direction 0 is ascending with unset fields first, 1 is descending with them last
+        auto unset = device_sort_cache::unset_start(sorted, order_field);
+
+        for (size_t i = in_window_start; i < window_end; i++) {
+            const auto& d = (*sorted)[device_sort_cache::position(sorted->size(), unset, i,
+                    in_order_direction == 1)];
+            output_devices_elem->push_back(SummarizeSingleTrackerElement(d, summary_vec, rename_map));
+        }
+
+        if (transmit == nullptr)
+            transmit = output_devices_elem;
+
+        Globalreg::globalreg->entrytracker->Serialize(kishttpd::GetSuffix(uri), stream, transmit, rename_map);
+
+        return 200;
+    }
+
     // Next vector we do work on
     auto next_work_vec = std::make_shared<TrackerElementVector>();
 
@@ -28,6 +28,7 @@
 #include "trackedelement.h"
 #include "trackedcomponent.h"
 #include "devicetracker_component.h"
+#include "devicetracker_table.h"
 #include "devicetracker_view_workers.h"
 
 // Common view holder mechanism which handles view endpoints, view filtering, and so on.
@@ -124,6 +125,9 @@ protected:
     // Map of device presence in our list for fast referece during updates
     std::map<device_key, bool> device_presence_map;
 
+    // Sort orders of the device list for datatables paging
+    device_sort_cache sort_cache;
+
     // Complex endpoint
     std::shared_ptr<Kis_Net_Httpd_Simple_Post_Endpoint> device_endp;
 
@@ -81,6 +81,8 @@ DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(SharedStructured shar
 #ifdef HAVE_LIBPCRE
     auto vec = shared_pcre_vec->getStructuredArray();
 
+    std::vector<std::pair<std::string, std::string>> str_pcre_vec;
+
     for (auto i : vec) {
         auto rpair = i->getStructuredArray();
 
@@ -88,12 +90,12 @@ DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(SharedStructured shar
             throw std::runtime_error("expected [field, regex] pair from incoming filter");
 
         auto field = rpair[0]->getString();
-        auto regex = rpair[0]->getString();
-
-        auto worker_filter = std::make_shared<DevicetrackerViewRegexWorker::pcre_filter>(field, regex);
+        auto regex = rpair[1]->getString();
 
-        filter_vec.push_back(worker_filter);
+        str_pcre_vec.push_back(std::make_pair(field, regex));
     }
+
+    matcher = std::make_shared<device_pcre_matcher>(str_pcre_vec);
 #else
     throw std::runtime_error("Kismet was not compiled with PCRE support");
 #endif
@@ -101,14 +103,7 @@ DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(SharedStructured shar
 
 DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(const std::vector<std::pair<std::string, std::string>>& str_pcre_vec) {
 #ifdef HAVE_LIBPCRE
-    for (auto i : str_pcre_vec) {
-        auto field = std::get<0>(i);
-        auto regex = std::get<1>(i);
-
-        auto worker_filter = std::make_shared<DevicetrackerViewRegexWorker::pcre_filter>(field, regex);
-
-        filter_vec.push_back(worker_filter);
-    }
+    matcher = std::make_shared<device_pcre_matcher>(str_pcre_vec);
 #else
     throw std::runtime_error("Kismet was ot compiled with PCRE support");
 #endif
@@ -116,40 +111,17 @@ DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(const std::vector<std
 
 bool DevicetrackerViewRegexWorker::matchDevice(std::shared_ptr<kis_tracked_device_base> device) {
 #ifdef HAVE_LIBPCRE
-    bool matched = false;
+    if (matcher != nullptr && matcher->match(device))
+        return true;
 
     for (auto i : filter_vec) {
         auto fields = GetTrackerElementMultiPath(i->target, device);
 
         for (auto fi : fields) {
-            std::string val;
-
-            if (fi->get_type() == TrackerType::TrackerString)
-                val = GetTrackerValue<std::string>(fi);
-            else if (fi->get_type() == TrackerType::TrackerMac)
-                val = GetTrackerValue<mac_addr>(fi).Mac2String();
-            else if (fi->get_type() == TrackerType::TrackerUuid)
-                val = GetTrackerValue<uuid>(fi).UUID2String();
-            else if (fi->get_type() == TrackerType::TrackerByteArray) 
-                val = std::static_pointer_cast<TrackerElementByteArray>(fi)->get();
-            else
-                continue;
-
-            int rc;
-            int ovector[128];
-
-            rc = pcre_exec(i->re, i->study, val.c_str(), val.length(), 0, 0, ovector, 128);
-
             // Stop matching as soon as we find a hit
-            if (rc >= 0) {
-                matched = true;
-                break;
-            }
-
+            if (device_pcre_matcher::match_field(i->re, i->study, fi))
+                return true;
         }
-
-        if (matched)
-            return true;
     }
 #endif
     return false;
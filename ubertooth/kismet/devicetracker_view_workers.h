@@ -28,6 +28,7 @@
 #include "trackedelement.h"
 #include "trackedcomponent.h"
 #include "devicetracker_component.h"
+#include "devicetracker_workers.h"
 
 #ifdef HAVE_LIBPCRE
 #include <pcre.h>
@@ -98,6 +99,9 @@ public:
 
     DevicetrackerViewRegexWorker(const DevicetrackerViewRegexWorker& w) {
         filter_vec = w.filter_vec;
+#ifdef HAVE_LIBPCRE
+        matcher = w.matcher;
+#endif
         matched = w.matched;
     }
 
@@ -108,6 +112,11 @@ public:
 protected:
     std::vector<std::shared_ptr<DevicetrackerViewRegexWorker::pcre_filter>> filter_vec;
 
+#ifdef HAVE_LIBPCRE
+    // Filters compiled from field/regex pairs
+    std::shared_ptr<device_pcre_matcher> matcher;
+#endif
+
 };
 
 // Generic string search for any string-like value (and a few more complex values, like MAC addresses).
@@ -57,6 +57,8 @@ devicetracker_function_worker::devicetracker_function_worker(
 
     mcb = in_mcb;
     fcb = in_fcb;
+
+    concurrent = false;
 }
 
 devicetracker_function_worker::~devicetracker_function_worker() {
@@ -134,121 +136,284 @@ void devicetracker_stringmatch_worker::Finalize(Devicetracker *devicetracker __a
 
 #ifdef HAVE_LIBPCRE
 
-devicetracker_pcre_worker::devicetracker_pcre_worker(
-        const std::vector<std::shared_ptr<devicetracker_pcre_worker::pcre_filter>>& in_filter_vec) {
+#ifndef PCRE_STUDY_JIT_COMPILE
+#define PCRE_STUDY_JIT_COMPILE 0
+#endif
 
-    filter_vec = in_filter_vec;
-    error = false;
+namespace {
+    const char pcre_hex_chars[] = "0123456789ABCDEF";
+
+    char *pcre_render_hex(char *out, uint64_t val, int digits) {
+        for (int d = digits - 1; d >= 0; d--) {
+            out[d] = pcre_hex_chars[val & 0xF];
+            val >>= 4;
+        }
+
+        return out + digits;
+    }
+
+    // Expressions which can't be wrapped in a group and joined to others without
+    // changing their meaning: quoting and comments can run past the end of the
+    // expression, and verbs are only valid at the start of a pattern
+    bool pcre_combinable(const std::string& in_regex) {
+        return in_regex.find("\\Q") == std::string::npos &&
+            in_regex.find('#') == std::string::npos &&
+            in_regex.find("(*") == std::string::npos;
+    }
 }
 
-devicetracker_pcre_worker::devicetracker_pcre_worker(SharedStructured raw_pcre_vec) {
-    error = false;
+device_pcre_matcher::compiled device_pcre_matcher::compile(const std::string& in_regex) {
+    compiled c;
+    const char *compile_error, *study_error;
+    int erroroffset;
 
-    // Process a structuredarray of sub-arrays of [target, filter]; throw any 
-    // exceptions we encounter
+    c.re = pcre_compile(in_regex.c_str(), 0, &compile_error, &erroroffset, NULL);
 
-    StructuredData::structured_vec rawvec = raw_pcre_vec->getStructuredArray();
-    for (auto i : rawvec) {
-        StructuredData::structured_vec rpair = i->getStructuredArray();
+    if (c.re == NULL) 
+        throw std::runtime_error(fmt::format("Could not parse pcre expression: {} at {}",
+                    compile_error, erroroffset));
 
-        if (rpair.size() != 2)
-            throw StructuredDataException("expected [field, regex] pair");
+    c.study = pcre_study(c.re, PCRE_STUDY_JIT_COMPILE, &study_error);
 
-        std::string field = rpair[0]->getString();
-        std::string regex = rpair[1]->getString();
+    if (study_error != NULL) {
+        pcre_free(c.re);
+        throw std::runtime_error(fmt::format("Could not parse PCRE expression, optimization failure {}",
+                    study_error));
+    }
 
-        std::shared_ptr<pcre_filter> filter(new pcre_filter());
-        filter->target = field;
+    return c;
+}
 
-        const char *compile_error, *study_error;
-        int erroroffset;
+void device_pcre_matcher::release(compiled& c) {
+    if (c.study != NULL) {
+#ifdef PCRE_CONFIG_JIT
+        pcre_free_study(c.study);
+#else
+        pcre_free(c.study);
+#endif
+    }
 
-        filter->re =
-            pcre_compile(regex.c_str(), 0, &compile_error, &erroroffset, NULL);
+    if (c.re != NULL)
+        pcre_free(c.re);
 
-        if (filter->re == NULL) {
-            throw std::runtime_error(fmt::format("Could not parse pcre expression: {} at {}",
-                        compile_error, erroroffset));
-        }
+    c.re = NULL;
+    c.study = NULL;
+}
 
-        filter->study = pcre_study(filter->re, 0, &study_error);
-        if (study_error != NULL) {
-            throw std::runtime_error(fmt::format("Could not parse PCRE expression, optimization failure {}",
-                        study_error));
+device_pcre_matcher::device_pcre_matcher(const std::vector<std::pair<std::string, std::string>>& in_filters) {
+    // Group the expressions by the field they target, keeping the order fields
+    // were first seen in
+    std::vector<std::pair<std::string, std::vector<std::string>>> grouped;
+
+    for (const auto& fi : in_filters) {
+        auto gi = std::find_if(grouped.begin(), grouped.end(), 
+                [&fi](const std::pair<std::string, std::vector<std::string>>& g) -> bool {
+                    return g.first == fi.first;
+                });
+
+        if (gi == grouped.end()) {
+            grouped.push_back(std::make_pair(fi.first, std::vector<std::string>{}));
+            gi = grouped.end() - 1;
         }
 
-        filter_vec.push_back(filter);
+        gi->second.push_back(fi.second);
     }
-}
 
-devicetracker_pcre_worker::devicetracker_pcre_worker(const std::vector<std::pair<std::string, std::string>>& str_pcre_vec) {
-    error = false;
+    try {
+        for (const auto& gi : grouped) {
+            field_filter f;
 
-    // Process a structuredarray of sub-arrays of [target, filter]; throw any 
-    // exceptions we encounter
+            for (const auto& pe : StrTokenize(gi.first, "/")) {
+                if (pe.length() == 0)
+                    continue;
 
-    for (auto i : str_pcre_vec) {
-        std::shared_ptr<pcre_filter> filter(new pcre_filter());
-        filter->target = i.first;
+                f.path.push_back(Globalreg::globalreg->entrytracker->GetFieldId(pe));
+            }
 
-        const char *compile_error, *study_error;
-        int erroroffset;
+            filters.push_back(f);
 
-        filter->re =
-            pcre_compile(i.second.c_str(), 0, &compile_error, &erroroffset, NULL);
+            auto& filter = filters.back();
 
-        if (filter->re == NULL) {
-            throw std::runtime_error(fmt::format("Could not parse pcre expression: {} at {}",
-                        compile_error, erroroffset));
-        }
+            // Compile every expression alone first, so errors are reported against
+            // the expression which caused them and we can tell which ones are safe
+            // to combine
+            std::string combined;
+            unsigned int num_combined = 0;
+
+            for (const auto& re : gi.second) {
+                auto c = compile(re);
+
+                int backrefs = 0;
+                pcre_fullinfo(c.re, c.study, PCRE_INFO_BACKREFMAX, &backrefs);
+
+                if (gi.second.size() == 1 || backrefs != 0 || !pcre_combinable(re)) {
+                    filter.res.push_back(c);
+                    continue;
+                }
+
+                release(c);
 
-        filter->study = pcre_study(filter->re, 0, &study_error);
-        if (study_error != NULL) {
-            throw std::runtime_error(fmt::format("Could not parse PCRE expression, optimization failure {}",
-                        study_error));
+                if (num_combined != 0)
+                    combined += "|";
+
+                combined += "(?:" + re + ")";
+                num_combined++;
+            }
+
+            if (num_combined == 0)
+                continue;
+
+            // Fall back to compiling them separately if the combination doesn't work
+            // for some reason we didn't predict
+            try {
+                filter.res.push_back(compile(combined));
+            } catch (const std::runtime_error& e) {
+                for (const auto& re : gi.second) {
+                    if (pcre_combinable(re))
+                        filter.res.push_back(compile(re));
+                }
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        for (auto& f : filters) {
+            for (auto& c : f.res)
+                release(c);
         }
 
-        filter_vec.push_back(filter);
+        throw;
     }
 }
 
-devicetracker_pcre_worker::devicetracker_pcre_worker(const std::string& in_target,
-        SharedStructured raw_pcre_vec) {
+device_pcre_matcher::~device_pcre_matcher() {
+    for (auto& f : filters) {
+        for (auto& c : f.res)
+            release(c);
+    }
+}
+
+bool device_pcre_matcher::match_field(const pcre *in_re, const pcre_extra *in_study,
+        const SharedTrackerElement& in_field) {
+    // Long enough for a UUID, the longest thing we render
+    char buf[40];
+    const char *val;
+    size_t len;
+
+    switch (in_field->get_type()) {
+        case TrackerType::TrackerString:
+        case TrackerType::TrackerByteArray:
+            {
+                const auto& s = std::static_pointer_cast<TrackerElementCoreScalar<std::string>>(in_field)->get();
+                val = s.data();
+                len = s.length();
+            }
+            break;
+        case TrackerType::TrackerMac:
+            {
+                const auto& m = std::static_pointer_cast<TrackerElementMacAddr>(in_field)->get();
+                char *w = buf;
+
+                for (int i = 0; i < 6; i++) {
+                    if (i != 0)
+                        *w++ = ':';
+                    w = pcre_render_hex(w, m[i], 2);
+                }
+
+                val = buf;
+                len = w - buf;
+            }
+            break;
+        case TrackerType::TrackerUuid:
+            {
+                const auto& u = std::static_pointer_cast<TrackerElementUUID>(in_field)->get();
+                char *w = buf;
+
+                w = pcre_render_hex(w, *u.time_low, 8);
+                *w++ = '-';
+                w = pcre_render_hex(w, *u.time_mid, 4);
+                *w++ = '-';
+                w = pcre_render_hex(w, *u.time_hi, 4);
+                *w++ = '-';
+                w = pcre_render_hex(w, *u.clock_seq, 4);
+                *w++ = '-';
+
+                for (int i = 0; i < 6; i++)
+                    w = pcre_render_hex(w, u.node[i], 2);
+
+                val = buf;
+                len = w - buf;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    // We only care if it matched, so don't ask for the captures
+    return pcre_exec(in_re, in_study, val, len, 0, 0, NULL, 0) >= 0;
+}
+
+bool device_pcre_matcher::match(const SharedTrackerElement& in_device) const {
+    for (const auto& f : filters) {
+        auto fields = GetTrackerElementMultiPath(f.path, in_device);
+
+        for (const auto& fi : fields) {
+            for (const auto& c : f.res) {
+                if (match_field(c.re, c.study, fi))
+                    return true;
+            }
+        }
+    }
 
+    return false;
+}
+
+devicetracker_pcre_worker::devicetracker_pcre_worker(
+        const std::vector<std::shared_ptr<devicetracker_pcre_worker::pcre_filter>>& in_filter_vec) {
+
+    filter_vec = in_filter_vec;
+    error = false;
+}
+
+devicetracker_pcre_worker::devicetracker_pcre_worker(SharedStructured raw_pcre_vec) {
     error = false;
 
     // Process a structuredarray of sub-arrays of [target, filter]; throw any 
     // exceptions we encounter
 
+    std::vector<std::pair<std::string, std::string>> str_pcre_vec;
+
     StructuredData::structured_vec rawvec = raw_pcre_vec->getStructuredArray();
     for (auto i : rawvec) {
-        std::string regex = i->getString();
+        StructuredData::structured_vec rpair = i->getStructuredArray();
 
-        std::shared_ptr<pcre_filter> filter(new pcre_filter());
-        filter->target = in_target; 
+        if (rpair.size() != 2)
+            throw StructuredDataException("expected [field, regex] pair");
 
-        const char *compile_error, *study_error;
-        int erroroffset;
-        std::ostringstream errordesc;
+        str_pcre_vec.push_back(std::make_pair(rpair[0]->getString(), rpair[1]->getString()));
+    }
 
-        filter->re =
-            pcre_compile(regex.c_str(), 0, &compile_error, &erroroffset, NULL);
+    matcher = std::make_shared<device_pcre_matcher>(str_pcre_vec);
+}
 
-        if (filter->re == NULL) {
-            errordesc << "Could not parse PCRE expression: " << compile_error <<
-                " at character " << erroroffset;
-            throw std::runtime_error(errordesc.str());
-        }
+devicetracker_pcre_worker::devicetracker_pcre_worker(const std::vector<std::pair<std::string, std::string>>& str_pcre_vec) {
+    error = false;
 
-        filter->study = pcre_study(filter->re, 0, &study_error);
-        if (study_error != NULL) {
-            errordesc << "Could not parse PCRE expression, study/optimization "
-                "failure: " << study_error;
-            throw std::runtime_error(errordesc.str());
-        }
+    matcher = std::make_shared<device_pcre_matcher>(str_pcre_vec);
+}
 
-        filter_vec.push_back(filter);
-    }
+devicetracker_pcre_worker::devicetracker_pcre_worker(const std::string& in_target,
+        SharedStructured raw_pcre_vec) {
+
+    error = false;
+
+    // Process a structuredarray of filters which all apply to the same target
+
+    std::vector<std::pair<std::string, std::string>> str_pcre_vec;
+
+    StructuredData::structured_vec rawvec = raw_pcre_vec->getStructuredArray();
+    for (auto i : rawvec) 
+        str_pcre_vec.push_back(std::make_pair(in_target, i->getString()));
+
+    matcher = std::make_shared<device_pcre_matcher>(str_pcre_vec);
 }
 
 devicetracker_pcre_worker::~devicetracker_pcre_worker() {
@@ -256,9 +421,11 @@ devicetracker_pcre_worker::~devicetracker_pcre_worker() {
 
 bool devicetracker_pcre_worker::MatchDevice(Devicetracker *devicetracker __attribute__((unused)),
         std::shared_ptr<kis_tracked_device_base> device) {
-    bool matched = false;
 
-    // Go through all the filters until we find one that hits
+    if (matcher != nullptr && matcher->match(device))
+        return true;
+
+    // Go through all the prepared filters until we find one that hits
     for (auto i : filter_vec) {
         // Get complex fields - this lets us search nested vectors
         // or strings or whatnot
@@ -266,35 +433,9 @@ bool devicetracker_pcre_worker::MatchDevice(Devicetracker *devicetracker __attri
             GetTrackerElementMultiPath(i->target, device);
 
         for (auto fi : fields) {
-            std::string val;
-
-            // Process a few different types
-            if (fi->get_type() == TrackerType::TrackerString)
-                val = GetTrackerValue<std::string>(fi);
-            else if (fi->get_type() == TrackerType::TrackerMac)
-                val = GetTrackerValue<mac_addr>(fi).Mac2String();
-            else if (fi->get_type() == TrackerType::TrackerUuid)
-                val = GetTrackerValue<uuid>(fi).UUID2String();
-            else if (fi->get_type() == TrackerType::TrackerByteArray) 
-                val = std::static_pointer_cast<TrackerElementByteArray>(fi)->get();
-            else
-                continue;
-
-            int rc;
-            int ovector[128];
-
-            rc = pcre_exec(i->re, i->study, val.c_str(), val.length(), 0, 0, ovector, 128);
-
-            // Stop matching as soon as we find a hit
-            if (rc >= 0) {
-                matched = true;
-                break;
-            }
-
+            if (device_pcre_matcher::match_field(i->re, i->study, fi))
+                return true;
         }
-
-        if (matched)
-            return true;
     }
 
     return false;
@@ -25,6 +25,9 @@
 #include <pcre.h>
 #endif
 
+#include <atomic>
+#include <functional>
+
 #include "trackedelement.h"
 #include "trackedcomponent.h"
 
@@ -32,11 +35,20 @@ class kis_tracked_device_base;
 
 // Filter-handler class.  Subclassed by a filter supplicant to be passed to the
 // device filter functions.
+//
+// Devices are matched in chunks.  Workers which can match from several threads at
+// once return true from ConcurrentMatch, and the chunks of a large device list are
+// then spread over the devicetracker match pool; the devices matched in each chunk
+// are merged into the matched devices in the order of the source list before
+// Finalize is called.  Workers which keep their own partial results should size
+// them in PrepareChunks, fill them from MatchDeviceChunk, and merge them in
+// Finalize; each chunk is only ever matched by one thread at a time.
 class DevicetrackerFilterWorker {
     friend class Devicetracker;
 
 public:
-    DevicetrackerFilterWorker() {
+    DevicetrackerFilterWorker() :
+        cancelled {false} {
         matched_devices = std::make_shared<TrackerElementVector>();
     };
     virtual ~DevicetrackerFilterWorker() { };
@@ -45,13 +57,50 @@ public:
     virtual bool MatchDevice(Devicetracker *devicetracker,
             std::shared_ptr<kis_tracked_device_base> base) = 0;
 
-    // Finalize operations
+    // Perform a match on a device as part of a chunk; chunks are numbered from 0
+    // to the count given to PrepareChunks
+    virtual bool MatchDeviceChunk(Devicetracker *devicetracker,
+            std::shared_ptr<kis_tracked_device_base> base,
+            size_t chunk __attribute__((unused))) {
+        return MatchDevice(devicetracker, base);
+    }
+
+    // Called before matching with the number of chunks the devices are split into
+    virtual void PrepareChunks(size_t nchunks __attribute__((unused))) { }
+
+    // Can MatchDevice be called from multiple threads at once?
+    virtual bool ConcurrentMatch() { return false; }
+
+    // Finalize operations; called when matching is done, even if it was cancelled
     virtual void Finalize(Devicetracker *devicetracker __attribute__((unused))) { }
 
     virtual std::shared_ptr<TrackerElementVector> GetMatchedDevices() {
         return matched_devices;
     }
 
+    // Stop matching; chunks which haven't started are skipped.  A cancel check is
+    // polled between chunks, typically to stop when the http client requesting the
+    // results has gone away.
+    void Cancel() {
+        cancelled = true;
+    }
+
+    void SetCancelCheck(const std::function<bool ()>& in_check) {
+        cancel_check = in_check;
+    }
+
+    bool Cancelled() {
+        if (cancelled)
+            return true;
+
+        if (cancel_check != nullptr && cancel_check()) {
+            cancelled = true;
+            return true;
+        }
+
+        return false;
+    }
+
 protected:
     virtual void MatchedDevice(SharedTrackerElement d) {
         local_locker lock(&worker_mutex);
@@ -60,6 +109,9 @@ protected:
 
     kis_recursive_timed_mutex worker_mutex;
     std::shared_ptr<TrackerElementVector> matched_devices;
+
+    std::atomic<bool> cancelled;
+    std::function<bool ()> cancel_check;
 };
 
 // C++ lambda matcher
@@ -76,9 +128,21 @@ public:
 
     virtual void Finalize(Devicetracker *devicetracker);
 
+    // Function workers are matched serially unless the match callback is known to
+    // be safe to call from multiple threads
+    void set_concurrent(bool in_concurrent) {
+        concurrent = in_concurrent;
+    }
+
+    virtual bool ConcurrentMatch() override {
+        return concurrent;
+    }
+
 protected:
     GlobalRegistry *globalreg;
 
+    bool concurrent;
+
     std::function<bool (Devicetracker *, 
             std::shared_ptr<kis_tracked_device_base>)> mcb;
     std::function<void (Devicetracker *)> fcb;
@@ -102,6 +166,9 @@ public:
     virtual bool MatchDevice(Devicetracker *devicetracker,
             std::shared_ptr<kis_tracked_device_base> device);
 
+    // Matching only reads the device and the query
+    virtual bool ConcurrentMatch() override { return true; }
+
     virtual void Finalize(Devicetracker *devicetracker);
 
 protected:
@@ -114,6 +181,49 @@ protected:
 };
 
 #ifdef HAVE_LIBPCRE
+// Compiled set of [field, regex] filters, shared by the device and view regex
+// workers.  A device matches if any expression matches any value of its field.
+//
+// Expressions targeting the same field are combined into one alternation and
+// compiled once (with the PCRE JIT where it's available), so each field value is
+// scanned once no matter how many expressions target it; expressions which
+// can't safely be combined, such as ones using back-references, are compiled on
+// their own.  Field paths are resolved when the matcher is built, string values
+// are matched in place, and MAC and UUID values are rendered into a local buffer
+// instead of a new string per comparison.
+class device_pcre_matcher {
+public:
+    // Throws std::runtime_error if an expression can't be compiled
+    device_pcre_matcher(const std::vector<std::pair<std::string, std::string>>& in_filters);
+    ~device_pcre_matcher();
+
+    device_pcre_matcher(const device_pcre_matcher&) = delete;
+    device_pcre_matcher& operator=(const device_pcre_matcher&) = delete;
+
+    bool match(const SharedTrackerElement& in_device) const;
+
+    // Match a single field value against a compiled expression; fields which can't
+    // be expressed as a string never match
+    static bool match_field(const pcre *in_re, const pcre_extra *in_study, 
+            const SharedTrackerElement& in_field);
+
+protected:
+    struct compiled {
+        pcre *re;
+        pcre_extra *study;
+    };
+
+    struct field_filter {
+        std::vector<int> path;
+        std::vector<compiled> res;
+    };
+
+    static compiled compile(const std::string& in_regex);
+    static void release(compiled& c);
+
+    std::vector<field_filter> filters;
+};
+
 // Retrieve a list of devices based on complex field paths and
 // return them in a vector sharedtrackerelement
 class devicetracker_pcre_worker : public DevicetrackerFilterWorker {
@@ -170,12 +280,20 @@ public:
     virtual bool MatchDevice(Devicetracker *devicetracker,
             std::shared_ptr<kis_tracked_device_base> device);
 
+    // Matching only reads the device and the compiled expressions
+    virtual bool ConcurrentMatch() override { return true; }
+
     virtual void Finalize(Devicetracker *devicetracker);
 
 protected:
     int pcre_match_id;
 
+    // Prepared filters handed to us directly
     std::vector<std::shared_ptr<devicetracker_pcre_worker::pcre_filter> > filter_vec;
+
+    // Filters we compiled ourselves from field/regex pairs
+    std::shared_ptr<device_pcre_matcher> matcher;
+
     bool error;
 };
 #else
@@ -35,7 +35,8 @@ class KisGps;
 typedef std::shared_ptr<KisGps> SharedGps;
 
 // Packet info attached to each packet, if there isn't already GPS info present
-class kis_gps_packinfo : public packet_component {
+class kis_gps_packinfo : public packet_component,
+    public packet_component_pool<kis_gps_packinfo> {
 public:
 	kis_gps_packinfo() {
 		self_destruct = 1;
@@ -35,6 +35,15 @@
 #include "uuid.h"
 #include "devicetracker_component.h"
 #include "json_adapter.h"
+#include "endian_magic.h"
+#include "fmt.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* StringExtraSpace and SanitizeString taken from nlohmann's jsonhpp library,
    Copyright 2013-2015 Niels Lohmann. and under the MIT license */
@@ -71,450 +80,601 @@ std::size_t JsonAdapter::StringExtraSpace(const std::string& s) noexcept {
     return result;
 }
 
-std::string JsonAdapter::SanitizeString(const std::string& s) noexcept {
-    const auto space = StringExtraSpace(s);
-    if (space == 0) {
-        return s;
+namespace {
+
+// Output buffer for the packer.  Serialized json is collected in a fixed block
+// and handed to the stream in large writes instead of one ostream insertion per
+// token; the block lives on the stack of the top-level Pack call so nothing is
+// allocated while walking the element tree.
+class json_writer {
+public:
+    json_writer(std::ostream& in_stream) :
+        stream {&in_stream},
+        str {nullptr},
+        pos {0} { }
+
+    json_writer(std::string& in_str) :
+        stream {nullptr},
+        str {&in_str},
+        pos {0} { }
+
+    ~json_writer() {
+        flush();
     }
 
-    // create a result string of necessary size
-    std::string result(s.size() + space, '\\');
-    std::size_t pos = 0;
+    void put(char c) {
+        if (pos == sizeof(buf))
+            flush();
+        buf[pos++] = c;
+    }
+
+    void write(const char *data, size_t len) {
+        if (len > sizeof(buf) - pos) {
+            flush();
+
+            if (len > sizeof(buf)) {
+                sink(data, len);
+                return;
+            }
+        }
+
+        memcpy(buf + pos, data, len);
+        pos += len;
+    }
+
+    void write(const std::string& s) {
+        write(s.data(), s.length());
+    }
+
+    template<size_t N>
+    void lit(const char (&s)[N]) {
+        write(s, N - 1);
+    }
+
+    void flush() {
+        if (pos == 0)
+            return;
+
+        sink(buf, pos);
+        pos = 0;
+    }
+
+protected:
+    void sink(const char *data, size_t len) {
+        if (stream != nullptr)
+            stream->write(data, len);
+        else
+            str->append(data, len);
+    }
+
+    std::ostream *stream;
+    std::string *str;
+
+    char buf[8192];
+    size_t pos;
+};
+
+const char json_hex_upper[] = "0123456789ABCDEF";
+const char json_hex_lower[] = "0123456789abcdef";
+
+void json_write_escaped(json_writer& w, const char *s, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        size_t start = i;
+
+#ifdef __SSE2__
+        // Skip over runs of characters which don't need escaping 16 at a time;
+        // quote, backslash, and anything <= 0x1F are flagged
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i bslash = _mm_set1_epi8('\\');
+        const __m128i ctrl = _mm_set1_epi8(0x1F);
+
+        while (i + 16 <= len) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                    _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+            int mask = _mm_movemask_epi8(m);
+
+            if (mask != 0) {
+                i += __builtin_ctz(mask);
+                break;
+            }
+
+            i += 16;
+        }
+#endif
+
+        while (i < len) {
+            unsigned char c = (unsigned char) s[i];
+            if (c < 0x20 || c == '"' || c == '\\')
+                break;
+            i++;
+        }
+
+        if (i != start)
+            w.write(s + start, i - start);
+
+        if (i == len)
+            break;
+
+        unsigned char c = (unsigned char) s[i++];
 
-    for (const auto& c : s) {
         switch (c) {
-            // quotation mark (0x22)
             case '"':
-                {
-                    result[pos + 1] = '"';
-                    pos += 2;
-                    break;
-                }
-
-                // reverse solidus (0x5c)
+                w.lit("\\\"");
+                break;
             case '\\':
-                {
-                    // nothing to change
-                    pos += 2;
-                    break;
-                }
-
-                // backspace (0x08)
+                w.lit("\\\\");
+                break;
             case '\b':
-                {
-                    result[pos + 1] = 'b';
-                    pos += 2;
-                    break;
-                }
-
-                // formfeed (0x0c)
+                w.lit("\\b");
+                break;
             case '\f':
-                {
-                    result[pos + 1] = 'f';
-                    pos += 2;
-                    break;
-                }
-
-                // newline (0x0a)
+                w.lit("\\f");
+                break;
             case '\n':
-                {
-                    result[pos + 1] = 'n';
-                    pos += 2;
-                    break;
-                }
-
-                // carriage return (0x0d)
+                w.lit("\\n");
+                break;
             case '\r':
-                {
-                    result[pos + 1] = 'r';
-                    pos += 2;
-                    break;
-                }
-
-                // horizontal tab (0x09)
+                w.lit("\\r");
+                break;
             case '\t':
-                {
-                    result[pos + 1] = 't';
-                    pos += 2;
-                    break;
-                }
-
+                w.lit("\\t");
+                break;
             default:
                 {
-                    if (c >= 0x00 and c <= 0x1f)
-                    {
-                        // print character c as \uxxxx
-                        sprintf(&result[pos + 1], "u%04x", int(c));
-                        pos += 6;
-                        // overwrite trailing null character
-                        result[pos] = '\\';
-                    }
-                    else
-                    {
-                        // all other characters are added as-is
-                        result[pos++] = c;
-                    }
-                    break;
+                    char u[6] = { '\\', 'u', '0', '0', 
+                        json_hex_lower[c >> 4], json_hex_lower[c & 0xF] };
+                    w.write(u, 6);
                 }
+                break;
         }
     }
+}
 
-    return result;
+void json_write_string(json_writer& w, const std::string& s) {
+    w.put('"');
+    json_write_escaped(w, s.data(), s.length());
+    w.put('"');
 }
 
-void JsonAdapter::Pack(std::ostream &stream, SharedTrackerElement e, 
-        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
-        bool prettyprint, unsigned int depth) {
+template<typename T>
+void json_write_int(json_writer& w, T v) {
+    fmt::format_int f(v);
+    w.write(f.data(), f.size());
+}
 
-    std::string indent;
-    std::string ppendl;
-    
-    if (prettyprint) {
-        indent = std::string(depth, ' ');
-        ppendl = "\r\n";
+// Doubles match the std::fixed formatting of the original stream serializer,
+// and nan and inf, which json can't represent, are written as 0
+void json_write_double(json_writer& w, double d) {
+    if (std::isnan(d) || std::isinf(d)) {
+        w.put('0');
+        return;
     }
 
-    if (e == NULL) {
+    char nbuf[64];
+    int r = snprintf(nbuf, sizeof(nbuf), "%f", d);
+
+    if (r < 0)
+        return;
+
+    if ((size_t) r >= sizeof(nbuf)) {
+        // Only very large magnitudes land here
+        w.write(fmt::format("{:f}", d));
         return;
     }
 
-    SerializerScope s(e, name_map);
+    w.write(nbuf, r);
+}
 
-    mac_addr mac;
-    uuid euuid;
+void json_write_mac(json_writer& w, const mac_addr& m) {
+    char mbuf[17];
 
-    std::string tname;
+    for (unsigned int x = 0; x < 6; x++) {
+        unsigned int b = m.index64(m.longmac, x);
 
-    std::string bytes;
-    const char* bytes_c;
+        mbuf[x * 3] = json_hex_upper[(b >> 4) & 0xF];
+        mbuf[x * 3 + 1] = json_hex_upper[b & 0xF];
 
-    bool prepend_comma;
+        if (x < 5)
+            mbuf[x * 3 + 2] = ':';
+    }
 
-    std::ios::fmtflags fflags;
+    w.write(mbuf, sizeof(mbuf));
+}
+
+void json_write_key(json_writer& w, const device_key& k) {
+    char kbuf[48];
+
+    int r = snprintf(kbuf, sizeof(kbuf), "%02" PRIX64 "_%" PRIX64, 
+            (uint64_t) kis_hton64(k.get_spkey()), (uint64_t) kis_hton64(k.get_dkey()));
+
+    if (r > 0)
+        w.write(kbuf, r);
+}
+
+void json_write_bytes(json_writer& w, const std::string& bytes) {
+    for (const auto& c : bytes) {
+        w.put(json_hex_upper[(c >> 4) & 0xF]);
+        w.put(json_hex_upper[c & 0xF]);
+    }
+}
+
+// Escaped field names by id, filled from the entry tracker the first time a field
+// is seen by this thread so the common path doesn't need the tracker lock
+thread_local std::vector<std::string> json_field_names;
+
+const std::string& json_field_name(int id, std::string& scratch) {
+    if (id >= 0 && (size_t) id < json_field_names.size() && json_field_names[id].length() != 0)
+        return json_field_names[id];
+
+    auto name = Globalreg::globalreg->entrytracker->GetFieldName(id);
+    scratch = JsonAdapter::SanitizeString(name);
+
+    // Don't remember placeholder names for fields which aren't registered yet
+    if (id < 0 || name == "field.unknown.not.registered")
+        return scratch;
+
+    if ((size_t) id >= json_field_names.size())
+        json_field_names.resize(id + 1);
+
+    json_field_names[id] = scratch;
+
+    return json_field_names[id];
+}
+
+void json_pack(json_writer& w, const SharedTrackerElement& e,
+        const std::shared_ptr<TrackerElementSerializer::rename_map>& name_map,
+        bool prettyprint, unsigned int depth);
+
+void json_indent(json_writer& w, bool prettyprint, unsigned int depth) {
+    if (!prettyprint)
+        return;
+
+    for (unsigned int x = 0; x < depth; x++)
+        w.put(' ');
+}
+
+void json_endl(json_writer& w, bool prettyprint) {
+    if (prettyprint)
+        w.lit("\r\n");
+}
+
+// Common framing for the keyed maps; write_key emits the quoted key
+template<typename M, typename KF>
+void json_pack_keyed(json_writer& w, M *m, KF write_key,
+        const std::shared_ptr<TrackerElementSerializer::rename_map>& name_map,
+        bool prettyprint, unsigned int depth) {
+    json_endl(w, prettyprint);
+    json_indent(w, prettyprint, depth);
+    w.put('{');
+    json_endl(w, prettyprint);
+
+    bool prepend_comma = false;
+
+    for (const auto& i : *m) {
+        if (i.second == nullptr)
+            continue;
+
+        if (prepend_comma)
+            w.put(',');
+        prepend_comma = true;
+
+        json_indent(w, prettyprint, depth);
+        w.put('"');
+        write_key(i.first);
+        w.lit("\": ");
+
+        json_pack(w, i.second, name_map, prettyprint, depth + 1);
+
+        json_endl(w, prettyprint);
+    }
+
+    json_indent(w, prettyprint, depth);
+    w.put('}');
+}
+
+void json_pack(json_writer& w, const SharedTrackerElement& e,
+        const std::shared_ptr<TrackerElementSerializer::rename_map>& name_map,
+        bool prettyprint, unsigned int depth) {
+
+    if (e == nullptr) {
+        return;
+    }
+
+    SerializerScope s(e, name_map);
+
+    bool prepend_comma;
 
     switch (e->get_type()) {
         case TrackerType::TrackerString:
-            stream << "\"" << SanitizeString(GetTrackerValue<std::string>(e)) << "\"";
+            json_write_string(w, static_cast<TrackerElementString *>(e.get())->get());
             break;
         case TrackerType::TrackerInt8:
-            stream << (int) GetTrackerValue<int8_t>(e);
+            json_write_int(w, (int) static_cast<TrackerElementInt8 *>(e.get())->get());
             break;
         case TrackerType::TrackerUInt8:
-            stream << (unsigned int) GetTrackerValue<uint8_t>(e);
+            json_write_int(w, (unsigned int) static_cast<TrackerElementUInt8 *>(e.get())->get());
             break;
         case TrackerType::TrackerInt16:
-            stream << (int) GetTrackerValue<int16_t>(e);
+            json_write_int(w, (int) static_cast<TrackerElementInt16 *>(e.get())->get());
             break;
         case TrackerType::TrackerUInt16:
-            stream << (unsigned int) GetTrackerValue<uint16_t>(e);
+            json_write_int(w, (unsigned int) static_cast<TrackerElementUInt16 *>(e.get())->get());
             break;
         case TrackerType::TrackerInt32:
-            stream << GetTrackerValue<int32_t>(e);
+            json_write_int(w, static_cast<TrackerElementInt32 *>(e.get())->get());
             break;
         case TrackerType::TrackerUInt32:
-            stream << GetTrackerValue<uint32_t>(e);
+            json_write_int(w, static_cast<TrackerElementUInt32 *>(e.get())->get());
             break;
         case TrackerType::TrackerInt64:
-            stream << GetTrackerValue<int64_t>(e);
+            json_write_int(w, (long long) static_cast<TrackerElementInt64 *>(e.get())->get());
             break;
         case TrackerType::TrackerUInt64:
-            stream << GetTrackerValue<uint64_t>(e);
+            json_write_int(w, (unsigned long long) static_cast<TrackerElementUInt64 *>(e.get())->get());
             break;
         case TrackerType::TrackerFloat:
-            if (std::isnan(GetTrackerValue<float>(e)) || std::isinf(GetTrackerValue<float>(e)))
-                stream << 0;
-            else
-                stream << std::fixed << GetTrackerValue<float>(e);
+            json_write_double(w, static_cast<TrackerElementFloat *>(e.get())->get());
             break;
         case TrackerType::TrackerDouble:
-            if (std::isnan(GetTrackerValue<double>(e)) || std::isinf(GetTrackerValue<double>(e)))
-                stream << 0;
-            else
-                stream << std::fixed << GetTrackerValue<double>(e);
+            json_write_double(w, static_cast<TrackerElementDouble *>(e.get())->get());
             break;
         case TrackerType::TrackerMac:
-            mac = GetTrackerValue<mac_addr>(e);
             // Mac is quoted as a string value, mac only
-            stream << "\"" << mac.Mac2String() << "\"";
+            w.put('"');
+            json_write_mac(w, static_cast<TrackerElementMacAddr *>(e.get())->get());
+            w.put('"');
             break;
         case TrackerType::TrackerUuid:
-            euuid = GetTrackerValue<uuid>(e);
             // UUID is quoted as a string value
-            stream << "\"" << euuid.UUID2String() << "\"";
+            json_write_string(w, static_cast<TrackerElementUUID *>(e.get())->get().UUID2String());
             break;
         case TrackerType::TrackerKey:
-            stream << "\"" << GetTrackerValue<device_key>(e).as_string() << "\"";
+            w.put('"');
+            json_write_key(w, static_cast<TrackerElementDeviceKey *>(e.get())->get());
+            w.put('"');
             break;
         case TrackerType::TrackerVector:
-            stream << ppendl << indent << "[" << ppendl;
+            json_endl(w, prettyprint);
+            json_indent(w, prettyprint, depth);
+            w.put('[');
+            json_endl(w, prettyprint);
 
             prepend_comma = false;
 
-            for (auto i : *(std::static_pointer_cast<TrackerElementVector>(e))) {
-                if (i == NULL)
+            for (const auto& i : *static_cast<TrackerElementVector *>(e.get())) {
+                if (i == nullptr)
                     continue;
 
                 if (prepend_comma)
-                    stream << ",";
+                    w.put(',');
                 prepend_comma = true;
 
-                if (prettyprint)
-                    stream << indent;
+                json_indent(w, prettyprint, depth);
 
-                JsonAdapter::Pack(stream, i, name_map, prettyprint, depth + 1);
+                json_pack(w, i, name_map, prettyprint, depth + 1);
 
-                stream << ppendl;
+                json_endl(w, prettyprint);
             }
-            stream << indent << "]";
+
+            json_indent(w, prettyprint, depth);
+            w.put(']');
             break;
         case TrackerType::TrackerVectorDouble:
-            stream << ppendl << indent << "[" << ppendl;
+            json_endl(w, prettyprint);
+            json_indent(w, prettyprint, depth);
+            w.put('[');
+            json_endl(w, prettyprint);
 
             prepend_comma = false;
 
-            for (auto i : *(std::static_pointer_cast<TrackerElementVectorDouble>(e))) {
+            for (const auto& i : *static_cast<TrackerElementVectorDouble *>(e.get())) {
                 if (prepend_comma)
-                    stream << ",";
+                    w.put(',');
                 prepend_comma = true;
 
-                if (prettyprint)
-                    stream << indent;
-
-                stream << i;
-
-                stream << ppendl;
+                json_indent(w, prettyprint, depth);
+                json_write_double(w, i);
+                json_endl(w, prettyprint);
             }
-            stream << indent << "]";
+
+            json_indent(w, prettyprint, depth);
+            w.put(']');
             break;
         case TrackerType::TrackerVectorString:
-            stream << ppendl << indent << "[" << ppendl;
+            json_endl(w, prettyprint);
+            json_indent(w, prettyprint, depth);
+            w.put('[');
+            json_endl(w, prettyprint);
 
             prepend_comma = false;
 
-            for (auto i : *(std::static_pointer_cast<TrackerElementVectorString>(e))) {
+            for (const auto& i : *static_cast<TrackerElementVectorString *>(e.get())) {
                 if (prepend_comma)
-                    stream << ",";
+                    w.put(',');
                 prepend_comma = true;
 
-                if (prettyprint)
-                    stream << indent;
-
-                stream << i;
-
-                stream << ppendl;
+                json_indent(w, prettyprint, depth);
+                json_write_string(w, i);
+                json_endl(w, prettyprint);
             }
-            stream << indent << "]";
+
+            json_indent(w, prettyprint, depth);
+            w.put(']');
             break;
         case TrackerType::TrackerMap:
-            stream << ppendl << indent << "{" << ppendl;
-
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+            {
+                json_endl(w, prettyprint);
+                json_indent(w, prettyprint, depth);
+                w.put('{');
+                json_endl(w, prettyprint);
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                std::string scratch;
 
-                bool named = false;
+                prepend_comma = false;
 
-                if (name_map != NULL) {
-                    TrackerElementSerializer::rename_map::iterator nmi = name_map->find(i.second);
-                    if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
-                        tname = nmi->second->rename;
-                        named = true;
-                    }
-                }
+                for (const auto& i : *static_cast<TrackerElementMap *>(e.get())) {
+                    if (i.second == nullptr)
+                        continue;
 
-                if (!named) {
-                    if (i.second == NULL) {
-                        tname = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
-                    } else {
-                        if ((tname = i.second->get_local_name()) == "")
-                            tname = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
-                    }
-                }
+                    if (prepend_comma)
+                        w.put(',');
+                    prepend_comma = true;
 
-                tname = SanitizeString(tname);
+                    const std::string *tname = nullptr;
 
-                if (prettyprint) {
-                    stream << indent << "\"description." << tname << "\": ";
-                    stream << "\"";
-                    if (i.second != nullptr) {
-                        stream << SanitizeString(i.second->get_type_as_string());
-                        stream << ", ";
+                    if (name_map != nullptr) {
+                        auto nmi = name_map->find(i.second);
+                        if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
+                            scratch = JsonAdapter::SanitizeString(nmi->second->rename);
+                            tname = &scratch;
+                        }
                     }
-                    stream << SanitizeString(Globalreg::globalreg->entrytracker->GetFieldDescription(i.first));
-                    stream << "\",";
-                    stream << ppendl;
-                }
-
-                stream << indent << "\"" << tname << "\": ";
 
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                    if (tname == nullptr) {
+                        const auto& lname = i.second->get_local_name();
 
-                stream << ppendl << ppendl;
-            }
-            stream << indent << "}";
+                        if (lname.length() != 0) {
+                            scratch = JsonAdapter::SanitizeString(lname);
+                            tname = &scratch;
+                        } else {
+                            tname = &json_field_name(i.first, scratch);
+                        }
+                    }
 
-            break;
-        case TrackerType::TrackerIntMap:
-            stream << ppendl << indent << "{" << ppendl;
+                    if (prettyprint) {
+                        json_indent(w, prettyprint, depth);
+                        w.lit("\"description.");
+                        w.write(*tname);
+                        w.lit("\": \"");
+                        auto tstr = i.second->get_type_as_string();
+                        json_write_escaped(w, tstr.data(), tstr.length());
+                        w.lit(", ");
+                        auto desc = Globalreg::globalreg->entrytracker->GetFieldDescription(i.first);
+                        json_write_escaped(w, desc.data(), desc.length());
+                        w.lit("\",");
+                        json_endl(w, prettyprint);
+                    }
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementIntMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    json_indent(w, prettyprint, depth);
+                    w.put('"');
+                    w.write(*tname);
+                    w.lit("\": ");
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                    json_pack(w, i.second, name_map, prettyprint, depth + 1);
 
-                // Integer dictionary keys in json are still quoted as strings
-                stream << indent << "\"" << i.first << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                    json_endl(w, prettyprint);
+                    json_endl(w, prettyprint);
+                }
 
-                stream << ppendl;
+                json_indent(w, prettyprint, depth);
+                w.put('}');
             }
-            stream << indent << "}";
+            break;
+        case TrackerType::TrackerIntMap:
+            // Integer dictionary keys in json are still quoted as strings
+            json_pack_keyed(w, static_cast<TrackerElementIntMap *>(e.get()),
+                    [&w](int k) { json_write_int(w, k); },
+                    name_map, prettyprint, depth);
             break;
         case TrackerType::TrackerMacMap:
-            stream << ppendl << indent << "{" << ppendl;
-
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementMacMap>(e))) {
-                if (i.second == NULL)
-                    continue;
-
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
-
-                // Mac keys are strings and we push only the mac not the mask */
-                stream << indent << "\"" << i.first.Mac2String() << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
-
-                stream << ppendl;
-            }
-            stream << indent << "}";
+            // Mac keys are strings and we push only the mac not the mask
+            json_pack_keyed(w, static_cast<TrackerElementMacMap *>(e.get()),
+                    [&w](const mac_addr& k) { json_write_mac(w, k); },
+                    name_map, prettyprint, depth);
             break;
         case TrackerType::TrackerStringMap:
-            stream << ppendl << indent << "{" << ppendl;
-
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementStringMap>(e))) {
-                if (i.second == NULL)
-                    continue;
-
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
-
-                stream << indent << "\"" << JsonAdapter::SanitizeString(i.first) << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
-
-                stream << ppendl;
-            }
-            stream << indent << "}";
+            json_pack_keyed(w, static_cast<TrackerElementStringMap *>(e.get()),
+                    [&w](const std::string& k) { json_write_escaped(w, k.data(), k.length()); },
+                    name_map, prettyprint, depth);
             break;
         case TrackerType::TrackerDoubleMap:
-            stream << ppendl << indent << "{" << ppendl;
-
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMap>(e))) {
-                if (i.second == NULL)
-                    continue;
-
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
-
-                // Double keys are handled as strings in json
-                stream << indent << "\"" << std::fixed << i.first << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
-
-                stream << ppendl;
-            }
-            stream << indent << "}";
+            // Double keys are handled as strings in json
+            json_pack_keyed(w, static_cast<TrackerElementDoubleMap *>(e.get()),
+                    [&w](double k) { json_write_double(w, k); },
+                    name_map, prettyprint, depth);
             break;
         case TrackerType::TrackerHashkeyMap:
-            stream << ppendl << indent << "{" << ppendl;
-
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementHashkeyMap>(e))) {
-                if (i.second == NULL)
-                    continue;
-
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
-
-                // Double keys are handled as strings in json
-                stream << indent << "\"" << std::fixed << i.first << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
-
-                stream << ppendl;
-            }
-            stream << indent << "}";
+            json_pack_keyed(w, static_cast<TrackerElementHashkeyMap *>(e.get()),
+                    [&w](size_t k) { json_write_int(w, (unsigned long long) k); },
+                    name_map, prettyprint, depth);
             break;
         case TrackerType::TrackerDoubleMapDouble:
-            stream << ppendl << indent << "{" << ppendl;
+            json_endl(w, prettyprint);
+            json_indent(w, prettyprint, depth);
+            w.put('{');
+            json_endl(w, prettyprint);
 
             prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMapDouble>(e))) {
+
+            for (const auto& i : *static_cast<TrackerElementDoubleMapDouble *>(e.get())) {
                 if (prepend_comma)
-                    stream << ",";
+                    w.put(',');
                 prepend_comma = true;
 
                 // Double keys are handled as strings in json
-                stream << indent << "\"" << std::fixed << i.first << "\": ";
-                stream << i.second;
-                stream << ppendl;
+                json_indent(w, prettyprint, depth);
+                w.put('"');
+                json_write_double(w, i.first);
+                w.lit("\": ");
+                json_write_double(w, i.second);
+                json_endl(w, prettyprint);
             }
-            stream << indent << "}";
+
+            json_indent(w, prettyprint, depth);
+            w.put('}');
             break;
         case TrackerType::TrackerKeyMap:
-            stream << ppendl << indent << "{" << ppendl;
-
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementDeviceKeyMap>(e))) {
-                if (i.second == NULL)
-                    continue;
-
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
-
-                // Keymap keys are handled as strings
-                stream << indent << "\"" << i.first << "\": ";
-                JsonAdapter::Pack(stream,i.second, name_map, prettyprint, depth + 1);
-                stream << ppendl;
-            }
-            stream << indent << "}";
+            // Keymap keys are handled as strings
+            json_pack_keyed(w, static_cast<TrackerElementDeviceKeyMap *>(e.get()),
+                    [&w](const device_key& k) { json_write_key(w, k); },
+                    name_map, prettyprint, depth);
             break;
         case TrackerType::TrackerByteArray:
-            bytes = std::static_pointer_cast<TrackerElementByteArray>(e)->get();
-            bytes_c = bytes.data();
-           
-            fflags = stream.flags();
-
-            stream << "\"";
-            for (size_t szx = 0; szx < bytes.length(); szx++) {
-                stream << std::uppercase << std::setfill('0') << std::setw(2) 
-                    << std::hex << (int) (bytes_c[szx] & 0xFF);
-            }
-            stream << "\"";
-            stream.flags(fflags);
-
+            w.put('"');
+            json_write_bytes(w, static_cast<TrackerElementByteArray *>(e.get())->get());
+            w.put('"');
             break;
 
-
         default:
             break;
     }
 }
 
+}
+
+std::string JsonAdapter::SanitizeString(const std::string& s) noexcept {
+    const auto space = StringExtraSpace(s);
+    if (space == 0) {
+        return s;
+    }
+
+    std::string result;
+    result.reserve(s.size() + space);
+
+    {
+        json_writer w(result);
+        json_write_escaped(w, s.data(), s.length());
+    }
+
+    return result;
+}
+
+void JsonAdapter::Pack(std::ostream &stream, SharedTrackerElement e, 
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
+        bool prettyprint, unsigned int depth) {
+    json_writer w(stream);
+    json_pack(w, e, name_map, prettyprint, depth);
+}
+
+void JsonAdapter::Pack(std::string &out, SharedTrackerElement e, 
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map) {
+    json_writer w(out);
+    json_pack(w, e, name_map, false, 0);
+}
+
 // An unfortunate duplication of code but overloading the json/prettyjson to also do
 // storage tagging would get a bit out of hand
 void StorageJsonAdapter::Pack(std::ostream &stream, SharedTrackerElement e, 
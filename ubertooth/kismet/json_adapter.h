@@ -36,6 +36,11 @@ void Pack(std::ostream &stream, SharedTrackerElement e,
         std::shared_ptr<TrackerElementSerializer::rename_map> name_map = nullptr,
         bool prettyprint = false, unsigned int depth = 0);
 
+// Pack into a string, appending to any existing content.  Callers serializing
+// many records can reuse the same string to avoid reallocating per record.
+void Pack(std::string &out, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map = nullptr);
+
 std::string SanitizeString(const std::string& in) noexcept;
 std::size_t StringExtraSpace(const std::string& in) noexcept;
 
@@ -0,0 +1,418 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "configfile.h"
+#include "devicetracker.h"
+#include "kis_columnlogfile.h"
+#include "messagebus.h"
+
+KisColumnLogfile::KisColumnLogfile(SharedLogBuilder in_builder) :
+    KisLogfile(in_builder),
+    writer_shutdown {false},
+    segment_seq {0},
+    segments_written {0},
+    segments_dropped {0},
+    last_drop_warning {0} {
+
+    std::shared_ptr<Packetchain> packetchain =
+        Globalreg::FetchMandatoryGlobalAs<Packetchain>("PACKETCHAIN");
+
+    pack_comp_linkframe = packetchain->RegisterPacketComponent("LINKFRAME");
+    pack_comp_radiodata = packetchain->RegisterPacketComponent("RADIODATA");
+    pack_comp_common = packetchain->RegisterPacketComponent("COMMON");
+
+    segment_seconds =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("kis_column_segment_seconds", 300);
+    segment_packets =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("kis_column_segment_packets", 100000);
+    max_pending =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("kis_column_pending", 4);
+
+    if (segment_seconds == 0)
+        segment_seconds = 1;
+
+    if (segment_packets == 0)
+        segment_packets = 1;
+
+    if (max_pending == 0)
+        max_pending = 1;
+
+    if (Globalreg::globalreg->kismet_config->FetchOptBoolean("kis_column_compress", true))
+        compress_level = Z_DEFAULT_COMPRESSION;
+    else
+        compress_level = Z_NO_COMPRESSION;
+}
+
+KisColumnLogfile::~KisColumnLogfile() {
+    Log_Close();
+}
+
+bool KisColumnLogfile::Log_Open(std::string in_path) {
+    local_locker lock(&log_mutex);
+
+    set_int_log_path(in_path);
+
+    // The log is a directory of segments
+    if (mkdir(in_path.c_str(), 0755) < 0) {
+        _MSG("Failed to create columnar log directory '" + in_path + "': " +
+                std::string(strerror(errno)), MSGFLAG_ERROR);
+        return false;
+    }
+
+    writer_shutdown = false;
+    writer_thread = std::thread([this]() { segment_writer(); });
+
+    std::shared_ptr<Packetchain> packetchain =
+        Globalreg::FetchMandatoryGlobalAs<Packetchain>("PACKETCHAIN");
+
+    packetchain->RegisterHandler(&KisColumnLogfile::packet_handler, this,
+            CHAINPOS_LOGGING, -100);
+
+    _MSG("Opened columnar packet log '" + in_path + "'", MSGFLAG_INFO);
+
+    set_int_log_open(true);
+
+    return true;
+}
+
+void KisColumnLogfile::Log_Close() {
+    local_locker lock(&log_mutex);
+
+    if (!get_log_open())
+        return;
+
+    set_int_log_open(false);
+
+    std::shared_ptr<Packetchain> packetchain =
+        Globalreg::FetchGlobalAs<Packetchain>("PACKETCHAIN");
+    if (packetchain != NULL)
+        packetchain->RemoveHandler(&KisColumnLogfile::packet_handler, CHAINPOS_LOGGING);
+
+    // The writer finishes everything pending, including the open segments, before
+    // it exits
+    {
+        std::lock_guard<std::mutex> lk(segment_mutex);
+
+        while (open_segments.size() > 0)
+            seal_segment_nb(open_segments.begin());
+
+        writer_shutdown = true;
+        segment_cv.notify_all();
+    }
+
+    if (writer_thread.joinable())
+        writer_thread.join();
+
+    _MSG("Closed columnar packet log '" + get_log_path() + "', " +
+            UIntToString(segments_written) + " segments written", MSGFLAG_INFO);
+}
+
+int KisColumnLogfile::packet_handler(CHAINCALL_PARMS) {
+    KisColumnLogfile *logfile = (KisColumnLogfile *) auxdata;
+
+    return logfile->log_packet(in_pack);
+}
+
+int KisColumnLogfile::log_packet(kis_packet *in_pack) {
+    kis_datachunk *chunk =
+        (kis_datachunk *) in_pack->fetch(pack_comp_linkframe);
+
+    // Only packets with a frame can be extracted as pcap
+    if (chunk == NULL || chunk->length == 0)
+        return 0;
+
+    kis_layer1_packinfo *radioinfo =
+        (kis_layer1_packinfo *) in_pack->fetch(pack_comp_radiodata);
+
+    kis_common_info *commoninfo =
+        (kis_common_info *) in_pack->fetch(pack_comp_common);
+
+    time_t partition = in_pack->ts.tv_sec - (in_pack->ts.tv_sec % segment_seconds);
+
+    std::lock_guard<std::mutex> lk(segment_mutex);
+
+    if (writer_shutdown)
+        return 0;
+
+    auto oi = open_segments.find(partition);
+
+    if (oi != open_segments.end() && oi->second->ts.size() >= segment_packets) {
+        seal_segment_nb(oi);
+        oi = open_segments.end();
+    }
+
+    if (oi == open_segments.end()) {
+        // Make room by sealing the oldest partition
+        if (open_segments.size() >= KIS_COLUMN_OPEN_PARTITIONS)
+            seal_segment_nb(open_segments.begin());
+
+        oi = open_segments.emplace(partition, std::unique_ptr<segment>(new segment())).first;
+        oi->second->partition = partition;
+    }
+
+    auto s = oi->second.get();
+
+    s->last_append = time(0);
+
+    s->ts.push_back((int64_t) in_pack->ts.tv_sec * 1000000 + in_pack->ts.tv_usec);
+    s->dlt.push_back(chunk->dlt);
+    s->length.push_back(chunk->length);
+    s->data.append((const char *) chunk->data, chunk->length);
+
+    if (commoninfo != NULL) {
+        s->phy.push_back(commoninfo->phyid);
+        s->source.push_back(commoninfo->source.longmac);
+        s->dest.push_back(commoninfo->dest.longmac);
+        s->freq.push_back((uint64_t) commoninfo->freq_khz);
+    } else {
+        s->phy.push_back(-1);
+        s->source.push_back(0);
+        s->dest.push_back(0);
+        s->freq.push_back(0);
+    }
+
+    if (radioinfo != NULL)
+        s->signal.push_back(radioinfo->signal_dbm);
+    else
+        s->signal.push_back(0);
+
+    return 1;
+}
+
+void KisColumnLogfile::seal_segment_nb(open_map_t::iterator in_segment) {
+    std::unique_ptr<segment> sealed = std::move(in_segment->second);
+    open_segments.erase(in_segment);
+
+    // If the disk can't keep up, lose the segment rather than stall packet handling
+    if (pending.size() >= max_pending) {
+        segments_dropped++;
+
+        time_t now = time(0);
+
+        if (now - last_drop_warning > 30) {
+            last_drop_warning = now;
+            _MSG("The columnar packet log writer has fallen behind and packets are being "
+                    "dropped from the log; the disk may be too slow or busy.  The queue can "
+                    "be tuned with 'kis_column_pending' in kismet_logging.conf",
+                    MSGFLAG_ERROR);
+        }
+
+        return;
+    }
+
+    pending.push_back(std::move(sealed));
+    segment_cv.notify_all();
+}
+
+void KisColumnLogfile::segment_writer() {
+    std::unique_lock<std::mutex> lk(segment_mutex);
+
+    while (1) {
+        if (pending.size() == 0) {
+            if (writer_shutdown)
+                break;
+
+            segment_cv.wait_for(lk, std::chrono::seconds(1));
+
+            // Don't hold quiet segments open indefinitely
+            time_t now = time(0);
+
+            for (auto oi = open_segments.begin(); oi != open_segments.end(); ) {
+                auto si = oi++;
+
+                if (now - si->second->last_append >= (time_t) segment_seconds)
+                    seal_segment_nb(si);
+            }
+
+            continue;
+        }
+
+        std::unique_ptr<segment> s = std::move(pending.front());
+        pending.pop_front();
+
+        lk.unlock();
+        write_segment(s.get());
+        s.reset();
+        lk.lock();
+    }
+}
+
+bool KisColumnLogfile::write_segment(segment *in_segment) {
+    auto devicetracker = Globalreg::FetchMandatoryGlobalAs<Devicetracker>();
+
+    size_t count = in_segment->ts.size();
+
+    if (count == 0)
+        return true;
+
+    kis_column_segment_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    memcpy(hdr.magic, KIS_COLUMN_SEGMENT_MAGIC, 8);
+    hdr.byteorder = 0x01020304;
+    hdr.version = KIS_COLUMN_SEGMENT_VERSION;
+    hdr.count = count;
+
+    auto ts_mm = std::minmax_element(in_segment->ts.begin(), in_segment->ts.end());
+    hdr.min_ts = *ts_mm.first;
+    hdr.max_ts = *ts_mm.second;
+
+    auto sig_mm = std::minmax_element(in_segment->signal.begin(), in_segment->signal.end());
+    hdr.min_signal = *sig_mm.first;
+    hdr.max_signal = *sig_mm.second;
+
+    auto freq_mm = std::minmax_element(in_segment->freq.begin(), in_segment->freq.end());
+    hdr.min_freq = *freq_mm.first;
+    hdr.max_freq = *freq_mm.second;
+
+    // Every address in the segment, so device queries can skip segments without
+    // decompressing anything
+    std::vector<uint64_t> macs;
+    macs.reserve(count * 2);
+    macs.insert(macs.end(), in_segment->source.begin(), in_segment->source.end());
+    macs.insert(macs.end(), in_segment->dest.begin(), in_segment->dest.end());
+    std::sort(macs.begin(), macs.end());
+    macs.erase(std::unique(macs.begin(), macs.end()), macs.end());
+    if (macs.size() > 0 && macs[0] == 0)
+        macs.erase(macs.begin());
+
+    hdr.num_macs = macs.size();
+
+    // Phy names, nul separated and indexed by the phy ids in the phy column
+    std::string phynames;
+    int max_phy = *std::max_element(in_segment->phy.begin(), in_segment->phy.end());
+
+    for (int p = 0; p <= max_phy; p++) {
+        phynames.append(devicetracker->FetchPhyName(p));
+        phynames.push_back(0);
+    }
+
+    struct column_src {
+        uint32_t id;
+        const void *data;
+        size_t len;
+    };
+
+    std::vector<column_src> sources = {
+        { KIS_COLUMN_TS, in_segment->ts.data(), count * sizeof(int64_t) },
+        { KIS_COLUMN_PHY, in_segment->phy.data(), count * sizeof(int32_t) },
+        { KIS_COLUMN_DLT, in_segment->dlt.data(), count * sizeof(int32_t) },
+        { KIS_COLUMN_SOURCE, in_segment->source.data(), count * sizeof(uint64_t) },
+        { KIS_COLUMN_DEST, in_segment->dest.data(), count * sizeof(uint64_t) },
+        { KIS_COLUMN_SIGNAL, in_segment->signal.data(), count * sizeof(int32_t) },
+        { KIS_COLUMN_FREQ, in_segment->freq.data(), count * sizeof(uint64_t) },
+        { KIS_COLUMN_LENGTH, in_segment->length.data(), count * sizeof(uint32_t) },
+        { KIS_COLUMN_DATA, in_segment->data.data(), in_segment->data.length() },
+        { KIS_COLUMN_PHYNAMES, phynames.data(), phynames.length() },
+    };
+
+    hdr.num_columns = sources.size();
+
+    std::vector<kis_column_segment_column> columns;
+    std::vector<std::vector<uint8_t>> compressed;
+
+    for (auto c : sources) {
+        kis_column_segment_column col;
+        memset(&col, 0, sizeof(col));
+
+        col.id = c.id;
+        col.raw_len = c.len;
+        col.codec = KIS_COLUMN_CODEC_RAW;
+        col.stored_len = c.len;
+
+        compressed.push_back(std::vector<uint8_t>());
+
+        // Columns which don't get any smaller are stored as-is
+        if (compress_level != Z_NO_COMPRESSION && c.len > 0) {
+            auto& z = compressed.back();
+            uLongf zlen = compressBound(c.len);
+            z.resize(zlen);
+
+            if (compress2(z.data(), &zlen, (const Bytef *) c.data, c.len,
+                        compress_level) == Z_OK && zlen < c.len) {
+                col.codec = KIS_COLUMN_CODEC_ZLIB;
+                col.stored_len = zlen;
+            } else {
+                z.clear();
+            }
+        }
+
+        columns.push_back(col);
+    }
+
+    char fname[64];
+    snprintf(fname, sizeof(fname), "%lld-%06u.kcseg",
+            (long long) in_segment->partition, segment_seq++);
+
+    auto path = get_log_path() + "/" + fname;
+    auto tmp_path = path + ".tmp";
+
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+
+    if (f == NULL) {
+        _MSG("Failed to write columnar log segment '" + path + "': " +
+                std::string(strerror(errno)), MSGFLAG_ERROR);
+        return false;
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+    if (ok && macs.size() > 0)
+        ok = fwrite(macs.data(), sizeof(uint64_t) * macs.size(), 1, f) == 1;
+
+    if (ok)
+        ok = fwrite(columns.data(), sizeof(kis_column_segment_column) * columns.size(), 1, f) == 1;
+
+    for (size_t c = 0; c < columns.size() && ok; c++) {
+        if (columns[c].stored_len == 0)
+            continue;
+
+        if (columns[c].codec == KIS_COLUMN_CODEC_ZLIB)
+            ok = fwrite(compressed[c].data(), columns[c].stored_len, 1, f) == 1;
+        else
+            ok = fwrite(sources[c].data, columns[c].stored_len, 1, f) == 1;
+    }
+
+    if (fclose(f) != 0)
+        ok = false;
+
+    // Readers never see a partial segment
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) < 0) {
+        _MSG("Failed to write columnar log segment '" + path + "': " +
+                std::string(strerror(errno)), MSGFLAG_ERROR);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    segments_written++;
+
+    return true;
+}
+
@@ -0,0 +1,208 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Columnar packet log
+ *
+ * Packets are written to a directory of segment files instead of a single
+ * stream.  Each segment holds the packets of one time partition (or part of one,
+ * if the partition has more packets than fit in a segment), stored as one
+ * compressed column per field, with an index header which gives the time, signal,
+ * and frequency range of the segment and every MAC address it contains.
+ *
+ * Readers only have to open the header of each segment to find the segments they
+ * need, and only have to decompress the columns they filter on until they find
+ * packets they want to extract.  log_tools/kismet_column_to_pcapng.py reads them.
+ *
+ * Docs in docs/dev/log_column.md
+ *
+ */
+
+#ifndef __KIS_COLUMNLOGFILE_H__
+#define __KIS_COLUMNLOGFILE_H__
+
+#include "config.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "globalregistry.h"
+#include "logtracker.h"
+#include "packetchain.h"
+
+#define KIS_COLUMN_SEGMENT_MAGIC    "KISCSEG1"
+
+// Partitions with an open segment at once; sources with skewed clocks and batched
+// reports straddle partition boundaries, so late packets keep going to their own
+// partition instead of sealing the current one
+#define KIS_COLUMN_OPEN_PARTITIONS  4
+#define KIS_COLUMN_SEGMENT_VERSION  1
+
+// Column ids
+#define KIS_COLUMN_TS           1
+#define KIS_COLUMN_PHY          2
+#define KIS_COLUMN_DLT          3
+#define KIS_COLUMN_SOURCE       4
+#define KIS_COLUMN_DEST         5
+#define KIS_COLUMN_SIGNAL       6
+#define KIS_COLUMN_FREQ         7
+#define KIS_COLUMN_LENGTH       8
+#define KIS_COLUMN_DATA         9
+#define KIS_COLUMN_PHYNAMES     10
+
+// Column codecs
+#define KIS_COLUMN_CODEC_RAW    0
+#define KIS_COLUMN_CODEC_ZLIB   1
+
+// Segment files are written in the byte order of the host which wrote them; the
+// byteorder field lets readers tell which that was
+struct kis_column_segment_header {
+    char magic[8];
+    uint32_t byteorder;
+    uint32_t version;
+    uint32_t count;
+    uint32_t num_columns;
+    uint32_t num_macs;
+    int32_t min_signal;
+    int32_t max_signal;
+    uint32_t reserved;
+    // Microseconds since the epoch
+    int64_t min_ts;
+    int64_t max_ts;
+    // Khz
+    uint64_t min_freq;
+    uint64_t max_freq;
+};
+
+struct kis_column_segment_column {
+    uint32_t id;
+    uint32_t codec;
+    uint64_t raw_len;
+    uint64_t stored_len;
+};
+
+class KisColumnLogfile : public KisLogfile {
+public:
+    KisColumnLogfile(SharedLogBuilder in_builder);
+    virtual ~KisColumnLogfile();
+
+    virtual bool Log_Open(std::string in_path) override;
+    virtual void Log_Close() override;
+
+protected:
+    // Packets of an open segment, one vector per column
+    struct segment {
+        segment() :
+            partition {0},
+            last_append {0} { }
+
+        time_t partition;
+        time_t last_append;
+
+        std::vector<int64_t> ts;
+        std::vector<int32_t> phy;
+        std::vector<int32_t> dlt;
+        std::vector<uint64_t> source;
+        std::vector<uint64_t> dest;
+        std::vector<int32_t> signal;
+        std::vector<uint64_t> freq;
+        std::vector<uint32_t> length;
+        std::string data;
+    };
+
+    static int packet_handler(CHAINCALL_PARMS);
+    int log_packet(kis_packet *in_pack);
+
+    using open_map_t = std::map<time_t, std::unique_ptr<segment>>;
+
+    // Queue an open segment for writing; must be called under the segment mutex
+    void seal_segment_nb(open_map_t::iterator in_segment);
+
+    // The writer thread compresses and writes sealed segments, and seals open
+    // segments once no packets have arrived for them for a partition length
+    void segment_writer();
+    bool write_segment(segment *in_segment);
+
+    int pack_comp_linkframe, pack_comp_radiodata, pack_comp_common;
+
+    unsigned int segment_seconds;
+    unsigned int segment_packets;
+    unsigned int max_pending;
+    int compress_level;
+
+    std::mutex segment_mutex;
+    std::condition_variable segment_cv;
+    open_map_t open_segments;
+    std::deque<std::unique_ptr<segment>> pending;
+
+    std::thread writer_thread;
+    bool writer_shutdown;
+    unsigned int segment_seq;
+
+    std::atomic<uint64_t> segments_written, segments_dropped;
+    std::atomic<time_t> last_drop_warning;
+};
+
+class KisColumnLogfileBuilder : public KisLogfileBuilder {
+public:
+    KisColumnLogfileBuilder() :
+        KisLogfileBuilder() {
+        register_fields();
+        reserve_fields(NULL);
+        initialize();
+    }
+
+    KisColumnLogfileBuilder(int in_id) :
+        KisLogfileBuilder(in_id) {
+        register_fields();
+        reserve_fields(NULL);
+        initialize();
+    }
+
+    KisColumnLogfileBuilder(int in_id, std::shared_ptr<TrackerElementMap> e) :
+        KisLogfileBuilder(in_id, e) {
+        register_fields();
+        reserve_fields(e);
+        initialize();
+    }
+
+    virtual ~KisColumnLogfileBuilder() { }
+
+    virtual SharedLogfile build_logfile(SharedLogBuilder builder) {
+        return SharedLogfile(new KisColumnLogfile(builder));
+    }
+
+    virtual void initialize() {
+        set_log_class("kiscolumn");
+        set_log_name("Kismet columnar packets");
+        set_stream(true);
+        set_singleton(false);
+        set_log_description("Time-partitioned, compressed columnar packet segments "
+                "indexed for fast extraction of a time window or device");
+    }
+
+};
+
+#endif
+
@@ -18,6 +18,8 @@
 
 #include "config.h"
 
+#include <zlib.h>
+
 #include "globalregistry.h"
 #include "messagebus.h"
 
@@ -28,6 +30,8 @@
 #include "kis_databaselogfile.h"
 
 #include "structured.h"
+#include "entrytracker.h"
+#include "xxhash.h"
 #include "kismet_json.h"
 
 #include "sqlite3_cpp11.h"
@@ -54,6 +58,14 @@ KisDatabaseLogfile::KisDatabaseLogfile():
     device_stmt = NULL;
     device_pz = NULL;
 
+    device_delta_stmt = NULL;
+    device_delta_pz = NULL;
+
+    device_deltas = false;
+    device_checkpoint = 20;
+    device_delta_compress = false;
+    device_log_passes = 0;
+
     packet_stmt = NULL;
     packet_pz = NULL;
 
@@ -76,15 +88,158 @@ KisDatabaseLogfile::KisDatabaseLogfile():
         Globalreg::FetchMandatoryGlobalAs<Devicetracker>("DEVICETRACKER");
 
     db_enabled = false;
+    closing = false;
+
+    packet_queue = nullptr;
+    packet_record_pool = nullptr;
+
+    writer_shutdown = false;
+    writer_sleeping = 0;
+
+    writer_batch = 512;
+    writer_flush_ms = 250;
+    commit_interval_ms = 10000;
+
+    packets_queued = 0;
+    packets_written = 0;
+    packets_dropped = 0;
+    queue_high_water = 0;
+    writer_batches = 0;
+    last_batch_size = 0;
+    last_batch_usec = 0;
+    max_batch_usec = 0;
+    commits = 0;
+    last_commit_usec = 0;
+    max_commit_usec = 0;
+    last_drop_warning = 0;
+
+    auto entrytracker =
+        Globalreg::FetchMandatoryGlobalAs<EntryTracker>("ENTRYTRACKER");
+
+    stats_queue_len_id =
+        entrytracker->RegisterField("kismet.database.packets.queue_len",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "packets waiting for the log writer");
+    stats_queue_max_id =
+        entrytracker->RegisterField("kismet.database.packets.queue_max",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "maximum packets waiting for the log writer before packets are dropped");
+    stats_queue_high_id =
+        entrytracker->RegisterField("kismet.database.packets.queue_high",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "most packets seen waiting for the log writer");
+    stats_queued_id =
+        entrytracker->RegisterField("kismet.database.packets.queued",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "packets handed to the log writer");
+    stats_written_id =
+        entrytracker->RegisterField("kismet.database.packets.written",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "packets written to the log");
+    stats_dropped_id =
+        entrytracker->RegisterField("kismet.database.packets.dropped",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "packets not logged because the log writer queue was full");
+    stats_batches_id =
+        entrytracker->RegisterField("kismet.database.writer.batches",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "packet batches written");
+    stats_last_batch_size_id =
+        entrytracker->RegisterField("kismet.database.writer.last_batch_size",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "packets in the last batch");
+    stats_last_batch_usec_id =
+        entrytracker->RegisterField("kismet.database.writer.last_batch_usec",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "time to write the last batch, in microseconds");
+    stats_max_batch_usec_id =
+        entrytracker->RegisterField("kismet.database.writer.max_batch_usec",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "longest time to write a batch, in microseconds");
+    stats_commits_id =
+        entrytracker->RegisterField("kismet.database.writer.commits",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "transactions committed");
+    stats_last_commit_usec_id =
+        entrytracker->RegisterField("kismet.database.writer.last_commit_usec",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "time to commit the last transaction, in microseconds");
+    stats_max_commit_usec_id =
+        entrytracker->RegisterField("kismet.database.writer.max_commit_usec",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "longest time to commit a transaction, in microseconds");
+
+    writer_stats_endp =
+        std::make_shared<Kis_Net_Httpd_Simple_Tracked_Endpoint>("/logging/kismetdb/writer", false,
+            [this]() -> std::shared_ptr<TrackerElement> {
+                auto stats = std::make_shared<TrackerElementMap>();
+
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_queue_len_id,
+                            packet_queue != nullptr ? packet_queue->size() : 0));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_queue_max_id,
+                            packet_queue != nullptr ? packet_queue->capacity() : 0));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_queue_high_id,
+                            queue_high_water));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_queued_id,
+                            packets_queued));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_written_id,
+                            packets_written));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_dropped_id,
+                            packets_dropped));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_batches_id,
+                            writer_batches));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_last_batch_size_id,
+                            last_batch_size));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_last_batch_usec_id,
+                            last_batch_usec));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_max_batch_usec_id,
+                            max_batch_usec));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_commits_id,
+                            commits));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_last_commit_usec_id,
+                            last_commit_usec));
+                stats->insert(std::make_shared<TrackerElementUInt64>(stats_max_commit_usec_id,
+                            max_commit_usec));
+
+                return stats;
+            });
 
     Bind_Httpd_Server();
 }
 
 KisDatabaseLogfile::~KisDatabaseLogfile() {
     Log_Close();
+
+    writer_shutdown = true;
+
+    {
+        std::lock_guard<std::mutex> lk(writer_mutex);
+        writer_cv.notify_all();
+    }
+
+    if (writer_thread.joinable())
+        writer_thread.join();
+
+    packet_record *r;
+
+    if (packet_queue != nullptr) {
+        while (packet_queue->pop(r))
+            delete r;
+        delete packet_queue;
+    }
+
+    if (packet_record_pool != nullptr) {
+        while (packet_record_pool->pop(r))
+            delete r;
+        delete packet_record_pool;
+    }
 }
 
 bool KisDatabaseLogfile::Log_Open(std::string in_path) {
+    // A writer from a previous open may still be on its way out
+    if (writer_thread.joinable())
+        writer_thread.join();
+
     local_locker dbl(&ds_mutex);
 
     bool dbr = Database_Open(in_path);
@@ -102,35 +257,69 @@ bool KisDatabaseLogfile::Log_Open(std::string in_path) {
 
 	_MSG("Opened kismetdb log file '" + in_path + "'", MSGFLAG_INFO);
 
-    if (Globalreg::globalreg->kismet_config->FetchOptBoolean("kis_log_packets", true)) {
-        _MSG("Saving packets to the Kismet database log.", MSGFLAG_INFO);
-        std::shared_ptr<Packetchain> packetchain =
-            Globalreg::FetchMandatoryGlobalAs<Packetchain>("PACKETCHAIN");
+    device_deltas =
+        Globalreg::globalreg->kismet_config->FetchOptBoolean("kis_log_device_deltas", false);
 
-        packetchain->RegisterHandler(&KisDatabaseLogfile::packet_handler, this, 
-                CHAINPOS_LOGGING, -100);
+    if (device_deltas) {
+        device_checkpoint = 
+            Globalreg::globalreg->kismet_config->FetchOptUInt("kis_log_device_checkpoint", 20);
+        if (device_checkpoint == 0)
+            device_checkpoint = 1;
+
+        device_delta_compress =
+            Globalreg::globalreg->kismet_config->FetchOptBoolean("kis_log_device_compress", false);
+
+        _MSG("Logging changed device fields to the Kismet database log, with a full "
+                "record every " + UIntToString(device_checkpoint) + " changes.", MSGFLAG_INFO);
+    }
+
+    // WAL lets the commit append to the log instead of rewriting pages in place,
+    // and only needs a sync at checkpoints
+    if (Globalreg::globalreg->kismet_config->FetchOptBoolean("kis_log_wal", true)) {
+        sqlite3_exec(db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
+        sqlite3_exec(db, "PRAGMA synchronous=NORMAL", NULL, NULL, NULL);
+    } else {
+        sqlite3_exec(db, "PRAGMA journal_mode=PERSIST", NULL, NULL, NULL);
+    }
+
+    writer_batch =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("kis_log_packet_batch", 512);
+    if (writer_batch == 0)
+        writer_batch = 1;
+
+    writer_flush_ms =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("kis_log_packet_flush_ms", 250);
+    if (writer_flush_ms == 0)
+        writer_flush_ms = 1;
+
+    commit_interval_ms =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("kis_log_commit_interval", 10) * 1000;
+
+    if (packet_queue == nullptr) {
+        unsigned int queue_sz =
+            Globalreg::globalreg->kismet_config->FetchOptUInt("kis_log_packet_queue", 8192);
+
+        packet_queue = new mpmc_bounded_queue<packet_record *>(queue_sz);
+        packet_record_pool = new mpmc_bounded_queue<packet_record *>(queue_sz);
     }
 
     db_enabled = true;
+    closing = false;
 
-    sqlite3_exec(db, "PRAGMA journal_mode=PERSIST", NULL, NULL, NULL);
-    
-    // Go into transactional mode where we only commit every 10 seconds
+    // Go into transactional mode; the writer thread commits every commit interval
     sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
 
-    std::shared_ptr<Timetracker> timetracker = 
-        Globalreg::FetchMandatoryGlobalAs<Timetracker>("TIMETRACKER");
-    transaction_timer = 
-        timetracker->RegisterTimer(SERVER_TIMESLICES_SEC * 10, NULL, 1,
-            [this](int) -> int {
-
-            local_locker dblock(&ds_mutex);
+    writer_shutdown = false;
+    writer_thread = std::thread([this]() { packet_writer(); });
 
-            sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
-            sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    if (Globalreg::globalreg->kismet_config->FetchOptBoolean("kis_log_packets", true)) {
+        _MSG("Saving packets to the Kismet database log.", MSGFLAG_INFO);
+        std::shared_ptr<Packetchain> packetchain =
+            Globalreg::FetchMandatoryGlobalAs<Packetchain>("PACKETCHAIN");
 
-            return 1;
-        });
+        packetchain->RegisterHandler(&KisDatabaseLogfile::packet_handler, this, 
+                CHAINPOS_LOGGING, -100);
+    }
 
     return true;
 }
@@ -138,13 +327,23 @@ bool KisDatabaseLogfile::Log_Open(std::string in_path) {
 void KisDatabaseLogfile::Log_Close() {
     local_locker dblock(&ds_mutex);
 
+    // Write out anything the writer thread hasn't gotten to yet; we may be here
+    // because a write failed, so only try once
+    if (db_enabled && !closing && packet_queue != nullptr) {
+        closing = true;
+        flush_packet_queue(packet_queue->capacity());
+    }
+
     set_int_log_open(false);
 
-    // Kill the timer
-    std::shared_ptr<Timetracker> timetracker = 
-        Globalreg::FetchMandatoryGlobalAs<Timetracker>("TIMETRACKER");
-    if (timetracker != NULL)
-        timetracker->RemoveTimer(transaction_timer);
+    // The writer exits once it sees the shutdown; we don't wait for it here
+    // because our caller may hold the database lock it needs
+    writer_shutdown = true;
+
+    {
+        std::lock_guard<std::mutex> lk(writer_mutex);
+        writer_cv.notify_all();
+    }
 
     // End the transaction
     {
@@ -164,6 +363,12 @@ void KisDatabaseLogfile::Log_Close() {
         device_stmt = NULL;
     }
 
+    {
+        if (device_delta_stmt != NULL)
+            sqlite3_finalize(device_delta_stmt);
+        device_delta_stmt = NULL;
+    }
+
     {
         if (packet_stmt != NULL)
             sqlite3_finalize(packet_stmt);
@@ -431,7 +636,48 @@ int KisDatabaseLogfile::Database_UpgradeDB() {
 
     }
 
-    Database_SetDBVersion(4);
+    if (dbv < 5) {
+        sql =
+            "CREATE TABLE device_deltas ("
+
+            "ts_sec INT, " // Timestamp of record
+
+            "devkey TEXT, " // Device key
+
+            "phyname TEXT, " // Phy records
+            "devmac TEXT, "
+
+            "full INT, " // Record is a complete device instead of changed fields
+
+            "compressed INT, " // Record is zlib compressed
+
+            "delta BLOB" // Device or changed fields, as JSON
+            ")";
+
+        r = sqlite3_exec(db, sql.c_str(),
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
+
+        if (r != SQLITE_OK) {
+            _MSG("Kismet log was unable to create device_deltas table in " + ds_dbfile + ": " +
+                    std::string(sErrMsg), MSGFLAG_ERROR);
+            Log_Close();
+            return -1;
+        }
+
+        sql = "CREATE INDEX device_deltas_devkey ON device_deltas (devkey, ts_sec)";
+
+        r = sqlite3_exec(db, sql.c_str(),
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
+
+        if (r != SQLITE_OK) {
+            _MSG("Kismet log was unable to create device_deltas index in " + ds_dbfile + ": " +
+                    std::string(sErrMsg), MSGFLAG_ERROR);
+            Log_Close();
+            return -1;
+        }
+    }
+
+    Database_SetDBVersion(5);
 
     // Prepare the statements we'll need later
     //
@@ -452,6 +698,20 @@ int KisDatabaseLogfile::Database_UpgradeDB() {
         return -1;
     }
 
+    sql =
+        "INSERT INTO device_deltas "
+        "(ts_sec, devkey, phyname, devmac, full, compressed, delta) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?)";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &device_delta_stmt, &device_delta_pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("KisDatabaseLogfile unable to prepare database insert for device deltas in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        Log_Close();
+        return -1;
+    }
+
     sql =
         "INSERT INTO packets "
         "(ts_sec, ts_usec, phyname, "
@@ -567,12 +827,12 @@ int KisDatabaseLogfile::log_devices(std::shared_ptr<TrackerElementVector> in_dev
     if (!db_enabled)
         return 0;
 
-    std::string sql;
+    if (device_deltas)
+        return log_device_deltas(in_devices);
 
-    std::string phystring;
-    std::string macstring;
-    std::string typestring;
-    std::string keystring;
+    // Reused for every device so the serialized json only reallocates when a
+    // device is larger than any before it
+    std::string streamstring;
 
     for (auto i : *in_devices) {
         if (i == NULL)
@@ -580,87 +840,299 @@ int KisDatabaseLogfile::log_devices(std::shared_ptr<TrackerElementVector> in_dev
 
         auto d = std::static_pointer_cast<kis_tracked_device_base>(i);
 
-        phystring = d->get_phyname();
-        macstring = d->get_macaddr().Mac2String();
-        typestring = d->get_type_string();
-        keystring = d->get_key().as_string();
+        // Serialize the device
+        streamstring.clear();
+        JsonAdapter::Pack(streamstring, d);
+
+        if (log_device_record(d, streamstring) < 0) {
+            Log_Close();
+            return -1;
+        }
+    }
+
+    return 1;
+}
 
-        int spos = 1;
+int KisDatabaseLogfile::log_device_record(std::shared_ptr<kis_tracked_device_base> d,
+        const std::string& json) {
+    std::string phystring = d->get_phyname();
+    std::string macstring = d->get_macaddr().Mac2String();
+    std::string typestring = d->get_type_string();
+    std::string keystring = d->get_key().as_string();
 
-        std::stringstream sstr;
+    int spos = 1;
 
-        // Serialize the device
-        JsonAdapter::Pack(sstr, d, NULL);
-        std::string streamstring = sstr.str();
+    local_locker dblock(&ds_mutex);
+
+    if (device_stmt == NULL)
+        return -1;
+
+    sqlite3_reset(device_stmt);
+
+    sqlite3_bind_int64(device_stmt, spos++, d->get_first_time());
+    sqlite3_bind_int64(device_stmt, spos++, d->get_last_time());
+    sqlite3_bind_text(device_stmt, spos++, keystring.c_str(), 
+            keystring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(device_stmt, spos++, phystring.c_str(), 
+            phystring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(device_stmt, spos++, macstring.c_str(), 
+            macstring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_int(device_stmt, spos++, d->get_signal_data()->get_max_signal());
+
+    if (d->get_tracker_location() != NULL) {
+        sqlite3_bind_int64(device_stmt, spos++, 
+                d->get_location()->get_min_loc()->get_lat() * 100000);
+        sqlite3_bind_int64(device_stmt, spos++,
+                d->get_location()->get_min_loc()->get_lon() * 100000);
+        sqlite3_bind_int64(device_stmt, spos++,
+                d->get_location()->get_max_loc()->get_lat() * 100000);
+        sqlite3_bind_int64(device_stmt, spos++,
+                d->get_location()->get_max_loc()->get_lon() * 100000);
+        sqlite3_bind_int64(device_stmt, spos++,
+                d->get_location()->get_avg_loc()->get_lat() * 100000);
+        sqlite3_bind_int64(device_stmt, spos++,
+                d->get_location()->get_avg_loc()->get_lon() * 100000);
+    } else {
+        // Empty location
+        sqlite3_bind_int(device_stmt, spos++, 0);
+        sqlite3_bind_int(device_stmt, spos++, 0);
+        sqlite3_bind_int(device_stmt, spos++, 0);
+        sqlite3_bind_int(device_stmt, spos++, 0);
+        sqlite3_bind_int(device_stmt, spos++, 0);
+        sqlite3_bind_int(device_stmt, spos++, 0);
+    }
+
+    sqlite3_bind_int64(device_stmt, spos++, d->get_datasize());
+    sqlite3_bind_text(device_stmt, spos++, typestring.c_str(), 
+            typestring.length(), SQLITE_TRANSIENT);
+
+    sqlite3_bind_text(device_stmt, spos++, json.c_str(), 
+            json.length(), SQLITE_TRANSIENT);
+
+    if (sqlite3_step(device_stmt) != SQLITE_DONE) {
+        _MSG("KisDatabaseLogfile unable to insert device in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return -1;
+    }
+
+    return 1;
+}
+
+int KisDatabaseLogfile::log_device_delta_record(std::shared_ptr<kis_tracked_device_base> d,
+        time_t ts, bool full, const std::string& json) {
+    std::string phystring = d->get_phyname();
+    std::string macstring = d->get_macaddr().Mac2String();
+    std::string keystring = d->get_key().as_string();
+
+    std::vector<unsigned char> zbuf;
+
+    if (device_delta_compress) {
+        uLongf zlen = compressBound(json.length());
+        zbuf.resize(zlen);
+
+        if (compress2(zbuf.data(), &zlen, (const Bytef *) json.data(), json.length(),
+                    Z_DEFAULT_COMPRESSION) != Z_OK) {
+            _MSG("KisDatabaseLogfile unable to compress device record", MSGFLAG_ERROR);
+            return -1;
+        }
+
+        zbuf.resize(zlen);
+    }
+
+    local_locker dblock(&ds_mutex);
+
+    if (device_delta_stmt == NULL)
+        return -1;
+
+    sqlite3_reset(device_delta_stmt);
+
+    sqlite3_bind_int64(device_delta_stmt, 1, ts);
+    sqlite3_bind_text(device_delta_stmt, 2, keystring.c_str(), 
+            keystring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(device_delta_stmt, 3, phystring.c_str(), 
+            phystring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(device_delta_stmt, 4, macstring.c_str(), 
+            macstring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_int(device_delta_stmt, 5, full);
+    sqlite3_bind_int(device_delta_stmt, 6, device_delta_compress);
+
+    if (device_delta_compress)
+        sqlite3_bind_blob(device_delta_stmt, 7, zbuf.data(), zbuf.size(), SQLITE_TRANSIENT);
+    else
+        sqlite3_bind_text(device_delta_stmt, 7, json.c_str(), json.length(), SQLITE_TRANSIENT);
+
+    if (sqlite3_step(device_delta_stmt) != SQLITE_DONE) {
+        _MSG("KisDatabaseLogfile unable to insert device delta in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return -1;
+    }
+
+    return 1;
+}
+
+int KisDatabaseLogfile::log_device_deltas(std::shared_ptr<TrackerElementVector> in_devices) {
+    local_locker dlock(&device_delta_mutex);
+
+    auto entrytracker = 
+        Globalreg::FetchMandatoryGlobalAs<EntryTracker>("ENTRYTRACKER");
+
+    time_t now = time(0);
+
+    std::vector<std::pair<int, uint64_t>> field_hashes;
+    std::string fieldjson, fulljson, deltajson, fieldname;
+
+    for (auto i : *in_devices) {
+        if (i == NULL)
+            continue;
+
+        auto d = std::static_pointer_cast<kis_tracked_device_base>(i);
+
+        auto& state = device_log_map[d->get_key()];
+
+        // Devices we haven't logged, or which have been replaced since we last saw
+        // them, always start with a full record
+        bool full = 
+            state.device.expired() || state.deltas_since_full + 1 >= device_checkpoint;
+
+        state.device = d;
+
+        field_hashes.clear();
+        fulljson = "{";
+        deltajson = "{";
+
+        auto old_hash = state.field_hashes.cbegin();
 
         {
-            local_locker dblock(&ds_mutex);
-            sqlite3_reset(device_stmt);
-
-            sqlite3_bind_int64(device_stmt, spos++, d->get_first_time());
-            sqlite3_bind_int64(device_stmt, spos++, d->get_last_time());
-            sqlite3_bind_text(device_stmt, spos++, keystring.c_str(), 
-                    keystring.length(), SQLITE_TRANSIENT);
-            sqlite3_bind_text(device_stmt, spos++, phystring.c_str(), 
-                    phystring.length(), SQLITE_TRANSIENT);
-            sqlite3_bind_text(device_stmt, spos++, macstring.c_str(), 
-                    macstring.length(), SQLITE_TRANSIENT);
-            sqlite3_bind_int(device_stmt, spos++, d->get_signal_data()->get_max_signal());
-
-            if (d->get_tracker_location() != NULL) {
-                sqlite3_bind_int64(device_stmt, spos++, 
-                        d->get_location()->get_min_loc()->get_lat() * 100000);
-                sqlite3_bind_int64(device_stmt, spos++,
-                        d->get_location()->get_min_loc()->get_lon() * 100000);
-                sqlite3_bind_int64(device_stmt, spos++,
-                        d->get_location()->get_max_loc()->get_lat() * 100000);
-                sqlite3_bind_int64(device_stmt, spos++,
-                        d->get_location()->get_max_loc()->get_lon() * 100000);
-                sqlite3_bind_int64(device_stmt, spos++,
-                        d->get_location()->get_avg_loc()->get_lat() * 100000);
-                sqlite3_bind_int64(device_stmt, spos++,
-                        d->get_location()->get_avg_loc()->get_lon() * 100000);
-            } else {
-                // Empty location
-                sqlite3_bind_int(device_stmt, spos++, 0);
-                sqlite3_bind_int(device_stmt, spos++, 0);
-                sqlite3_bind_int(device_stmt, spos++, 0);
-                sqlite3_bind_int(device_stmt, spos++, 0);
-                sqlite3_bind_int(device_stmt, spos++, 0);
-                sqlite3_bind_int(device_stmt, spos++, 0);
+            SerializerScope s(d, nullptr);
+
+            for (const auto& f : *d) {
+                if (f.second == nullptr)
+                    continue;
+
+                fieldname = f.second->get_local_name();
+                if (fieldname.length() == 0)
+                    fieldname = entrytracker->GetFieldName(f.first);
+                fieldname = JsonAdapter::SanitizeString(fieldname);
+
+                fieldjson.clear();
+                JsonAdapter::Pack(fieldjson, f.second);
+
+                uint64_t h = XXH64(fieldjson.data(), fieldjson.length(), 0);
+                field_hashes.push_back(std::make_pair(f.first, h));
+
+                if (fulljson.length() > 1)
+                    fulljson += ",";
+                fulljson += "\"" + fieldname + "\": " + fieldjson;
+
+                if (full)
+                    continue;
+
+                // Fields which have gone away since the last record are logged as null
+                while (old_hash != state.field_hashes.cend() && old_hash->first < f.first) {
+                    if (deltajson.length() > 1)
+                        deltajson += ",";
+                    deltajson += "\"" + 
+                        JsonAdapter::SanitizeString(entrytracker->GetFieldName(old_hash->first)) +
+                        "\": null";
+                    ++old_hash;
+                }
+
+                bool changed = true;
+
+                if (old_hash != state.field_hashes.cend() && old_hash->first == f.first) {
+                    changed = old_hash->second != h;
+                    ++old_hash;
+                }
+
+                if (!changed)
+                    continue;
+
+                if (deltajson.length() > 1)
+                    deltajson += ",";
+                deltajson += "\"" + fieldname + "\": " + fieldjson;
             }
+        }
+
+        if (!full) {
+            while (old_hash != state.field_hashes.cend()) {
+                if (deltajson.length() > 1)
+                    deltajson += ",";
+                deltajson += "\"" + 
+                    JsonAdapter::SanitizeString(entrytracker->GetFieldName(old_hash->first)) +
+                    "\": null";
+                ++old_hash;
+            }
+        }
 
-            sqlite3_bind_int64(device_stmt, spos++, d->get_datasize());
-            sqlite3_bind_text(device_stmt, spos++, typestring.c_str(), 
-                    typestring.length(), SQLITE_TRANSIENT);
+        fulljson += "}";
+        deltajson += "}";
 
-            sqlite3_bind_text(device_stmt, spos++, streamstring.c_str(), 
-                    streamstring.length(), SQLITE_TRANSIENT);
+        state.field_hashes.swap(field_hashes);
+
+        if (full) {
+            if (log_device_record(d, fulljson) < 0 || 
+                    log_device_delta_record(d, now, true, fulljson) < 0) {
+                Log_Close();
+                return -1;
+            }
 
-            if (sqlite3_step(device_stmt) != SQLITE_DONE) {
-                _MSG("KisDatabaseLogfile unable to insert device in " +
-                        ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+            state.deltas_since_full = 0;
+        } else if (deltajson.length() > 2) {
+            if (log_device_delta_record(d, now, false, deltajson) < 0) {
                 Log_Close();
                 return -1;
             }
+
+            state.deltas_since_full++;
+        }
+    }
+
+    // Periodically forget devices which no longer exist
+    if (++device_log_passes % device_checkpoint == 0) {
+        for (auto si = device_log_map.begin(); si != device_log_map.end(); ) {
+            if (si->second.device.expired())
+                si = device_log_map.erase(si);
+            else
+                ++si;
         }
     }
 
     return 1;
 }
 
+int KisDatabaseLogfile::checkpoint_devices() {
+    if (!db_enabled || !device_deltas)
+        return 0;
+
+    local_locker dlock(&device_delta_mutex);
+
+    std::string json;
+
+    for (auto& si : device_log_map) {
+        if (si.second.deltas_since_full == 0)
+            continue;
+
+        auto d = si.second.device.lock();
+
+        if (d == nullptr)
+            continue;
+
+        json.clear();
+        JsonAdapter::Pack(json, d);
+
+        if (log_device_record(d, json) < 0)
+            return -1;
+
+        si.second.deltas_since_full = 0;
+    }
+
+    return 1;
+}
+
 int KisDatabaseLogfile::log_packet(kis_packet *in_pack) {
     if (!db_enabled)
         return 0;
 
-    std::string phystring;
-    std::string macstring;
-    std::string deststring;
-    std::string transstring;
-    std::string keystring;
-    std::string sourceuuidstring;
-    double frequency;
-
     kis_datachunk *chunk = 
         (kis_datachunk *) in_pack->fetch(pack_comp_linkframe);
 
@@ -679,109 +1151,286 @@ int KisDatabaseLogfile::log_packet(kis_packet *in_pack) {
     packet_metablob *metablob =
         (packet_metablob *) in_pack->fetch(pack_comp_metablob);
 
-    Kis_Phy_Handler *phyh = NULL;
+    packet_record *r;
 
-    // Packets are no longer a 1:1 with a device
-    keystring = "0";
+    if (!packet_record_pool->pop(r))
+        r = new packet_record();
+
+    r->ts = in_pack->ts;
 
     if (commoninfo != NULL) {
-        phyh = devicetracker->FetchPhyHandler(commoninfo->phyid);
-        macstring = commoninfo->source.Mac2String();
-        deststring = commoninfo->dest.Mac2String();
-        transstring = commoninfo->transmitter.Mac2String();
-        frequency = commoninfo->freq_khz;
+        r->phyid = commoninfo->phyid;
+        r->source = commoninfo->source;
+        r->dest = commoninfo->dest;
+        r->trans = commoninfo->transmitter;
+        r->frequency = commoninfo->freq_khz;
     } else {
-        macstring = "00:00:00:00:00:00";
-        deststring = "00:00:00:00:00:00";
-        transstring = "00:00:00:00:00:00";
-        frequency = 0;
+        r->phyid = -1;
+        r->source = mac_addr();
+        r->dest = mac_addr();
+        r->trans = mac_addr();
+        r->frequency = 0;
     }
 
-    if (phyh == NULL)
-        phystring = "Unknown";
+    if (gpsdata != NULL) {
+        r->gps = true;
+        r->lat = gpsdata->lat;
+        r->lon = gpsdata->lon;
+    } else {
+        r->gps = false;
+        r->lat = r->lon = 0;
+    }
+
+    if (radioinfo != NULL)
+        r->signal = radioinfo->signal_dbm;
     else
-        phystring = phyh->FetchPhyName();
+        r->signal = 0;
 
+    if (datasrc != NULL)
+        r->datasource = datasrc->ref_source->get_source_uuid();
+    else
+        r->datasource = uuid();
 
-    if (datasrc != NULL) {
-        sourceuuidstring = datasrc->ref_source->get_source_uuid().UUID2String();
+    if (chunk != NULL) {
+        r->chunk = true;
+        r->dlt = chunk->dlt;
+        r->data.assign((const char *) chunk->data, chunk->length);
     } else {
-        sourceuuidstring = "00000000-0000-0000-0000-000000000000";
+        r->chunk = false;
+        r->dlt = -1;
+        r->data.clear();
     }
 
-    {
-        local_locker dblock(&ds_mutex);
-        sqlite3_reset(packet_stmt);
+    r->error = in_pack->error;
 
-        sqlite3_bind_int64(packet_stmt, 1, in_pack->ts.tv_sec);
-        sqlite3_bind_int64(packet_stmt, 2, in_pack->ts.tv_usec);
+    if (metablob != NULL) {
+        r->meta = true;
+        r->meta_type = metablob->meta_type;
+        r->meta_data = metablob->meta_data;
+    } else {
+        r->meta = false;
+    }
 
-        sqlite3_bind_text(packet_stmt, 3, phystring.c_str(), phystring.length(), SQLITE_TRANSIENT);
-        sqlite3_bind_text(packet_stmt, 4, macstring.c_str(), macstring.length(), SQLITE_TRANSIENT);
-        sqlite3_bind_text(packet_stmt, 5, deststring.c_str(), deststring.length(), SQLITE_TRANSIENT);
-        sqlite3_bind_text(packet_stmt, 6, transstring.c_str(), transstring.length(), SQLITE_TRANSIENT);
-        sqlite3_bind_text(packet_stmt, 7, keystring.c_str(), keystring.length(), SQLITE_TRANSIENT);
-        sqlite3_bind_double(packet_stmt, 8, frequency);
+    if (!packet_queue->push(r)) {
+        recycle_packet_record(r);
+        packets_dropped++;
 
-        if (gpsdata != NULL) {
-            sqlite3_bind_int64(packet_stmt, 9, gpsdata->lat * 100000);
-            sqlite3_bind_int64(packet_stmt, 10, gpsdata->lon * 100000);
-        } else {
-            sqlite3_bind_int(packet_stmt, 9, 0);
-            sqlite3_bind_int(packet_stmt, 10, 0);
-        }
+        time_t now = time(0);
 
-        if (chunk != NULL) {
-            sqlite3_bind_int64(packet_stmt, 11, chunk->length);
-        } else {
-            sqlite3_bind_int(packet_stmt, 11, 0);
+        if (now - last_drop_warning > 30) {
+            last_drop_warning = now;
+            _MSG("The kismetdb log writer has fallen behind and packets are being dropped "
+                    "from the log; the disk may be too slow or busy.  The queue can be "
+                    "tuned with 'kis_log_packet_queue' in kismet_logging.conf", 
+                    MSGFLAG_ERROR);
         }
 
-        if (radioinfo != NULL) {
-            sqlite3_bind_int(packet_stmt, 12, radioinfo->signal_dbm);
-        } else {
-            sqlite3_bind_int(packet_stmt, 12, 0);
-        }
+        return 0;
+    }
 
-        sqlite3_bind_text(packet_stmt, 13, sourceuuidstring.c_str(), 
-                sourceuuidstring.length(), SQLITE_TRANSIENT);
+    packets_queued++;
 
-        if (chunk != NULL) {
-            sqlite3_bind_int(packet_stmt, 14, chunk->dlt);
-            sqlite3_bind_blob(packet_stmt, 15, (const char *) chunk->data, chunk->length, 0);
-        } else {
-            sqlite3_bind_int(packet_stmt, 14, -1);
-            sqlite3_bind_text(packet_stmt, 15, "", 0, SQLITE_TRANSIENT);
-        }
+    size_t queue_sz = packet_queue->size();
 
-        sqlite3_bind_int(packet_stmt, 16, in_pack->error);
+    uint64_t high = queue_high_water;
+    while (queue_sz > high && !queue_high_water.compare_exchange_weak(high, queue_sz))
+        ;
 
-        if (sqlite3_step(packet_stmt) != SQLITE_DONE) {
-            _MSG("KisDatabaseLogfile unable to insert packet in " +
-                    ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-            Log_Close();
-            return -1;
+    // Only wake the writer for a full batch, and only when it's asleep; the fence
+    // orders our push against the writer announcing that it's going to sleep
+    if (queue_sz >= writer_batch) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (writer_sleeping != 0) {
+            std::lock_guard<std::mutex> lk(writer_mutex);
+            writer_cv.notify_one();
         }
     }
 
-    // If the packet has a metablob record, log that
-    if (metablob != NULL) {
-        mac_addr smac("00:00:00:00:00:00");
-        uuid puuid;
+    return 1;
+}
+
+void KisDatabaseLogfile::recycle_packet_record(packet_record *r) {
+    if (!packet_record_pool->push(r))
+        delete r;
+}
+
+int KisDatabaseLogfile::write_packet_record(packet_record *r) {
+    if (!db_enabled || packet_stmt == NULL)
+        return -1;
+
+    std::string phystring;
+
+    Kis_Phy_Handler *phyh = NULL;
+
+    if (r->phyid >= 0)
+        phyh = devicetracker->FetchPhyHandler(r->phyid);
+
+    if (phyh == NULL)
+        phystring = "Unknown";
+    else
+        phystring = phyh->FetchPhyName();
+
+    std::string macstring = r->source.Mac2String();
+    std::string deststring = r->dest.Mac2String();
+    std::string transstring = r->trans.Mac2String();
+    std::string sourceuuidstring = r->datasource.UUID2String();
+
+    // Packets are no longer a 1:1 with a device
+    std::string keystring = "0";
+
+    sqlite3_reset(packet_stmt);
+
+    sqlite3_bind_int64(packet_stmt, 1, r->ts.tv_sec);
+    sqlite3_bind_int64(packet_stmt, 2, r->ts.tv_usec);
+
+    sqlite3_bind_text(packet_stmt, 3, phystring.c_str(), phystring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(packet_stmt, 4, macstring.c_str(), macstring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(packet_stmt, 5, deststring.c_str(), deststring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(packet_stmt, 6, transstring.c_str(), transstring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(packet_stmt, 7, keystring.c_str(), keystring.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_double(packet_stmt, 8, r->frequency);
 
-        if (commoninfo != NULL)
-            smac = commoninfo->source;
+    if (r->gps) {
+        sqlite3_bind_int64(packet_stmt, 9, r->lat * 100000);
+        sqlite3_bind_int64(packet_stmt, 10, r->lon * 100000);
+    } else {
+        sqlite3_bind_int(packet_stmt, 9, 0);
+        sqlite3_bind_int(packet_stmt, 10, 0);
+    }
+
+    sqlite3_bind_int64(packet_stmt, 11, r->data.length());
+    sqlite3_bind_int(packet_stmt, 12, r->signal);
+
+    sqlite3_bind_text(packet_stmt, 13, sourceuuidstring.c_str(), 
+            sourceuuidstring.length(), SQLITE_TRANSIENT);
+
+    if (r->chunk) {
+        sqlite3_bind_int(packet_stmt, 14, r->dlt);
+        sqlite3_bind_blob(packet_stmt, 15, r->data.data(), r->data.length(), SQLITE_STATIC);
+    } else {
+        sqlite3_bind_int(packet_stmt, 14, -1);
+        sqlite3_bind_text(packet_stmt, 15, "", 0, SQLITE_TRANSIENT);
+    }
 
-        if (datasrc != NULL) 
-            puuid = datasrc->ref_source->get_source_uuid();
+    sqlite3_bind_int(packet_stmt, 16, r->error);
 
-        log_data(gpsdata, in_pack->ts, phystring, smac, puuid,
-                metablob->meta_type, metablob->meta_data);
+    if (sqlite3_step(packet_stmt) != SQLITE_DONE) {
+        _MSG("KisDatabaseLogfile unable to insert packet in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return -1;
+    }
+
+    // If the packet has a metablob record, log that
+    if (r->meta) {
+        kis_gps_packinfo gps;
+
+        gps.lat = r->lat;
+        gps.lon = r->lon;
+
+        if (log_data(r->gps ? &gps : NULL, r->ts, phystring, r->source, r->datasource,
+                r->meta_type, r->meta_data) < 0)
+            return -1;
     }
 
     return 1;
 }
 
+int KisDatabaseLogfile::flush_packet_queue(size_t in_max) {
+    local_locker dblock(&ds_mutex);
+
+    packet_record *r;
+    int n = 0;
+
+    while ((size_t) n < in_max && packet_queue->pop(r)) {
+        int ret = write_packet_record(r);
+
+        recycle_packet_record(r);
+
+        if (ret < 0)
+            return -1;
+
+        n++;
+    }
+
+    packets_written += n;
+
+    return n;
+}
+
+void KisDatabaseLogfile::packet_writer() {
+    auto last_commit = std::chrono::steady_clock::now();
+
+    while (1) {
+        if (packet_queue->size() != 0) {
+            auto batch_start = std::chrono::steady_clock::now();
+
+            int n = flush_packet_queue(writer_batch);
+
+            if (n < 0) {
+                Log_Close();
+                return;
+            }
+
+            if (n > 0) {
+                uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - batch_start).count();
+
+                writer_batches++;
+                last_batch_size = n;
+                last_batch_usec = usec;
+
+                if (usec > max_batch_usec)
+                    max_batch_usec = usec;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_commit).count() >= 
+                commit_interval_ms) {
+            {
+                local_locker dblock(&ds_mutex);
+
+                if (!db_enabled)
+                    return;
+
+                sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
+                sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+            }
+
+            last_commit = std::chrono::steady_clock::now();
+
+            uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                    last_commit - now).count();
+
+            commits++;
+            last_commit_usec = usec;
+
+            if (usec > max_commit_usec)
+                max_commit_usec = usec;
+        }
+
+        if (writer_shutdown)
+            return;
+
+        // Keep going while there's at least a full batch waiting
+        if (packet_queue->size() >= writer_batch)
+            continue;
+
+        // Otherwise sleep until a producer has a full batch for us or the flush
+        // interval passes; announce that we're sleeping before checking again so
+        // a producer either sees us or we see its packets
+        std::unique_lock<std::mutex> lk(writer_mutex);
+        writer_sleeping++;
+
+        if (!writer_shutdown && packet_queue->size() < writer_batch)
+            writer_cv.wait_for(lk, std::chrono::milliseconds(writer_flush_ms));
+
+        writer_sleeping--;
+    }
+}
+
 int KisDatabaseLogfile::log_data(kis_gps_packinfo *gps, struct timeval tv, 
         std::string phystring, mac_addr devmac, uuid datasource_uuid, 
         std::string type, std::string json) {
@@ -856,11 +1505,9 @@ int KisDatabaseLogfile::log_datasource(SharedTrackerElement in_datasource) {
     std::string namestring = ds->get_source_name();
     std::string intfstring = ds->get_source_interface();
 
-    std::stringstream ss;
     std::string jsonstring;
 
-    JsonAdapter::Pack(ss, in_datasource, NULL);
-    jsonstring = ss.str();
+    JsonAdapter::Pack(jsonstring, in_datasource);
 
     {
         local_locker dblock(&ds_mutex);
@@ -893,11 +1540,9 @@ int KisDatabaseLogfile::log_alert(std::shared_ptr<tracked_alert> in_alert) {
     std::string phystring = devicetracker->FetchPhyName(in_alert->get_phy());
     std::string headerstring = in_alert->get_header();
 
-    std::stringstream ss;
     std::string jsonstring;
 
-    JsonAdapter::Pack(ss, in_alert, NULL);
-    jsonstring = ss.str();
+    JsonAdapter::Pack(jsonstring, in_alert);
 
     // Break the double timestamp into two integers
     double intpart, fractpart;
@@ -38,15 +38,22 @@
 #include "config.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
 #include "kis_database.h"
 #include "devicetracker.h"
+#include "devicetracker_table.h"
 #include "alertracker.h"
 #include "logtracker.h"
+#include "mpmc_queue.h"
 #include "packetchain.h"
 #include "pcapng_stream_ringbuf.h"
 #include "sqlite3_cpp11.h"
@@ -83,14 +90,22 @@ public:
 
     virtual int Database_UpgradeDB() override;
 
-    // Log a vector of multiple devices, replacing any old device records
+    // Log a vector of multiple devices, replacing any old device records.  When
+    // delta logging is enabled, only the fields which changed since the device was
+    // last logged are recorded, with a full checkpoint every few passes
     virtual int log_devices(std::shared_ptr<TrackerElementVector> in_devices);
 
+    // Write a full record for every device with deltas logged since its last
+    // checkpoint, so the devices table is current; called at shutdown
+    virtual int checkpoint_devices();
+
     // Device logs are non-streaming; we need to know the last time we generated
     // device logs so that we can update just the logs we need.
     virtual time_t get_last_device_log_ts() { return last_device_log; }
 
-    // Log a packet
+    // Log a packet.  The packet is copied and handed to the writer thread, so
+    // packet threads never wait on the database; if the writer has fallen too far
+    // behind the packet is dropped from the log and counted
     virtual int log_packet(kis_packet *in_packet);
 
     // Log data that isn't a packet; this is a slightly more clunky API because we 
@@ -137,10 +152,42 @@ protected:
 
     std::atomic<time_t> last_device_log;
 
+    // Insert or replace the device table record
+    int log_device_record(std::shared_ptr<kis_tracked_device_base> d, const std::string& json);
+
+    // Delta logging; device state is recorded in the device_deltas table as
+    // either a complete device or the top-level fields which changed
+    int log_device_deltas(std::shared_ptr<TrackerElementVector> in_devices);
+    int log_device_delta_record(std::shared_ptr<kis_tracked_device_base> d, time_t ts,
+            bool full, const std::string& json);
+
+    bool device_deltas;
+    unsigned int device_checkpoint;
+    bool device_delta_compress;
+
+    // Per-device state of the last logged record; a hash of the serialized form of
+    // each top-level field, ordered by field id, lets us find the fields which have
+    // changed without keeping a copy of the json
+    struct device_log_state {
+        device_log_state() :
+            deltas_since_full {0} { }
+
+        std::weak_ptr<kis_tracked_device_base> device;
+        std::vector<std::pair<int, uint64_t>> field_hashes;
+        unsigned int deltas_since_full;
+    };
+
+    kis_recursive_timed_mutex device_delta_mutex;
+    std::unordered_map<device_key, device_log_state, device_key_hash> device_log_map;
+    unsigned int device_log_passes;
+
     // Prebaked parameterized statements
     sqlite3_stmt *device_stmt;
     const char *device_pz;
 
+    sqlite3_stmt *device_delta_stmt;
+    const char *device_delta_pz;
+
     sqlite3_stmt *packet_stmt;
     const char *packet_pz;
 
@@ -161,10 +208,69 @@ protected:
 
     static int packet_handler(CHAINCALL_PARMS);
 
-    // Keep track of our commit cycles; to avoid thrashing the filesystem with
-    // commit state we run a 10 second tranasction commit loop
-    kis_recursive_timed_mutex transaction_mutex;
-    int transaction_timer;
+    // Everything log_packet needs from a packet, copied so the packet can go back
+    // to the chain before the record is written.  Records are recycled through
+    // the pool so the data buffers keep their allocations.
+    struct packet_record {
+        struct timeval ts;
+        int phyid;
+        mac_addr source, dest, trans;
+        double frequency;
+        bool gps;
+        double lat, lon;
+        int signal;
+        uuid datasource;
+        bool chunk;
+        int dlt;
+        std::string data;
+        int error;
+        bool meta;
+        std::string meta_type, meta_data;
+    };
+
+    mpmc_bounded_queue<packet_record *> *packet_queue;
+    mpmc_bounded_queue<packet_record *> *packet_record_pool;
+
+    void recycle_packet_record(packet_record *r);
+
+    // Write a record; must be called under the database lock
+    int write_packet_record(packet_record *r);
+
+    // Write everything in the queue, returning how many records were written or
+    // -1 on a database error
+    int flush_packet_queue(size_t in_max);
+
+    // The writer thread drains the packet queue in batches, and commits the open
+    // transaction every commit interval so the commit i/o never lands on the
+    // packet or timer threads.  Producers only signal it when a full batch is
+    // waiting; otherwise it wakes every flush interval.
+    void packet_writer();
+
+    std::thread writer_thread;
+    std::atomic<bool> writer_shutdown;
+    std::mutex writer_mutex;
+    std::condition_variable writer_cv;
+    std::atomic<int> writer_sleeping;
+
+    unsigned int writer_batch;
+    unsigned int writer_flush_ms;
+    unsigned int commit_interval_ms;
+    bool closing;
+
+    // Writer statistics
+    std::atomic<uint64_t> packets_queued, packets_written, packets_dropped;
+    std::atomic<uint64_t> queue_high_water;
+    std::atomic<uint64_t> writer_batches, last_batch_size, last_batch_usec, max_batch_usec;
+    std::atomic<uint64_t> commits, last_commit_usec, max_commit_usec;
+    std::atomic<time_t> last_drop_warning;
+
+    int stats_queue_len_id, stats_queue_max_id, stats_queue_high_id,
+        stats_queued_id, stats_written_id, stats_dropped_id,
+        stats_batches_id, stats_last_batch_size_id, stats_last_batch_usec_id,
+        stats_max_batch_usec_id, stats_commits_id, stats_last_commit_usec_id,
+        stats_max_commit_usec_id;
+
+    std::shared_ptr<Kis_Net_Httpd_Simple_Tracked_Endpoint> writer_stats_endp;
 };
 
 class KisDatabaseLogfileBuilder : public KisLogfileBuilder {
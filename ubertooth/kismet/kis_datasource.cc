@@ -26,6 +26,8 @@
 #include "alertracker.h"
 #include "packetchain.h"
 
+#include <google/protobuf/io/coded_stream.h>
+
 // We never instantiate from a generic tracker component or from a stored
 // record so we always re-allocate ourselves
 KisDatasource::KisDatasource(SharedDatasourceBuilder in_builder) :
@@ -53,6 +55,9 @@ KisDatasource::KisDatasource(SharedDatasourceBuilder in_builder) :
     pack_comp_json = packetchain->RegisterPacketComponent("JSON");
     pack_comp_protobuf = packetchain->RegisterPacketComponent("PROTOBUF");
 
+    backpressure_ms =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("packet_backpressure_ms", 10);
+
     error_timer_id = -1;
     ping_timer_id = -1;
 
@@ -72,16 +77,17 @@ KisDatasource::KisDatasource(SharedDatasourceBuilder in_builder) :
 }
 
 KisDatasource::~KisDatasource() {
-    local_locker lock(&ext_mutex);
-
-    // fprintf(stderr, "debug - ~KisDatasource\n");
-
-    // Cancel any timer
+    // Cancel any timer, waiting out a running callback before taking the lock
+    // it needs
     if (error_timer_id > 0)
-        timetracker->RemoveTimer(error_timer_id);
+        timetracker->RemoveTimerAndWait(error_timer_id);
 
     if (ping_timer_id > 0)
-        timetracker->RemoveTimer(ping_timer_id);
+        timetracker->RemoveTimerAndWait(ping_timer_id);
+
+    local_locker lock(&ext_mutex);
+
+    // fprintf(stderr, "debug - ~KisDatasource\n");
 
     command_ack_map.clear();
 
@@ -646,6 +652,10 @@ bool KisDatasource::dispatch_rx_packet(std::shared_ptr<KismetExternal::Command>
     } else if (c->command() == "KDSDATAREPORT") {
         handle_packet_data_report(c->seqno(), c->content());
         return true;
+    } else if (c->command() == "KDSDATABATCHREPORT") {
+        handle_packet_data_batch_report(c->seqno(), 
+                (const uint8_t *) c->content().data(), c->content().length());
+        return true;
     } else if (c->command() == "KDSERRORREPORT") {
         handle_packet_error_report(c->seqno(), c->content());
         return true;
@@ -668,6 +678,20 @@ bool KisDatasource::dispatch_rx_packet(std::shared_ptr<KismetExternal::Command>
     return false;
 }
 
+bool KisDatasource::dispatch_rx_inplace(const std::string& in_command, uint32_t in_seqno,
+        const uint8_t *in_content, size_t in_sz) {
+    // Data reports are nearly all of the traffic from a capture tool
+    if (in_command == "KDSDATAREPORT") {
+        handle_packet_data_report(in_seqno, in_content, in_sz);
+        return true;
+    } else if (in_command == "KDSDATABATCHREPORT") {
+        handle_packet_data_batch_report(in_seqno, in_content, in_sz);
+        return true;
+    }
+
+    return false;
+}
+
 void KisDatasource::handle_msg_proxy(const std::string& msg, const int type) {
     if (get_source_remote())
         _MSG(fmt::format("{} - {}", get_source_name(), msg), type);
@@ -1112,7 +1136,32 @@ void KisDatasource::handle_packet_configure_report(uint32_t in_seqno, const std:
 
 }
 
+void KisDatasource::handle_packet_data_batch_report(uint32_t in_seqno, 
+        const uint8_t *in_content, size_t in_sz) {
+    // Each repeated report field is a complete DataReport; hand them off in 
+    // place, in the order the capture tool queued them
+    kis_protobuf_wire wire(in_content, in_sz);
+
+    while (wire.next()) {
+        if (wire.field() == 1 && wire.wiretype() == 2)
+            handle_packet_data_report(in_seqno, wire.data(), wire.length());
+    }
+
+    if (wire.error()) {
+        _MSG(std::string("Kismet datasource driver ") + get_source_builder()->get_source_type() + 
+                std::string(" could not parse the batched data report, something is wrong "
+                    "with the remote capture tool"), MSGFLAG_ERROR);
+        trigger_error("Invalid KDSDATABATCHREPORT");
+    }
+}
+
 void KisDatasource::handle_packet_data_report(uint32_t in_seqno, const std::string& in_content) {
+    handle_packet_data_report(in_seqno, (const uint8_t *) in_content.data(), 
+            in_content.length());
+}
+
+void KisDatasource::handle_packet_data_report(uint32_t in_seqno, const uint8_t *in_content,
+        size_t in_sz) {
     // If we're paused, throw away this packet
     {
         local_locker lock(&ext_mutex);
@@ -1123,7 +1172,67 @@ void KisDatasource::handle_packet_data_report(uint32_t in_seqno, const std::stri
 
     KismetDatasource::DataReport report;
 
-    if (!report.ParseFromString(in_content)) {
+    // The packet submessage is read in place so the packet bytes are only copied
+    // once, straight into the datachunk; the rest of the report is small and is 
+    // parsed normally from either side of it.  Splitting a message at a field
+    // boundary and merging the pieces is the same as parsing the whole.
+    kis_protobuf_wire wire(in_content, in_sz);
+    size_t subpacket_start = in_sz, subpacket_end = in_sz;
+    const uint8_t *subpacket = nullptr;
+    size_t subpacket_sz = 0;
+
+    while (wire.next()) {
+        if (wire.field() == 3 && wire.wiretype() == 2) {
+            subpacket_start = wire.field_start();
+            subpacket_end = wire.field_end();
+            subpacket = wire.data();
+            subpacket_sz = wire.length();
+        }
+    }
+
+    bool report_valid = !wire.error();
+
+    uint64_t pkt_time_sec = 0, pkt_time_usec = 0;
+    uint32_t pkt_dlt = 0;
+    const uint8_t *pkt_data = nullptr;
+    size_t pkt_data_sz = 0;
+
+    if (report_valid && subpacket != nullptr) {
+        kis_protobuf_wire pwire(subpacket, subpacket_sz);
+        unsigned int seen = 0;
+
+        while (pwire.next()) {
+            if (pwire.wiretype() == 0) {
+                if (pwire.field() == 1)
+                    pkt_time_sec = pwire.varint();
+                else if (pwire.field() == 2)
+                    pkt_time_usec = pwire.varint();
+                else if (pwire.field() == 3)
+                    pkt_dlt = pwire.varint();
+            } else if (pwire.wiretype() == 2 && pwire.field() == 5) {
+                pkt_data = pwire.data();
+                pkt_data_sz = pwire.length();
+            }
+
+            if (pwire.field() >= 1 && pwire.field() <= 5)
+                seen |= (1 << pwire.field());
+        }
+
+        // All of the SubPacket fields are required
+        if (pwire.error() || seen != 0x3E)
+            report_valid = false;
+    }
+
+    if (report_valid) {
+        google::protobuf::io::CodedInputStream head(in_content, (int) subpacket_start);
+        google::protobuf::io::CodedInputStream tail(in_content + subpacket_end, 
+                (int) (in_sz - subpacket_end));
+
+        report_valid = report.MergeFromCodedStream(&head) && 
+            report.MergeFromCodedStream(&tail);
+    }
+
+    if (!report_valid) {
         _MSG(std::string("Kismet datasource driver ") + get_source_builder()->get_source_type() + 
                 std::string(" could not parse the data report, something is wrong with "
                     "the remote capture tool"), MSGFLAG_ERROR);
@@ -1140,24 +1249,23 @@ void KisDatasource::handle_packet_data_report(uint32_t in_seqno, const std::stri
     kis_packet *packet = packetchain->GeneratePacket();
 
     // Process the data chunk
-    if (report.has_packet()) {
+    if (subpacket != nullptr) {
         kis_datachunk *datachunk = new kis_datachunk();
 
         if (clobber_timestamp && get_source_remote()) {
             gettimeofday(&(packet->ts), NULL);
         } else {
-            packet->ts.tv_sec = report.packet().time_sec();
-            packet->ts.tv_usec = report.packet().time_usec();
+            packet->ts.tv_sec = pkt_time_sec;
+            packet->ts.tv_usec = pkt_time_usec;
         }
 
         // Override the DLT if we have one
         if (get_source_override_linktype()) {
             datachunk->dlt = get_source_override_linktype();
         } else {
-            datachunk->dlt = report.packet().dlt();
+            datachunk->dlt = pkt_dlt;
         }
-        datachunk->copy_data((const uint8_t *) report.packet().data().data(), 
-                report.packet().data().length());
+        datachunk->copy_data(pkt_data, pkt_data_sz);
 
         packet->insert(pack_comp_linkframe, datachunk);
     }
@@ -1221,8 +1329,13 @@ void KisDatasource::handle_packet_data_report(uint32_t in_seqno, const std::stri
     inc_source_num_packets(1);
     get_source_packet_rrd()->add_sample(1, time(0));
 
-    // Inject the packet into the packetchain if we have one
-    packetchain->ProcessPacket(packet);
+    // Inject the packet into the packetchain if we have one; if the chain is
+    // backing up, stop reading from this source's socket for a moment so the
+    // capture tool blocks on it instead of the chain dropping packets.  We're
+    // called from the select loop, so we must never block here ourselves.
+    if (packetchain->ProcessPacket(packet) == PACKETCHAIN_BACKLOGGED && 
+            backpressure_ms != 0 && ringbuf_handler != nullptr)
+        ringbuf_handler->PauseRead(backpressure_ms);
 
 }
 
@@ -1346,6 +1459,8 @@ unsigned int KisDatasource::send_open_source(std::string in_definition,
 
     KismetDatasource::OpenSource o;
     o.set_definition(in_definition);
+    // Let the capture tool batch its data reports; older tools ignore this
+    o.set_max_batch_bytes(KDS_MAX_BATCH_BYTES);
 
     c->set_content(o.SerializeAsString());
 
@@ -38,6 +38,10 @@
 #include "protobuf_cpp/kismet.pb.h"
 #include "protobuf_cpp/datasource.pb.h"
 
+// Largest batch of data reports we tell capture tools to send in one frame; it
+// has to fit comfortably in the smallest (remote capture) receive buffer
+#define KDS_MAX_BATCH_BYTES     (64 * 1024)
+
 // Builder class responsible for making an instance of this datasource
 class KisDatasourceBuilder;
 typedef std::shared_ptr<KisDatasourceBuilder> SharedDatasourceBuilder;
@@ -473,10 +477,18 @@ protected:
     // Central packet dispatch override to add the datasource commands
     virtual bool dispatch_rx_packet(std::shared_ptr<KismetExternal::Command> c) override;
 
+    // Data reports are handled straight out of the ringbuffer
+    virtual bool dispatch_rx_inplace(const std::string& in_command, uint32_t in_seqno,
+            const uint8_t *in_content, size_t in_sz) override;
+
     virtual void handle_msg_proxy(const std::string& msg, const int type) override;
 
     virtual void handle_packet_configure_report(uint32_t in_seqno, const std::string& in_packet);
     virtual void handle_packet_data_report(uint32_t in_seqno, const std::string& in_packet);
+    virtual void handle_packet_data_report(uint32_t in_seqno, const uint8_t *in_packet,
+            size_t in_sz);
+    virtual void handle_packet_data_batch_report(uint32_t in_seqno, const uint8_t *in_packet,
+            size_t in_sz);
     virtual void handle_packet_error_report(uint32_t in_seqno, const std::string& in_packet);
     virtual void handle_packet_interfaces_report(uint32_t in_seqno, const std::string& in_packet);
     virtual void handle_packet_opensource_report(uint32_t in_seqno, const std::string& in_packet);
@@ -687,6 +699,9 @@ protected:
     // Packetchain
     std::shared_ptr<Packetchain> packetchain;
 
+    // How long to stall reading from the source when the packetchain is backlogged
+    unsigned int backpressure_ms;
+
     // Packet components we inject
     int pack_comp_linkframe, pack_comp_l1info, pack_comp_gps, pack_comp_datasrc,
         pack_comp_json, pack_comp_protobuf;
@@ -798,7 +813,8 @@ protected:
 
 // Packet chain component; we need to use a raw pointer here but it only exists
 // for the lifetime of the packet being processed
-class packetchain_comp_datasource : public packet_component {
+class packetchain_comp_datasource : public packet_component,
+    public packet_component_pool<packetchain_comp_datasource> {
 public:
     KisDatasource *ref_source;
 
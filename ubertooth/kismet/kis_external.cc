@@ -44,9 +44,10 @@ KisExternalInterface::KisExternalInterface() :
 }
 
 KisExternalInterface::~KisExternalInterface() {
-    local_locker el(&ext_mutex);
+    // Wait out a running ping before taking the lock it needs
+    timetracker->RemoveTimerAndWait(ping_timer_id);
 
-    timetracker->RemoveTimer(ping_timer_id);
+    local_locker el(&ext_mutex);
 
     // If we have a ringbuf handler, remove ourselves as the interface, trigger an error
     // to shut it down, and delete our shared reference to it
@@ -90,6 +91,80 @@ void KisExternalInterface::trigger_error(std::string in_error) {
     BufferError(in_error);
 }
 
+bool kis_protobuf_wire::read_varint(uint64_t *out) {
+    uint64_t v = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (pos >= sz)
+            return false;
+
+        uint8_t b = buf[pos++];
+        v |= (uint64_t) (b & 0x7F) << shift;
+
+        if ((b & 0x80) == 0) {
+            *out = v;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool kis_protobuf_wire::next() {
+    uint64_t tag, len;
+
+    if (err || pos >= sz)
+        return false;
+
+    start = pos;
+
+    if (!read_varint(&tag)) {
+        err = true;
+        return false;
+    }
+
+    f_num = tag >> 3;
+    f_type = tag & 0x07;
+
+    switch (f_type) {
+        case 0:
+            if (!read_varint(&f_varint)) {
+                err = true;
+                return false;
+            }
+            break;
+        case 1:
+            if (sz - pos < 8) {
+                err = true;
+                return false;
+            }
+            pos += 8;
+            break;
+        case 2:
+            if (!read_varint(&len) || len > sz - pos) {
+                err = true;
+                return false;
+            }
+            f_data = buf + pos;
+            f_len = len;
+            pos += len;
+            break;
+        case 5:
+            if (sz - pos < 4) {
+                err = true;
+                return false;
+            }
+            pos += 4;
+            break;
+        default:
+            // Groups are never used by the external protocol
+            err = true;
+            return false;
+    }
+
+    return true;
+}
+
 void KisExternalInterface::BufferAvailable(size_t in_amt __attribute__((unused))) {
     local_locker lock(&ext_mutex);
 
@@ -102,25 +177,31 @@ void KisExternalInterface::BufferAvailable(size_t in_amt __attribute__((unused))
         if (ringbuf_handler == NULL)
             return;
 
+        // Hold our own reference; a handler can close the interface while
+        // we're still looking at the peeked frame
+        std::shared_ptr<BufferHandlerGeneric> rbh = ringbuf_handler;
+
         // See if we have enough to get a frame header
-        size_t buffamt = ringbuf_handler->GetReadBufferUsed();
+        size_t buffamt = rbh->GetReadBufferUsed();
 
         if (buffamt < sizeof(kismet_external_frame_t)) {
             return;
         }
 
-        // Peek at the header
-        buffamt = ringbuf_handler->PeekReadBufferData((void **) &frame, buffamt);
+        // Peek at the header only; peeking the whole buffer would force a copy
+        // of everything queued whenever the data wraps around the ring
+        buffamt = rbh->PeekReadBufferData((void **) &frame, 
+                sizeof(kismet_external_frame_t));
 
         // Make sure we got the right amount
         if (buffamt < sizeof(kismet_external_frame_t)) {
-            ringbuf_handler->PeekFreeReadBufferData(frame);
+            rbh->PeekFreeReadBufferData(frame);
             return;
         }
 
         // Check the frame signature
         if (kis_ntoh32(frame->signature) != KIS_EXTERNAL_PROTO_SIG) {
-            ringbuf_handler->PeekFreeReadBufferData(frame);
+            rbh->PeekFreeReadBufferData(frame);
 
             _MSG("Kismet external interface got command frame with invalid signature", MSGFLAG_ERROR);
             trigger_error("Invalid signature on command frame");
@@ -132,15 +213,15 @@ void KisExternalInterface::BufferAvailable(size_t in_amt __attribute__((unused))
         data_sz = kis_ntoh32(frame->data_sz);
         frame_sz = data_sz + sizeof(kismet_external_frame);
 
-        // If we'll never be able to read it, blow up
-        if ((long int) frame_sz >= ringbuf_handler->GetReadBufferSize()) {
-            ringbuf_handler->PeekFreeReadBufferData(frame);
+        rbh->PeekFreeReadBufferData(frame);
 
+        // If we'll never be able to read it, blow up
+        if ((long int) frame_sz >= rbh->GetReadBufferSize()) {
             std::stringstream ss;
 
             ss << "Kismet external interface got command frame which is too large to "
                 "be processed (" << frame_sz << " / " << 
-                ringbuf_handler->GetReadBufferAvailable() << "), this can happen when you "
+                rbh->GetReadBufferAvailable() << "), this can happen when you "
                 "are using an old remote capture tool, make sure you have updated your "
                 "systems.";
 
@@ -151,17 +232,23 @@ void KisExternalInterface::BufferAvailable(size_t in_amt __attribute__((unused))
         }
 
         // If we don't have the whole buffer available, bail on this read
-        if (frame_sz > buffamt) {
-            ringbuf_handler->PeekFreeReadBufferData(frame);
+        if (frame_sz > rbh->GetReadBufferUsed()) {
             // fprintf(stderr, "debug - external - read %lu needed %u\n", buffamt, frame_sz);
             return;
         }
 
+        buffamt = rbh->PeekReadBufferData((void **) &frame, frame_sz);
+
+        if (buffamt < frame_sz) {
+            rbh->PeekFreeReadBufferData(frame);
+            return;
+        }
+
         // We have a complete payload, checksum 
         data_checksum = Adler32Checksum((const char *) frame->data, data_sz);
 
         if (data_checksum != kis_ntoh32(frame->data_checksum)) {
-            ringbuf_handler->PeekFreeReadBufferData(frame);
+            rbh->PeekFreeReadBufferData(frame);
 
             _MSG("Kismet external interface got command frame with invalid checksum",
                     MSGFLAG_ERROR);
@@ -170,11 +257,38 @@ void KisExternalInterface::BufferAvailable(size_t in_amt __attribute__((unused))
             return;
         }
 
+        // Pick the command header out of the frame in place and offer the
+        // content to the fast path before paying for a full parse, which 
+        // would copy the content into the Command
+        kis_protobuf_wire wire(frame->data, data_sz);
+        std::string wire_command;
+        uint32_t wire_seqno = 0;
+        const uint8_t *wire_content = nullptr;
+        size_t wire_content_sz = 0;
+
+        while (wire.next()) {
+            if (wire.field() == 1 && wire.wiretype() == 2)
+                wire_command.assign((const char *) wire.data(), wire.length());
+            else if (wire.field() == 2 && wire.wiretype() == 0)
+                wire_seqno = wire.varint();
+            else if (wire.field() == 3 && wire.wiretype() == 2) {
+                wire_content = wire.data();
+                wire_content_sz = wire.length();
+            }
+        }
+
+        if (!wire.error() && wire_command.length() != 0 && wire_content != nullptr &&
+                dispatch_rx_inplace(wire_command, wire_seqno, wire_content, wire_content_sz)) {
+            rbh->PeekFreeReadBufferData(frame);
+            rbh->ConsumeReadBufferData(frame_sz);
+            continue;
+        }
+
         // Process the data payload as a protobuf frame
         std::shared_ptr<KismetExternal::Command> cmd(new KismetExternal::Command());
 
         if (!cmd->ParseFromArray(frame->data, data_sz)) {
-            ringbuf_handler->PeekFreeReadBufferData(frame);
+            rbh->PeekFreeReadBufferData(frame);
 
             _MSG("Kismet external interface could not interpret the payload of the "
                     "command frame", MSGFLAG_ERROR);
@@ -185,10 +299,9 @@ void KisExternalInterface::BufferAvailable(size_t in_amt __attribute__((unused))
 
         // fprintf(stderr, "debug - KISEXTERNALAPI got command '%s' seq %u sz %lu\n", cmd->command().c_str(), cmd->seqno(), cmd->content().length());
 
-        // Consume the buffer now that we're done; we only consume the 
-        // frame size because we could have peeked a much larger buffer
-        ringbuf_handler->PeekFreeReadBufferData(frame);
-        ringbuf_handler->ConsumeReadBufferData(frame_sz);
+        // Consume the frame now that we're done with it
+        rbh->PeekFreeReadBufferData(frame);
+        rbh->ConsumeReadBufferData(frame_sz);
 
         // Dispatch the received command
         dispatch_rx_packet(cmd);
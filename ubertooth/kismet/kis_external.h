@@ -45,6 +45,50 @@ namespace KismetExternal {
     class Command;
 };
 
+// Minimal reader for the protobuf wire format, used to pick fields out of
+// frames still sitting in the ringbuffer without copying them into a message
+class kis_protobuf_wire {
+public:
+    kis_protobuf_wire(const uint8_t *in_buf, size_t in_sz) :
+        buf(in_buf), sz(in_sz), pos(0), start(0), 
+        f_num(0), f_type(0), f_varint(0), f_data(nullptr), f_len(0),
+        err(false) { }
+
+    // Step to the next field; returns false at the end of the buffer or if the
+    // buffer is malformed (check error())
+    bool next();
+
+    uint32_t field() const { return f_num; }
+    unsigned int wiretype() const { return f_type; }
+
+    // Value of a varint field
+    uint64_t varint() const { return f_varint; }
+
+    // Contents of a length-delimited field
+    const uint8_t *data() const { return f_data; }
+    size_t length() const { return f_len; }
+
+    // Span of the whole field, including the tag
+    size_t field_start() const { return start; }
+    size_t field_end() const { return pos; }
+
+    bool error() const { return err; }
+
+protected:
+    bool read_varint(uint64_t *out);
+
+    const uint8_t *buf;
+    size_t sz, pos, start;
+
+    uint32_t f_num;
+    unsigned int f_type;
+    uint64_t f_varint;
+    const uint8_t *f_data;
+    size_t f_len;
+
+    bool err;
+};
+
 struct KisExternalHttpSession {
     Kis_Net_Httpd_Connection *connection; 
     std::shared_ptr<conditional_locker<int> > locker;
@@ -96,6 +140,17 @@ protected:
     // Central packet dispatch handler
     virtual bool dispatch_rx_packet(std::shared_ptr<KismetExternal::Command> c);
 
+    // Fast path for high-volume commands, called with the command content still
+    // in the ringbuffer; the content is only valid for the duration of the call.
+    // Returns false if the command isn't handled here, in which case it is
+    // parsed and passed to dispatch_rx_packet
+    virtual bool dispatch_rx_inplace(const std::string& in_command __attribute__((unused)),
+            uint32_t in_seqno __attribute__((unused)), 
+            const uint8_t *in_content __attribute__((unused)), 
+            size_t in_sz __attribute__((unused))) {
+        return false;
+    }
+
     // Generic msg proxy
     virtual void handle_msg_proxy(const std::string& msg, const int msgtype) = 0; 
 
@@ -185,6 +185,24 @@ Kis_Net_Httpd::Kis_Net_Httpd(GlobalRegistry *in_globalreg) {
     session_timeout = 
         globalreg->kismet_config->FetchOptUInt("httpd_session_timeout", 7200);
 
+    pool_threads = 
+        globalreg->kismet_config->FetchOptUInt("httpd_pool_threads", 0);
+    max_connections =
+        globalreg->kismet_config->FetchOptUInt("httpd_max_connections", 0);
+    max_connections_per_ip =
+        globalreg->kismet_config->FetchOptUInt("httpd_max_connections_per_ip", 0);
+    connection_timeout =
+        globalreg->kismet_config->FetchOptUInt("httpd_connection_timeout", 0);
+
+    generator_max =
+        globalreg->kismet_config->FetchOptUInt("httpd_generator_threads", 16);
+    if (generator_max == 0)
+        generator_max = 1;
+    generator_idle = 0;
+    generator_shutdown = false;
+
+    active_requests = 0;
+
     use_ssl = globalreg->kismet_config->FetchOptBoolean("httpd_ssl", false);
     pem_path = globalreg->kismet_config->FetchOpt("httpd_ssl_cert");
     key_path = globalreg->kismet_config->FetchOpt("httpd_ssl_key");
@@ -279,6 +297,9 @@ Kis_Net_Httpd::~Kis_Net_Httpd() {
     // Wipe out all handlers
     handler_vec.erase(handler_vec.begin(), handler_vec.end());
 
+    // Finish the generators while the server can still drain their buffers
+    stop_generators();
+
     if (running)
         StopHttpd();
 
@@ -420,20 +441,51 @@ int Kis_Net_Httpd::StartHttpd() {
     }
 
 
-    if (!use_ssl) {
-        microhttpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION,
-                http_port, NULL, NULL, 
-                &http_request_handler, this, 
-                MHD_OPTION_NOTIFY_COMPLETED, &http_request_completed, NULL,
-                MHD_OPTION_END); 
+    std::vector<struct MHD_OptionItem> options;
+
+    options.push_back({MHD_OPTION_NOTIFY_COMPLETED, (intptr_t) &http_request_completed, NULL});
+
+    if (use_ssl) {
+        options.push_back({MHD_OPTION_HTTPS_MEM_KEY, 0, cert_key});
+        options.push_back({MHD_OPTION_HTTPS_MEM_CERT, 0, cert_pem});
+    }
+
+    if (max_connections != 0)
+        options.push_back({MHD_OPTION_CONNECTION_LIMIT, (intptr_t) max_connections, NULL});
+
+    if (max_connections_per_ip != 0)
+        options.push_back({MHD_OPTION_PER_IP_CONNECTION_LIMIT, 
+                (intptr_t) max_connections_per_ip, NULL});
+
+    if (connection_timeout != 0)
+        options.push_back({MHD_OPTION_CONNECTION_TIMEOUT, (intptr_t) connection_timeout, NULL});
+
+    unsigned int flags;
+
+    if (pool_threads == 0) {
+        flags = MHD_USE_THREAD_PER_CONNECTION;
     } else {
-        microhttpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_USE_SSL,
-                http_port, NULL, NULL, &http_request_handler, this, 
-                MHD_OPTION_HTTPS_MEM_KEY, cert_key,
-                MHD_OPTION_HTTPS_MEM_CERT, cert_pem,
-                MHD_OPTION_END); 
+        // A fixed pool of threads polls all the connections; streaming responses
+        // suspend their connection while they wait for data instead of holding a
+        // thread
+        flags = MHD_USE_SELECT_INTERNALLY | MHD_USE_SUSPEND_RESUME;
+#ifdef SYS_LINUX
+        flags |= MHD_USE_EPOLL_LINUX_ONLY;
+#endif
+
+        options.push_back({MHD_OPTION_THREAD_POOL_SIZE, (intptr_t) pool_threads, NULL});
     }
 
+    if (use_ssl)
+        flags |= MHD_USE_SSL;
+
+    options.push_back({MHD_OPTION_END, 0, NULL});
+
+    microhttpd = MHD_start_daemon(flags, http_port, NULL, NULL, 
+            &http_request_handler, this, 
+            MHD_OPTION_ARRAY, options.data(),
+            MHD_OPTION_END); 
+
 
     if (microhttpd == NULL) {
         _MSG("Failed to start http server on port " + UIntToString(http_port),
@@ -446,7 +498,17 @@ int Kis_Net_Httpd::StartHttpd() {
 
     running = true;
 
-    _MSG("Started http server on port " + UIntToString(http_port), MSGFLAG_INFO);
+    if (pool_threads == 0)
+        _MSG("Started http server on port " + UIntToString(http_port), MSGFLAG_INFO);
+    else
+        _MSG("Started http server on port " + UIntToString(http_port) + " with " +
+                UIntToString(pool_threads) + " server threads", MSGFLAG_INFO);
+
+    metrics_endp =
+        std::make_shared<Kis_Net_Httpd_Simple_Tracked_Endpoint>("/system/httpd", false,
+                [this]() -> std::shared_ptr<TrackerElement> {
+                    return metrics_endp_handler();
+                });
 
     return 1;
 }
@@ -614,6 +676,9 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         concls->url = std::string(url);
         concls->connection = connection;
 
+        if (handler != NULL)
+            kishttpd->active_requests++;
+
         // Normally we'd build the post processor and read in the post data; if we don't have a handler,
         // we don't do that
         if (handler != NULL) {
@@ -730,12 +795,18 @@ int Kis_Net_Httpd::http_post_handler(void *coninfo_cls, enum MHD_ValueKind kind,
 void Kis_Net_Httpd::http_request_completed(void *cls __attribute__((unused)), 
         struct MHD_Connection *connection __attribute__((unused)),
         void **con_cls, 
-        enum MHD_RequestTerminationCode toe __attribute__((unused))) {
+        enum MHD_RequestTerminationCode toe) {
     Kis_Net_Httpd_Connection *con_info = (Kis_Net_Httpd_Connection *) *con_cls;
 
     if (con_info == NULL)
         return;
 
+    // Only requests handled by an endpoint are counted; static files would
+    // drown out everything else
+    if (con_info->httpdhandler != NULL && con_info->httpd != NULL)
+        con_info->httpd->record_request(con_info, 
+                con_info->httpcode >= 400 || toe != MHD_REQUEST_TERMINATED_COMPLETED_OK);
+
     // Lock and shut it down
     {
         std::lock_guard<std::mutex> lk(con_info->connection_mutex);
@@ -751,6 +822,218 @@ void Kis_Net_Httpd::http_request_completed(void *cls __attribute__((unused)),
     delete(con_info);
 }
 
+void Kis_Net_Httpd::record_request(Kis_Net_Httpd_Connection *in_connection, bool in_error) {
+    active_requests--;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - in_connection->start_time).count();
+
+    // Group by the first two components of the path, so that per-device and 
+    // per-source URIs land in the same bucket; if the second is the last it's
+    // the file and loses its format suffix
+    std::string key;
+    size_t start = 0;
+
+    for (unsigned int c = 0; c < 2; c++) {
+        size_t pos = in_connection->url.find('/', start + 1);
+
+        if (pos == std::string::npos) {
+            key = in_connection->url.substr(0, in_connection->url.find('.', start));
+            break;
+        }
+
+        key = in_connection->url.substr(0, pos);
+        start = pos;
+    }
+
+    local_locker lock(&metrics_mutex);
+
+    auto stats = endpoint_stats_map.find(key);
+
+    if (stats == endpoint_stats_map.end()) {
+        // Don't let a client grow the map forever with random paths
+        if (endpoint_stats_map.size() >= 256)
+            key = "other";
+
+        stats = endpoint_stats_map.emplace(key, endpoint_stats {0, 0, 0, 0}).first;
+    }
+
+    stats->second.requests++;
+
+    if (in_error)
+        stats->second.errors++;
+
+    stats->second.total_usec += elapsed;
+
+    if ((uint64_t) elapsed > stats->second.max_usec)
+        stats->second.max_usec = elapsed;
+}
+
+std::shared_ptr<TrackerElement> Kis_Net_Httpd::metrics_endp_handler() {
+    auto entrytracker = Globalreg::globalreg->entrytracker;
+
+    auto ret = std::make_shared<TrackerElementMap>();
+
+    auto mode = 
+        entrytracker->RegisterAndGetFieldAs<TrackerElementString>("kismet.httpd.mode",
+                TrackerElementFactory<TrackerElementString>(),
+                "HTTP server threading mode (thread, pool)");
+    mode->set(pool_threads == 0 ? "thread" : "pool");
+    ret->insert(mode);
+
+    auto pool =
+        entrytracker->RegisterAndGetFieldAs<TrackerElementUInt32>("kismet.httpd.pool_threads",
+                TrackerElementFactory<TrackerElementUInt32>(),
+                "HTTP server pool threads");
+    pool->set(pool_threads);
+    ret->insert(pool);
+
+    auto active =
+        entrytracker->RegisterAndGetFieldAs<TrackerElementUInt32>("kismet.httpd.active_requests",
+                TrackerElementFactory<TrackerElementUInt32>(),
+                "Endpoint requests in progress");
+    active->set(active_requests);
+    ret->insert(active);
+
+    {
+        std::lock_guard<std::mutex> lk(generator_mutex);
+
+        auto gen_threads =
+            entrytracker->RegisterAndGetFieldAs<TrackerElementUInt32>("kismet.httpd.generator_threads",
+                    TrackerElementFactory<TrackerElementUInt32>(),
+                    "Response generator threads");
+        gen_threads->set(generator_threads.size());
+        ret->insert(gen_threads);
+
+        auto gen_queue =
+            entrytracker->RegisterAndGetFieldAs<TrackerElementUInt32>("kismet.httpd.generator_queue",
+                    TrackerElementFactory<TrackerElementUInt32>(),
+                    "Responses waiting for a generator thread");
+        gen_queue->set(generator_queue.size());
+        ret->insert(gen_queue);
+    }
+
+    auto endpoints =
+        entrytracker->RegisterAndGetFieldAs<TrackerElementStringMap>("kismet.httpd.endpoints",
+                TrackerElementFactory<TrackerElementStringMap>(),
+                "Request metrics by endpoint");
+    ret->insert(endpoints);
+
+    int requests_id =
+        entrytracker->RegisterField("kismet.httpd.endpoint.requests",
+                TrackerElementFactory<TrackerElementUInt64>(), "Completed requests");
+    int errors_id =
+        entrytracker->RegisterField("kismet.httpd.endpoint.errors",
+                TrackerElementFactory<TrackerElementUInt64>(), 
+                "Requests which failed or were aborted");
+    int total_id =
+        entrytracker->RegisterField("kismet.httpd.endpoint.total_usec",
+                TrackerElementFactory<TrackerElementUInt64>(), 
+                "Total time spent on requests (microseconds)");
+    int max_id =
+        entrytracker->RegisterField("kismet.httpd.endpoint.max_usec",
+                TrackerElementFactory<TrackerElementUInt64>(), 
+                "Longest request (microseconds)");
+    int avg_id =
+        entrytracker->RegisterField("kismet.httpd.endpoint.avg_usec",
+                TrackerElementFactory<TrackerElementUInt64>(), 
+                "Average request (microseconds)");
+
+    local_locker lock(&metrics_mutex);
+
+    for (auto s : endpoint_stats_map) {
+        auto e = std::make_shared<TrackerElementMap>();
+
+        e->insert(std::make_shared<TrackerElementUInt64>(requests_id, s.second.requests));
+        e->insert(std::make_shared<TrackerElementUInt64>(errors_id, s.second.errors));
+        e->insert(std::make_shared<TrackerElementUInt64>(total_id, s.second.total_usec));
+        e->insert(std::make_shared<TrackerElementUInt64>(max_id, s.second.max_usec));
+        e->insert(std::make_shared<TrackerElementUInt64>(avg_id, 
+                    s.second.requests == 0 ? 0 : s.second.total_usec / s.second.requests));
+
+        endpoints->insert(s.first, e);
+    }
+
+    return ret;
+}
+
+void Kis_Net_Httpd::QueueGenerator(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux,
+        std::function<void ()> in_generator) {
+    std::unique_lock<std::mutex> lk(generator_mutex);
+
+    if (generator_shutdown) {
+        lk.unlock();
+        in_aux->trigger_error();
+        in_aux->generator_complete();
+        return;
+    }
+
+    generator_queue.push_back(generator_job {in_aux, in_generator});
+
+    // Generators can block on a full buffer until the client reads, so only
+    // reuse an idle worker; queue behind the busy ones once we're at the limit
+    if (generator_idle == 0 && generator_threads.size() < generator_max)
+        generator_threads.push_back(std::thread([this]() { generator_worker(); }));
+    else
+        generator_cv.notify_one();
+}
+
+void Kis_Net_Httpd::generator_worker() {
+    std::unique_lock<std::mutex> lk(generator_mutex);
+
+    while (1) {
+        if (generator_queue.size() == 0) {
+            if (generator_shutdown)
+                return;
+
+            generator_idle++;
+            generator_cv.wait(lk);
+            generator_idle--;
+            continue;
+        }
+
+        auto job = generator_queue.front();
+        generator_queue.pop_front();
+
+        lk.unlock();
+
+        // A generator which throws is treated as the end of the stream
+        try {
+            job.generator();
+        } catch (const std::exception& e) {
+            job.aux->sync();
+            job.aux->trigger_error();
+        }
+
+        job.aux->generator_complete();
+
+        lk.lock();
+    }
+}
+
+void Kis_Net_Httpd::stop_generators() {
+    std::deque<generator_job> pending;
+
+    {
+        std::lock_guard<std::mutex> lk(generator_mutex);
+        generator_shutdown = true;
+        pending.swap(generator_queue);
+        generator_cv.notify_all();
+    }
+
+    // Anything which never got a thread ends now
+    for (auto j : pending) {
+        j.aux->trigger_error();
+        j.aux->generator_complete();
+    }
+
+    for (auto& t : generator_threads)
+        if (t.joinable())
+            t.join();
+
+    generator_threads.clear();
+}
+
 static ssize_t file_reader(void *cls, uint64_t pos, char *buf, size_t max) {
     FILE *file = (FILE *) cls;
 
@@ -1235,7 +1518,10 @@ Kis_Net_Httpd_Buffer_Stream_Aux::Kis_Net_Httpd_Buffer_Stream_Aux(
     ringbuf_handler(in_ringbuf_handler),
     in_error(false),
     aux(in_aux),
-    free_aux_cb(in_free_aux) {
+    free_aux_cb(in_free_aux),
+    generator_done(true),
+    mhd_connection(NULL),
+    suspended(false) {
 
     httpd_stream_handler = in_handler;
     httpd_connection = in_httpd_connection;
@@ -1272,6 +1558,43 @@ void Kis_Net_Httpd_Buffer_Stream_Aux::BufferAvailable(size_t in_amt __attribute_
     // buffer_event_cb callback will unlock and read from the buffer, then
     // re-lock and block
     cl->unlock(1);
+
+    resume_connection();
+}
+
+bool Kis_Net_Httpd_Buffer_Stream_Aux::suspend_until_data(std::shared_ptr<BufferHandlerGeneric> rbh) {
+    local_locker lock(&aux_mutex);
+
+    if (rbh->GetWriteBufferUsed() || get_in_error())
+        return false;
+
+    // Checked and suspended under the same lock that BufferAvailable and 
+    // trigger_error resume under, so a write can't slip in between
+    suspended = true;
+    MHD_suspend_connection(mhd_connection);
+
+    return true;
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::resume_connection() {
+    local_locker lock(&aux_mutex);
+
+    if (!suspended)
+        return;
+
+    suspended = false;
+    MHD_resume_connection(mhd_connection);
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::generator_complete() {
+    std::lock_guard<std::mutex> lk(generator_mutex);
+    generator_done = true;
+    generator_cv.notify_all();
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::wait_generator() {
+    std::unique_lock<std::mutex> lk(generator_mutex);
+    generator_cv.wait(lk, [this]() { return generator_done; });
 }
 
 void Kis_Net_Httpd_Buffer_Stream_Aux::block_until_data(std::shared_ptr<BufferHandlerGeneric> rbh) {
@@ -1280,7 +1603,7 @@ void Kis_Net_Httpd_Buffer_Stream_Aux::block_until_data(std::shared_ptr<BufferHan
             local_locker lock(&aux_mutex);
 
             // Immediately return if we have pending data
-            if (rbh->GetReadBufferUsed()) {
+            if (rbh->GetWriteBufferUsed()) {
                 return;
             }
 
@@ -1323,7 +1646,14 @@ ssize_t Kis_Net_Httpd_Buffer_Stream_Handler::buffer_event_cb(void *cls, uint64_t
     while (read_sz == 0) {
         // We get called as soon as the webserver has either a) processed our request
         // or b) sent what we gave it; we need to hold the thread until we
-        // get more data in the buf, so we block until we have data
+        // get more data in the buf, so we block until we have data.  A pool thread
+        // can't be held, so suspend the connection and tell the server there's 
+        // nothing yet; we're called again once it's resumed.
+        if (stream_aux->mhd_connection != NULL && stream_aux->suspend_until_data(rbh)) {
+            stream_aux->get_buffer_event_mutex()->unlock();
+            return 0;
+        }
+
         stream_aux->block_until_data(rbh);
 
         read_sz = rbh->ZeroCopyPeekWriteBufferData((void **) &zbuf, max);
@@ -1385,8 +1715,8 @@ static void free_buffer_aux_callback(void *cls) {
 
     aux->get_buffer_event_mutex()->unlock();
 
-    // Get the thread that's generating data
-    aux->generator_thread.join();
+    // Wait for the generator to finish with the stream
+    aux->wait_generator();
 
     if (aux->free_aux_cb != NULL) {
         aux->free_aux_cb(aux);
@@ -1412,40 +1742,28 @@ int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandleGetRequest(Kis_Net_Httpd *h
             new Kis_Net_Httpd_Buffer_Stream_Aux(this, connection, rbh, NULL, NULL);
         connection->custom_extension = aux;
 
-        // Set up a locker to make sure the thread is up and running
-        conditional_locker<int> cl;
-        cl.lock();
+        if (httpd->UsingThreadPool())
+            aux->mhd_connection = connection->connection;
 
-        // Run it in its own thread and set up the connection streaming object; we MUST pass
-        // the aux as a direct pointer because the microhttpd backend can delete the 
+        // Run it in the generator pool and set up the connection streaming object; we MUST 
+        // pass the aux as a direct pointer because the microhttpd backend can delete the 
         // connection BEFORE calling our cleanup on our response!
-        aux->generator_thread =
-            std::thread([this, &cl, aux, httpd, connection, url, method, 
-                    upload_data, upload_data_size] {
-                // Unlock the http thread as soon as we've spawned it
-                cl.unlock(1);
+        aux->generator_done = false;
 
+        httpd->QueueGenerator(aux, 
+            [this, aux, httpd, connection, url, method, upload_data, upload_data_size] {
                 // Trigger 'error' when the function is complete & returns a 'complete' value;
                 // causing us to finish the stream; if the stream returns a MHD_NO we expect
                 // it to close its stream itself later; if we have an exception, treat it as
                 // the stream closing
-                try {
-                    int r = Httpd_CreateStreamResponse(httpd, connection, url, method, upload_data,
-                            upload_data_size);
+                int r = Httpd_CreateStreamResponse(httpd, connection, url, method, upload_data,
+                        upload_data_size);
 
-                    if (r == MHD_YES) {
-                        aux->sync();
-                        aux->trigger_error();
-                    }
-                } catch (const std::exception& e) {
+                if (r == MHD_YES) {
                     aux->sync();
                     aux->trigger_error();
                 }
-
-                });
-
-        // We unlock when the generator thread has started
-        cl.block_until();
+            });
 
         connection->response = 
             MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32 * 1024,
@@ -1477,34 +1795,23 @@ int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandlePostRequest(Kis_Net_Httpd *
 
         // fprintf(stderr, "debug - made post aux %p\n", aux);
 
+        if (httpd->UsingThreadPool())
+            aux->mhd_connection = connection->connection;
+
         // Call the post complete and populate our stream;
-        // Run it in its own thread and set up the connection streaming object; we MUST pass
-        // the aux as a direct pointer because the microhttpd backend can delete the 
+        // Run it in the generator pool and set up the connection streaming object; we MUST 
+        // pass the aux as a direct pointer because the microhttpd backend can delete the 
         // connection BEFORE calling our cleanup on our response!
-        //
-        // Set up a locker to make sure the thread is up and running
-        conditional_locker<int> cl;
-        cl.lock();
-
-        aux->generator_thread =
-            std::thread([this, &cl, aux, connection] {
-                cl.unlock(1);
-
-                try {
-                    int r = Httpd_PostComplete(connection);
-                    if (r == MHD_YES) {
-                        // fprintf(stderr, "debug - triggering complete\n");
-                        aux->sync();
-                        aux->trigger_error();
-                    }
-                } catch (const std::exception& e) {
-                    // fprintf(stderr, "debug - exception - triggering error\n");
+        aux->generator_done = false;
+
+        httpd->QueueGenerator(aux, [this, aux, connection] {
+                int r = Httpd_PostComplete(connection);
+                if (r == MHD_YES) {
+                    // fprintf(stderr, "debug - triggering complete\n");
                     aux->sync();
                     aux->trigger_error();
                 }
-                });
-
-        cl.block_until();
+            });
 
         connection->response = 
             MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32 * 1024,
@@ -22,10 +22,14 @@
 #include "config.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <stdio.h>
 #include <time.h>
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -85,6 +89,7 @@ public:
         connection = NULL;
         response = NULL;
         custom_extension = NULL;
+        start_time = std::chrono::steady_clock::now();
     }
 
     // response generated by post
@@ -152,6 +157,9 @@ public:
 
     // Integrity locker
     std::mutex connection_mutex;
+
+    // When the request arrived, for the endpoint latency metrics
+    std::chrono::steady_clock::time_point start_time;
 };
 
 class Kis_Net_Httpd_Session {
@@ -411,6 +419,7 @@ public:
     void trigger_error() {
         in_error = true;
         cl->unlock(0);
+        resume_connection();
     }
 
     void set_aux(void *in_aux, 
@@ -444,6 +453,18 @@ public:
     // session)
     void block_until_data(std::shared_ptr<BufferHandlerGeneric> rbh);
 
+    // Thread pool equivalent of block_until_data; if there's nothing to send yet,
+    // suspend the connection so the pool thread can serve others, and return true.
+    // The connection is resumed as soon as data is written or the stream ends.
+    bool suspend_until_data(std::shared_ptr<BufferHandlerGeneric> rbh);
+    void resume_connection();
+
+    // Called once the generator has finished, or will never run
+    void generator_complete();
+
+    // Wait for the generator to finish before tearing down the stream
+    void wait_generator();
+
     // Get the buffer event mutex
     kis_recursive_timed_mutex *get_buffer_event_mutex() {
         return &buffer_event_mutex;
@@ -468,9 +489,6 @@ public:
     // Are we in error?
     std::atomic<bool> in_error;
 
-    // Possible worker thread for processing the buffer fill
-    std::thread generator_thread;
-
     // Additional arbitrary data - Used by the buffer streamer to store the
     // buffer processor, and by the CPP Streamer to store the streambuf
     void *aux;
@@ -481,6 +499,17 @@ public:
     // Sync function; called to make sure the buffer is flushed and fully synced 
     // prior to flagging it complete
     std::function<void (Kis_Net_Httpd_Buffer_Stream_Aux *)> sync_cb;
+
+    // Completion of the generator filling the buffer, which runs in the httpd
+    // generator pool
+    std::mutex generator_mutex;
+    std::condition_variable generator_cv;
+    bool generator_done;
+
+    // Connection to suspend while waiting for data, when the server runs a thread
+    // pool; null when each connection has its own thread and can simply block
+    struct MHD_Connection *mhd_connection;
+    bool suspended;
     
 };
 
@@ -678,6 +707,15 @@ public:
     static void MHD_Panic(void *cls, const char *file, unsigned int line,
             const char *reason);
 
+    // Are connections served by a thread pool instead of a thread each?  Handlers 
+    // must not block a pool thread waiting for data.
+    bool UsingThreadPool() { return pool_threads != 0; }
+
+    // Run a response generator for a buffer stream in the generator pool.  The
+    // stream aux is told when the generator has finished, or, if the server shuts
+    // down first, that it will never run.
+    void QueueGenerator(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux, std::function<void ()> in_generator);
+
 protected:
     GlobalRegistry *globalreg;
 
@@ -745,6 +783,43 @@ protected:
     std::shared_ptr<Kis_Httpd_Websession> websession;
     unsigned int session_timeout;
 
+    // Server threading and connection limits; a pool size of 0 runs a thread per
+    // connection
+    unsigned int pool_threads;
+    unsigned int max_connections, max_connections_per_ip, connection_timeout;
+
+    // Response generator pool; workers are started as they're needed, up to the max
+    struct generator_job {
+        Kis_Net_Httpd_Buffer_Stream_Aux *aux;
+        std::function<void ()> generator;
+    };
+
+    void generator_worker();
+    void stop_generators();
+
+    std::mutex generator_mutex;
+    std::condition_variable generator_cv;
+    std::deque<generator_job> generator_queue;
+    std::vector<std::thread> generator_threads;
+    unsigned int generator_max, generator_idle;
+    bool generator_shutdown;
+
+    // Per-endpoint latency metrics, keyed by the first two components of the URI
+    struct endpoint_stats {
+        uint64_t requests;
+        uint64_t errors;
+        uint64_t total_usec;
+        uint64_t max_usec;
+    };
+
+    void record_request(Kis_Net_Httpd_Connection *in_connection, bool in_error);
+    std::shared_ptr<TrackerElement> metrics_endp_handler();
+
+    kis_recursive_timed_mutex metrics_mutex;
+    std::unordered_map<std::string, endpoint_stats> endpoint_stats_map;
+    std::atomic<unsigned int> active_requests;
+    std::shared_ptr<Kis_Net_Httpd_Simple_Tracked_Endpoint> metrics_endp;
+
 };
 
 #endif
@@ -72,11 +72,13 @@
 #include "datasource_rtl433.h"
 #include "datasource_freaklabs_zigbee.h"
 #include "datasource_nrf_mousejack.h"
+#include "datasource_ubertooth_one.h"
 
 #include "logtracker.h"
 #include "kis_ppilogfile.h"
 #include "kis_databaselogfile.h"
 #include "kis_pcapnglogfile.h"
+#include "kis_columnlogfile.h"
 
 #include "timetracker.h"
 #include "alertracker.h"
@@ -97,6 +99,7 @@
 #include "phy_bluetooth.h"
 #include "phy_uav_drone.h"
 #include "phy_nrf_mousejack.h"
+#include "phy_ubertooth_one.h"
 
 #include "ipc_remote2.h"
 
@@ -227,6 +230,10 @@ void SpindownKismet(std::shared_ptr<PollableTracker> pollabletracker) {
     // Eat the child signal handler
     signal(SIGCHLD, SIG_DFL);
 
+    // Stop running timers before anything starts shutting down under them
+    if (globalregistry->timetracker != NULL)
+        globalregistry->timetracker->StopTimers();
+
     // Shut down the webserver first
     auto httpd = Globalreg::FetchGlobalAs<Kis_Net_Httpd>("HTTPD_SERVER");
     if (httpd != NULL)
@@ -239,6 +246,11 @@ void SpindownKismet(std::shared_ptr<PollableTracker> pollabletracker) {
         devicetracker->databaselog_write_devices();
     }
 
+    auto databaselog =
+        Globalreg::FetchGlobalAs<KisDatabaseLogfile>("DATABASELOG");
+    if (databaselog != NULL)
+        databaselog->checkpoint_devices();
+
     // Shutdown everything
     globalregistry->Shutdown_Deferred();
     globalregistry->spindown = 1;
@@ -1004,6 +1016,7 @@ int main(int argc, char *argv[], char *envp[]) {
     Globalreg::FetchMandatoryGlobalAs<Devicetracker>()->RegisterPhyHandler(new Kis_Bluetooth_Phy(globalregistry));
     Globalreg::FetchMandatoryGlobalAs<Devicetracker>()->RegisterPhyHandler(new Kis_UAV_Phy(globalregistry));
     Globalreg::FetchMandatoryGlobalAs<Devicetracker>()->RegisterPhyHandler(new Kis_Mousejack_Phy(globalregistry));
+    Globalreg::FetchMandatoryGlobalAs<Devicetracker>()->RegisterPhyHandler(new Kis_Ubertooth_One_Phy(globalregistry));
 
     if (globalregistry->fatal_condition) 
         SpindownKismet(pollabletracker);
@@ -1017,6 +1030,7 @@ int main(int argc, char *argv[], char *envp[]) {
     datasourcetracker->register_datasource(SharedDatasourceBuilder(new DatasourceRtl433MqttBuilder()));
     datasourcetracker->register_datasource(SharedDatasourceBuilder(new DatasourceFreaklabsZigbeeBuilder()));
     datasourcetracker->register_datasource(SharedDatasourceBuilder(new DatasourceNrfMousejackBuilder()));
+    datasourcetracker->register_datasource(SharedDatasourceBuilder(new DatasourceUbertoothOneBuilder()));
 
     // Create the database logger as a global because it's a special case
     KisDatabaseLogfile::create_kisdatabaselog();
@@ -1026,6 +1040,7 @@ int main(int argc, char *argv[], char *envp[]) {
     Globalreg::FetchMandatoryGlobalAs<LogTracker>()->register_log(SharedLogBuilder(new KisPPILogfileBuilder()));
     Globalreg::FetchMandatoryGlobalAs<LogTracker>()->register_log(SharedLogBuilder(new KisDatabaseLogfileBuilder()));
     Globalreg::FetchMandatoryGlobalAs<LogTracker>()->register_log(SharedLogBuilder(new KisPcapNGLogfileBuilder()));
+    Globalreg::FetchMandatoryGlobalAs<LogTracker>()->register_log(SharedLogBuilder(new KisColumnLogfileBuilder()));
 
     std::shared_ptr<Plugintracker> plugintracker;
 
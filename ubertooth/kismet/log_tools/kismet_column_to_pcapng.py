@@ -0,0 +1,301 @@
+#!/usr/bin/env python2
+
+# Extract packets from a Kismet columnar packet log (log type 'kiscolumn') as
+# pcapng, optionally limited to a time window, devices, or phy.  Segments which
+# can't contain matching packets are skipped using their index headers, and only
+# the columns needed to filter a segment are decompressed until it's known to
+# contain packets to extract.
+
+import argparse
+import bisect
+import datetime
+import os
+import struct
+import sys
+import zlib
+
+try:
+    from dateutil import parser as dateparser
+except Exception as e:
+    print("kismet_column_to_pcapng requires dateutil; please install it either via your distribution")
+    print("(python-dateutil) or via pip (pip install dateutil)")
+    sys.exit(1)
+
+SEGMENT_MAGIC = b"KISCSEG1"
+SEGMENT_VERSION = 1
+
+# magic, byteorder, version, count, num_columns, num_macs, min_signal, max_signal,
+# reserved, min_ts, max_ts, min_freq, max_freq
+HEADER_FMT = "8sIIIIIiiIqqQQ"
+COLUMN_FMT = "IIQQ"
+
+COLUMN_TS = 1
+COLUMN_PHY = 2
+COLUMN_DLT = 3
+COLUMN_SOURCE = 4
+COLUMN_DEST = 5
+COLUMN_SIGNAL = 6
+COLUMN_FREQ = 7
+COLUMN_LENGTH = 8
+COLUMN_DATA = 9
+COLUMN_PHYNAMES = 10
+
+COLUMN_TYPES = {
+    COLUMN_TS: "q",
+    COLUMN_PHY: "i",
+    COLUMN_DLT: "i",
+    COLUMN_SOURCE: "Q",
+    COLUMN_DEST: "Q",
+    COLUMN_SIGNAL: "i",
+    COLUMN_FREQ: "Q",
+    COLUMN_LENGTH: "I",
+}
+
+CODEC_RAW = 0
+CODEC_ZLIB = 1
+
+class Segment(object):
+    def __init__(self, path):
+        self.path = path
+        self.f = open(path, "rb")
+
+        raw = self.f.read(struct.calcsize("<" + HEADER_FMT))
+
+        if len(raw) != struct.calcsize("<" + HEADER_FMT) or raw[0:8] != SEGMENT_MAGIC:
+            raise ValueError("not a kismet column segment")
+
+        # Segments are in the byte order of the host which wrote them
+        if struct.unpack("<I", raw[8:12])[0] == 0x01020304:
+            self.endian = "<"
+        else:
+            self.endian = ">"
+
+        (_, _, version, self.count, num_columns, num_macs, self.min_signal,
+                self.max_signal, _, self.min_ts, self.max_ts, self.min_freq,
+                self.max_freq) = struct.unpack(self.endian + HEADER_FMT, raw)
+
+        if version != SEGMENT_VERSION:
+            raise ValueError("unsupported segment version {}".format(version))
+
+        self.macs = list(struct.unpack(self.endian + "{}Q".format(num_macs),
+            self.f.read(8 * num_macs)))
+
+        colsz = struct.calcsize(self.endian + COLUMN_FMT)
+        self.columns = {}
+        offt = self.f.tell() + colsz * num_columns
+
+        for c in range(num_columns):
+            (cid, codec, raw_len, stored_len) = struct.unpack(self.endian + COLUMN_FMT,
+                    self.f.read(colsz))
+            self.columns[cid] = (codec, raw_len, stored_len, offt)
+            offt = offt + stored_len
+
+        self.cache = {}
+
+    def has_mac(self, mac):
+        i = bisect.bisect_left(self.macs, mac)
+        return i < len(self.macs) and self.macs[i] == mac
+
+    def raw_column(self, cid):
+        (codec, raw_len, stored_len, offt) = self.columns[cid]
+
+        self.f.seek(offt)
+        data = self.f.read(stored_len)
+
+        if codec == CODEC_ZLIB:
+            data = zlib.decompress(data)
+
+        return data
+
+    def column(self, cid):
+        if cid in self.cache:
+            return self.cache[cid]
+
+        data = self.raw_column(cid)
+
+        if cid in COLUMN_TYPES:
+            data = struct.unpack(self.endian + "{}{}".format(self.count, COLUMN_TYPES[cid]), data)
+        elif cid == COLUMN_PHYNAMES:
+            data = data.decode("utf-8", "replace").split("\0")[:-1]
+
+        self.cache[cid] = data
+        return data
+
+    def close(self):
+        self.f.close()
+
+def mac_to_int(mac):
+    return int(mac.replace(":", "").replace("-", ""), 16)
+
+def int_to_mac(mac):
+    return ":".join("{:02X}".format((mac >> s) & 0xFF) for s in range(40, -8, -8))
+
+def parse_time(t):
+    try:
+        st = dateparser.parse(t, fuzzy = True)
+    except ValueError as e:
+        print("Could not extract a date/time from time argument:", e)
+        sys.exit(1)
+
+    return int((st - epoch).total_seconds() * 1000000)
+
+def pcapng_block(btype, body):
+    pad = (4 - (len(body) % 4)) % 4
+    blen = 12 + len(body) + pad
+    return struct.pack("<II", btype, blen) + body + (b"\0" * pad) + struct.pack("<I", blen)
+
+def pcapng_shb():
+    return pcapng_block(0x0A0D0D0A, struct.pack("<IHHq", 0x1A2B3C4D, 1, 0, -1))
+
+def pcapng_idb(dlt):
+    # Default timestamp resolution is microseconds, which matches the log
+    return pcapng_block(0x00000001, struct.pack("<HHI", dlt, 0, 0))
+
+def pcapng_epb(ifid, ts, frame):
+    return pcapng_block(0x00000006,
+            struct.pack("<IIIII", ifid, (ts >> 32) & 0xFFFFFFFF, ts & 0xFFFFFFFF,
+                len(frame), len(frame)) + frame)
+
+parser = argparse.ArgumentParser(description="Kismet Columnar Log to Pcap-NG")
+parser.add_argument("--in", action="store", dest="indir", help='Input (.kiscolumn) log directory')
+parser.add_argument("--out", action="store", dest="outfile", help='Output pcapng filename')
+parser.add_argument("--start-time", action="store", dest="starttime", help='Only packets after this time (optional)')
+parser.add_argument("--end-time", action="store", dest="endtime", help='Only packets before this time (optional)')
+parser.add_argument("--device", action="append", dest="devices", help='Only packets to or from this MAC address (optional, may be repeated)')
+parser.add_argument("--phy", action="store", dest="phy", help='Only packets from this phy, such as IEEE802.11 (optional)')
+parser.add_argument("--min-signal", action="store", type=int, dest="minsignal", help='Only packets at or above this signal level (optional)')
+parser.add_argument("--list", action="store_true", dest="listsegs", help='List the segments in the log instead of extracting packets')
+
+results = parser.parse_args()
+
+if results.indir is None:
+    print("Expected --in [log directory]")
+    sys.exit(1)
+
+if not os.path.isdir(results.indir):
+    print("Could not find input log directory '{}'".format(results.indir))
+    sys.exit(1)
+
+if results.outfile is None and not results.listsegs:
+    print("Expected --out [file] or --list")
+    sys.exit(1)
+
+epoch = datetime.datetime.utcfromtimestamp(0)
+
+start_ts = None
+end_ts = None
+
+if results.starttime:
+    start_ts = parse_time(results.starttime)
+
+if results.endtime:
+    end_ts = parse_time(results.endtime)
+
+devices = None
+
+if results.devices:
+    try:
+        devices = set(mac_to_int(d) for d in results.devices)
+    except ValueError as e:
+        print("Could not parse device MAC address:", e)
+        sys.exit(1)
+
+# Segments are named by partition start time and sequence
+def segment_order(n):
+    (part, seq) = n.split(".")[0].split("-")
+    return (int(part), int(seq))
+
+segfiles = sorted([n for n in os.listdir(results.indir) if n.endswith(".kcseg")], key = segment_order)
+
+if results.listsegs:
+    for n in segfiles:
+        seg = Segment(os.path.join(results.indir, n))
+        print("{}  {} packets  {} - {}  {} devices  signal {} to {}  freq {} to {} KHz".format(n,
+            seg.count,
+            datetime.datetime.utcfromtimestamp(seg.min_ts / 1000000.0),
+            datetime.datetime.utcfromtimestamp(seg.max_ts / 1000000.0),
+            len(seg.macs), seg.min_signal, seg.max_signal, seg.min_freq, seg.max_freq))
+        seg.close()
+    sys.exit(0)
+
+logf = open(results.outfile, "wb")
+logf.write(pcapng_shb())
+
+interfaces = {}
+npackets = 0
+nsegments = 0
+
+for n in segfiles:
+    seg = Segment(os.path.join(results.indir, n))
+
+    # Skip whole segments using the index header
+    if start_ts is not None and seg.max_ts < start_ts:
+        seg.close()
+        continue
+
+    if end_ts is not None and seg.min_ts > end_ts:
+        seg.close()
+        continue
+
+    if results.minsignal is not None and seg.max_signal < results.minsignal:
+        seg.close()
+        continue
+
+    if devices is not None and not any(seg.has_mac(d) for d in devices):
+        seg.close()
+        continue
+
+    # Narrow down the packets one column at a time
+    ts = seg.column(COLUMN_TS)
+    matches = range(seg.count)
+
+    if start_ts is not None:
+        matches = [i for i in matches if ts[i] >= start_ts]
+
+    if end_ts is not None:
+        matches = [i for i in matches if ts[i] <= end_ts]
+
+    if devices is not None and len(matches) > 0:
+        src = seg.column(COLUMN_SOURCE)
+        dst = seg.column(COLUMN_DEST)
+        matches = [i for i in matches if src[i] in devices or dst[i] in devices]
+
+    if results.minsignal is not None and len(matches) > 0:
+        sig = seg.column(COLUMN_SIGNAL)
+        matches = [i for i in matches if sig[i] >= results.minsignal]
+
+    if results.phy is not None and len(matches) > 0:
+        phy = seg.column(COLUMN_PHY)
+        names = seg.column(COLUMN_PHYNAMES)
+        matches = [i for i in matches if phy[i] >= 0 and phy[i] < len(names) and names[phy[i]] == results.phy]
+
+    if len(matches) == 0:
+        seg.close()
+        continue
+
+    nsegments = nsegments + 1
+
+    dlt = seg.column(COLUMN_DLT)
+    length = seg.column(COLUMN_LENGTH)
+    data = seg.raw_column(COLUMN_DATA)
+
+    offsets = []
+    offt = 0
+    for l in length:
+        offsets.append(offt)
+        offt = offt + l
+
+    for i in matches:
+        if not dlt[i] in interfaces:
+            interfaces[dlt[i]] = len(interfaces)
+            logf.write(pcapng_idb(dlt[i]))
+
+        logf.write(pcapng_epb(interfaces[dlt[i]], ts[i], data[offsets[i]:offsets[i] + length[i]]))
+        npackets = npackets + 1
+
+    seg.close()
+
+logf.close()
+
+print("Extracted {} packets from {} of {} segments".format(npackets, nsegments, len(segfiles)))
+
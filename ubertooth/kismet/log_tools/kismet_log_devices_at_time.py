@@ -0,0 +1,115 @@
+#!/usr/bin/env python2
+
+# Rebuild the state of devices at a given time from the device delta records
+# in a kismet log, and export them as a json array
+
+import argparse
+import datetime
+import json
+import os
+import sqlite3
+import sys
+import zlib
+
+try:
+    from dateutil import parser as dateparser
+except Exception as e:
+    print("kismet_log_devices_at_time requires dateutil; please install it either via your distribution")
+    print("(python-dateutil) or via pip (pip install dateutil)")
+    sys.exit(1)
+
+parser = argparse.ArgumentParser(description="Kismet Device Delta Log Reader")
+parser.add_argument("--in", action="store", dest="infile", help='Input (.kismet) file')
+parser.add_argument("--out", action="store", dest="outfile", help='Output filename (optional)')
+parser.add_argument("--time", action="store", dest="attime", help='Rebuild devices as of the given time (optional, defaults to the end of the log)')
+parser.add_argument("--key", action="store", dest="devkey", help='Only rebuild the device with the given key (optional)')
+
+results = parser.parse_args()
+
+if results.infile is None:
+    print("Expected --in [file]")
+    sys.exit(1)
+
+if not os.path.isfile(results.infile):
+    print("Could not find input file '{}'".format(results.infile))
+    sys.exit(1)
+
+try:
+    db = sqlite3.connect(results.infile)
+except Exception as e:
+    print("Failed to open kismet logfile: ", e)
+    sys.exit(1)
+
+c = db.cursor()
+
+c.execute("SELECT name FROM sqlite_master WHERE type='table' AND name='device_deltas'")
+if c.fetchone() is None:
+    print("Log file does not contain device deltas; was it written with kis_log_device_deltas enabled?")
+    sys.exit(1)
+
+epoch = datetime.datetime.utcfromtimestamp(0)
+
+replacements = {}
+select = ""
+
+if results.attime:
+    try:
+        st = dateparser.parse(results.attime, fuzzy = True)
+    except ValueError as e:
+        print("Could not extract a date/time from time argument:", e)
+        sys.exit(0)
+
+    replacements["tsend"] = (st - epoch).total_seconds()
+    select = "ts_sec <= :tsend"
+
+if results.devkey:
+    replacements["devkey"] = results.devkey
+
+    if select == "":
+        select = "devkey = :devkey"
+    else:
+        select = select + " AND devkey = :devkey"
+
+sql = "SELECT devkey, full, compressed, delta FROM device_deltas"
+
+if select != "":
+    sql = sql + " WHERE " + select
+
+# Records are written in order, so the rowid orders deltas recorded within the
+# same second
+sql = sql + " ORDER BY rowid"
+
+devs = {}
+
+for row in c.execute(sql, replacements):
+    (devkey, full, compressed, delta) = row
+
+    if compressed:
+        delta = zlib.decompress(delta)
+
+    record = json.loads(delta)
+
+    if full:
+        devs[devkey] = record
+        continue
+
+    # Deltas before the first complete record can't be applied to anything
+    if devkey not in devs:
+        continue
+
+    dev = devs[devkey]
+
+    for k in record:
+        if record[k] is None:
+            dev.pop(k, None)
+        else:
+            dev[k] = record[k]
+
+output = json.dumps(list(devs.values()), sort_keys = True, indent = 4, separators=(',', ': '))
+
+if results.outfile:
+    logf = open(results.outfile, "w")
+    logf.write(output)
+else:
+    print(output)
+
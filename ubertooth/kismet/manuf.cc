@@ -19,13 +19,28 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
 #include "configfile.h"
 #include "entrytracker.h"
 #include "messagebus.h"
 #include "util.h"
 #include "manuf.h"
 
-Manuf::Manuf() {
+Manuf::Manuf() :
+    db {nullptr},
+    db_len {0},
+    db_mapped {false},
+    db_ouis {nullptr},
+    db_offsets {nullptr},
+    db_strings {nullptr},
+    db_count {0} {
+
     auto entrytracker = Globalreg::FetchMandatoryGlobalAs<EntryTracker>();
 
     manuf_id = 
@@ -47,11 +62,13 @@ Manuf::Manuf() {
         return;
     }
 
+    FILE *mfile = NULL;
+
     for (auto f : fname) {
         auto expanded = Globalreg::globalreg->kismet_config->ExpandLogPath(f, "", "", 0, 1);
 
         if ((mfile = fopen(expanded.c_str(), "r")) != NULL) {
-            _MSG("Opened OUI file '" + expanded, MSGFLAG_INFO);
+            _MSG("Opened OUI file '" + expanded + "'", MSGFLAG_INFO);
             break;
         }
 
@@ -64,148 +81,293 @@ Manuf::Manuf() {
         return;
     }
 
-    IndexOUI();
-}
+    struct stat source;
 
-void Manuf::IndexOUI() {
-    char buf[1024];
-    int line = 0;
-    fpos_t prev_pos;
-    short int m[3];
-    uint32_t last_oui = 0;
+    if (fstat(fileno(mfile), &source) < 0) {
+        _MSG("Could not stat OUI file: " + std::string(strerror(errno)) + ", will not resolve "
+                "manufacturer names for MAC addresses", MSGFLAG_ERROR);
+        fclose(mfile);
+        return;
+    }
+
+    auto cache = Globalreg::globalreg->kismet_config->FetchOpt("ouicache");
 
-    if (mfile == NULL)
+    if (cache != "")
+        cache = Globalreg::globalreg->kismet_config->ExpandLogPath(cache, "", "", 0, 1);
+
+    // Use the compiled table if it's current
+    if (cache != "" && MapDb(cache, source)) {
+        fclose(mfile);
+        _MSG("Loaded " + UIntToString(db_count) + " manufacturers from OUI cache '" + 
+                cache + "'", MSGFLAG_INFO);
         return;
+    }
 
     _MSG("Indexing manufacturer db", MSGFLAG_INFO);
 
-    fgetpos(mfile, &prev_pos);
+    if (!BuildDb(mfile, source)) {
+        fclose(mfile);
+        _MSG("No usable entries in OUI file, will not resolve manufacturer "
+             "names for MAC addresses", MSGFLAG_ERROR);
+        return;
+    }
 
-    while (!feof(mfile)) {
-        if (fgets(buf, 1024, mfile) == NULL || feof(mfile))
-            break;
+    fclose(mfile);
 
-        if ((line % 50) == 0) {
-            if (sscanf(buf, "%hx:%hx:%hx",
-                       &(m[0]), &(m[1]), &(m[2])) == 3) {
-
-                // Log a position at the previous pos - which is the line before
-                // this one, so we're inclusive
-                index_pos ip;
-                uint32_t oui;
-
-                oui = 0;
-                oui |= (uint32_t) m[0] << 16;
-                oui |= (uint32_t) m[1] << 8;
-                oui |= (uint32_t) m[2];
-
-                if (oui < last_oui) {
-                    _MSG("Warning:  Manuf file appears to be out of order, expected "
-                            "sorted manuf OUI data", MSGFLAG_ERROR);
-                }
-
-                ip.oui = oui;
-                ip.pos = prev_pos;
-
-                last_oui = oui;
-
-                index_vec.push_back(ip);
-            } else {
-                // Compensate for not getting a reasonable line (probably a
-                // comment) by decrementing here so we keep trying at each
-                // index point until we get info we're looking for
-                line--;
-            }
-        }
+    _MSG("Completed indexing manufacturer db, " + UIntToString(db_count) + " manufacturers",
+            MSGFLAG_INFO);
 
-        fgetpos(mfile, &prev_pos);
-        line++;
+    // Save it for next time and drop the in-memory copy in favor of the mapped one
+    if (cache != "" && WriteDb(cache) && MapDb(cache, source)) {
+        db_buf.clear();
+        db_buf.shrink_to_fit();
     }
+}
 
-    _MSG("Completed indexing manufacturer db, " + IntToString(line) + " lines " +
-         IntToString(index_vec.size()) + " indexes", MSGFLAG_INFO);
+Manuf::~Manuf() {
+    if (db_mapped)
+        munmap((void *) db, db_len);
 }
 
-std::shared_ptr<TrackerElementString> Manuf::LookupOUI(mac_addr in_mac) {
-    uint32_t soui = in_mac.OUI(), toui;
-    int matched = -1;
-    char buf[1024];
-    short int m[3];
+bool Manuf::MapDb(const std::string& in_path, const struct stat& in_source) {
+    int fd = open(in_path.c_str(), O_RDONLY);
 
-    if (mfile == NULL)
-        return unknown_manuf;
+    if (fd < 0)
+        return false;
+
+    struct stat sbuf;
 
-    // Use the cache first
-    if (oui_map.find(soui) != oui_map.end()) {
-        return oui_map[soui].manuf;
+    if (fstat(fd, &sbuf) < 0 || sbuf.st_size < (off_t) sizeof(oui_db_header)) {
+        close(fd);
+        return false;
     }
 
-    for (unsigned int x = 0; x < index_vec.size(); x++) {
-        if (soui > index_vec[x].oui) {
-            matched = x;
-            continue;
-        }
+    void *m = mmap(NULL, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (m == MAP_FAILED)
+        return false;
 
-        break;
+    auto prev_db = db;
+    auto prev_len = db_len;
+    auto prev_mapped = db_mapped;
+
+    if (!SetDb((const uint8_t *) m, sbuf.st_size, in_source)) {
+        munmap(m, sbuf.st_size);
+        return false;
     }
 
-    // Cache unknown to save us effort in the future
-    if (matched < 0) {
-        manuf_data md;
-        md.oui = soui;
-        md.manuf = unknown_manuf;
-        oui_map[soui] = md;
+    if (prev_mapped)
+        munmap((void *) prev_db, prev_len);
+
+    db_mapped = true;
+
+    return true;
+}
+
+bool Manuf::SetDb(const uint8_t *in_db, size_t in_len, const struct stat& in_source) {
+    if (in_len < sizeof(oui_db_header))
+        return false;
 
-        return md.manuf;
+    auto hdr = (const oui_db_header *) in_db;
+
+    // Only trust a table built from this exact OUI file, on this host
+    if (memcmp(hdr->magic, "KISMOUI1", 8) != 0 ||
+            hdr->byteorder != 0x01020304 ||
+            hdr->source_size != (uint64_t) in_source.st_size ||
+            hdr->source_mtime != (int64_t) in_source.st_mtime)
+        return false;
+
+    if (hdr->count == 0 || hdr->strings_len == 0 ||
+            in_len != sizeof(oui_db_header) + 
+            (size_t) hdr->count * sizeof(uint32_t) * 2 + hdr->strings_len)
+        return false;
+
+    auto ouis = (const uint32_t *) (in_db + sizeof(oui_db_header));
+    auto offsets = ouis + hdr->count;
+    auto strings = (const char *) (offsets + hdr->count);
+
+    if (strings[hdr->strings_len - 1] != 0)
+        return false;
+
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        if (offsets[i] >= hdr->strings_len)
+            return false;
+
+        if (i > 0 && ouis[i] <= ouis[i - 1])
+            return false;
     }
 
-    // Jump backwards one index in the matching unless we're in the first block
-    if (matched > 0)
-        matched -= 1;
+    db = in_db;
+    db_len = in_len;
+    db_mapped = false;
+    db_ouis = ouis;
+    db_offsets = offsets;
+    db_strings = strings;
+    db_count = hdr->count;
 
-    fsetpos(mfile, &(index_vec[matched].pos));
+    return true;
+}
 
-    while (!feof(mfile)) {
-        if (fgets(buf, 1024, mfile) == NULL || feof(mfile))
-            break;
+bool Manuf::BuildDb(FILE *in_file, const struct stat& in_source) {
+    char buf[1024];
+    unsigned int m[3];
+    uint32_t last_oui = 0;
+    bool warned = false;
 
-        if (strlen(buf) < 10)
+    std::vector<std::pair<uint32_t, uint32_t>> entries;
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> interned;
+
+    while (fgets(buf, sizeof(buf), in_file) != NULL) {
+        if (buf[0] == '#' || strlen(buf) < 10)
             continue;
 
-        // Trim \n
-        auto mlen = strlen(buf + 9) - 1;
+        if (sscanf(buf, "%2x:%2x:%2x", &(m[0]), &(m[1]), &(m[2])) != 3)
+            continue;
 
-        if (mlen == 0)
+        // Only whole OUIs; skip the longer masked prefixes some manuf files carry
+        if (buf[8] != '\t' && buf[8] != ' ')
             continue;
 
+        uint32_t oui = (m[0] << 16) | (m[1] << 8) | m[2];
+
+        if (oui < last_oui && !warned) {
+            _MSG("Warning:  Manuf file appears to be out of order, expected "
+                    "sorted manuf OUI data", MSGFLAG_ERROR);
+            warned = true;
+        }
+
+        last_oui = oui;
 
-        if (sscanf(buf, "%hx:%hx:%hx\t", &(m[0]), &(m[1]), &(m[2])) == 3) {
+        char *name = buf + 9;
 
-            // Log a position at the previous pos - which is the line before
-            // this one, so we're inclusive
-            toui = mac_addr::OUI(m);
+        while (*name == '\t' || *name == ' ')
+            name++;
 
-            if (toui == soui) {
-                manuf_data md;
-                md.oui = soui;
+        // Trim the newline
+        auto nlen = strlen(name);
+        while (nlen > 0 && (name[nlen - 1] == '\n' || name[nlen - 1] == '\r'))
+            name[--nlen] = 0;
 
-                md.manuf = std::make_shared<TrackerElementString>(manuf_id);
-                md.manuf->set(MungeToPrintable(std::string(buf + 9, mlen)));
-                oui_map[soui] = md;
-                return md.manuf;
-            }
+        // Wireshark manuf files carry a short and a long name; use the long one
+        auto tab = strchr(name, '\t');
+        if (tab != NULL && tab[1] != 0)
+            name = tab + 1;
 
-            if (toui > soui) {
-                manuf_data md;
-                md.oui = soui;
-                md.manuf = unknown_manuf;
-                oui_map[soui] = md;
-                return md.manuf;
-            }
+        if (*name == 0)
+            continue;
+
+        auto manuf = MungeToPrintable(std::string(name));
+
+        auto i = interned.find(manuf);
+        uint32_t offt;
+
+        if (i == interned.end()) {
+            offt = strings.length();
+            strings.append(manuf);
+            strings.push_back(0);
+            interned.emplace(manuf, offt);
+        } else {
+            offt = i->second;
         }
+
+        entries.push_back(std::make_pair(oui, offt));
     }
 
-    return unknown_manuf;
+    // Keep the first entry for any OUI listed more than once
+    std::stable_sort(entries.begin(), entries.end(), 
+            [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                return a.first < b.first;
+            });
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                    return a.first == b.first;
+                }), entries.end());
+
+    if (entries.size() == 0)
+        return false;
+
+    oui_db_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "KISMOUI1", 8);
+    hdr.byteorder = 0x01020304;
+    hdr.count = entries.size();
+    hdr.strings_len = strings.length();
+    hdr.source_size = in_source.st_size;
+    hdr.source_mtime = in_source.st_mtime;
+
+    db_buf.resize(sizeof(hdr) + entries.size() * sizeof(uint32_t) * 2 + strings.length());
+
+    memcpy(db_buf.data(), &hdr, sizeof(hdr));
+
+    auto ouis = (uint32_t *) (db_buf.data() + sizeof(hdr));
+    auto offsets = ouis + entries.size();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        ouis[i] = entries[i].first;
+        offsets[i] = entries[i].second;
+    }
+
+    memcpy(offsets + entries.size(), strings.data(), strings.length());
+
+    return SetDb(db_buf.data(), db_buf.size(), in_source);
+}
+
+bool Manuf::WriteDb(const std::string& in_path) {
+    // Write it beside the cache and move it into place, so a reader never maps
+    // a partial table
+    auto tmp_path = in_path + ".tmp";
+
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+
+    if (f == NULL) {
+        _MSG("Could not save OUI cache '" + in_path + "': " + std::string(strerror(errno)),
+                MSGFLAG_INFO);
+        return false;
+    }
+
+    bool ok = fwrite(db, db_len, 1, f) == 1;
+
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok || rename(tmp_path.c_str(), in_path.c_str()) < 0) {
+        _MSG("Could not save OUI cache '" + in_path + "': " + std::string(strerror(errno)),
+                MSGFLAG_INFO);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<TrackerElementString> Manuf::LookupOUI(mac_addr in_mac) {
+    if (db_count == 0)
+        return unknown_manuf;
+
+    uint32_t soui = in_mac.OUI();
+
+    auto end = db_ouis + db_count;
+    auto i = std::lower_bound(db_ouis, end, soui);
+
+    if (i == end || *i != soui)
+        return unknown_manuf;
+
+    uint32_t offt = db_offsets[i - db_ouis];
+
+    std::lock_guard<std::mutex> lk(manuf_mutex);
+
+    auto mi = manuf_map.find(offt);
+
+    if (mi != manuf_map.end())
+        return mi->second;
+
+    auto manuf = std::make_shared<TrackerElementString>(manuf_id);
+    manuf->set(std::string(db_strings + offt));
+    manuf_map.emplace(offt, manuf);
+
+    return manuf;
 }
 
 std::shared_ptr<TrackerElementString> Manuf::MakeManuf(const std::string& in_manuf) {
@@ -26,6 +26,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
 #endif
@@ -37,34 +41,57 @@
 
 #include "trackedelement.h"
 
+// Manufacturer lookup by OUI.
+//
+// The OUI text file is compiled into a sorted binary table (OUI keys, string 
+// offsets, and a string table with each manufacturer name stored once) which
+// is written to the OUI cache and mapped directly on later starts, until the
+// text file changes.  If the cache can't be written, the same table is kept in
+// memory.  Lookups are a binary search, and every OUI with the same
+// manufacturer shares one string element.
 class Manuf {
     public:
         Manuf();
-
-        void IndexOUI();
+        ~Manuf();
 
         std::shared_ptr<TrackerElementString> LookupOUI(mac_addr in_mac);
 
         std::shared_ptr<TrackerElementString> MakeManuf(const std::string& in_manuf);
 
-        struct index_pos {
-            uint32_t oui;
-            fpos_t pos;
-        };
-
-        struct manuf_data {
-            uint32_t oui;
-            std::shared_ptr<TrackerElementString> manuf;
-        }; 
-
         bool IsUnknownManuf(std::shared_ptr<TrackerElementString> in_manuf);
 
     protected:
-        std::vector<index_pos> index_vec;
+        // Compiled table layout:  the header, count uint32 OUIs in ascending order,
+        // count uint32 offsets into the string table, then the NUL-terminated 
+        // strings.  The source size and time identify the text file it was built from.
+        struct oui_db_header {
+            char magic[8];
+            uint32_t byteorder;
+            uint32_t count;
+            uint32_t strings_len;
+            uint32_t reserved;
+            uint64_t source_size;
+            int64_t source_mtime;
+        };
+
+        bool MapDb(const std::string& in_path, const struct stat& in_source);
+        bool BuildDb(FILE *in_file, const struct stat& in_source);
+        bool WriteDb(const std::string& in_path);
+        bool SetDb(const uint8_t *in_db, size_t in_len, const struct stat& in_source);
+
+        const uint8_t *db;
+        size_t db_len;
+        bool db_mapped;
+        std::vector<uint8_t> db_buf;
 
-        std::map<uint32_t, manuf_data> oui_map;
+        const uint32_t *db_ouis;
+        const uint32_t *db_offsets;
+        const char *db_strings;
+        uint32_t db_count;
 
-        FILE *mfile;
+        // Shared manufacturer elements, by string table offset
+        std::mutex manuf_mutex;
+        std::unordered_map<uint32_t, std::shared_ptr<TrackerElementString>> manuf_map;
 
         // IDs for manufacturer objects
         int manuf_id;
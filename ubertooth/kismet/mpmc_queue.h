@@ -0,0 +1,158 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __MPMC_QUEUE_H__
+#define __MPMC_QUEUE_H__
+
+#include "config.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Bounded lock-free multi-producer / multi-consumer queue.
+//
+// Each slot carries a sequence number which tells producers and consumers
+// whether it is free for the current lap of the ring; claiming a slot is a
+// single CAS on the enqueue or dequeue position, so threads only contend
+// when they race for the same slot.  Capacity is rounded up to a power of
+// two.
+template<class T>
+class mpmc_bounded_queue {
+public:
+    mpmc_bounded_queue(size_t in_capacity) {
+        size_t cap = 2;
+
+        while (cap < in_capacity)
+            cap <<= 1;
+
+        mask = cap - 1;
+        slots = new slot[cap];
+
+        for (size_t i = 0; i < cap; i++)
+            slots[i].seq.store(i, std::memory_order_relaxed);
+
+        enqueue_pos.store(0, std::memory_order_relaxed);
+        dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    // Items still queued are not released; owners of pointers must drain the
+    // queue first
+    ~mpmc_bounded_queue() {
+        delete[] slots;
+    }
+
+    mpmc_bounded_queue(const mpmc_bounded_queue&) = delete;
+    mpmc_bounded_queue& operator=(const mpmc_bounded_queue&) = delete;
+
+    // Returns false if the queue is full
+    bool push(const T& in_data) {
+        slot *s;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+        while (1) {
+            s = &slots[pos & mask];
+            size_t seq = s->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        s->data = in_data;
+        s->seq.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& out_data) {
+        slot *s;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+
+        while (1) {
+            s = &slots[pos & mask];
+            size_t seq = s->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        out_data = s->data;
+        s->seq.store(pos + mask + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Pop up to in_max items, returning how many were taken
+    size_t pop_bulk(T *out_data, size_t in_max) {
+        size_t n = 0;
+
+        while (n < in_max && pop(out_data[n]))
+            n++;
+
+        return n;
+    }
+
+    // Approximate; only exact when no other thread is using the queue
+    size_t size() const {
+        size_t e = enqueue_pos.load(std::memory_order_relaxed);
+        size_t d = dequeue_pos.load(std::memory_order_relaxed);
+
+        return e > d ? e - d : 0;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+protected:
+    struct slot {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    slot *slots;
+    size_t mask;
+
+    // Keep the producer and consumer positions on separate cache lines; padded
+    // by hand because over-aligned types can't be heap allocated before c++17
+    char pad0[64];
+    std::atomic<size_t> enqueue_pos;
+    char pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeue_pos;
+    char pad2[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif
+
@@ -42,12 +42,12 @@ kis_packet::kis_packet(GlobalRegistry *in_globalreg) {
 	filtered = 0;
     duplicate = 0;
 
-	// Stock and init the content vector
-	content_vec.resize(MAX_PACKET_COMPONENTS, NULL);
-	/*
-	   for (unsigned int y = 0; y < MAX_PACKET_COMPONENTS; y++)
-	   content_vec[y] = NULL;
-	   */
+    ts.tv_sec = 0;
+    ts.tv_usec = 0;
+
+	// Init the content vector
+    for (unsigned int y = 0; y < MAX_PACKET_COMPONENTS; y++)
+        content_vec[y] = NULL;
 }
 
 kis_packet::~kis_packet() {
@@ -59,6 +59,25 @@ kis_packet::~kis_packet() {
             delete pcm;
     }
 }
+
+void kis_packet::reset() {
+    for (unsigned int y = 0; y < MAX_PACKET_COMPONENTS; y++) {
+        if (content_vec[y] == nullptr)
+            continue;
+
+        if (content_vec[y]->self_destruct)
+            delete content_vec[y];
+
+        content_vec[y] = NULL;
+    }
+
+    error = 0;
+    filtered = 0;
+    duplicate = 0;
+
+    ts.tv_sec = 0;
+    ts.tv_usec = 0;
+}
    
 void kis_packet::insert(const unsigned int index, packet_component *data) {
 	if (index >= MAX_PACKET_COMPONENTS) 
@@ -34,6 +34,7 @@
 #include <map>
 
 #include "globalregistry.h"
+#include "mpmc_queue.h"
 #include "macaddr.h"
 #include "packet_ieee80211.h"
 #include "trackedelement.h"
@@ -51,6 +52,9 @@
 // even when we don't have pcap
 #define KDLT_IEEE802_11			105
 
+// How many free blocks of each pooled component type are kept for reuse
+#define PACKET_COMPONENT_POOL_SIZE  1024
+
 // High-level packet component so that we can provide our own destructors
 class packet_component {
 public:
@@ -59,6 +63,43 @@ public:
 	int self_destruct;
 };
 
+// Recycling allocator for components which are created for nearly every 
+// packet.  Deriving from packet_component_pool<T> gives the component a class
+// new and delete backed by a lock-free free list, so the existing new at the
+// dissectors and the delete when the packet is destroyed reuse blocks instead
+// of going to the system allocator.  Subclasses of a different size fall
+// through to the global allocator.
+template<class T>
+class packet_component_pool {
+public:
+    static void *operator new(size_t sz) {
+        void *block;
+
+        if (sz == sizeof(T) && free_list().pop(block))
+            return block;
+
+        return ::operator new(sz);
+    }
+
+    static void operator delete(void *block, size_t sz) {
+        if (block == nullptr)
+            return;
+
+        if (sz == sizeof(T) && free_list().push(block))
+            return;
+
+        ::operator delete(block);
+    }
+
+protected:
+    // Never torn down, so components destroyed during shutdown can't outlive it
+    static mpmc_bounded_queue<void *>& free_list() {
+        static mpmc_bounded_queue<void *> *fl = 
+            new mpmc_bounded_queue<void *>(PACKET_COMPONENT_POOL_SIZE);
+        return *fl;
+    }
+};
+
 // Overall packet container that holds packet information
 class kis_packet {
 public:
@@ -75,8 +116,9 @@ public:
     // Are we a duplicate?
     int duplicate;
 
-	// Actual vector of bits in the packet
-    std::vector<packet_component *> content_vec;
+	// Actual vector of bits in the packet; kept inline so a recycled packet
+    // doesn't need any allocation
+    packet_component *content_vec[MAX_PACKET_COMPONENTS];
    
     // Init stuff
     kis_packet() {
@@ -85,6 +127,9 @@ public:
 
 	kis_packet(GlobalRegistry *in_globalreg);
     ~kis_packet();
+
+    // Destroy all components and clear the packet so it can be reused
+    void reset();
    
     void insert(const unsigned int index, packet_component *data);
     void *fetch(const unsigned int index) const;
@@ -169,7 +214,8 @@ protected:
 };
 
 // Arbitrary data chunk, decapsulated from the link headers
-class kis_datachunk : public packet_component {
+class kis_datachunk : public packet_component, 
+    public packet_component_pool<kis_datachunk> {
 public:
     uint8_t *data;
     unsigned int length;
@@ -410,7 +456,8 @@ enum kis_layer1_packinfo_signal_type {
     kis_l1_signal_type_rssi
 };
 
-class kis_layer1_packinfo : public packet_component {
+class kis_layer1_packinfo : public packet_component,
+    public packet_component_pool<kis_layer1_packinfo> {
 public:
 	kis_layer1_packinfo() {
 		self_destruct = 1;  // Safe to delete us
@@ -57,16 +57,45 @@ Packetchain::Packetchain(GlobalRegistry *in_globalreg) {
     last_packet_drop_user_warning = 0;
 
     packet_queue_warning = 
-        globalreg->kismet_config->FetchOptUInt("packet_log_warning", 0);
+        globalreg->kismet_config->FetchOptUInt("packet_backlog_warning", 
+                globalreg->kismet_config->FetchOptUInt("packet_log_warning", 0));
     packet_queue_drop =
         globalreg->kismet_config->FetchOptUInt("packet_backlog_limit", 8192);
 
+    // An unbounded queue still gets a lock-free ring for the common case and
+    // only spills into the overflow queue when that fills up
+    if (packet_queue_drop == 0)
+        packet_queue = new mpmc_bounded_queue<kis_packet *>(65536);
+    else
+        packet_queue = new mpmc_bounded_queue<kis_packet *>(packet_queue_drop);
+
+    // The ring only comes in powers of two; use all of it rather than pretend 
+    // we enforce the configured limit
+    if (packet_queue_drop != 0 && packet_queue->capacity() != packet_queue_drop) {
+        _MSG_ERROR("packet_backlog_limit must be a power of two, using {} instead "
+                "of {}", packet_queue->capacity(), packet_queue_drop);
+        packet_queue_drop = packet_queue->capacity();
+    }
+
+    // Ask sources to back off at the warning level, or once the queue is 3/4
+    // full if there isn't one
+    if (packet_queue_warning != 0)
+        packet_queue_backlog = packet_queue_warning;
+    else if (packet_queue_drop != 0)
+        packet_queue_backlog = packet_queue_drop - (packet_queue_drop / 4);
+    else
+        packet_queue_backlog = packet_queue->capacity() - (packet_queue->capacity() / 4);
+
+    packet_pool = new mpmc_bounded_queue<kis_packet *>(PACKETCHAIN_POOL_SIZE);
+
+    overflow_size = 0;
+    sleeping_workers = 0;
+
     packetchain_shutdown = false;
 
-    // Lock the packet conditional
-    packet_condition.lock();
+    unsigned int nthreads = std::max(std::thread::hardware_concurrency(), 1U);
 
-    for (unsigned int i = 0; i < std::thread::hardware_concurrency(); i++) {
+    for (unsigned int i = 0; i < nthreads; i++) {
         packet_threads.push_back(std::thread([this]() { 
             packet_queue_processor();
         }));
@@ -75,15 +104,29 @@ Packetchain::Packetchain(GlobalRegistry *in_globalreg) {
 
 Packetchain::~Packetchain() {
     {
-        // Tell the packet thread we're dying and unlock it
-        local_locker qlock(&packetqueue_mutex);
+        // Tell the packet threads we're dying and wake them up
+        std::lock_guard<std::mutex> lk(wake_mutex);
         packetchain_shutdown = true;
-        packet_condition.unlock();
+    }
+    wake_cv.notify_all();
+
+    for (auto& t : packet_threads)
+        t.join();
+
+    // Anything still queued never made it through the chain; destroy it while the
+    // destruction chain is still around, so its components go back to their pools
+    kis_packet *pack;
 
-        for (auto& t : packet_threads)
-            t.join();
+    while (packet_queue->pop(pack))
+        DestroyPacket(pack);
+
+    while (overflow_queue.size()) {
+        DestroyPacket(overflow_queue.front());
+        overflow_queue.pop();
     }
 
+    overflow_size = 0;
+
     {
         local_eol_locker lock(&packetchain_mutex);
 
@@ -129,6 +172,13 @@ Packetchain::~Packetchain() {
         }
     }
 
+    delete packet_queue;
+
+    while (packet_pool->pop(pack))
+        delete pack;
+
+    delete packet_pool;
+
 }
 
 int Packetchain::RegisterPacketComponent(std::string in_component) {
@@ -181,10 +231,14 @@ std::string Packetchain::FetchPacketComponentName(int in_id) {
 }
 
 kis_packet *Packetchain::GeneratePacket() {
-    local_locker lock(&packetchain_mutex);
-    kis_packet *newpack = new kis_packet(globalreg);
+    kis_packet *newpack;
     pc_link *pcl;
 
+    if (!packet_pool->pop(newpack))
+        newpack = new kis_packet(globalreg);
+
+    local_locker lock(&packetchain_mutex);
+
     // Run the frame through the genesis chain incase anything
     // needs to add something at the beginning
     for (unsigned int x = 0; x < genesis_chain.size(); x++) {
@@ -210,101 +264,110 @@ kis_packet *Packetchain::GeneratePacket() {
     return newpack;
 }
 
-void Packetchain::packet_queue_processor() {
-    kis_packet *packet = NULL;
-    local_demand_locker queue_lock(&(packetqueue_mutex));
-    local_demand_locker chain_lock(&(packetchain_mutex));
+void Packetchain::process_chains(kis_packet *in_pack) {
+    for (auto pcl : postcap_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-    while (1) {
-        queue_lock.lock();
+    for (auto pcl : llcdissect_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-        // Are we shutting down?
-        if (packetchain_shutdown)
-            return;
-      
-        if (packet_queue.size() != 0) {
-            // Get the next packet
-            packet = packet_queue.front();
-            packet_queue.pop();
+    for (auto pcl : decrypt_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-            // Unlock the queue while we process that packet
-            queue_lock.unlock();
+    for (auto pcl : datadissect_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-            // Lock the  packet chain itself because we need to have consistent
-            // packet chain vectors
-            
-            for (auto pcl : postcap_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+    for (auto pcl : classifier_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-            for (auto pcl : llcdissect_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+    for (auto pcl : tracker_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-            for (auto pcl : decrypt_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+    for (auto pcl : logging_chain) {
+        if (pcl->callback != NULL)
+            pcl->callback(globalreg, pcl->auxdata, in_pack);
+        else if (pcl->l_callback != NULL)
+            pcl->l_callback(in_pack);
+    }
 
-            for (auto pcl : datadissect_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+    DestroyPacket(in_pack);
+}
 
-            for (auto pcl : classifier_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+bool Packetchain::pop_packets(kis_packet **out_packs, size_t *out_n) {
+    *out_n = packet_queue->pop_bulk(out_packs, PACKETCHAIN_BATCH);
 
-            for (auto pcl : tracker_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+    // Only look at the overflow queue when the ring has run dry, so that
+    // spilled packets are handled in order behind the ring
+    if (*out_n == 0 && overflow_size != 0) {
+        std::lock_guard<std::mutex> lk(overflow_mutex);
 
-            for (auto pcl : logging_chain) {
-                if (pcl->callback != NULL)
-                    pcl->callback(globalreg, pcl->auxdata, packet);
-                else if (pcl->l_callback != NULL)
-                    pcl->l_callback(packet);
-            }
+        while (*out_n < PACKETCHAIN_BATCH && overflow_queue.size()) {
+            out_packs[(*out_n)++] = overflow_queue.front();
+            overflow_queue.pop();
+            overflow_size--;
+        }
+    }
 
-            DestroyPacket(packet);
+    return *out_n != 0;
+}
+
+void Packetchain::packet_queue_processor() {
+    kis_packet *batch[PACKETCHAIN_BATCH];
+    size_t n;
+
+    while (1) {
+        if (packetchain_shutdown)
+            return;
+
+        if (pop_packets(batch, &n)) {
+            for (size_t i = 0; i < n; i++)
+                process_chains(batch[i]);
 
             // re-loop in case we have more packets
             continue;
-        } else {
-            // We have no packets, lock our conditional until something queues 
-            // a new packet and fall out of the selector
-            packet_condition.lock();
         }
 
-        // No packets; fall through to blocking until we have them
-        queue_lock.unlock();
+        // We have no packets; announce that we're going to sleep and check
+        // again before blocking, so a producer that queued a packet in the
+        // meantime either sees us sleeping or we see its packet
+        std::unique_lock<std::mutex> lk(wake_mutex);
+        sleeping_workers++;
 
+        if (!packetchain_shutdown && packet_queue->size() == 0 && overflow_size == 0)
+            wake_cv.wait_for(lk, std::chrono::milliseconds(100));
 
-        // Block until something pokes the conditional locker
-        packet_condition.block_until();
+        sleeping_workers--;
     }
 }
 
 int Packetchain::ProcessPacket(kis_packet *in_pack) {
-    local_locker qlock(&packetqueue_mutex);
+    size_t queue_sz = packet_queue->size() + overflow_size;
 
-    if (packet_queue.size() > packet_queue_warning &&
+    if (queue_sz > packet_queue_warning &&
             packet_queue_warning != 0) {
         time_t offt = time(0) - last_packet_queue_user_warning;
 
@@ -314,37 +377,53 @@ int Packetchain::ProcessPacket(kis_packet *in_pack) {
             std::shared_ptr<Alertracker> alertracker =
                 Globalreg::FetchMandatoryGlobalAs<Alertracker>(globalreg, "ALERTTRACKER");
             alertracker->RaiseOneShot("PACKETQUEUE", 
-                    "The packet queue has a backlog of " + IntToString(packet_queue.size()) + 
+                    "The packet queue has a backlog of " + IntToString(queue_sz) + 
                     " packets; if you have multiple data sources it's possible that your "
                     "system is not fast enough.  Kismet will continue to process "
                     "packets, this may be a momentary spike in packet load.", -1);
         }
     }
 
-    if (packet_queue_drop != 0 && packet_queue.size() > packet_queue_drop) {
-        time_t offt = time(0) - last_packet_drop_user_warning;
+    if (!packet_queue->push(in_pack)) {
+        if (packet_queue_drop != 0) {
+            time_t offt = time(0) - last_packet_drop_user_warning;
 
-        if (offt > 30) {
-            last_packet_drop_user_warning = time(0);
+            if (offt > 30) {
+                last_packet_drop_user_warning = time(0);
 
-            std::shared_ptr<Alertracker> alertracker =
-                Globalreg::FetchMandatoryGlobalAs<Alertracker>(globalreg, "ALERTTRACKER");
-            alertracker->RaiseOneShot("PACKETLOST", 
-                    "Kismet has started to drop packets; the packet queue has a backlog "
-                    "of " + IntToString(packet_queue.size()) + " packets.  Your system "
-                    "may not be fast enough to process the number of packets being seen. "
-                    "You change this behavior in 'kismet_memory.conf'.", -1);
+                std::shared_ptr<Alertracker> alertracker =
+                    Globalreg::FetchMandatoryGlobalAs<Alertracker>(globalreg, "ALERTTRACKER");
+                alertracker->RaiseOneShot("PACKETLOST", 
+                        "Kismet has started to drop packets; the packet queue has a backlog "
+                        "of " + IntToString(queue_sz) + " packets.  Your system "
+                        "may not be fast enough to process the number of packets being seen. "
+                        "You change this behavior in 'kismet_memory.conf'.", -1);
+            }
+
+            // Don't queue packets; the caller has handed the packet off to us so
+            // it's ours to dispose of
+            DestroyPacket(in_pack);
+            return PACKETCHAIN_DROPPED;
         }
 
-        // Don't queue packets
-        return 1;
+        std::lock_guard<std::mutex> lk(overflow_mutex);
+        overflow_queue.push(in_pack);
+        overflow_size++;
     }
 
-    packet_queue.push(in_pack);
+    // Only pay for the wakeup when a worker is actually asleep; the fence
+    // orders our push against a worker announcing that it's going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    packet_condition.unlock();
+    if (sleeping_workers != 0) {
+        std::lock_guard<std::mutex> lk(wake_mutex);
+        wake_cv.notify_one();
+    }
 
-    return 1;
+    if (Backlogged())
+        return PACKETCHAIN_BACKLOGGED;
+
+    return PACKETCHAIN_QUEUED;
 }
 
 void Packetchain::DestroyPacket(kis_packet *in_pack) {
@@ -360,7 +439,14 @@ void Packetchain::DestroyPacket(kis_packet *in_pack) {
         (*(pcl->callback))(globalreg, pcl->auxdata, in_pack);
     }
 
-	delete in_pack;
+    lock.unlock();
+
+    // Release the components back to their pools and keep the packet for the
+    // next GeneratePacket
+    in_pack->reset();
+
+    if (!packet_pool->push(in_pack))
+        delete in_pack;
 }
 
 int Packetchain::RegisterIntHandler(pc_callback in_cb, void *in_aux,
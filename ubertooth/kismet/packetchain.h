@@ -35,9 +35,12 @@
 #include <functional>
 #include <queue>
 #include <thread>
+#include <atomic>
+#include <condition_variable>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
+#include "mpmc_queue.h"
 #include "packet.h"
 
 
@@ -84,6 +87,16 @@
 #define CHAINPOS_LOGGING        8
 #define CHAINPOS_DESTROY        9
 
+#define PACKETCHAIN_DROPPED     -1
+#define PACKETCHAIN_QUEUED      1
+#define PACKETCHAIN_BACKLOGGED  2
+
+// Packets a worker pulls from the queue at once
+#define PACKETCHAIN_BATCH       32
+
+// Destroyed packets kept for reuse by GeneratePacket
+#define PACKETCHAIN_POOL_SIZE   4096
+
 #define CHAINCALL_PARMS GlobalRegistry *globalreg __attribute__ ((unused)), \
     void *auxdata __attribute__ ((unused)), \
     kis_packet *in_pack
@@ -116,8 +129,15 @@ public:
 
     // Generate a packet and hand it back
     kis_packet *GeneratePacket();
-    // Inject a packet into the chain
+    // Inject a packet into the chain.  Returns PACKETCHAIN_QUEUED,
+    // PACKETCHAIN_BACKLOGGED if the packet was queued but the queue is
+    // past the backlog warning level and the source should slow down, or
+    // PACKETCHAIN_DROPPED if the queue was full and the packet was destroyed.
     int ProcessPacket(kis_packet *in_pack);
+
+    bool Backlogged() {
+        return packet_queue->size() + overflow_size >= packet_queue_backlog;
+    }
     // Destroy a packet at the end of its life
     void DestroyPacket(kis_packet *in_pack);
  
@@ -141,6 +161,8 @@ protected:
     GlobalRegistry *globalreg;
 
     void packet_queue_processor();
+    void process_chains(kis_packet *in_pack);
+    bool pop_packets(kis_packet **out_packs, size_t *out_n);
 
     // Common function for both insertion methods
     int RegisterIntHandler(pc_callback in_cb, void *in_aux, 
@@ -171,13 +193,28 @@ protected:
 
     std::vector<std::thread> packet_threads;
 
-    kis_recursive_timed_mutex packetqueue_mutex;
-    conditional_locker<int> packet_condition;
-    std::queue<kis_packet *> packet_queue;
-    bool packetchain_shutdown;
+    // Lock-free packet queue; producers never block each other or the
+    // workers.  When the queue limit is 0 (unbounded), packets which
+    // don't fit spill into the locked overflow queue.
+    mpmc_bounded_queue<kis_packet *> *packet_queue;
+    std::mutex overflow_mutex;
+    std::queue<kis_packet *> overflow_queue;
+    std::atomic<size_t> overflow_size;
+
+    // Idle workers sleep on the wake condition; producers only take the
+    // mutex to signal it when someone is sleeping
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::atomic<int> sleeping_workers;
+
+    std::atomic<bool> packetchain_shutdown;
+
+    // Recycled packets, already reset and ready to go back into the chain
+    mpmc_bounded_queue<kis_packet *> *packet_pool;
 
-    // Warning and discard levels for packet queue being full
-    unsigned int packet_queue_warning, packet_queue_drop;
+    // Warning and discard levels for packet queue being full, and the
+    // level past which sources are asked to back off
+    unsigned int packet_queue_warning, packet_queue_drop, packet_queue_backlog;
     time_t last_packet_queue_user_warning, last_packet_drop_user_warning;
 };
 
@@ -45,7 +45,8 @@
 
 class bluetooth_tracked_device;
 
-class bluetooth_packinfo : public packet_component {
+class bluetooth_packinfo : public packet_component,
+    public packet_component_pool<bluetooth_packinfo> {
 public:
     bluetooth_packinfo() {
         self_destruct = 1;
@@ -64,22 +64,13 @@ public:
         return b;
     }
 
-    // Simple average
-    static int64_t combine_vector(std::shared_ptr<TrackerElementVectorDouble> e) {
-        int64_t avg = 0;
-        int64_t avg_c = 0;
-
-        for (auto i : *e) {
-            if (i != default_val()) {
-                avg += i;
-                avg_c++;
-            }
-        }
-
-        if (avg_c == 0)
+    // Simple average of the slots which have a value
+    static int64_t combine_slots(const int64_t sum, const size_t used, 
+            const size_t total __attribute__((unused))) {
+        if (used == 0)
             return default_val();
 
-        return avg / avg_c;
+        return sum / (int64_t) used;
     }
 
     // Default 'empty' value, no legit signal would be 0
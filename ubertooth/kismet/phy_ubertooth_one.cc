@@ -0,0 +1,239 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "endian_magic.h"
+#include "globalregistry.h"
+#include "packetchain.h"
+#include "phy_ubertooth_one.h"
+#include "devicetracker.h"
+
+// Pseudo-headers, as written by capture_ubertooth_one
+struct ubertooth_le_ll_phdr {
+    uint8_t rf_channel;
+    int8_t signal_power;
+    int8_t noise_power;
+    uint8_t access_address_offenses;
+    uint32_t ref_access_address;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct ubertooth_bredr_bb_phdr {
+    uint8_t rf_channel;
+    int8_t signal_power;
+    int8_t noise_power;
+    uint8_t access_code_offenses;
+    uint8_t payload_transport_rate;
+    uint8_t corrected_header_bits;
+    int16_t corrected_payload_bits;
+    uint32_t lap;
+    uint32_t ref_lap_uap;
+    uint32_t bt_header;
+    uint16_t flags;
+} __attribute__((packed));
+
+#define UBERTOOTH_LE_SIGPOWER_VALID     0x0002
+#define UBERTOOTH_LE_NOISEPOWER_VALID   0x0004
+#define UBERTOOTH_BREDR_SIGPOWER_VALID  0x0002
+#define UBERTOOTH_BREDR_NOISEPOWER_VALID 0x0004
+
+#define UBERTOOTH_LE_ADV_AA             0x8E89BED6
+
+Kis_Ubertooth_One_Phy::Kis_Ubertooth_One_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
+    Kis_Phy_Handler(in_globalreg, in_phyid) {
+
+    SetPhyName("UbertoothOne");
+
+    packetchain =
+        Globalreg::FetchMandatoryGlobalAs<Packetchain>("PACKETCHAIN");
+
+    pack_comp_common = packetchain->RegisterPacketComponent("COMMON");
+    pack_comp_linkframe = packetchain->RegisterPacketComponent("LINKFRAME");
+    pack_comp_l1info = packetchain->RegisterPacketComponent("RADIODATA");
+
+    packetchain->RegisterHandler(&DissectorUbertooth, this, CHAINPOS_LLCDISSECT, -100);
+    packetchain->RegisterHandler(&CommonClassifierUbertooth, this, CHAINPOS_CLASSIFIER, -100);
+}
+
+Kis_Ubertooth_One_Phy::~Kis_Ubertooth_One_Phy() {
+    packetchain->RemoveHandler(&DissectorUbertooth, CHAINPOS_LLCDISSECT);
+    packetchain->RemoveHandler(&CommonClassifierUbertooth, CHAINPOS_CLASSIFIER);
+}
+
+int Kis_Ubertooth_One_Phy::DissectorUbertooth(CHAINCALL_PARMS) {
+    auto uphy = static_cast<Kis_Ubertooth_One_Phy *>(auxdata);
+
+    auto packdata = in_pack->fetch<kis_datachunk>(uphy->pack_comp_linkframe);
+
+    if (packdata == NULL)
+        return 0;
+
+    // Did something already classify this?
+    if (in_pack->fetch<kis_common_info>(uphy->pack_comp_common) != NULL)
+        return 0;
+
+    if (packdata->dlt == KDLT_BLUETOOTH_LE_LL_WITH_PHDR)
+        return uphy->DissectBtle(in_pack, packdata);
+
+    if (packdata->dlt == KDLT_BLUETOOTH_BREDR_BB)
+        return uphy->DissectBredr(in_pack, packdata);
+
+    return 0;
+}
+
+int Kis_Ubertooth_One_Phy::DissectBtle(kis_packet *in_pack, kis_datachunk *in_chunk) {
+    ubertooth_le_ll_phdr phdr;
+
+    // Pseudo-header, access address, and PDU header
+    if (in_chunk->length < sizeof(phdr) + 6)
+        return 0;
+
+    memcpy(&phdr, in_chunk->data, sizeof(phdr));
+
+    const uint8_t *ll = in_chunk->data + sizeof(phdr);
+    uint32_t aa = ll[0] | (ll[1] << 8) | (ll[2] << 16) | ((uint32_t) ll[3] << 24);
+    unsigned int pdu_type = ll[4] & 0x0F;
+    unsigned int pdu_len = ll[5] & 0x3F;
+
+    // Only advertising channel PDUs carry a device address
+    if (aa != UBERTOOTH_LE_ADV_AA || pdu_len < 6 || 
+            in_chunk->length < sizeof(phdr) + 6 + pdu_len)
+        return 0;
+
+    const uint8_t *payload = ll + 6;
+
+    // Addresses are sent least significant byte first
+    uint8_t addr[6];
+
+    auto common = new kis_common_info;
+
+    common->phyid = FetchPhyId();
+    common->basic_crypt_set = crypt_none;
+    common->type = packet_basic_mgmt;
+
+    for (unsigned int i = 0; i < 6; i++)
+        addr[i] = payload[5 - i];
+    common->source = mac_addr(addr, 6);
+    common->transmitter = common->source;
+
+    // ADV_DIRECT_IND, SCAN_REQ, and CONNECT_REQ name a second device
+    if ((pdu_type == 1 || pdu_type == 3 || pdu_type == 5) && pdu_len >= 12) {
+        for (unsigned int i = 0; i < 6; i++)
+            addr[i] = payload[11 - i];
+        common->dest = mac_addr(addr, 6);
+    }
+
+    // Physical channel 0-39 is 2402MHz + 2MHz per channel
+    common->channel = IntToString(phdr.rf_channel);
+    common->freq_khz = (2402 + (2 * phdr.rf_channel)) * 1000;
+
+    in_pack->insert(pack_comp_common, common);
+
+    uint16_t flags = kis_letoh16(phdr.flags);
+
+    if (in_pack->fetch(pack_comp_l1info) == NULL && (flags & UBERTOOTH_LE_SIGPOWER_VALID)) {
+        auto l1 = new kis_layer1_packinfo;
+
+        l1->signal_type = kis_l1_signal_type_dbm;
+        l1->signal_dbm = phdr.signal_power;
+        if (flags & UBERTOOTH_LE_NOISEPOWER_VALID)
+            l1->noise_dbm = phdr.noise_power;
+        l1->freq_khz = common->freq_khz;
+        l1->channel = common->channel;
+
+        in_pack->insert(pack_comp_l1info, l1);
+    }
+
+    return 1;
+}
+
+int Kis_Ubertooth_One_Phy::DissectBredr(kis_packet *in_pack, kis_datachunk *in_chunk) {
+    ubertooth_bredr_bb_phdr phdr;
+
+    if (in_chunk->length < sizeof(phdr))
+        return 0;
+
+    memcpy(&phdr, in_chunk->data, sizeof(phdr));
+
+    uint32_t lap = kis_letoh32(phdr.lap) & 0xFFFFFF;
+
+    uint8_t addr[6] = { 0, 0, 0, 
+        (uint8_t) (lap >> 16), (uint8_t) (lap >> 8), (uint8_t) lap };
+
+    auto common = new kis_common_info;
+
+    common->phyid = FetchPhyId();
+    common->basic_crypt_set = crypt_none;
+    common->type = packet_basic_phy;
+    common->source = mac_addr(addr, 6);
+    common->transmitter = common->source;
+
+    // Channel 0-78 is 2402MHz + 1MHz per channel
+    common->channel = IntToString(phdr.rf_channel);
+    common->freq_khz = (2402 + phdr.rf_channel) * 1000;
+
+    in_pack->insert(pack_comp_common, common);
+
+    uint16_t flags = kis_letoh16(phdr.flags);
+
+    if (in_pack->fetch(pack_comp_l1info) == NULL && (flags & UBERTOOTH_BREDR_SIGPOWER_VALID)) {
+        auto l1 = new kis_layer1_packinfo;
+
+        l1->signal_type = kis_l1_signal_type_dbm;
+        l1->signal_dbm = phdr.signal_power;
+        if (flags & UBERTOOTH_BREDR_NOISEPOWER_VALID)
+            l1->noise_dbm = phdr.noise_power;
+        l1->freq_khz = common->freq_khz;
+        l1->channel = common->channel;
+
+        in_pack->insert(pack_comp_l1info, l1);
+    }
+
+    return 1;
+}
+
+int Kis_Ubertooth_One_Phy::CommonClassifierUbertooth(CHAINCALL_PARMS) {
+    auto uphy = static_cast<Kis_Ubertooth_One_Phy *>(auxdata);
+
+    auto packdata = in_pack->fetch<kis_datachunk>(uphy->pack_comp_linkframe);
+
+    if (packdata == NULL)
+        return 0;
+
+    if (packdata->dlt != KDLT_BLUETOOTH_LE_LL_WITH_PHDR &&
+            packdata->dlt != KDLT_BLUETOOTH_BREDR_BB)
+        return 0;
+
+    // Did we classify this?
+    auto common = in_pack->fetch<kis_common_info>(uphy->pack_comp_common);
+
+    if (common == NULL || common->phyid != uphy->FetchPhyId())
+        return 0;
+
+    uphy->devicetracker->UpdateCommonDevice(common, common->source, uphy, in_pack,
+            (UCD_UPDATE_SIGNAL | UCD_UPDATE_FREQUENCIES |
+             UCD_UPDATE_PACKETS | UCD_UPDATE_LOCATION |
+             UCD_UPDATE_SEENBY),
+            packdata->dlt == KDLT_BLUETOOTH_LE_LL_WITH_PHDR ? "BTLE" : "BR/EDR");
+
+    return 1;
+}
+
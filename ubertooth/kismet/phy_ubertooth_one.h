@@ -0,0 +1,66 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __PHY_UBERTOOTH_ONE_H__
+#define __PHY_UBERTOOTH_ONE_H__
+
+#include "config.h"
+
+#include <string>
+
+#include "globalregistry.h"
+#include "packetchain.h"
+#include "devicetracker.h"
+#include "devicetracker_component.h"
+
+/* Classifies the frames the Ubertooth One capture produces: BTLE link layer
+ * packets (DLT_BLUETOOTH_LE_LL_WITH_PHDR) and BR/EDR access codes
+ * (DLT_BLUETOOTH_BREDR_BB).  BTLE devices are tracked by the advertising address;
+ * BR/EDR devices are only seen by their LAP, so they're tracked as
+ * 00:00:00:LAP. */
+
+#define KDLT_BLUETOOTH_BREDR_BB             255
+#define KDLT_BLUETOOTH_LE_LL_WITH_PHDR      256
+
+class Kis_Ubertooth_One_Phy : public Kis_Phy_Handler {
+public:
+    Kis_Ubertooth_One_Phy(GlobalRegistry *in_globalreg) :
+        Kis_Phy_Handler(in_globalreg) { }
+
+    Kis_Ubertooth_One_Phy(GlobalRegistry *in_globalreg, int in_phyid);
+
+    virtual ~Kis_Ubertooth_One_Phy();
+
+    virtual Kis_Phy_Handler *CreatePhyHandler(GlobalRegistry *in_globalreg, int in_phyid) {
+        return new Kis_Ubertooth_One_Phy(in_globalreg, in_phyid);
+    }
+
+    static int DissectorUbertooth(CHAINCALL_PARMS);
+    static int CommonClassifierUbertooth(CHAINCALL_PARMS);
+
+protected:
+    int DissectBtle(kis_packet *in_pack, kis_datachunk *in_chunk);
+    int DissectBredr(kis_packet *in_pack, kis_datachunk *in_chunk);
+
+    std::shared_ptr<Packetchain> packetchain;
+
+    int pack_comp_common, pack_comp_linkframe, pack_comp_l1info;
+};
+
+#endif
+
@@ -95,7 +95,7 @@ int PipeClient::MergeSet(int in_max_fd, fd_set *out_rset, fd_set *out_wset) {
 
     // If we have room to read set the readfd, otherwise skip it for now
     if (read_fd > -1) {
-        if (handler->GetReadBufferAvailable() > 0) {
+        if (handler->GetReadBufferAvailable() > 0 && !handler->GetReadPaused()) {
             if (max_fd < read_fd)
                 max_fd = read_fd;
             FD_SET(read_fd, out_rset);
@@ -136,8 +136,9 @@ int TcpClientV2::MergeSet(int in_max_fd, fd_set *out_rset, fd_set *out_wset) {
         FD_SET(cli_fd, out_wset);
     }
 
-    // We always want to read data
-    FD_SET(cli_fd, out_rset);
+    // We always want to read data, unless we've been asked to hold off
+    if (!handler->GetReadPaused())
+        FD_SET(cli_fd, out_rset);
 
     if (in_max_fd < cli_fd)
         return cli_fd;
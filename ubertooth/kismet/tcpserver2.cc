@@ -142,7 +142,7 @@ int TcpServerV2::MergeSet(int in_max_fd, fd_set *out_rset, fd_set *out_wset) {
     }
 
     for (auto i = handler_map.begin(); i != handler_map.end(); ++i) {
-        if (i->second->GetReadBufferAvailable() > 0) {
+        if (i->second->GetReadBufferAvailable() > 0 && !i->second->GetReadPaused()) {
             FD_SET(i->first, out_rset);
 
             if (maxfd < i->first)
@@ -21,18 +21,33 @@
 #include <sys/time.h>
 
 #include "timetracker.h"
+#include "configfile.h"
+#include "messagebus.h"
 
 Timetracker::Timetracker(GlobalRegistry *in_globalreg) {
     globalreg = in_globalreg;
 
     next_timer_id = 0;
+    schedule_gen = 0;
 
-	globalreg->start_time = time(0);
+    threads_running = false;
+    shutdown = false;
+
+    // Timer callbacks are handed to a pool of workers so that a slow callback
+    // doesn't hold up the others
+    if (globalreg->kismet_config != NULL)
+        num_workers = globalreg->kismet_config->FetchOptUInt("timer_workers", 4);
+    else
+        num_workers = 0;
+
+    globalreg->start_time = time(0);
 	gettimeofday(&(globalreg->timestamp), NULL);
 }
 
 Timetracker::~Timetracker() {
-    local_locker lock(&time_mutex);
+    StopTimers();
+
+    std::lock_guard<std::mutex> lock(time_mutex);
 
     globalreg->RemoveGlobal("TIMETRACKER");
     globalreg->timetracker = NULL;
@@ -43,131 +58,274 @@ Timetracker::~Timetracker() {
         delete x->second;
 }
 
-int Timetracker::Tick() {
-    std::vector<timer_event *> action_timers;
+void Timetracker::StopTimers() {
+    {
+        std::lock_guard<std::mutex> lock(time_mutex);
+
+        if (!threads_running)
+            return;
+
+        shutdown = true;
+        timer_cv.notify_all();
+        worker_cv.notify_all();
+    }
 
-    local_demand_locker lock(&time_mutex);
+    timer_thread.join();
 
-    lock.lock();
+    for (auto& w : worker_threads)
+        w.join();
+
+    worker_threads.clear();
+
+    std::lock_guard<std::mutex> lock(time_mutex);
+    threads_running = false;
+}
+
+int Timetracker::Tick() {
+    std::unique_lock<std::mutex> lock(time_mutex);
 
     // Handle scheduled events
     struct timeval cur_tm;
     gettimeofday(&cur_tm, NULL);
-	globalreg->timestamp.tv_sec = cur_tm.tv_sec;
-	globalreg->timestamp.tv_usec = cur_tm.tv_usec;
-    timer_event *evt;
-    int timerid;
+    globalreg->timestamp.tv_sec = cur_tm.tv_sec;
+    globalreg->timestamp.tv_usec = cur_tm.tv_usec;
 
-    std::vector<int> removed_timers;
+    if (num_workers > 0) {
+        if (!threads_running && !shutdown) {
+            threads_running = true;
 
-    for (unsigned int x = 0; x < sorted_timers.size(); x++) {
-        evt = sorted_timers[x];
-        timerid = evt->timer_id;
+            for (unsigned int w = 0; w < num_workers; w++)
+                worker_threads.push_back(std::thread([this]() { worker_loop(); }));
 
-        if ((cur_tm.tv_sec < evt->trigger_tm.tv_sec) ||
-            ((cur_tm.tv_sec == evt->trigger_tm.tv_sec) && 
-			 (cur_tm.tv_usec < evt->trigger_tm.tv_usec))) {
+            timer_thread = std::thread([this]() { timer_thread_loop(); });
+        }
 
-            lock.unlock();
-            break;
-		}
+        return 1;
+    }
+
+    // Only run events which were scheduled before this tick, so a recurring 
+    // event which comes due again immediately waits for the next one
+    uint64_t tick_gen = schedule_gen;
+    timer_event *evt;
+
+    while ((evt = NextDue_nb(cur_tm, tick_gen)) != NULL) {
+        evt->running = true;
+        evt->running_thread = std::this_thread::get_id();
 
         lock.unlock();
+        int ret = Dispatch(evt);
+        lock.lock();
 
-        // Call the function with the given parameters
-        int ret = 0;
-        if (evt->callback != NULL) {
-            ret = (*evt->callback)(evt, evt->callback_parm, globalreg);
-        } else if (evt->event != NULL) {
-            ret = evt->event->timetracker_event(evt->timer_id);
-        } else if (evt->event_func != NULL) {
-            ret = evt->event_func(evt->timer_id);
+        Complete_nb(evt, ret, cur_tm);
+    }
+
+    return 1;
+}
+
+void Timetracker::timer_thread_loop() {
+    std::unique_lock<std::mutex> lock(time_mutex);
+
+    while (!shutdown) {
+        struct timeval cur_tm;
+        gettimeofday(&cur_tm, NULL);
+
+        timer_event *evt;
+
+        while ((evt = NextDue_nb(cur_tm, UINT64_MAX)) != NULL) {
+            evt->running = true;
+            dispatch_queue.push_back(evt);
+            worker_cv.notify_one();
+        }
+
+        // Sleep until the next event is due, or something is scheduled; never 
+        // sleep more than a second, in case the wall clock is changed
+        auto wake = std::chrono::system_clock::now() + std::chrono::seconds(1);
+
+        if (schedule.size() > 0) {
+            auto next = std::chrono::system_clock::time_point(
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                        std::chrono::seconds(schedule.front().trigger_tm.tv_sec) +
+                        std::chrono::microseconds(schedule.front().trigger_tm.tv_usec)));
+
+            if (next < wake)
+                wake = next;
         }
 
-        if (ret > 0 && evt->timeslices != -1 && evt->recurring) {
-            evt->schedule_tm.tv_sec = cur_tm.tv_sec;
-            evt->schedule_tm.tv_usec = cur_tm.tv_usec;
-            evt->trigger_tm.tv_sec = evt->schedule_tm.tv_sec + 
-                (evt->timeslices / SERVER_TIMESLICES_SEC);
-            evt->trigger_tm.tv_usec = evt->schedule_tm.tv_usec + 
-				((evt->timeslices % SERVER_TIMESLICES_SEC) *
-                 (1000000L / SERVER_TIMESLICES_SEC));
-
-            if (evt->trigger_tm.tv_usec >= 999999L) {
-                evt->trigger_tm.tv_sec++;
-                evt->trigger_tm.tv_usec %= 1000000L;
+        timer_cv.wait_until(lock, wake);
+    }
+}
+
+void Timetracker::worker_loop() {
+    std::unique_lock<std::mutex> lock(time_mutex);
+
+    while (1) {
+        if (shutdown) {
+            // Drop anything which hasn't started
+            while (dispatch_queue.size() > 0) {
+                auto evt = dispatch_queue.front();
+                dispatch_queue.pop_front();
+
+                evt->running = false;
+
+                if (evt->removed)
+                    delete evt;
             }
 
-        } else {
-            removed_timers.push_back(timerid);
+            complete_cv.notify_all();
+
+            return;
         }
 
-        for (auto x : removed_timers) {
-            RemoveTimer_nb(x);
+        if (dispatch_queue.size() == 0) {
+            worker_cv.wait(lock);
+            continue;
         }
 
-        // Re-sort the list
-        lock.lock();
-        stable_sort(sorted_timers.begin(), sorted_timers.end(), 
-                SortTimerEventsTrigger());
+        auto evt = dispatch_queue.front();
+        dispatch_queue.pop_front();
+
+        // Removed before it started
+        if (evt->removed) {
+            delete evt;
+            continue;
+        }
+
+        evt->running_thread = std::this_thread::get_id();
+
         lock.unlock();
-    }
 
-    return 1;
+        // Nothing above a worker can catch a failed callback; drop the timer
+        // instead of taking the server down
+        int ret = 0;
+
+        try {
+            ret = Dispatch(evt);
+        } catch (const std::exception& e) {
+            _MSG_ERROR("Timer {} failed: {}", evt->timer_id, e.what());
+        } catch (...) {
+            _MSG_ERROR("Timer {} failed with an unknown error", evt->timer_id);
+        }
+
+        struct timeval cur_tm;
+        gettimeofday(&cur_tm, NULL);
+
+        lock.lock();
+
+        Complete_nb(evt, ret, cur_tm);
+
+        // The rescheduled event may be the next one due
+        timer_cv.notify_one();
+    }
 }
 
-int Timetracker::RegisterTimer(int in_timeslices, struct timeval *in_trigger,
-                               int in_recurring, 
-                               int (*in_callback)(TIMEEVENT_PARMS),
-                               void *in_parm) {
-    local_locker lock(&time_mutex);
-    return RegisterTimer_nb(in_timeslices, in_trigger, 
-            in_recurring, in_callback, in_parm);
+int Timetracker::Dispatch(timer_event *evt) {
+    // Call the function with the given parameters
+    int ret = 0;
+
+    if (evt->callback != NULL) {
+        ret = (*evt->callback)(evt, evt->callback_parm, globalreg);
+    } else if (evt->event != NULL) {
+        ret = evt->event->timetracker_event(evt->timer_id);
+    } else if (evt->event_func != NULL) {
+        ret = evt->event_func(evt->timer_id);
+    }
+
+    return ret;
 }
 
-int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
-                               int in_recurring, 
-                               int (*in_callback)(TIMEEVENT_PARMS),
-                               void *in_parm) {
-    timer_event *evt = new timer_event;
+void Timetracker::Complete_nb(timer_event *evt, int in_ret, const struct timeval& in_now) {
+    evt->running = false;
+    evt->running_thread = std::thread::id();
 
-    evt->timer_id = next_timer_id++;
-    gettimeofday(&(evt->schedule_tm), NULL);
+    complete_cv.notify_all();
 
-    if (in_trigger != NULL) {
-        evt->trigger_tm.tv_sec = in_trigger->tv_sec;
-        evt->trigger_tm.tv_usec = in_trigger->tv_usec;
-        evt->timeslices = -1;
-    } else {
-        evt->trigger_tm.tv_sec = evt->schedule_tm.tv_sec + (in_timeslices / 10);
-        evt->trigger_tm.tv_usec = evt->schedule_tm.tv_usec + (in_timeslices % 10);
-        evt->timeslices = in_timeslices;
+    // Removed while the callback was running
+    if (evt->removed) {
+        delete evt;
+        return;
     }
 
-    evt->recurring = in_recurring;
-    evt->callback = in_callback;
-    evt->callback_parm = in_parm;
-    evt->event = NULL;
+    if (in_ret > 0 && evt->timeslices != -1 && evt->recurring) {
+        // A recurring event with no delay runs once per slice at most
+        int slices = evt->timeslices > 0 ? evt->timeslices : 1;
 
-    timer_map[evt->timer_id] = evt;
-    sorted_timers.push_back(evt);
+        evt->schedule_tm.tv_sec = in_now.tv_sec;
+        evt->schedule_tm.tv_usec = in_now.tv_usec;
+        evt->trigger_tm.tv_sec = evt->schedule_tm.tv_sec + 
+            (slices / SERVER_TIMESLICES_SEC);
+        evt->trigger_tm.tv_usec = evt->schedule_tm.tv_usec + 
+            ((slices % SERVER_TIMESLICES_SEC) *
+             (1000000L / SERVER_TIMESLICES_SEC));
 
-    // Resort the list
-    stable_sort(sorted_timers.begin(), sorted_timers.end(), SortTimerEventsTrigger());
+        if (evt->trigger_tm.tv_usec >= 999999L) {
+            evt->trigger_tm.tv_sec++;
+            evt->trigger_tm.tv_usec %= 1000000L;
+        }
 
-    return evt->timer_id;
+        Enqueue_nb(evt);
+    } else {
+        timer_map.erase(evt->timer_id);
+        delete evt;
+    }
 }
 
-int Timetracker::RegisterTimer(int in_timeslices, struct timeval *in_trigger,
-        int in_recurring, TimetrackerEvent *in_event) {
-    local_locker lock(&time_mutex);
-    return RegisterTimer_nb(in_timeslices, in_trigger, in_recurring, in_event);
+void Timetracker::Enqueue_nb(timer_event *evt) {
+    evt->schedule_gen = schedule_gen++;
+
+    schedule.push_back(schedule_entry {evt->trigger_tm, evt->schedule_gen, evt->timer_id});
+    std::push_heap(schedule.begin(), schedule.end(), ScheduleEntryLater());
+
+    // Removed and rescheduled events leave stale entries behind; if they've come 
+    // to outnumber the live ones, rebuild from the live events
+    if (schedule.size() > 64 && schedule.size() > timer_map.size() * 2) {
+        schedule.clear();
+
+        for (auto t : timer_map) {
+            if (t.second->running)
+                continue;
+
+            schedule.push_back(schedule_entry {t.second->trigger_tm, 
+                    t.second->schedule_gen, t.second->timer_id});
+        }
+
+        std::make_heap(schedule.begin(), schedule.end(), ScheduleEntryLater());
+    }
+
+    timer_cv.notify_one();
 }
 
-int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
-        int in_recurring, TimetrackerEvent *in_event) {
-    timer_event *evt = new timer_event;
+Timetracker::timer_event *Timetracker::NextDue_nb(const struct timeval& in_now, 
+        uint64_t in_max_gen) {
+    while (schedule.size() > 0) {
+        const schedule_entry& top = schedule.front();
+
+        auto ti = timer_map.find(top.timer_id);
 
+        if (ti == timer_map.end() || ti->second->running || 
+                ti->second->schedule_gen != top.gen) {
+            std::pop_heap(schedule.begin(), schedule.end(), ScheduleEntryLater());
+            schedule.pop_back();
+            continue;
+        }
+
+        if ((in_now.tv_sec < top.trigger_tm.tv_sec) ||
+            ((in_now.tv_sec == top.trigger_tm.tv_sec) && 
+             (in_now.tv_usec < top.trigger_tm.tv_usec)))
+            return NULL;
+
+        if (top.gen >= in_max_gen)
+            return NULL;
+
+        std::pop_heap(schedule.begin(), schedule.end(), ScheduleEntryLater());
+        schedule.pop_back();
+
+        return ti->second;
+    }
+
+    return NULL;
+}
+
+int Timetracker::Schedule_nb(timer_event *evt, int in_timeslices, struct timeval *in_trigger) {
     evt->timer_id = next_timer_id++;
     gettimeofday(&(evt->schedule_tm), NULL);
 
@@ -190,50 +348,65 @@ int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
         evt->timeslices = in_timeslices;
     }
 
-    evt->recurring = in_recurring;
-    evt->callback = NULL;
-    evt->callback_parm = NULL;
-    evt->event = in_event;
+    evt->running = false;
+    evt->removed = false;
 
     timer_map[evt->timer_id] = evt;
-    sorted_timers.push_back(evt);
-
-    // Resort the list
-    stable_sort(sorted_timers.begin(), sorted_timers.end(), SortTimerEventsTrigger());
+    Enqueue_nb(evt);
 
     return evt->timer_id;
 }
 
 int Timetracker::RegisterTimer(int in_timeslices, struct timeval *in_trigger,
-        int in_recurring, std::function<int (int)> in_event) {
-    local_locker lock(&time_mutex);
+                               int in_recurring, 
+                               int (*in_callback)(TIMEEVENT_PARMS),
+                               void *in_parm) {
+    std::lock_guard<std::mutex> lock(time_mutex);
+    return RegisterTimer_nb(in_timeslices, in_trigger, 
+            in_recurring, in_callback, in_parm);
+}
+
+int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
+                               int in_recurring, 
+                               int (*in_callback)(TIMEEVENT_PARMS),
+                               void *in_parm) {
+    timer_event *evt = new timer_event;
+
+    evt->recurring = in_recurring;
+    evt->callback = in_callback;
+    evt->callback_parm = in_parm;
+    evt->event = NULL;
+
+    return Schedule_nb(evt, in_timeslices, in_trigger);
+}
+
+int Timetracker::RegisterTimer(int in_timeslices, struct timeval *in_trigger,
+        int in_recurring, TimetrackerEvent *in_event) {
+    std::lock_guard<std::mutex> lock(time_mutex);
     return RegisterTimer_nb(in_timeslices, in_trigger, in_recurring, in_event);
 }
 
 int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
-        int in_recurring, std::function<int (int)> in_event) {
+        int in_recurring, TimetrackerEvent *in_event) {
     timer_event *evt = new timer_event;
 
-    evt->timer_id = next_timer_id++;
-    gettimeofday(&(evt->schedule_tm), NULL);
+    evt->recurring = in_recurring;
+    evt->callback = NULL;
+    evt->callback_parm = NULL;
+    evt->event = in_event;
 
-    if (in_trigger != NULL) {
-        evt->trigger_tm.tv_sec = in_trigger->tv_sec;
-        evt->trigger_tm.tv_usec = in_trigger->tv_usec;
-        evt->timeslices = -1;
-    } else {
-        evt->trigger_tm.tv_sec = evt->schedule_tm.tv_sec + 
-            (in_timeslices / SERVER_TIMESLICES_SEC);
-        evt->trigger_tm.tv_usec = evt->schedule_tm.tv_usec + 
-            ((in_timeslices % SERVER_TIMESLICES_SEC) * 
-             (1000000L / SERVER_TIMESLICES_SEC));
-        evt->timeslices = in_timeslices;
+    return Schedule_nb(evt, in_timeslices, in_trigger);
+}
 
-        if (evt->trigger_tm.tv_usec >= 999999L) {
-            evt->trigger_tm.tv_sec++;
-            evt->trigger_tm.tv_usec %= 1000000L;
-        }
-    }
+int Timetracker::RegisterTimer(int in_timeslices, struct timeval *in_trigger,
+        int in_recurring, std::function<int (int)> in_event) {
+    std::lock_guard<std::mutex> lock(time_mutex);
+    return RegisterTimer_nb(in_timeslices, in_trigger, in_recurring, in_event);
+}
+
+int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
+        int in_recurring, std::function<int (int)> in_event) {
+    timer_event *evt = new timer_event;
 
     evt->recurring = in_recurring;
     evt->callback = NULL;
@@ -242,17 +415,29 @@ int Timetracker::RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
     
     evt->event_func = in_event;
 
-    timer_map[evt->timer_id] = evt;
-    sorted_timers.push_back(evt);
-
-    // Resort the list
-    stable_sort(sorted_timers.begin(), sorted_timers.end(), SortTimerEventsTrigger());
-
-    return evt->timer_id;
+    return Schedule_nb(evt, in_timeslices, in_trigger);
 }
 
 int Timetracker::RemoveTimer(int in_timerid) {
-    local_locker lock(&time_mutex);
+    std::lock_guard<std::mutex> lock(time_mutex);
+    return RemoveTimer_nb(in_timerid);
+}
+
+int Timetracker::RemoveTimerAndWait(int in_timerid) {
+    std::unique_lock<std::mutex> lock(time_mutex);
+
+    // A callback removing its own timer can't wait for itself
+    while (1) {
+        auto itr = timer_map.find(in_timerid);
+
+        if (itr == timer_map.end() || !itr->second->running ||
+                itr->second->running_thread == std::thread::id() ||
+                itr->second->running_thread == std::this_thread::get_id())
+            break;
+
+        complete_cv.wait(lock);
+    }
+
     return RemoveTimer_nb(in_timerid);
 }
 
@@ -262,22 +447,19 @@ int Timetracker::RemoveTimer_nb(int in_timerid) {
     itr = timer_map.find(in_timerid);
 
     if (itr != timer_map.end()) {
-        for (unsigned int x = 0; x < sorted_timers.size(); x++) {
-            if (sorted_timers[x]->timer_id == in_timerid) {
-                sorted_timers.erase(sorted_timers.begin() + x);
-                break;
-            }
-        }
+        timer_event *evt = itr->second;
 
-        delete itr->second;
         timer_map.erase(itr);
 
-        // Resort the list
-        stable_sort(sorted_timers.begin(), sorted_timers.end(), SortTimerEventsTrigger());
+        // The schedule entry is discarded when it reaches the top; a running
+        // event is freed when its callback returns
+        if (evt->running)
+            evt->removed = true;
+        else
+            delete evt;
 
         return 1;
     }
 
     return -1;
 }
-
@@ -29,7 +29,11 @@
 #include <algorithm>
 #include <string>
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <thread>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
@@ -66,6 +70,17 @@ public:
         // C function, if we weren't
         int (*callback)(timer_event *, void *, GlobalRegistry *);
         void *callback_parm;
+
+        // Generation of the live schedule entry for this event
+        uint64_t schedule_gen;
+
+        // Callback is queued or running; a timer removed while running is freed 
+        // when the callback returns
+        bool running;
+        bool removed;
+
+        // Thread running the callback, once it has started
+        std::thread::id running_thread;
     };
 
     // Sort alerts by alert trigger time
@@ -97,9 +112,13 @@ private:
 public:
     virtual ~Timetracker();
 
-    // Tick and handle timers
+    // Tick and handle timers.  When timers are dispatched to worker threads, the 
+    // first tick starts them and later ticks only update the global timestamp.
     int Tick();
 
+    // Stop dispatching timers and wait for any running callbacks to finish
+    void StopTimers();
+
     // Register an optionally recurring timer.  Slices are 1/100th of a second,
     // the smallest linux can slice without getting into weird calls.
     int RegisterTimer(int in_timeslices, struct timeval *in_trigger,
@@ -113,13 +132,19 @@ public:
     int RegisterTimer(int timeslices, struct timeval *in_trigger,
             int in_recurring, std::function<int (int)> event);
 
-    // Remove a timer that's going to execute
+    // Remove a timer that's going to execute.  If the timer callback is running
+    // it is allowed to finish, and the timer is discarded after.
     int RemoveTimer(int timer_id);
 
+    // Remove a timer and wait for a callback running on another thread to finish,
+    // for teardown which frees what the callback uses.  The caller must not hold
+    // any lock the callback takes.
+    int RemoveTimerAndWait(int timer_id);
+
 protected:
     GlobalRegistry *globalreg;
 
-    kis_recursive_timed_mutex time_mutex;
+    std::mutex time_mutex;
 
     // Nonblocking versions
     int RegisterTimer_nb(int in_timeslices, struct timeval *in_trigger,
@@ -132,9 +157,62 @@ protected:
             int in_recurring, std::function<int (int)> event);
     int RemoveTimer_nb(int timer_id);
 
+    // Fill in the trigger time and schedule a new event
+    int Schedule_nb(timer_event *evt, int in_timeslices, struct timeval *in_trigger);
+
+    // Schedule queue, a min-heap by trigger time.  Removing or rescheduling a 
+    // timer leaves its old entry in place; entries which don't match the current
+    // generation of their event are discarded as they reach the top.
+    struct schedule_entry {
+        struct timeval trigger_tm;
+        uint64_t gen;
+        int timer_id;
+    };
+
+    class ScheduleEntryLater {
+    public:
+        inline bool operator() (const schedule_entry& x, const schedule_entry& y) const {
+            if (x.trigger_tm.tv_sec != y.trigger_tm.tv_sec)
+                return x.trigger_tm.tv_sec > y.trigger_tm.tv_sec;
+            if (x.trigger_tm.tv_usec != y.trigger_tm.tv_usec)
+                return x.trigger_tm.tv_usec > y.trigger_tm.tv_usec;
+            return x.gen > y.gen;
+        }
+    };
+
+    void Enqueue_nb(timer_event *evt);
+
+    // Pop the next event due at in_now which was scheduled before generation 
+    // in_max_gen, or NULL
+    timer_event *NextDue_nb(const struct timeval& in_now, uint64_t in_max_gen);
+
+    // Reschedule or discard an event after its callback has run
+    void Complete_nb(timer_event *evt, int in_ret, const struct timeval& in_now);
+
+    int Dispatch(timer_event *evt);
+
     int next_timer_id;
     std::map<int, timer_event *> timer_map;
-    std::vector<timer_event *> sorted_timers;
+
+    std::vector<schedule_entry> schedule;
+    uint64_t schedule_gen;
+
+    // Timer thread and callback workers; with no workers, timers are run in
+    // the main loop from Tick()
+    void timer_thread_loop();
+    void worker_loop();
+
+    unsigned int num_workers;
+    bool threads_running;
+    bool shutdown;
+
+    std::condition_variable timer_cv;
+    std::condition_variable worker_cv;
+    std::condition_variable complete_cv;
+    std::deque<timer_event *> dispatch_queue;
+
+    std::thread timer_thread;
+    std::vector<std::thread> worker_threads;
 };
 
 class TimetrackerEvent {
@@ -27,6 +27,9 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <limits>
+#include <mutex>
 #include <string>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -54,14 +57,12 @@ public:
         return a + b;
     }
 
-    // Combine a vector for a higher-level record (seconds to minutes, minutes to 
-    // hours, and so on).
-    static int64_t combine_vector(std::shared_ptr<TrackerElementVectorDouble> e) {
-        int64_t avg = 0;
-        for (auto i : *e)
-            avg += i;
-
-        return avg / e->size();
+    // Combine a set of slots for a higher-level record (seconds to minutes, minutes 
+    // to hours, and so on).  The RRD keeps a running sum of the slots which hold 
+    // a value other than the default, and how many of them there are, so this
+    // doesn't need to look at the slots themselves.
+    static int64_t combine_slots(const int64_t sum, const size_t used, const size_t total) {
+        return (sum + (int64_t) (total - used) * default_val()) / (int64_t) total;
     }
 
     // Default 'empty' value
@@ -74,30 +75,258 @@ public:
     }
 };
 
-template <class Aggregator = kis_tracked_rrd_default_aggregator>
-class kis_tracked_rrd : public tracker_component {
+// Fixed set of RRD slots stored inline, with a running sum of the slots which
+// aren't blank.  Samples are clamped to the storage type, so RRDs which only
+// ever see small values (packet counts, signal levels) can use a narrow type.
+template <typename Sample, size_t N>
+class kis_tracked_rrd_slots {
+public:
+    void reset(int64_t in_blank) {
+        slots.fill((Sample) in_blank);
+        sum = 0;
+        used = 0;
+    }
+
+    int64_t get(size_t in_slot) const {
+        return slots[in_slot];
+    }
+
+    void set(size_t in_slot, int64_t in_val, int64_t in_blank) {
+        Sample v = clamp(in_val);
+
+        if (slots[in_slot] != (Sample) in_blank) {
+            sum -= slots[in_slot];
+            used--;
+        }
+
+        if (v != (Sample) in_blank) {
+            sum += v;
+            used++;
+        }
+
+        slots[in_slot] = v;
+    }
+
+    template <class Aggregator>
+    int64_t combine() const {
+        return Aggregator::combine_slots(sum, used, N);
+    }
+
+    size_t size() const {
+        return N;
+    }
+
+protected:
+    static Sample clamp(int64_t in_val) {
+        if (in_val > (int64_t) std::numeric_limits<Sample>::max())
+            return std::numeric_limits<Sample>::max();
+        if (in_val < (int64_t) std::numeric_limits<Sample>::min())
+            return std::numeric_limits<Sample>::min();
+        return (Sample) in_val;
+    }
+
+    std::array<Sample, N> slots;
+    int64_t sum;
+    uint8_t used;
+};
+
+// Common RRD record handling.  The RRD data lives in the fixed slot arrays of
+// the RRD itself; the tracked fields are only built while the RRD is being 
+// serialized, or when a single field is looked up by path, and are dropped again
+// when the last serialization finishes.  
+//
+// The exported fields are only added to or removed from the map under the 
+// export lock, and never while a serializer is walking the map.
+template <class Aggregator>
+class kis_tracked_rrd_common : public tracker_component {
+public:
+    kis_tracked_rrd_common() :
+        tracker_component(),
+        last_time {0},
+        export_refs {0},
+        update_first {true} { }
+
+    kis_tracked_rrd_common(int in_id) :
+        tracker_component(in_id),
+        last_time {0},
+        export_refs {0},
+        update_first {true} { }
+
+    // By default a RRD will fast forward to the current time before
+    // transmission (this is desirable for RRD records that may not be
+    // routinely updated, like records tracking activity on a specific 
+    // device).  For records which are updated on a timer and the most
+    // recently used value accessed (like devices per frequency) turning
+    // this off may produce better results.
+    void update_before_serialize(bool in_upd) {
+        update_first = in_upd;
+    }
+
+    time_t get_last_time() const {
+        return last_time;
+    }
+
+    void set_last_time(time_t in_time) {
+        last_time = in_time;
+    }
+
+    virtual void add_sample(int64_t in_s, time_t in_time) = 0;
+
+    virtual SharedTrackerElement get_sub(int in_id) override {
+        std::lock_guard<std::mutex> lk(export_mutex);
+
+        if (export_refs == 0)
+            export_field(in_id);
+
+        return TrackerElementMap::get_sub(in_id);
+    }
+
+    virtual void pre_serialize() override {
+        tracker_component::pre_serialize();
+        Aggregator agg;
+
+        if (update_first) {
+            add_sample(agg.default_val(), time(0));
+        }
+
+        std::lock_guard<std::mutex> lk(export_mutex);
+
+        export_refs++;
+
+        for (auto id : field_ids())
+            export_field(id);
+    }
+
+    virtual void post_serialize() override {
+        tracker_component::post_serialize();
+
+        std::lock_guard<std::mutex> lk(export_mutex);
+
+        if (export_refs > 0 && --export_refs == 0)
+            map.clear();
+    }
+
+protected:
+    inline int minutes_different(int m1, int m2) const {
+        if (m1 == m2) {
+            return 0;
+        } else if (m1 < m2) {
+            return m2 - m1;
+        } else {
+            return 60 - m1 + m2;
+        }
+    }
+
+    inline int hours_different(int h1, int h2) const {
+        if (h1 == h2) {
+            return 0;
+        } else if (h1 < h2) {
+            return h2 - h1;
+        } else {
+            return 24 - h1 + h2;
+        }
+    }
+
+    virtual void register_fields() override {
+        tracker_component::register_fields();
+
+        last_time_id =
+            RegisterField("kismet.common.rrd.last_time", 
+                    TrackerElementFactory<TrackerElementUInt64>(),
+                    "last time udpated");
+        blank_val_id =
+            RegisterField("kismet.common.rrd.blank_val", 
+                    TrackerElementFactory<TrackerElementInt64>(),
+                    "blank value");
+        aggregator_id =
+            RegisterField("kismet.common.rrd.aggregator", 
+                    TrackerElementFactory<TrackerElementString>(),
+                    "aggregator name");
+
+        RegisterField("kismet.common.rrd.second", 
+                TrackerElementFactory<TrackerElementInt64>(),
+                "second value");
+    }
+
+    // All exported field ids
+    virtual std::vector<int> field_ids() const {
+        return std::vector<int>{last_time_id, blank_val_id, aggregator_id};
+    }
+
+    // Build, or refresh, an exported field
+    virtual void export_field(int in_id) {
+        Aggregator agg;
+
+        if (in_id == last_time_id)
+            export_value<TrackerElementUInt64>(in_id, (uint64_t) last_time);
+        else if (in_id == blank_val_id)
+            export_value<TrackerElementInt64>(in_id, agg.default_val());
+        else if (in_id == aggregator_id)
+            export_value<TrackerElementString>(in_id, agg.name());
+    }
+
+    template <class T, typename V>
+    void export_value(int in_id, const V& in_val) {
+        auto e = map.find(in_id);
+
+        if (e == map.end()) {
+            auto v = Globalreg::globalreg->entrytracker->GetSharedInstanceAs<T>(in_id);
+            v->set(in_val);
+            map.emplace(in_id, v);
+        } else {
+            std::static_pointer_cast<T>(e->second)->set(in_val);
+        }
+    }
+
+    template <typename S>
+    void export_slots(int in_id, const S& in_slots) {
+        auto e = map.find(in_id);
+
+        if (e == map.end()) {
+            auto v = 
+                Globalreg::globalreg->entrytracker->GetSharedInstanceAs<TrackerElementVectorDouble>(in_id);
+            v->reserve(in_slots.size());
+            for (size_t i = 0; i < in_slots.size(); i++)
+                v->push_back(in_slots.get(i));
+            map.emplace(in_id, v);
+        } else {
+            auto v = std::static_pointer_cast<TrackerElementVectorDouble>(e->second);
+            for (size_t i = 0; i < in_slots.size(); i++)
+                (*v)[i] = in_slots.get(i);
+        }
+    }
+
+    time_t last_time;
+
+    int last_time_id;
+    int blank_val_id;
+    int aggregator_id;
+
+    std::mutex export_mutex;
+    unsigned int export_refs;
+
+    bool update_first;
+};
+
+template <class Aggregator = kis_tracked_rrd_default_aggregator, typename Sample = int64_t>
+class kis_tracked_rrd : public kis_tracked_rrd_common<Aggregator> {
 public:
     kis_tracked_rrd() :
-        tracker_component() {
+        kis_tracked_rrd_common<Aggregator>() {
         register_fields();
         reserve_fields(NULL);
-        update_first = true;
     }
 
     kis_tracked_rrd(int in_id) :
-        tracker_component(in_id) {
+        kis_tracked_rrd_common<Aggregator>(in_id) {
         register_fields();
         reserve_fields(NULL);
-        update_first = true;
     }
 
     kis_tracked_rrd(int in_id, std::shared_ptr<TrackerElementMap> e) :
-        tracker_component(in_id) {
-
+        kis_tracked_rrd_common<Aggregator>(in_id) {
         register_fields();
         reserve_fields(e);
-        update_first = true;
-
     }
 
     virtual uint32_t get_signature() const override {
@@ -116,27 +345,16 @@ public:
         return std::move(dup);
     }
 
-    // By default a RRD will fast forward to the current time before
-    // transmission (this is desirable for RRD records that may not be
-    // routinely updated, like records tracking activity on a specific 
-    // device).  For records which are updated on a timer and the most
-    // recently used value accessed (like devices per frequency) turning
-    // this off may produce better results.
-    void update_before_serialize(bool in_upd) {
-        update_first = in_upd;
-    }
-
-    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
-
     // Add a sample.  Use combinator function 'c' to derive the new sample value
-    void add_sample(int64_t in_s, time_t in_time) {
+    virtual void add_sample(int64_t in_s, time_t in_time) override {
         Aggregator agg;
+        const int64_t blank = agg.default_val();
 
         int sec_bucket = in_time % 60;
         int min_bucket = (in_time / 60) % 60;
         int hour_bucket = (in_time / 3600) % 24;
 
-        time_t ltime = get_last_time();
+        time_t ltime = this->get_last_time();
 
         // The second slot for the last time
         int last_sec_bucket = ltime % 60;
@@ -154,281 +372,164 @@ public:
         // none of it is valid.  This is the simplest case.
         if (in_time - ltime > (60 * 60 * 24)) {
             // Directly fill in this second, clear rest of the minute
-            for (auto i = minute_vec->begin(); i != minute_vec->end(); ++i) {
-                if (i - minute_vec->begin() == sec_bucket)
-                    *i = in_s;
-                else
-                    *i = agg.default_val();
-            }
+            minute_slots.reset(blank);
+            minute_slots.set(sec_bucket, in_s, blank);
 
             // Reset the last hour, setting it to a single sample
-            // Get the combined value for the minute
-            int64_t min_val = agg.combine_vector(minute_vec);
-            for (auto i = hour_vec->begin(); i != hour_vec->end(); ++i) {
-                if (i - hour_vec->begin() == min_bucket)
-                    *i = min_val;
-                else
-                    *i = agg.default_val();
-            }
+            hour_slots.reset(blank);
+            hour_slots.set(min_bucket, minute_slots.template combine<Aggregator>(), blank);
 
             // Reset the last day, setting it to a single sample
-            int64_t hr_val = agg.combine_vector(hour_vec);
-            for (auto i = day_vec->begin(); i != day_vec->end(); ++i) {
-                if (i - day_vec->begin() == hour_bucket)
-                    *i = hr_val;
-                else
-                    *i = agg.default_val();
-            }
+            day_slots.reset(blank);
+            day_slots.set(hour_bucket, hour_slots.template combine<Aggregator>(), blank);
 
-            set_last_time(in_time);
+            this->set_last_time(in_time);
 
             return;
         } else if (in_time - ltime > (60*60)) {
-            // printf("debug - rrd - been an hour since last value\n");
             // If we haven't seen data in an hour but we're still w/in the day:
-            //   - Average the seconds we know about & set the minute record
             //   - Clear seconds data & set our current value
-            //   - Average the minutes we know about & set the hour record
-            //
-           
-            int64_t sec_avg = 0, min_avg = 0;
+            //   - Clear the hour & set the minute record
+            //   - Clear the hours since the last data & set the hour record
 
-            // We only have this entry in the minute, so set it and get the 
-            // combined value
-            
-            for (auto i = minute_vec->begin(); i != minute_vec->end(); ++i) {
-                if (i - minute_vec->begin() == sec_bucket)
-                    *i = in_s;
-                else
-                    *i = agg.default_val();
-            }
-            sec_avg = agg.combine_vector(minute_vec);
-
-            // We haven't seen anything in this hour, so clear it, set the minute
-            // and get the aggregate
-            for (auto i = hour_vec->begin(); i != hour_vec->end(); ++i) {
-                if (i - hour_vec->begin() == min_bucket)
-                    *i = sec_avg;
-                else
-                    *i = agg.default_val();
-            }
-            min_avg = agg.combine_vector(hour_vec);
+            // We only have this entry in the minute
+            minute_slots.reset(blank);
+            minute_slots.set(sec_bucket, in_s, blank);
+
+            // We haven't seen anything in this hour, so clear it and set the minute
+            hour_slots.reset(blank);
+            hour_slots.set(min_bucket, minute_slots.template combine<Aggregator>(), blank);
 
             // Fill the hours between the last time we saw data and now with
             // zeroes; fastforward time
-            for (int h = 0; h < hours_different(last_hour_bucket + 1, hour_bucket); h++) {
-                *(hour_vec->begin() + ((last_hour_bucket + 1 + h) % 24)) = agg.default_val();
-            }
-
-            *(day_vec->begin() + hour_bucket) = min_avg;
+            for (int h = 0; h < this->hours_different(last_hour_bucket + 1, hour_bucket); h++) 
+                day_slots.set((last_hour_bucket + 1 + h) % 24, blank, blank);
 
+            day_slots.set(hour_bucket, hour_slots.template combine<Aggregator>(), blank);
         } else if (in_time - ltime > 60) {
-            // - Calculate the average seconds
             // - Wipe the seconds
             // - Set the new second value
             // - Update minutes
             // - Update hours
-            // printf("debug - rrd - been over a minute since last value\n");
-
-            int64_t sec_avg = 0, min_avg = 0;
-
-            for (auto i = minute_vec->begin(); i != minute_vec->end(); ++i) {
-                if (i - minute_vec->begin() == sec_bucket)
-                    *i = in_s;
-                else
-                    *i = agg.default_val();
-            }
-            sec_avg = agg.combine_vector(minute_vec);
+            minute_slots.reset(blank);
+            minute_slots.set(sec_bucket, in_s, blank);
 
             // Zero between last and current
-            for (int m = 0; 
-                    m < minutes_different(last_min_bucket + 1, min_bucket); m++) {
-                *(hour_vec->begin() + ((last_min_bucket + 1 + m) % 60)) = agg.default_val();
-            }
+            for (int m = 0; m < this->minutes_different(last_min_bucket + 1, min_bucket); m++) 
+                hour_slots.set((last_min_bucket + 1 + m) % 60, blank, blank);
 
             // Set the updated value
-            *(hour_vec->begin() + min_bucket) = sec_avg;;
-
-            min_avg = agg.combine_vector(hour_vec);
+            hour_slots.set(min_bucket, minute_slots.template combine<Aggregator>(), blank);
 
             // Reset the hour
-            *(day_vec->begin() + hour_bucket) = min_avg;
+            day_slots.set(hour_bucket, hour_slots.template combine<Aggregator>(), blank);
         } else {
-            // printf("debug - rrd - w/in the last minute %d seconds\n", in_time - last_time);
             // If in_time == last_time then we're updating an existing record,
             // use the aggregator class to combine it
             
             // Otherwise, fast-forward seconds with zero data, then propagate the
             // changes up
             if (in_time == ltime) {
-                int64_t v = *(minute_vec->begin() + sec_bucket);
-                *(minute_vec->begin() + sec_bucket) = agg.combine_element(v, in_s);
+                minute_slots.set(sec_bucket, 
+                        agg.combine_element(minute_slots.get(sec_bucket), in_s), blank);
             } else {
-                for (int s = 0; s < minutes_different(last_sec_bucket + 1, sec_bucket); s++) {
-                    *(minute_vec->begin() + ((last_sec_bucket + 1 + s) % 60)) = agg.default_val();
-                }
+                for (int s = 0; s < this->minutes_different(last_sec_bucket + 1, sec_bucket); s++) 
+                    minute_slots.set((last_sec_bucket + 1 + s) % 60, blank, blank);
 
-                *(minute_vec->begin() + sec_bucket) = in_s;
+                minute_slots.set(sec_bucket, in_s, blank);
             }
 
-            // Update all the averages
-            int64_t sec_avg = 0, min_avg = 0;
-
-            sec_avg = agg.combine_vector(minute_vec);
-
-            // Set the minute
-            *(hour_vec->begin() + min_bucket) = sec_avg;
-
-            min_avg = agg.combine_vector(hour_vec);
-
-            // Set the hour
-            *(day_vec->begin() + hour_bucket) = min_avg;
+            // Set the minute and the hour from the running totals
+            hour_slots.set(min_bucket, minute_slots.template combine<Aggregator>(), blank);
+            day_slots.set(hour_bucket, hour_slots.template combine<Aggregator>(), blank);
         }
 
-        set_last_time(in_time);
-    }
-
-    virtual void pre_serialize() override {
-        tracker_component::pre_serialize();
-        Aggregator agg;
-
-        // printf("debug - rrd - preserialize\n");
-        // Update the averages
-        if (update_first) {
-            add_sample(agg.default_val(), time(0));
-        }
+        this->set_last_time(in_time);
     }
 
 protected:
-    inline int minutes_different(int m1, int m2) const {
-        if (m1 == m2) {
-            return 0;
-        } else if (m1 < m2) {
-            return m2 - m1;
-        } else {
-            return 60 - m1 + m2;
-        }
-    }
-
-    inline int hours_different(int h1, int h2) const {
-        if (h1 == h2) {
-            return 0;
-        } else if (h1 < h2) {
-            return h2 - h1;
-        } else {
-            return 24 - h1 + h2;
-        }
-    }
-
-    inline int days_different(int d1, int d2) const {
-        if (d1 == d2) {
-            return 0;
-        } else if (d1 < d2) {
-            return d2 - d1;
-        } else {
-            return 7 - d1 + d2;
-        }
-    }
-
     virtual void register_fields() override {
-        tracker_component::register_fields();
-
-        RegisterField("kismet.common.rrd.last_time", "last time udpated", &last_time);
-
-        RegisterField("kismet.common.rrd.minute_vec", "past minute values per second", &minute_vec);
-        RegisterField("kismet.common.rrd.hour_vec", "past hour values per minute", &hour_vec);
-        RegisterField("kismet.common.rrd.day_vec", "past day values per hour", &day_vec);
-
-        RegisterField("kismet.common.rrd.blank_val", "blank value", &blank_val);
-        RegisterField("kismet.common.rrd.aggregator", "aggregator name", &aggregator_name);
-
-        second_entry_id = 
-            RegisterField("kismet.common.rrd.second", 
-                    TrackerElementFactory<TrackerElementInt64>(),
-                    "second value");
-        minute_entry_id = 
-            RegisterField("kismet.common.rrd.minute", 
-                    TrackerElementFactory<TrackerElementInt64>(),
-                    "minute value");
-        hour_entry_id = 
-            RegisterField("kismet.common.rrd.hour", 
-                    TrackerElementFactory<TrackerElementInt64>(),
-                    "hour value", NULL);
-
+        kis_tracked_rrd_common<Aggregator>::register_fields();
+
+        minute_vec_id =
+            this->RegisterField("kismet.common.rrd.minute_vec", 
+                    TrackerElementFactory<TrackerElementVectorDouble>(),
+                    "past minute values per second");
+        hour_vec_id =
+            this->RegisterField("kismet.common.rrd.hour_vec", 
+                    TrackerElementFactory<TrackerElementVectorDouble>(),
+                    "past hour values per minute");
+        day_vec_id =
+            this->RegisterField("kismet.common.rrd.day_vec", 
+                    TrackerElementFactory<TrackerElementVectorDouble>(),
+                    "past day values per hour");
+
+        this->RegisterField("kismet.common.rrd.minute", 
+                TrackerElementFactory<TrackerElementInt64>(),
+                "minute value");
+        this->RegisterField("kismet.common.rrd.hour", 
+                TrackerElementFactory<TrackerElementInt64>(),
+                "hour value");
     } 
 
     virtual void reserve_fields(std::shared_ptr<TrackerElementMap> e) override {
-        tracker_component::reserve_fields(e);
-
-        // Build slots for all the times
-        int x;
-        if ((x = minute_vec->size()) != 60) {
-            for ( ; x < 60; x++) {
-                minute_vec->push_back(0);
-            }
-        }
-
-        if ((x = hour_vec->size()) != 60) {
-            for ( ; x < 60; x++) {
-                hour_vec->push_back(0);
-            }
-        }
-
-        if ((x = day_vec->size()) != 24) {
-            for ( ; x < 24; x++) {
-                day_vec->push_back(0);
-            }
-        }
+        kis_tracked_rrd_common<Aggregator>::reserve_fields(e);
 
         Aggregator agg;
-        (*blank_val).set(agg.default_val());
-        (*aggregator_name).set(agg.name());
-
+        minute_slots.reset(agg.default_val());
+        hour_slots.reset(agg.default_val());
+        day_slots.reset(agg.default_val());
     }
 
-    std::shared_ptr<TrackerElementUInt64> last_time;
-
-    std::shared_ptr<TrackerElementVectorDouble> minute_vec;
-    std::shared_ptr<TrackerElementVectorDouble> hour_vec;
-    std::shared_ptr<TrackerElementVectorDouble> day_vec;
+    virtual std::vector<int> field_ids() const override {
+        auto ids = kis_tracked_rrd_common<Aggregator>::field_ids();
+        ids.push_back(minute_vec_id);
+        ids.push_back(hour_vec_id);
+        ids.push_back(day_vec_id);
+        return ids;
+    }
 
-    std::shared_ptr<TrackerElementInt64> blank_val;
-    std::shared_ptr<TrackerElementString> aggregator_name;
+    virtual void export_field(int in_id) override {
+        if (in_id == minute_vec_id)
+            this->export_slots(in_id, minute_slots);
+        else if (in_id == hour_vec_id)
+            this->export_slots(in_id, hour_slots);
+        else if (in_id == day_vec_id)
+            this->export_slots(in_id, day_slots);
+        else
+            kis_tracked_rrd_common<Aggregator>::export_field(in_id);
+    }
 
-    int second_entry_id;
-    int minute_entry_id;
-    int hour_entry_id;
+    kis_tracked_rrd_slots<Sample, 60> minute_slots;
+    kis_tracked_rrd_slots<Sample, 60> hour_slots;
+    kis_tracked_rrd_slots<Sample, 24> day_slots;
 
-    bool update_first;
+    int minute_vec_id;
+    int hour_vec_id;
+    int day_vec_id;
 };
 
 // Easier to make this it's own class since for a single-minute RRD the logic is
-// far simpler.  In a perfect would this would be derived from the common
-// RRD (or the other way around) but until it becomes a problem that's a
-// task for another day.
-template <class Aggregator = kis_tracked_rrd_default_aggregator >
-class kis_tracked_minute_rrd : public tracker_component {
+// far simpler.
+template <class Aggregator = kis_tracked_rrd_default_aggregator, typename Sample = int64_t>
+class kis_tracked_minute_rrd : public kis_tracked_rrd_common<Aggregator> {
 public:
     kis_tracked_minute_rrd() :
-        tracker_component(0) {
+        kis_tracked_rrd_common<Aggregator>(0) {
         register_fields();
         reserve_fields(NULL);
-        update_first = true;
     }
 
     kis_tracked_minute_rrd(int in_id) :
-        tracker_component(in_id) {
+        kis_tracked_rrd_common<Aggregator>(in_id) {
         register_fields();
         reserve_fields(NULL);
-        update_first = true;
     }
 
     kis_tracked_minute_rrd(int in_id, std::shared_ptr<TrackerElementMap> e) :
-        tracker_component(in_id) {
-
+        kis_tracked_rrd_common<Aggregator>(in_id) {
         register_fields();
         reserve_fields(e);
-        update_first = true;
     }
 
     virtual uint32_t get_signature() const override {
@@ -447,24 +548,13 @@ public:
         return std::move(dup);
     }
 
-    // By default a RRD will fast forward to the current time before
-    // transmission (this is desirable for RRD records that may not be
-    // routinely updated, like records tracking activity on a specific 
-    // device).  For records which are updated on a timer and the most
-    // recently used value accessed (like devices per frequency) turning
-    // this off may produce better results.
-    void update_before_serialize(bool in_upd) {
-        update_first = in_upd;
-    }
-
-    __Proxy(last_time, uint64_t, time_t, time_t, last_time);
-
-    void add_sample(int64_t in_s, time_t in_time) {
+    virtual void add_sample(int64_t in_s, time_t in_time) override {
         Aggregator agg;
+        const int64_t blank = agg.default_val();
 
         int sec_bucket = in_time % 60;
 
-        time_t ltime = get_last_time();
+        time_t ltime = this->get_last_time();
 
         // The second slot for the last time
         int last_sec_bucket = ltime % 60;
@@ -473,95 +563,61 @@ public:
             return;
         }
         
-        SharedTrackerElement e;
-
-        // If we haven't seen data in a minute, wipe
+        // If we haven't seen data in a minute, wipe and start over with this sample
         if (in_time - ltime > 60) {
-            for (int x = 0; x < 60; x++) {
-                *(minute_vec->begin() + x) = agg.default_val();
-            }
+            minute_slots.reset(blank);
+            minute_slots.set(sec_bucket, in_s, blank);
         } else {
             // If in_time == last_time then we're updating an existing record, so
             // add that in.
-            // Otherwise, fast-forward seconds with zero data, average the seconds,
-            // and propagate the averages up
+            // Otherwise, fast-forward seconds with zero data
             if (in_time == ltime) {
-                uint64_t v = *(minute_vec->begin() + sec_bucket);
-                *(minute_vec->begin() + sec_bucket) = agg.combine_element(v, in_s);
+                minute_slots.set(sec_bucket, 
+                        agg.combine_element(minute_slots.get(sec_bucket), in_s), blank);
             } else {
-                for (int s = 0; s < minutes_different(last_sec_bucket + 1, sec_bucket); s++) {
-                    *(minute_vec->begin() + ((last_sec_bucket + 1 + s) % 60)) = agg.default_val();
-                }
+                for (int s = 0; s < this->minutes_different(last_sec_bucket + 1, sec_bucket); s++) 
+                    minute_slots.set((last_sec_bucket + 1 + s) % 60, blank, blank);
 
-                *(minute_vec->begin() + sec_bucket) = in_s;
+                minute_slots.set(sec_bucket, in_s, blank);
             }
         }
 
-        set_last_time(in_time);
-    }
-
-    virtual void pre_serialize() override {
-        tracker_component::pre_serialize();
-        Aggregator agg;
-
-        if (update_first) {
-            add_sample(agg.default_val(), time(0));
-        }
+        this->set_last_time(in_time);
     }
 
 protected:
-    inline int minutes_different(int m1, int m2) const {
-        if (m1 == m2) {
-            return 0;
-        } else if (m1 < m2) {
-            return m2 - m1;
-        } else {
-            return 60 - m1 + m2;
-        }
-    }
-
     virtual void register_fields() override {
-        tracker_component::register_fields();
-
-        RegisterField("kismet.common.rrd.last_time", "last time udpated", &last_time);
-
-        RegisterField("kismet.common.rrd.minute_vec", "past minute values per second", &minute_vec);
-
-        second_entry_id = 
-            RegisterField("kismet.common.rrd.second", 
-                    TrackerElementFactory<TrackerElementInt64>(),
-                    "second value");
+        kis_tracked_rrd_common<Aggregator>::register_fields();
 
-        RegisterField("kismet.common.rrd.blank_val", "blank value", &blank_val);
-        RegisterField("kismet.common.rrd.aggregator", "aggregator name", &aggregator_name);
+        minute_vec_id =
+            this->RegisterField("kismet.common.rrd.minute_vec", 
+                    TrackerElementFactory<TrackerElementVectorDouble>(),
+                    "past minute values per second");
     } 
 
     virtual void reserve_fields(std::shared_ptr<TrackerElementMap> e) override {
-        tracker_component::reserve_fields(e);
-
-        set_last_time(0);
-
-        // Build slots for all the times
-        int x;
-        if ((x = minute_vec->size()) != 60) {
-            for ( ; x < 60; x++) {
-                minute_vec->push_back(0);
-            }
-        }
+        kis_tracked_rrd_common<Aggregator>::reserve_fields(e);
 
         Aggregator agg;
-        (*blank_val).set(agg.default_val());
-        (*aggregator_name).set(agg.name());
+        minute_slots.reset(agg.default_val());
     }
 
-    std::shared_ptr<TrackerElementUInt64> last_time;
-    std::shared_ptr<TrackerElementVectorDouble> minute_vec;
-    std::shared_ptr<TrackerElementInt64> blank_val;
-    std::shared_ptr<TrackerElementString> aggregator_name;
+    virtual std::vector<int> field_ids() const override {
+        auto ids = kis_tracked_rrd_common<Aggregator>::field_ids();
+        ids.push_back(minute_vec_id);
+        return ids;
+    }
+
+    virtual void export_field(int in_id) override {
+        if (in_id == minute_vec_id)
+            this->export_slots(in_id, minute_slots);
+        else
+            kis_tracked_rrd_common<Aggregator>::export_field(in_id);
+    }
 
-    int second_entry_id;
+    kis_tracked_rrd_slots<Sample, 60> minute_slots;
 
-    bool update_first;
+    int minute_vec_id;
 };
 
 // Signal level RRD, peak selector on overlap, averages signal but ignores
@@ -575,24 +631,13 @@ public:
         return a;
     }
 
-    // Select the strongest signal of the bucket
-    static int64_t combine_vector(std::shared_ptr<TrackerElementVectorDouble> e) {
-        int64_t avg = 0, avgc = 0;
-
-        for (auto i : *e) {
-            int64_t v = i;
-
-            if (v == 0)
-                continue;
-
-            avg += v;
-            avgc++;
-        }
-
-        if (avgc == 0)
+    // Average the signal of the bucket, ignoring empty slots
+    static int64_t combine_slots(const int64_t sum, const size_t used, 
+            const size_t total __attribute__((unused))) {
+        if (used == 0)
             return default_val();
 
-        return avg / avgc;
+        return sum / (int64_t) used;
     }
 
     // Default 'empty' value, no legit signal would be 0
@@ -634,13 +679,8 @@ public:
     }
 
     // Simple average
-    static int64_t combine_vector(std::shared_ptr<TrackerElementVectorDouble> e) {
-        int64_t avg = 0;
-
-        for (auto i : *e) 
-            avg += i;
-
-        return avg / e->size();
+    static int64_t combine_slots(const int64_t sum, const size_t used, const size_t total) {
+        return (sum + (int64_t) (total - used) * default_val()) / (int64_t) total;
     }
 
     // Default 'empty' value, no legit signal would be 0
@@ -44,6 +44,8 @@ int tracker_component::RegisterField(const std::string& in_name,
 }
 
 void tracker_component::reserve_fields(std::shared_ptr<TrackerElementMap> e) {
+    std::vector<registered_field *> compact_fields;
+
     for (unsigned int i = 0; i < registered_fields.size(); i++) {
         auto& rf = registered_fields[i];
 
@@ -53,12 +55,68 @@ void tracker_component::reserve_fields(std::shared_ptr<TrackerElementMap> e) {
                 // proxydynamictrackable can fill it in;
                 *(rf->assign) = nullptr;
                 insert(rf->id, std::shared_ptr<TrackerElement>());
+            } else if (rf->compact_build != nullptr && 
+                    (e == nullptr || e->get_type() != TrackerType::TrackerMap ||
+                     e->get_sub(rf->id) == nullptr)) {
+                // New fixed fields get built together below
+                compact_fields.push_back(rf.get());
             } else {
                 // otherwise generate a variable for the destination
                 *(rf->assign) = import_or_new(e, rf->id);
             }
         }
     }
+
+    if (compact_fields.size() > 0)
+        build_compact_fields(compact_fields);
+
+    // Registrations are only needed to reserve the fields; don't carry them around
+    // for the life of every component
+    registered_fields.clear();
+    registered_fields.shrink_to_fit();
+}
+
+// The compact block starts with a count of constructed fields and their offsets so
+// it can destroy them when the last reference goes away
+struct tracker_compact_block_deleter {
+    void operator()(uint8_t *block) const {
+        auto hdr = reinterpret_cast<uint32_t *>(block);
+
+        for (uint32_t i = 0; i < hdr[0]; i++)
+            reinterpret_cast<TrackerElement *>(block + hdr[i + 1])->~TrackerElement();
+
+        delete[] block;
+    }
+};
+
+void tracker_component::build_compact_fields(const std::vector<registered_field *>& in_fields) {
+    std::vector<uint32_t> offsets;
+    size_t sz = sizeof(uint32_t) * (in_fields.size() + 1);
+
+    for (auto rf : in_fields) {
+        sz = (sz + rf->compact_align - 1) & ~(rf->compact_align - 1);
+        offsets.push_back(sz);
+        sz += rf->compact_size;
+    }
+
+    auto raw = new uint8_t[sz];
+    auto hdr = reinterpret_cast<uint32_t *>(raw);
+    hdr[0] = 0;
+
+    std::shared_ptr<uint8_t> block(raw, tracker_compact_block_deleter());
+
+    for (unsigned int i = 0; i < in_fields.size(); i++) {
+        auto te = in_fields[i]->compact_build(raw + offsets[i], in_fields[i]->id);
+
+        hdr[i + 1] = offsets[i];
+        hdr[0]++;
+
+        // Shares the block's refcount instead of getting its own
+        auto ste = SharedTrackerElement(block, te);
+
+        insert(ste);
+        *(in_fields[i]->assign) = ste;
+    }
 }
 
 SharedTrackerElement tracker_component::import_or_new(std::shared_ptr<TrackerElementMap> e, int i) {
@@ -31,11 +31,38 @@
 #include <map>
 
 #include <memory>
+#include <new>
 
 #include "globalregistry.h"
 #include "trackedelement.h"
 #include "entrytracker.h"
 
+// Build fixed scalar fields of a component in one contiguous block instead of
+// allocating each one (and its refcount) separately
+#define TRACKER_COMPACT_FIELDS  1
+
+// Scalar field types which can be placed in a component's compact field block
+template<typename T> struct tracker_compact_field { static constexpr bool value = false; };
+
+#define __TrackerCompactField(t) \
+    template<> struct tracker_compact_field<t> { static constexpr bool value = true; }
+
+__TrackerCompactField(TrackerElementString);
+__TrackerCompactField(TrackerElementByteArray);
+__TrackerCompactField(TrackerElementDeviceKey);
+__TrackerCompactField(TrackerElementUUID);
+__TrackerCompactField(TrackerElementMacAddr);
+__TrackerCompactField(TrackerElementUInt8);
+__TrackerCompactField(TrackerElementInt8);
+__TrackerCompactField(TrackerElementUInt16);
+__TrackerCompactField(TrackerElementInt16);
+__TrackerCompactField(TrackerElementUInt32);
+__TrackerCompactField(TrackerElementInt32);
+__TrackerCompactField(TrackerElementUInt64);
+__TrackerCompactField(TrackerElementInt64);
+__TrackerCompactField(TrackerElementFloat);
+__TrackerCompactField(TrackerElementDouble);
+
 
 // Complex trackable unit based on trackertype dataunion.
 //
@@ -55,6 +82,11 @@
 //
 // Subclasses MUST override the signature, typically with a checksum of the class
 // name, so that the entry tracker can differentiate multiple TrackerMap classes
+//
+// Fixed scalar fields which aren't imported from an existing map are built 
+// together in a single block owned by the component (see build_compact_fields);
+// the field pointers share the block's refcount, so a field handed out for 
+// serialization keeps the block alive on its own.
 class tracker_component : public TrackerElementMap {
 
 // Ugly trackercomponent macro for proxying trackerelement values
@@ -392,8 +424,15 @@ protected:
             std::shared_ptr<T> *in_dest) {
         using build_type = typename std::remove_reference<decltype(**in_dest)>::type;
 
-        return RegisterField(in_name, TrackerElementFactory<build_type>(), in_desc, 
+        int id = RegisterField(in_name, TrackerElementFactory<build_type>(), in_desc, 
                 reinterpret_cast<SharedTrackerElement *>(in_dest));
+
+#if TRACKER_COMPACT_FIELDS == 1
+        if (tracker_compact_field<build_type>::value)
+            registered_fields.back()->set_compact<build_type>();
+#endif
+
+        return id;
     }
 
     // Register a field, automatically deriving its type from the provided destination
@@ -446,6 +485,8 @@ protected:
                     this->dynamic = true;
                 else
                     this->dynamic = false;
+
+                compact_build = nullptr;
             }
 
             registered_field(int id, SharedTrackerElement *assign, bool dynamic) {
@@ -456,13 +497,29 @@ protected:
                 this->id = id;
                 this->assign = assign;
                 this->dynamic = dynamic;
+
+                compact_build = nullptr;
+            }
+
+            template<typename T>
+            void set_compact() {
+                compact_size = sizeof(T);
+                compact_align = alignof(T);
+                compact_build = [](void *p, int id) -> TrackerElement * { return new (p) T(id); };
             }
 
             int id;
             bool dynamic;
             SharedTrackerElement *assign;
+
+            // Placement builder for fields which can live in the compact block
+            size_t compact_size, compact_align;
+            TrackerElement *(*compact_build)(void *, int);
     };
 
+    // Build fields in a single shared block and assign them
+    void build_compact_fields(const std::vector<registered_field *>& in_fields);
+
     std::vector<std::unique_ptr<registered_field>> registered_fields;
 };
 
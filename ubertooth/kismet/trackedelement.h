@@ -93,6 +93,10 @@ public:
 
     bool get_error() { return error; }
 
+    // Raw components; the device component is the mac address for phys keyed by mac
+    uint64_t get_spkey() const { return spkey; }
+    uint64_t get_dkey() const { return dkey; }
+
 protected:
     uint64_t spkey, dkey;
     bool error;
@@ -227,11 +231,14 @@ public:
     }
 
     void set_local_name(const std::string& in_name) {
-        local_name = in_name;
+        local_name.reset(new std::string(in_name));
     }
 
     std::string get_local_name() {
-        return local_name;
+        if (local_name == nullptr)
+            return "";
+
+        return *local_name;
     }
 
     void set_type(TrackerType type);
@@ -272,8 +279,9 @@ protected:
     TrackerType type;
     int tracked_id;
 
-    // Overridden name for this instance only
-    std::string local_name;
+    // Overridden name for this instance only; almost never set, so only pay for
+    // the pointer
+    std::unique_ptr<std::string> local_name;
 };
 
 // Generator function for making various elements
@@ -599,7 +607,7 @@ public:
     }
 
     virtual void coercive_set(double in_num) override {
-        if (in_num < value_min || in_num > value_max)
+        if (in_num < value_min() || in_num > value_max())
             throw std::runtime_error(fmt::format("cannot coerce to {}, number out of range",
                         this->get_type_as_string()));
 
@@ -759,30 +767,24 @@ public:
     }
 
 protected:
-    // Min/max ranges for conversion
-    double value_min, value_max;
+    // Min/max ranges for conversion; fixed per type so they aren't stored in
+    // every element
+    virtual double value_min() const = 0;
+    virtual double value_max() const = 0;
+
     N value;
 };
 
 class TrackerElementUInt8 : public TrackerElementCoreNumeric<uint8_t> {
 public:
     TrackerElementUInt8() :
-        TrackerElementCoreNumeric<uint8_t>(TrackerType::TrackerUInt8) {
-            value_min = 0;
-            value_max = INT8_MAX;
-        }
+        TrackerElementCoreNumeric<uint8_t>(TrackerType::TrackerUInt8) { }
 
     TrackerElementUInt8(int id) :
-        TrackerElementCoreNumeric<uint8_t>(TrackerType::TrackerUInt8, id) {
-            value_min = 0;
-            value_max = INT8_MAX;
-        }
+        TrackerElementCoreNumeric<uint8_t>(TrackerType::TrackerUInt8, id) { }
 
     TrackerElementUInt8(int id, const uint8_t& v) :
-        TrackerElementCoreNumeric<uint8_t>(TrackerType::TrackerUInt8, id, v) {
-            value_min = 0;
-            value_max = INT8_MAX;
-        }
+        TrackerElementCoreNumeric<uint8_t>(TrackerType::TrackerUInt8, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerUInt8;
@@ -799,27 +801,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return 0;
+    }
+
+    virtual double value_max() const override {
+        return INT8_MAX;
+    }
 };
 
 class TrackerElementInt8 : public TrackerElementCoreNumeric<int8_t> {
 public:
     TrackerElementInt8() :
-        TrackerElementCoreNumeric<int8_t>(TrackerType::TrackerInt8) {
-            value_min = INT8_MIN;
-            value_max = INT8_MAX;
-        }
+        TrackerElementCoreNumeric<int8_t>(TrackerType::TrackerInt8) { }
 
     TrackerElementInt8(int id) :
-        TrackerElementCoreNumeric<int8_t>(TrackerType::TrackerInt8, id) {
-            value_min = INT8_MIN;
-            value_max = INT8_MAX;
-        }
+        TrackerElementCoreNumeric<int8_t>(TrackerType::TrackerInt8, id) { }
 
     TrackerElementInt8(int id, const int8_t& v) :
-        TrackerElementCoreNumeric<int8_t>(TrackerType::TrackerInt8, id, v) {
-            value_min = INT8_MIN;
-            value_max = INT8_MAX;
-        }
+        TrackerElementCoreNumeric<int8_t>(TrackerType::TrackerInt8, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerInt8;
@@ -836,27 +838,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return INT8_MIN;
+    }
+
+    virtual double value_max() const override {
+        return INT8_MAX;
+    }
 };
 
 class TrackerElementUInt16 : public TrackerElementCoreNumeric<uint16_t> {
 public:
     TrackerElementUInt16() :
-        TrackerElementCoreNumeric<uint16_t>(TrackerType::TrackerUInt16) {
-            value_min = 0;
-            value_max = UINT16_MAX;
-        }
+        TrackerElementCoreNumeric<uint16_t>(TrackerType::TrackerUInt16) { }
 
     TrackerElementUInt16(int id) :
-        TrackerElementCoreNumeric<uint16_t>(TrackerType::TrackerUInt16, id) {
-            value_min = 0;
-            value_max = UINT16_MAX;
-        }
+        TrackerElementCoreNumeric<uint16_t>(TrackerType::TrackerUInt16, id) { }
 
     TrackerElementUInt16(int id, const uint16_t& v) :
-        TrackerElementCoreNumeric<uint16_t>(TrackerType::TrackerUInt16, id, v) {
-            value_min = 0;
-            value_max = UINT16_MAX;
-        }
+        TrackerElementCoreNumeric<uint16_t>(TrackerType::TrackerUInt16, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerUInt16;
@@ -873,27 +875,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return 0;
+    }
+
+    virtual double value_max() const override {
+        return UINT16_MAX;
+    }
 };
 
 class TrackerElementInt16 : public TrackerElementCoreNumeric<int16_t> {
 public:
     TrackerElementInt16() :
-        TrackerElementCoreNumeric<int16_t>(TrackerType::TrackerInt16) {
-            value_min = INT16_MIN;
-            value_max = INT16_MAX;
-        }
+        TrackerElementCoreNumeric<int16_t>(TrackerType::TrackerInt16) { }
 
     TrackerElementInt16(int id) :
-        TrackerElementCoreNumeric<int16_t>(TrackerType::TrackerInt16, id) {
-            value_min = INT16_MIN;
-            value_max = INT16_MAX;
-        }
+        TrackerElementCoreNumeric<int16_t>(TrackerType::TrackerInt16, id) { }
 
     TrackerElementInt16(int id, const int16_t& v) :
-        TrackerElementCoreNumeric<int16_t>(TrackerType::TrackerInt16, id, v) {
-            value_min = INT16_MIN;
-            value_max = INT16_MAX;
-        }
+        TrackerElementCoreNumeric<int16_t>(TrackerType::TrackerInt16, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerInt16;
@@ -910,27 +912,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return INT16_MIN;
+    }
+
+    virtual double value_max() const override {
+        return INT16_MAX;
+    }
 };
 
 class TrackerElementUInt32 : public TrackerElementCoreNumeric<uint32_t> {
 public:
     TrackerElementUInt32() :
-        TrackerElementCoreNumeric<uint32_t>(TrackerType::TrackerUInt32) {
-            value_min = 0;
-            value_max = UINT32_MAX;
-        }
+        TrackerElementCoreNumeric<uint32_t>(TrackerType::TrackerUInt32) { }
 
     TrackerElementUInt32(int id) :
-        TrackerElementCoreNumeric<uint32_t>(TrackerType::TrackerUInt32, id) {
-            value_min = 0;
-            value_max = UINT32_MAX;
-        }
+        TrackerElementCoreNumeric<uint32_t>(TrackerType::TrackerUInt32, id) { }
 
     TrackerElementUInt32(int id, const uint32_t& v) :
-        TrackerElementCoreNumeric<uint32_t>(TrackerType::TrackerUInt32, id, v) {
-            value_min = 0;
-            value_max = UINT32_MAX;
-        }
+        TrackerElementCoreNumeric<uint32_t>(TrackerType::TrackerUInt32, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerUInt32;
@@ -947,27 +949,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return 0;
+    }
+
+    virtual double value_max() const override {
+        return UINT32_MAX;
+    }
 };
 
 class TrackerElementInt32 : public TrackerElementCoreNumeric<int32_t> {
 public:
     TrackerElementInt32() :
-        TrackerElementCoreNumeric<int32_t>(TrackerType::TrackerInt32) {
-            value_min = INT32_MIN;
-            value_max = INT32_MAX;
-        }
+        TrackerElementCoreNumeric<int32_t>(TrackerType::TrackerInt32) { }
 
     TrackerElementInt32(int id) :
-        TrackerElementCoreNumeric<int32_t>(TrackerType::TrackerInt32, id) {
-            value_min = INT32_MIN;
-            value_max = INT32_MAX;
-        }
+        TrackerElementCoreNumeric<int32_t>(TrackerType::TrackerInt32, id) { }
 
     TrackerElementInt32(int id, const int32_t& v) :
-        TrackerElementCoreNumeric<int32_t>(TrackerType::TrackerInt32, id, v) {
-            value_min = INT32_MIN;
-            value_max = INT32_MAX;
-        }
+        TrackerElementCoreNumeric<int32_t>(TrackerType::TrackerInt32, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerInt32;
@@ -984,27 +986,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return INT32_MIN;
+    }
+
+    virtual double value_max() const override {
+        return INT32_MAX;
+    }
 };
 
 class TrackerElementUInt64 : public TrackerElementCoreNumeric<uint64_t> {
 public:
     TrackerElementUInt64() :
-        TrackerElementCoreNumeric<uint64_t>(TrackerType::TrackerUInt64) {
-            value_min = 0;
-            value_max = UINT64_MAX;
-        }
+        TrackerElementCoreNumeric<uint64_t>(TrackerType::TrackerUInt64) { }
 
     TrackerElementUInt64(int id) :
-        TrackerElementCoreNumeric<uint64_t>(TrackerType::TrackerUInt64, id) {
-            value_min = 0;
-            value_max = UINT64_MAX;
-        }
+        TrackerElementCoreNumeric<uint64_t>(TrackerType::TrackerUInt64, id) { }
 
     TrackerElementUInt64(int id, const uint64_t& v) :
-        TrackerElementCoreNumeric<uint64_t>(TrackerType::TrackerUInt64, id, v) {
-            value_min = 0;
-            value_max = UINT64_MAX;
-        }
+        TrackerElementCoreNumeric<uint64_t>(TrackerType::TrackerUInt64, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerUInt64;
@@ -1021,27 +1023,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return 0;
+    }
+
+    virtual double value_max() const override {
+        return UINT64_MAX;
+    }
 };
 
 class TrackerElementInt64 : public TrackerElementCoreNumeric<int64_t> {
 public:
     TrackerElementInt64() :
-        TrackerElementCoreNumeric<int64_t>(TrackerType::TrackerInt64) {
-            value_min = INT64_MIN;
-            value_max = INT64_MAX;
-        }
+        TrackerElementCoreNumeric<int64_t>(TrackerType::TrackerInt64) { }
 
     TrackerElementInt64(int id) :
-        TrackerElementCoreNumeric<int64_t>(TrackerType::TrackerInt64, id) {
-            value_min = INT64_MIN;
-            value_max = INT64_MAX;
-        }
+        TrackerElementCoreNumeric<int64_t>(TrackerType::TrackerInt64, id) { }
 
     TrackerElementInt64(int id, const int64_t& v) :
-        TrackerElementCoreNumeric<int64_t>(TrackerType::TrackerInt64, id, v) {
-            value_min = INT64_MIN;
-            value_max = INT64_MAX;
-        }
+        TrackerElementCoreNumeric<int64_t>(TrackerType::TrackerInt64, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerInt64;
@@ -1058,27 +1060,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return INT64_MIN;
+    }
+
+    virtual double value_max() const override {
+        return INT64_MAX;
+    }
 };
 
 class TrackerElementFloat : public TrackerElementCoreNumeric<float> {
 public:
     TrackerElementFloat() :
-        TrackerElementCoreNumeric<float>(TrackerType::TrackerFloat) {
-            value_min = std::numeric_limits<float>::min();
-            value_max = std::numeric_limits<float>::max();
-        }
+        TrackerElementCoreNumeric<float>(TrackerType::TrackerFloat) { }
 
     TrackerElementFloat(int id) :
-        TrackerElementCoreNumeric<float>(TrackerType::TrackerFloat, id) {
-            value_min = std::numeric_limits<float>::min();
-            value_max = std::numeric_limits<float>::max();
-        }
+        TrackerElementCoreNumeric<float>(TrackerType::TrackerFloat, id) { }
 
     TrackerElementFloat(int id, const float& v) :
-        TrackerElementCoreNumeric<float>(TrackerType::TrackerFloat, id, v) {
-            value_min = std::numeric_limits<float>::min();
-            value_max = std::numeric_limits<float>::max();
-        }
+        TrackerElementCoreNumeric<float>(TrackerType::TrackerFloat, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerFloat;
@@ -1095,27 +1097,27 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return std::numeric_limits<float>::min();
+    }
+
+    virtual double value_max() const override {
+        return std::numeric_limits<float>::max();
+    }
 };
 
 class TrackerElementDouble : public TrackerElementCoreNumeric<double> {
 public:
     TrackerElementDouble() :
-        TrackerElementCoreNumeric<double>(TrackerType::TrackerDouble) {
-            value_min = std::numeric_limits<double>::min();
-            value_max = std::numeric_limits<double>::max();
-        }
+        TrackerElementCoreNumeric<double>(TrackerType::TrackerDouble) { }
 
     TrackerElementDouble(int id) :
-        TrackerElementCoreNumeric<double>(TrackerType::TrackerDouble, id) {
-            value_min = std::numeric_limits<double>::min();
-            value_max = std::numeric_limits<double>::max();
-        }
+        TrackerElementCoreNumeric<double>(TrackerType::TrackerDouble, id) { }
 
     TrackerElementDouble(int id, const double& v) :
-        TrackerElementCoreNumeric<double>(TrackerType::TrackerDouble, id, v) {
-            value_min = std::numeric_limits<double>::min();
-            value_max = std::numeric_limits<double>::max();
-        }
+        TrackerElementCoreNumeric<double>(TrackerType::TrackerDouble, id, v) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerDouble;
@@ -1132,6 +1134,15 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+protected:
+    virtual double value_min() const override {
+        return std::numeric_limits<double>::min();
+    }
+
+    virtual double value_max() const override {
+        return std::numeric_limits<double>::max();
+    }
 };
 
 
@@ -1255,7 +1266,9 @@ public:
         return std::move(dup);
     }
 
-    SharedTrackerElement get_sub(int id) {
+    // Virtual so that components which only build some fields on demand can 
+    // provide them when they're looked up by path
+    virtual SharedTrackerElement get_sub(int id) {
         auto v = map.find(id);
 
         if (v == map.end())
@@ -1266,12 +1279,7 @@ public:
 
     template<typename T>
     std::shared_ptr<T> get_sub_as(int id) {
-        auto v = map.find(id);
-
-        if (v == map.end())
-            return NULL;
-
-        return std::static_pointer_cast<T>(v->second);
+        return std::static_pointer_cast<T>(get_sub(id));
     }
 
     std::pair<iterator, bool> insert(SharedTrackerElement e) {
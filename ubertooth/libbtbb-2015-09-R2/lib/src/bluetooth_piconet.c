@@ -25,6 +25,7 @@
 #include "uthash.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 int perm_table_initialized = 0;
 char perm_table[0x20][0x20][0x200];
@@ -56,8 +57,10 @@ void
 btbb_piconet_unref(btbb_piconet *pn)
 {
 	pn->refcount--;
-	if (pn->refcount == 0)
+	if (pn->refcount == 0) {
+		release_hop_pattern(pn);
 		free(pn);
+	}
 }
 
 void btbb_init_piconet(btbb_piconet *pn, uint32_t lap)
@@ -132,16 +135,28 @@ uint8_t *btbb_piconet_get_afh_map(btbb_piconet *pn) {
 	return pn->afh_map;
 }
 
-void btbb_piconet_set_channel_seen(btbb_piconet *pn, uint8_t channel)
+/* Add a channel to the map without counting a packet on it */
+static void mark_channel_seen(btbb_piconet *pn, uint8_t channel)
 {
 	if(!(pn->afh_map[channel/8] & 0x1 << (channel % 8))) {
 		pn->afh_map[channel/8] |= 0x1 << (channel % 8);
 		pn->used_channels++;
-		if(btbb_piconet_get_flag(pn, BTBB_UAP_VALID))
+		/* Only regenerate if hop reversal is using the sequence */
+		if(btbb_piconet_get_flag(pn, BTBB_HOP_REVERSAL_INIT))
 			get_hop_pattern(pn);
 	}
 }
 
+/* Count a packet on a channel; call once per packet */
+void btbb_piconet_set_channel_seen(btbb_piconet *pn, uint8_t channel)
+{
+	if(channel < BT_NUM_CHANNELS) {
+		pn->channel_hits[channel]++;
+		pn->channel_hits_total++;
+	}
+	mark_channel_seen(pn, channel);
+}
+
 uint8_t btbb_piconet_get_channel_seen(btbb_piconet *pn, uint8_t channel)
 {
 	if(channel < BT_NUM_CHANNELS)
@@ -150,6 +165,104 @@ uint8_t btbb_piconet_get_channel_seen(btbb_piconet *pn, uint8_t channel)
 		return 1;
 }
 
+/* probability that a used channel gets fewer than min_hits of n packets
+ * spread evenly over m channels */
+static double afh_miss_probability(int m, int min_hits, uint32_t n)
+{
+	double q = 1.0 / m;
+	double p = 1.0 - q;
+	double none = 1.0;
+	uint32_t e = n;
+
+	/* (1 - 1/m)^n by repeated squaring */
+	while (e) {
+		if (e & 1)
+			none *= p;
+		p *= p;
+		e >>= 1;
+	}
+	if (min_hits < 2 || n == 0)
+		return none;
+
+	/* plus the chance of exactly one hit */
+	return none + n * q * none / (1.0 - q);
+}
+
+int btbb_piconet_estimate_afh_map(btbb_piconet *pn, uint8_t *afh_map)
+{
+	int i, seen = 0, used = 0, min_hits = 1;
+	uint32_t total = pn->channel_hits_total;
+	double missing;
+
+	for (i = 0; i < 10; i++)
+		afh_map[i] = 0;
+	if (total == 0)
+		return 0;
+
+	for (i = 0; i < BT_NUM_CHANNELS; i++)
+		if (pn->channel_hits[i])
+			seen++;
+
+	/* Once every used channel should have been hit many times, a
+	 * channel seen only once is more likely a false access code
+	 * match than a used channel. */
+	if (total / seen >= 16)
+		min_hits = 2;
+
+	for (i = 0; i < BT_NUM_CHANNELS; i++) {
+		if (pn->channel_hits[i] >= (uint32_t)min_hits) {
+			afh_map[i/8] |= 0x1 << (i % 8);
+			used++;
+		}
+	}
+
+	/* not a legal AFH map yet, more channels must be in use */
+	if (used < AFH_MIN_CHANNELS)
+		return 0;
+	if (used == BT_NUM_CHANNELS)
+		return 100;
+
+	/* chance that any of the used channels has not shown up yet */
+	missing = used * afh_miss_probability(used, min_hits, total);
+	if (missing >= 1.0)
+		return 0;
+	return (int)((1.0 - missing) * 100);
+}
+
+/* true if some channels have stayed quiet for longer than is plausible when
+ * all 79 are in use */
+static int afh_channels_unused(btbb_piconet *pn)
+{
+	int i, seen = 0;
+	double missing;
+
+	for (i = 0; i < BT_NUM_CHANNELS; i++)
+		if (pn->channel_hits[i])
+			seen++;
+	if (seen == BT_NUM_CHANNELS)
+		return 0;
+
+	missing = BT_NUM_CHANNELS *
+		afh_miss_probability(BT_NUM_CHANNELS, 1, pn->channel_hits_total);
+	return missing < (100 - AFH_MIN_CONFIDENCE) / 100.0;
+}
+
+/* With AFH, hop reversal only works on the right set of used channels.
+ * Install the estimated map once it is trustworthy. */
+static int afh_map_ready(btbb_piconet *pn)
+{
+	uint8_t afh_map[10];
+
+	if (!btbb_piconet_get_flag(pn, BTBB_IS_AFH))
+		return 1;
+	if (btbb_piconet_estimate_afh_map(pn, afh_map) < AFH_MIN_CONFIDENCE)
+		return 0;
+
+	btbb_piconet_set_afh_map(pn, afh_map);
+	printf("Using estimated AFH map with %d channels\n", pn->used_channels);
+	return 1;
+}
+
 /* do all the precalculation that can be done before knowing the address */
 void precalc(btbb_piconet *pn)
 {
@@ -337,19 +450,24 @@ static void gen_hops(btbb_piconet *pn)
 					}
 					base_f += 16;
 					f = base_f % BT_NUM_CHANNELS;
-					f_dash = f % pn->used_channels;
+					/* used_channels is only set with AFH */
+					if (btbb_piconet_get_flag(pn, BTBB_IS_AFH))
+						f_dash = f % pn->used_channels;
 				}
 			}
 		}
 	}
 }
 
-/* Function to calculate piconet hopping patterns and add to hash map */
-void gen_hop_pattern(btbb_piconet *pn)
+/* Function to calculate piconet hopping patterns, into the given buffer or a
+ * newly allocated one */
+void gen_hop_pattern(btbb_piconet *pn, char *sequence)
 {
 	printf("\nCalculating complete hopping sequence.\n");
 	/* this holds the entire hopping sequence */
-	pn->sequence = (char*) malloc(SEQUENCE_LENGTH);
+	if (sequence == NULL)
+		sequence = (char*) malloc(SEQUENCE_LENGTH);
+	pn->sequence = sequence;
 
 	precalc(pn);
 	address_precalc(((pn->UAP<<24) | pn->LAP) & 0xfffffff, pn);
@@ -358,36 +476,100 @@ void gen_hop_pattern(btbb_piconet *pn)
 	printf("Hopping sequence calculated.\n");
 }
 
+/* A generated hopping sequence, shared by the cache and every piconet using it */
+struct hop_sequence {
+	char *sequence;
+	int refcount;
+};
+
+static struct hop_sequence *hop_sequence_new(char *sequence)
+{
+	struct hop_sequence *h = malloc(sizeof(struct hop_sequence));
+	h->sequence = sequence;
+	h->refcount = 1;
+	return h;
+}
+
+static void hop_sequence_unref(struct hop_sequence *h)
+{
+	h->refcount--;
+	if (h->refcount == 0) {
+		free(h->sequence);
+		free(h);
+	}
+}
+
 /* Container for hopping pattern */
 typedef struct {
-    uint64_t key; /* afh flag + address */
-    char *sequence;             
-    UT_hash_handle hh;
+	/* afh flag + address */
+	struct {
+		uint32_t address;
+		uint8_t afh;
+	} key;
+	/* channel map the sequence was generated for, with AFH */
+	uint8_t afh_map[10];
+	struct hop_sequence *hop;
+	UT_hash_handle hh;
 } hopping_struct;
 
 static hopping_struct *hopping_map = NULL;
 
-/* Function to fetch piconet hopping patterns */
+/* Drop the piconet's reference on its hopping sequence */
+void release_hop_pattern(btbb_piconet *pn)
+{
+	if (pn->hop_ref != NULL)
+		hop_sequence_unref(pn->hop_ref);
+	pn->hop_ref = NULL;
+	pn->sequence = NULL;
+}
+
+/* Function to fetch piconet hopping patterns
+ *
+ * Each address keeps at most one sequence without AFH and one with it.  The
+ * estimated channel map changes as channels are seen, so when the AFH
+ * sequence was built for a different map than the one asked for it is
+ * replaced.  It is only regenerated in place when no other piconet holds
+ * it; otherwise a new one is allocated and the old one is freed once its
+ * last holder lets go. */
 void get_hop_pattern(btbb_piconet *pn)
 {
-	hopping_struct *s;
-	uint64_t key;
- 
-	/* Two stages to avoid "left shift count >= width of type" warning */
-	key = btbb_piconet_get_flag(pn, BTBB_IS_AFH);
-	key = (key<<39) | ((uint64_t)pn->used_channels<<32) | (pn->UAP<<24) | pn->LAP;
-	HASH_FIND(hh, hopping_map, &key, 4, s);
-	
+	hopping_struct *s, k;
+	int others;
+
+	memset(&k.key, 0, sizeof(k.key));
+	k.key.address = (pn->UAP<<24) | pn->LAP;
+	k.key.afh = btbb_piconet_get_flag(pn, BTBB_IS_AFH);
+	HASH_FIND(hh, hopping_map, &k.key, sizeof(k.key), s);
+
 	if (s == NULL) {
-		gen_hop_pattern(pn);
+		gen_hop_pattern(pn, NULL);
 		s = malloc(sizeof(hopping_struct));
-		s->key = key;
-		s->sequence = pn->sequence;
-		HASH_ADD(hh, hopping_map, key, 4, s);
+		memcpy(&s->key, &k.key, sizeof(s->key));
+		memcpy(s->afh_map, pn->afh_map, sizeof(s->afh_map));
+		s->hop = hop_sequence_new(pn->sequence);
+		HASH_ADD(hh, hopping_map, key, sizeof(s->key), s);
+	} else if (s->key.afh && memcmp(s->afh_map, pn->afh_map, sizeof(s->afh_map))) {
+		/* references besides the cache's own and this piconet's */
+		others = s->hop->refcount - 1 - (pn->hop_ref == s->hop);
+		if (others == 0) {
+			gen_hop_pattern(pn, s->hop->sequence);
+		} else {
+			gen_hop_pattern(pn, NULL);
+			hop_sequence_unref(s->hop);
+			s->hop = hop_sequence_new(pn->sequence);
+		}
+		memcpy(s->afh_map, pn->afh_map, sizeof(s->afh_map));
 	} else {
 		printf("\nFound hopping sequence in cache.\n");
-		pn->sequence = s->sequence;
 	}
+
+	if (pn->hop_ref != s->hop) {
+		if (pn->hop_ref != NULL)
+			hop_sequence_unref(pn->hop_ref);
+		s->hop->refcount++;
+		pn->hop_ref = s->hop;
+	}
+	pn->sequence = s->hop->sequence;
 }
 
 /* determine channel for a particular hop */
@@ -481,6 +663,8 @@ int btbb_init_hop_reversal(int aliased, btbb_piconet *pn)
 	return pn->num_candidates;
 }
 
+static void reacquire_seed(btbb_packet *pkt, btbb_piconet *pn);
+
 void try_hop(btbb_packet *pkt, btbb_piconet *pn)
 {
 	uint8_t filter_uap = pn->UAP;
@@ -488,7 +672,9 @@ void try_hop(btbb_packet *pkt, btbb_piconet *pn)
 	/* Decode packet - fixing clock drift in the process */
 	btbb_decode(pkt, pn);
 
-	if (btbb_piconet_get_flag(pn, BTBB_HOP_REVERSAL_INIT)) {
+	if (pn->reacquire_pending) {
+		reacquire_seed(pkt, pn);
+	} else if (btbb_piconet_get_flag(pn, BTBB_HOP_REVERSAL_INIT)) {
 		//pn->winnowed = 0;
 		pn->pattern_indices[pn->packets_observed] =
 			pkt->clkn - pn->first_pkt_time;
@@ -503,6 +689,13 @@ void try_hop(btbb_packet *pkt, btbb_piconet *pn)
 	} else {
 		if (btbb_piconet_get_flag(pn, BTBB_CLK6_VALID)) {
 			btbb_uap_from_header(pkt, pn);
+			/* Hop reversal may be waiting on an AFH map estimate */
+			if (btbb_piconet_get_flag(pn, BTBB_IS_AFH)
+			    && btbb_piconet_get_flag(pn, BTBB_CLK6_VALID)
+			    && filter_uap == pn->UAP && afh_map_ready(pn)) {
+				btbb_init_hop_reversal(0, pn);
+				btbb_winnow(pn);
+			}
 			if (btbb_piconet_get_flag(pn, BTBB_CLK27_VALID)) {
 				printf("got CLK1-27\n");
 				printf("clock offset = %d.\n", pn->clk_offset);
@@ -510,8 +703,12 @@ void try_hop(btbb_packet *pkt, btbb_piconet *pn)
 		} else {
 			if (btbb_uap_from_header(pkt, pn)) {
 				if (filter_uap == pn->UAP) {
-					btbb_init_hop_reversal(0, pn);
-					btbb_winnow(pn);
+					if (afh_map_ready(pn)) {
+						btbb_init_hop_reversal(0, pn);
+						btbb_winnow(pn);
+					} else {
+						printf("waiting for AFH map estimate\n");
+					}
 				} else {
 					printf("failed to confirm UAP\n");
 				}
@@ -533,7 +730,7 @@ static void reset(btbb_piconet *pn)
 
 	if(btbb_piconet_get_flag(pn, BTBB_HOP_REVERSAL_INIT)) {
 		free(pn->clock_candidates);
-		pn->sequence = NULL;
+		release_hop_pattern(pn);
 	}
 	btbb_piconet_set_flag(pn, BTBB_GOT_FIRST_PACKET, 0);
 	btbb_piconet_set_flag(pn, BTBB_HOP_REVERSAL_INIT, 0);
@@ -541,11 +738,19 @@ static void reset(btbb_piconet *pn)
 	btbb_piconet_set_flag(pn, BTBB_CLK6_VALID, 0);
 	btbb_piconet_set_flag(pn, BTBB_CLK27_VALID, 0);
 	pn->packets_observed = 0;
+	pn->reacquire_stage = REACQUIRE_NONE;
+	pn->reacquire_pending = 0;
 
 	/*
 	 * If we have recently observed two packets in a row on the same
-	 * channel, try AFH next time.  If not, don't.
+	 * channel, or channels have stayed quiet for too long, try AFH
+	 * next time.  If not, don't.
 	 */
+	if (!btbb_piconet_get_flag(pn, BTBB_LOOKS_LIKE_AFH)
+	    && afh_channels_unused(pn)) {
+		btbb_piconet_set_flag(pn, BTBB_LOOKS_LIKE_AFH, 1);
+		printf("Channel usage appears to be AFH\n");
+	}
 	btbb_piconet_set_flag(pn, BTBB_IS_AFH,
 			      btbb_piconet_get_flag(pn, BTBB_LOOKS_LIKE_AFH));
 	// btbb_piconet_set_flag(pn, BTBB_LOOKS_LIKE_AFH, 0);
@@ -581,9 +786,17 @@ static int channel_winnow(int offset, char channel, btbb_piconet *pn)
 		pn->clk_offset = ((pn->clock_candidates[0]<<1) - (pn->first_pkt_time<<1));
 		printf("\nAcquired CLK1-27 = 0x%07x\n", pn->clock_candidates[0]);
 		btbb_piconet_set_flag(pn, BTBB_CLK27_VALID, 1);
+		pn->reacquire_stage = REACQUIRE_NONE;
 	}
 	else if (new_count == 0) {
-		reset(pn);
+		if (pn->reacquire_stage == REACQUIRE_NEAR) {
+			/* not close to where we lost it, but CLK1-6 may
+			 * still hold; widen the search from the next packet */
+			pn->reacquire_stage = REACQUIRE_CLK6;
+			pn->reacquire_pending = 1;
+		} else {
+			reset(pn);
+		}
 	}
 	//else {
 	//printf("%d CLK1-27 candidates remaining (channel=%d)\n", new_count, channel);
@@ -627,6 +840,82 @@ int btbb_winnow(btbb_piconet *pn)
 	return new_count;
 }
 
+void btbb_piconet_reacquire(btbb_piconet *pn)
+{
+	btbb_piconet_set_flag(pn, BTBB_FOLLOWING, 0);
+	btbb_piconet_set_flag(pn, BTBB_CLK27_VALID, 0);
+	pn->follow_failures = 0;
+	pn->reacquire_stage = REACQUIRE_NEAR;
+	pn->reacquire_pending = 1;
+}
+
+/* Start hop reversal over again from a single packet, reusing what we knew
+ * before sync was lost.  The first attempt only keeps clocks close to the
+ * one we were following, which is where drift leaves us; the second keeps
+ * every clock with the same CLK1-6. */
+static void reacquire_seed(btbb_packet *pkt, btbb_piconet *pn)
+{
+	uint32_t predicted, clock;
+	int i, max_candidates;
+	char observable_channel;
+
+	predicted = (pkt->clkn + pn->clk_offset / 2) & (SEQUENCE_LENGTH - 1);
+
+	if (btbb_piconet_get_flag(pn, BTBB_HOP_REVERSAL_INIT))
+		free(pn->clock_candidates);
+	if (pn->sequence == NULL)
+		get_hop_pattern(pn);
+
+	pn->first_pkt_time = pkt->clkn;
+	pn->pattern_indices[0] = 0;
+	pn->pattern_channels[0] = pkt->channel;
+	pn->packets_observed = 1;
+	pn->winnowed = 1;
+	pn->num_candidates = 0;
+
+	if (pn->reacquire_stage == REACQUIRE_NEAR) {
+		pn->clock_candidates = (uint32_t*) malloc(sizeof(uint32_t) * (2 * REACQUIRE_WINDOW + 1));
+		for (i = -REACQUIRE_WINDOW; i <= REACQUIRE_WINDOW; i++) {
+			clock = (predicted + i) & (SEQUENCE_LENGTH - 1);
+			if (pn->aliased)
+				observable_channel = aliased_channel(pn->sequence[clock]);
+			else
+				observable_channel = pn->sequence[clock];
+			if (observable_channel == pkt->channel)
+				pn->clock_candidates[pn->num_candidates++] = clock;
+		}
+	} else {
+		if (pn->aliased)
+			max_candidates = (SEQUENCE_LENGTH / ALIASED_CHANNELS) / 32;
+		else
+			max_candidates = (SEQUENCE_LENGTH / BT_NUM_CHANNELS) / 32;
+		pn->clock_candidates = (uint32_t*) malloc(sizeof(uint32_t) * max_candidates);
+		pn->num_candidates = init_candidates(pkt->channel, predicted & 0x3f, pn);
+	}
+
+	btbb_piconet_set_flag(pn, BTBB_HOP_REVERSAL_INIT, 1);
+	btbb_piconet_set_flag(pn, BTBB_CLK6_VALID, 1);
+	pn->reacquire_pending = 0;
+
+	printf("Reacquiring: %d CLK1-27 candidates\n", pn->num_candidates);
+
+	/* settle zero or one candidates right away */
+	if (pn->num_candidates <= 1)
+		channel_winnow(0, pkt->channel, pn);
+}
+
+void btbb_piconet_shift_clkn(btbb_piconet *pn, int clkn_shift)
+{
+	/* candidates are piconet clocks at first_pkt_time (CLK1) */
+	pn->first_pkt_time += clkn_shift / 2;
+
+	/* offset is in CLKN units once CLK27 is known, CLK1-6 before */
+	if (btbb_piconet_get_flag(pn, BTBB_CLK27_VALID))
+		pn->clk_offset -= clkn_shift;
+	else if (btbb_piconet_get_flag(pn, BTBB_CLK6_VALID))
+		pn->clk_offset = (pn->clk_offset - clkn_shift / 2) & 0x3f;
+}
+
 /* use packet headers to determine UAP */
 int btbb_uap_from_header(btbb_packet *pkt, btbb_piconet *pn)
 {
@@ -640,8 +929,9 @@ int btbb_uap_from_header(btbb_packet *pkt, btbb_piconet *pn)
 	if (!btbb_piconet_get_flag(pn, BTBB_GOT_FIRST_PACKET))
 		pn->first_pkt_time = clkn;
 
-	// Set afh channel map
-	btbb_piconet_set_channel_seen(pn, pkt->channel);
+	// Set afh channel map; btbb_process_packet() has already counted the
+	// packet, so only make sure the channel is in the map
+	mark_channel_seen(pn, pkt->channel);
 
 	if (pn->packets_observed < MAX_PATTERN_LENGTH) {
 		pn->pattern_indices[pn->packets_observed] = clkn - pn->first_pkt_time;
@@ -924,14 +1214,26 @@ int btbb_process_packet(btbb_packet *pkt, btbb_piconet *pn) {
 
 		/* Have LAP/UAP/clocks, now hopping along with the piconet. */
 		if (btbb_piconet_get_flag(pn, BTBB_FOLLOWING)) {
+			uint32_t expected = pkt->clkn + pn->clk_offset / 2;
+
 			btbb_packet_set_uap(pkt, btbb_piconet_get_uap(pn));
 			btbb_packet_set_flag(pkt, BTBB_CLK6_VALID, 1);
 			btbb_packet_set_flag(pkt, BTBB_CLK27_VALID, 1);
-			
-			if(btbb_decode(pkt, pn))
+			pkt->clock = expected;
+
+			/* A packet that only decodes on another clock
+			 * means we have drifted */
+			if (btbb_decode(pkt, pn) && !((pkt->clock ^ expected) & 0x3f)) {
 				btbb_print_packet(pkt);
-			else
+				pn->follow_failures = 0;
+			} else {
 				printf("Failed to decode packet\n");
+				if (++pn->follow_failures >= MAX_FOLLOW_FAILURES) {
+					printf("Lost sync with piconet\n");
+					btbb_piconet_reacquire(pn);
+					return BTBB_PROCESS_LOST;
+				}
+			}
 		}
 
 		/* Have LAP/UAP, need clocks. */
@@ -940,7 +1242,7 @@ int btbb_process_packet(btbb_packet *pkt, btbb_piconet *pn) {
 			if (btbb_piconet_get_flag(pn, BTBB_CLK6_VALID) &&
 			    btbb_piconet_get_flag(pn, BTBB_CLK27_VALID)) {
 				btbb_piconet_set_flag(pn, BTBB_FOLLOWING, 1);
-				return -1;
+				return BTBB_PROCESS_FOLLOW;
 			}
 		}
 		
@@ -44,6 +44,12 @@ struct btbb_piconet {
 	/* Number of used channel derived from AFH channel map */
 	uint8_t used_channels;
 
+	/* number of packets observed on each channel, for AFH map estimation */
+	uint32_t channel_hits[BT_NUM_CHANNELS];
+
+	/* total number of packets counted in channel_hits */
+	uint32_t channel_hits_total;
+
 	/* lower address part (of master's BD_ADDR) */
 	uint32_t LAP;
 
@@ -69,6 +75,9 @@ struct btbb_piconet {
 	/* this holds the entire hopping sequence */
 	char *sequence;
 
+	/* cached sequence this piconet holds a reference on */
+	struct hop_sequence *hop_ref;
+
 	/* number of candidates for CLK1-27 */
 	int num_candidates;
 
@@ -96,6 +105,16 @@ struct btbb_piconet {
 
 	/* queue of packets to be decoded */
 	pkt_queue *queue;
+
+	/* consecutive packets that did not decode on the expected clock
+	 * while following */
+	int follow_failures;
+
+	/* how far clock recovery has widened since sync was lost */
+	int reacquire_stage;
+
+	/* seed new clock candidates from the next packet */
+	int reacquire_pending;
 };
 
 /* number of hops in the hopping sequence (i.e. number of possible values of CLK1-27) */
@@ -104,6 +123,25 @@ struct btbb_piconet {
 /* number of aliased channels received */
 #define ALIASED_CHANNELS 25
 
+/* minimum number of used channels allowed by AFH */
+#define AFH_MIN_CHANNELS 20
+
+/* confidence (in percent) an estimated AFH map needs before hop reversal
+ * is run on it */
+#define AFH_MIN_CONFIDENCE 95
+
+/* bad packets in a row after which a followed piconet counts as lost */
+#define MAX_FOLLOW_FAILURES 8
+
+/* CLK1-27 values either side of the last known clock that are tried
+ * first when reacquiring a lost piconet */
+#define REACQUIRE_WINDOW 256
+
+/* reacquire_stage */
+#define REACQUIRE_NONE 0
+#define REACQUIRE_NEAR 1 /* candidates within REACQUIRE_WINDOW */
+#define REACQUIRE_CLK6 2 /* every candidate matching the last CLK1-6 */
+
 /* do all the precalculation that can be done before knowing the address */
 void precalc(btbb_piconet *pnet);
 
@@ -128,4 +166,6 @@ void try_hop(btbb_packet *pkt, btbb_piconet *pn);
 
 void get_hop_pattern(btbb_piconet *pn);
 
+void release_hop_pattern(btbb_piconet *pn);
+
 #endif /* INCLUDED_BLUETOOTH_PICONET_H */
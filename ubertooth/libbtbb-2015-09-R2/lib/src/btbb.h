@@ -22,6 +22,7 @@
 #ifndef INCLUDED_BTBB_H
 #define INCLUDED_BTBB_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define BTBB_WHITENED    0
@@ -184,9 +185,26 @@ void btbb_piconet_set_channel_seen(btbb_piconet *pn, uint8_t channel);
 void btbb_piconet_set_afh_map(btbb_piconet *pn, uint8_t *afh_map);
 uint8_t *btbb_piconet_get_afh_map(btbb_piconet *pn);
 
+/* Estimate the AFH channel map from the channels packets were observed on.
+ * Fills afh_map with the channels believed to be in use and returns the
+ * confidence (0-100) that no used channel is missing from it. */
+int btbb_piconet_estimate_afh_map(btbb_piconet *pn, uint8_t *afh_map);
+
+/* btbb_process_packet() results */
+#define BTBB_PROCESS_FOLLOW -1 /* clocks recovered, start hopping with the piconet */
+#define BTBB_PROCESS_LOST   -2 /* sync lost while following, stop hopping */
+
 /* Extract as much information (LAP/UAP/CLK) as possible from received packet */
 int btbb_process_packet(btbb_packet *pkt, btbb_piconet *pn);
 
+/* Drop a followed piconet back to clock recovery, keeping its UAP and
+ * trying clocks near the last known one first */
+void btbb_piconet_reacquire(btbb_piconet *pn);
+
+/* The local clock (CLKN) was moved by clkn_shift, e.g. by starting to hop
+ * with another piconet; keep clock recovery state consistent with it */
+void btbb_piconet_shift_clkn(btbb_piconet *pn, int clkn_shift);
+
 /* use packet headers to determine UAP */
 int btbb_uap_from_header(btbb_packet *pkt, btbb_piconet *pn);
 
@@ -211,6 +229,12 @@ btbb_piconet *btbb_next_survey_result(void);
 typedef struct btbb_pcapng_handle btbb_pcapng_handle;
 /* create a PCAPNG file for BREDR captures */
 int btbb_pcapng_create_file(const char *filename, const char *interface_desc, btbb_pcapng_handle ** ph);
+/* create a PCAPNG stream for BREDR captures on an open descriptor such as a
+ * FIFO; packets are written in batches of buffer_size bytes or after
+ * flush_ms, and bdaddr/btclock records are not supported */
+int btbb_pcapng_create_stream(const int fd, const char *interface_desc,
+                              const size_t buffer_size, const unsigned flush_ms,
+                              btbb_pcapng_handle ** ph);
 /* save a BREDR packet to PCAPNG capture file */
 int btbb_pcapng_append_packet(btbb_pcapng_handle * h, const uint64_t ns,
                               const int8_t sigdbm, const int8_t noisedbm,
@@ -222,6 +246,8 @@ int btbb_pcapng_record_bdaddr(btbb_pcapng_handle * h, const uint64_t bdaddr,
 /* record BT CLOCK to PCAPNG capture file */
 int btbb_pcapng_record_btclock(btbb_pcapng_handle * h, const uint64_t bdaddr,
                                const uint64_t ns, const uint32_t clk, const uint32_t clkmask);
+/* write out packets buffered by a stream, if due or if force is set */
+int btbb_pcapng_flush(btbb_pcapng_handle * h, const int force);
 int btbb_pcapng_close(btbb_pcapng_handle * h);
 
 
@@ -243,12 +269,19 @@ void lell_print(const lell_packet *pkt);
 typedef struct lell_pcapng_handle lell_pcapng_handle;
 /* create a PCAPNG file for LE captures */
 int lell_pcapng_create_file(const char *filename, const char *interface_desc, lell_pcapng_handle ** ph);
+/* create a PCAPNG stream for LE captures on an open descriptor such as a
+ * FIFO; CONNECT_REQ records are not supported */
+int lell_pcapng_create_stream(const int fd, const char *interface_desc,
+                              const size_t buffer_size, const unsigned flush_ms,
+                              lell_pcapng_handle ** ph);
 /* save an LE packet to PCAPNG capture file */
 int lell_pcapng_append_packet(lell_pcapng_handle * h, const uint64_t ns,
                               const int8_t sigdbm, const int8_t noisedbm,
                               const uint32_t refAA, const lell_packet *pkt);
 /* record LE CONNECT_REQ parameters to PCAPNG capture file */
 int lell_pcapng_record_connect_req(lell_pcapng_handle * h, const uint64_t ns, const uint8_t * pdu);
+/* write out packets buffered by a stream, if due or if force is set */
+int lell_pcapng_flush(lell_pcapng_handle *h, const int force);
 int lell_pcapng_close(lell_pcapng_handle *h);
 
 
@@ -95,6 +95,55 @@ check_and_fix_tsresol( PCAPNG_HANDLE * handle,
 	return retval;
 }
 
+/* Streams cannot have options appended once the headers are written, so
+   the description and timestamp resolution go in up front. */
+static int
+create_stream_single_interface( PCAPNG_HANDLE ** ph,
+				const int fd,
+				const char * interface_desc,
+				const uint16_t link_type,
+				const uint32_t snaplen,
+				const size_t buffer_size,
+				const unsigned flush_ms )
+{
+	int retval = PCAPNG_OK;
+	PCAPNG_HANDLE * handle = malloc( sizeof(PCAPNG_HANDLE) );
+	if (handle) {
+		/* description, tsresol and end of options */
+		uint8_t ifopts[4+256+8+4] = { 0 };
+		option_header * opt = (option_header *) ifopts;
+		if (interface_desc) {
+			size_t len = strnlen( interface_desc, 255 );
+			opt->option_code = IF_DESCRIPTION;
+			opt->option_length = (uint16_t) len;
+			(void) memcpy( &ifopts[4], interface_desc, len );
+			opt = (option_header *) &ifopts[4+4*((len+3)/4)];
+		}
+		opt->option_code = IF_TSRESOL;
+		opt->option_length = 1;
+		((uint8_t *) opt)[4] = 9; /* 10^-9 is nanoseconds */
+
+		retval = -pcapng_create_stream( handle,
+						fd,
+						(const option_header *) &libbtbb_section_options,
+						link_type,
+						snaplen,
+						(const option_header *) ifopts,
+						buffer_size,
+						flush_ms );
+		if (retval == PCAPNG_OK) {
+			*ph = handle;
+		}
+		else {
+			free( handle );
+		}
+	}
+	else {
+		retval = -PCAPNG_NO_MEMORY;
+	}
+	return retval;
+}
+
 /* --------------------------------- BR/EDR ----------------------------- */
 
 static PCAPNG_RESULT
@@ -165,6 +214,21 @@ int btbb_pcapng_create_file( const char *filename,
 	return retval;
 }
 
+int btbb_pcapng_create_stream( const int fd,
+			       const char *interface_desc,
+			       const size_t buffer_size,
+			       const unsigned flush_ms,
+			       btbb_pcapng_handle ** ph )
+{
+	return create_stream_single_interface( (PCAPNG_HANDLE **) ph,
+					       fd,
+					       interface_desc,
+					       DLT_BLUETOOTH_BREDR_BB,
+					       BREDR_MAX_PAYLOAD,
+					       buffer_size,
+					       flush_ms );
+}
+
 static PCAPNG_RESULT
 append_bredr_packet( PCAPNG_HANDLE * handle,
 		     pcapng_bredr_packet * pkt )
@@ -326,6 +390,11 @@ int btbb_pcapng_record_btclock(btbb_pcapng_handle * h, const uint64_t bdaddr,
 						bdaddr, ns, clk, clkmask );
 }
 
+int btbb_pcapng_flush(btbb_pcapng_handle * h, const int force)
+{
+	return -pcapng_flush( (PCAPNG_HANDLE *) h, force );
+}
+
 int btbb_pcapng_close(btbb_pcapng_handle * h)
 {
 	pcapng_close( (PCAPNG_HANDLE *) h );
@@ -405,6 +474,20 @@ lell_pcapng_create_file(const char *filename, const char *interface_desc,
 	return retval;
 }
 
+int
+lell_pcapng_create_stream(const int fd, const char *interface_desc,
+			  const size_t buffer_size, const unsigned flush_ms,
+			  lell_pcapng_handle ** ph)
+{
+	return create_stream_single_interface( (PCAPNG_HANDLE **) ph,
+					       fd,
+					       interface_desc,
+					       DLT_BLUETOOTH_LE_LL_WITH_PHDR,
+					       64,
+					       buffer_size,
+					       flush_ms );
+}
+
 static PCAPNG_RESULT
 append_le_packet( PCAPNG_HANDLE * handle,
 		  pcapng_le_packet * pkt )
@@ -512,6 +595,11 @@ lell_pcapng_record_connect_req(lell_pcapng_handle * h, const uint64_t ns,
 	return -record_le_connect_req_info( (PCAPNG_HANDLE *) h, ns, pdu );
 }
 
+int lell_pcapng_flush(lell_pcapng_handle *h, const int force)
+{
+	return -pcapng_flush( (PCAPNG_HANDLE *) h, force );
+}
+
 int lell_pcapng_close(lell_pcapng_handle *h)
 {
 	pcapng_close( (PCAPNG_HANDLE *) h );
@@ -24,10 +24,12 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 static option_header padopt = {
@@ -53,6 +55,8 @@ PCAPNG_RESULT pcapng_create( PCAPNG_HANDLE * handle,
 	handle->section_header_size = handle->next_section_option_offset =
 		handle->interface_description_size =
 		handle->next_interface_option_offset = 0;
+	handle->stream_buf = NULL;
+	handle->stream_buf_size = handle->stream_buf_used = 0;
 
 	handle->fd = open( filename, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP );
 	if (handle->fd == -1) {
@@ -224,6 +228,122 @@ PCAPNG_RESULT pcapng_create( PCAPNG_HANDLE * handle,
 	return retval;
 }
 
+/* write() until everything is out; FIFOs may take partial writes */
+static int write_all( int fd, const uint8_t * buf, size_t len )
+{
+	while (len > 0) {
+		ssize_t result = write( fd, buf, len );
+		if (result == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += result;
+		len -= result;
+	}
+	return 0;
+}
+
+static uint64_t stream_now_ns( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* size of an option list, padded, without the end of options marker */
+static size_t options_size( const option_header * options )
+{
+	size_t size = 0;
+	while (options &&
+	       options->option_code &&
+	       options->option_length) {
+		size_t paddedsz = 4*((options->option_length+3)/4);
+		size += 4+paddedsz;
+		options = (const option_header *) &((uint8_t *)options)[4+paddedsz];
+	}
+	return size;
+}
+
+/* copy a header followed by its options, end of options and trailing
+ * length into a complete block; returns the block size */
+static size_t build_block( uint8_t * dest,
+			   const void * header,
+			   const size_t header_size,
+			   const option_header * options )
+{
+	const size_t optsz = options_size( options );
+	const uint32_t total = (uint32_t) (header_size + optsz + 8);
+
+	(void) memcpy( dest, header, header_size );
+	((uint32_t *)dest)[1] = total;
+
+	/* options are already padded in their list */
+	if (optsz)
+		(void) memcpy( &dest[header_size], options, optsz );
+	(void) memset( &dest[header_size+optsz], 0, 4 );
+	(void) memcpy( &dest[total-4], &total, 4 );
+	return total;
+}
+
+PCAPNG_RESULT pcapng_create_stream( PCAPNG_HANDLE * handle,
+				    const int fd,
+				    const option_header * section_options,
+				    const uint16_t link_type,
+				    const uint32_t snaplen,
+				    const option_header * interface_options,
+				    const size_t buffer_size,
+				    const unsigned flush_ms )
+{
+	const section_header_block shb = {
+		.block_type = BLOCK_TYPE_SECTION_HEADER,
+		.block_total_length = 0,
+		.byte_order_magic = SECTION_HEADER_BYTE_ORDER_MAGIC,
+		.major_version = 1,
+		.minor_version = 0,
+		/* a stream cannot go back and fill this in */
+		.section_length = (uint64_t) -1,
+	};
+	const interface_description_block idb = {
+		.block_type = BLOCK_TYPE_INTERFACE,
+		.block_total_length = 0,
+		.link_type = link_type,
+		.snaplen = snaplen
+	};
+	size_t headersz = sizeof( shb ) + options_size( section_options ) + 8 +
+		sizeof( idb ) + options_size( interface_options ) + 8;
+	size_t used;
+	PCAPNG_RESULT retval;
+
+	handle->fd = fd;
+	handle->section_header = NULL;
+	handle->interface_description = NULL;
+	handle->section_header_size = handle->next_section_option_offset =
+		handle->interface_description_size =
+		handle->next_interface_option_offset = 0;
+
+	/* the headers go out with the first write too */
+	handle->stream_buf_size = buffer_size > headersz ? buffer_size : headersz;
+	handle->stream_buf = malloc( handle->stream_buf_size );
+	if (!handle->stream_buf) {
+		handle->stream_buf_size = handle->stream_buf_used = 0;
+		(void) pcapng_close( handle );
+		return PCAPNG_NO_MEMORY;
+	}
+
+	used = build_block( handle->stream_buf, &shb, sizeof( shb ), section_options );
+	used += build_block( &handle->stream_buf[used], &idb, sizeof( idb ), interface_options );
+	handle->stream_buf_used = used;
+	handle->stream_flush_ns = (uint64_t) flush_ms * 1000000ull;
+
+	/* let the reader see the headers right away */
+	retval = pcapng_flush( handle, 1 );
+	if (retval != PCAPNG_OK) {
+		(void) pcapng_close( handle );
+	}
+	return retval;
+}
+
 PCAPNG_RESULT pcapng_append_section_option( PCAPNG_HANDLE * handle,
 					    const option_header * section_option )
 {
@@ -290,12 +410,54 @@ PCAPNG_RESULT pcapng_append_packet( PCAPNG_HANDLE * handle,
 	PCAPNG_RESULT retval = PCAPNG_OK;
 	if (handle && (handle->fd != -1)) {
 		size_t writesz = packet->block_total_length;
-		ssize_t result = write( handle->fd, packet, writesz );
-		if (result == -1) {
-			result = PCAPNG_FILE_WRITE_ERROR;
+		if (handle->stream_buf) {
+			if (handle->stream_buf_used + writesz > handle->stream_buf_size)
+				retval = pcapng_flush( handle, 1 );
+			if (retval == PCAPNG_OK) {
+				if (writesz > handle->stream_buf_size) {
+					/* larger than the whole buffer, don't copy it */
+					if (write_all( handle->fd, (const uint8_t *) packet, writesz ) == -1)
+						retval = PCAPNG_FILE_WRITE_ERROR;
+				}
+				else {
+					if (handle->stream_buf_used == 0)
+						handle->stream_first_ns = stream_now_ns( );
+					(void) memcpy( &handle->stream_buf[handle->stream_buf_used],
+						       packet, writesz );
+					handle->stream_buf_used += writesz;
+					retval = pcapng_flush( handle, 0 );
+				}
+			}
 		}
 		else {
-			handle->section_header->section_length += writesz;
+			ssize_t result = write( handle->fd, packet, writesz );
+			if (result == -1) {
+				retval = PCAPNG_FILE_WRITE_ERROR;
+			}
+			else {
+				handle->section_header->section_length += writesz;
+			}
+		}
+	}
+	else {
+		retval = PCAPNG_INVALID_HANDLE;
+	}
+	return retval;
+}
+
+PCAPNG_RESULT pcapng_flush( PCAPNG_HANDLE * handle, const int force )
+{
+	PCAPNG_RESULT retval = PCAPNG_OK;
+	if (handle && (handle->fd != -1)) {
+		if (handle->stream_buf &&
+		    handle->stream_buf_used &&
+		    (force ||
+		     (stream_now_ns( ) - handle->stream_first_ns >= handle->stream_flush_ns))) {
+			if (write_all( handle->fd, handle->stream_buf,
+				       handle->stream_buf_used ) == -1)
+				retval = PCAPNG_FILE_WRITE_ERROR;
+			/* on error the reader is gone; drop what we had */
+			handle->stream_buf_used = 0;
 		}
 	}
 	else {
@@ -306,6 +468,11 @@ PCAPNG_RESULT pcapng_append_packet( PCAPNG_HANDLE * handle,
 
 PCAPNG_RESULT pcapng_close( PCAPNG_HANDLE * handle )
 {
+	if (handle->stream_buf) {
+		(void) pcapng_flush( handle, 1 );
+		free( handle->stream_buf );
+		handle->stream_buf = NULL;
+	}
 	if (handle->interface_description &&
 	    (handle->interface_description != MAP_FAILED)) {
 		(void) munmap( handle->interface_description,
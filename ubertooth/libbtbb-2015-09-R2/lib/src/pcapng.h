@@ -143,6 +143,12 @@ typedef struct {
 	interface_description_block * interface_description;
 	size_t interface_description_size;
 	size_t next_interface_option_offset;
+	/* stream mode: packets are collected here and written out together */
+	uint8_t * stream_buf;
+	size_t stream_buf_size;
+	size_t stream_buf_used;
+	uint64_t stream_flush_ns;
+	uint64_t stream_first_ns;
 } PCAPNG_HANDLE;
 
 typedef enum {
@@ -184,6 +190,32 @@ PCAPNG_RESULT pcapng_create( PCAPNG_HANDLE * handle,
 			     const option_header * interface_options,
 			     const size_t interface_options_space );
 
+/**
+ * Start a PCAP-NG stream on an already open descriptor, such as a FIFO,
+ * which can be neither created exclusively nor mmapped.  The headers are
+ * written complete with their options, so no options can be appended
+ * later.  Packets are collected in a buffer and written together.  On
+ * failure the handle is already closed, including fd.
+ *
+ * @param handle                  pointer to a handle that is populated by this call
+ * @param fd                      descriptor to write to, closed by pcapng_close
+ * @param section_options         list of section options, can be NULL
+ * @param link_type
+ * @param snaplen
+ * @param interface_options       list of interface options, can be NULL
+ * @param buffer_size             bytes of packets to collect before writing
+ * @param flush_ms                longest time a packet waits in the buffer
+ * @returns                       0 on success, non zero result code otherwise
+ */
+PCAPNG_RESULT pcapng_create_stream( PCAPNG_HANDLE * handle,
+				    const int fd,
+				    const option_header * section_options,
+				    const uint16_t link_type,
+				    const uint32_t snaplen,
+				    const option_header * interface_options,
+				    const size_t buffer_size,
+				    const unsigned flush_ms );
+
 PCAPNG_RESULT pcapng_append_section_option( PCAPNG_HANDLE * handle,
 					    const option_header * section_option );
 
@@ -193,6 +225,13 @@ PCAPNG_RESULT pcapng_append_interface_option( PCAPNG_HANDLE * handle,
 PCAPNG_RESULT pcapng_append_packet( PCAPNG_HANDLE * handle,
 				    const enhanced_packet_block * packet );
 
+/**
+ * Write out the packets buffered by a stream.  Unless force is set this
+ * only happens once the oldest has waited the flush interval, so it is
+ * cheap enough to call for every USB transfer.  Does nothing for files.
+ */
+PCAPNG_RESULT pcapng_flush( PCAPNG_HANDLE * handle, const int force );
+
 PCAPNG_RESULT pcapng_close( PCAPNG_HANDLE * handle );
 
 #endif /* PCAPNG_DOT_H */
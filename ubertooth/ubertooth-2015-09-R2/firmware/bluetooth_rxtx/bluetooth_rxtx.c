@@ -27,6 +27,7 @@
 #include "ubertooth_interface.h"
 #include "bluetooth.h"
 #include "bluetooth_le.h"
+#include "le_correlator.h"
 #include "cc2400_rangetest.h"
 #include "ego.h"
 
@@ -125,7 +126,7 @@ int le_jam_count = 0;
 /* set LE access address */
 static void le_set_access_address(u32 aa);
 
-typedef int (*data_cb_t)(char *);
+typedef int (*data_cb_t)(u8 *);
 data_cb_t data_cb = NULL;
 
 typedef void (*packet_cb_t)(u8 *);
@@ -142,6 +143,9 @@ int16_t rssi_iir[79] = {0};
 */
 #define CLK_TUNE_TIME   2250
 
+/* Packed symbol buffers (two rxbufs) */
+u8 packed[DMA_SIZE*2];
+
 /* Unpacked symbol buffers (two rxbufs) */
 char unpacked[DMA_SIZE*8*2];
 
@@ -1488,6 +1492,22 @@ void bt_stream_rx()
 	while ((requested_mode == MODE_RX_SYMBOLS) ||
 		   (requested_mode == MODE_BT_FOLLOW)) {
 
+		/* The host switches between following a piconet and
+		 * plain symbol streaming (to reacquire it) without
+		 * stopping; retune in place and keep DMA and USB running. */
+		if (requested_mode != mode) {
+			mode = requested_mode;
+			cc2400_strobe(SRFOFF);
+			while ((cc2400_status() & FS_LOCK));
+			if (mode == MODE_BT_FOLLOW) {
+				precalc();
+				cc2400_rx_sync((syncword >> 32) & 0xffffffff);
+			} else {
+				cc2400_rx();
+			}
+			hold = 0;
+		}
+
 		/* If timer says time to hop, do it. TODO - set
 		 * per-channel carrier sense threshold. Set by
 		 * firmware or host. TODO - if hop happened, clear
@@ -1651,7 +1671,6 @@ void bt_generic_le(u8 active_mode)
 {
 	u8 *tmp = NULL;
 	u8 hold;
-	int i, j;
 	int8_t rssi, rssi_at_trigger;
 
 	modulation = MOD_BT_LOW_ENERGY;
@@ -1763,19 +1782,11 @@ void bt_generic_le(u8 active_mode)
 		}
 		hold--;
 
-		// copy the previously unpacked symbols to the front of the buffer
-		memcpy(unpacked, unpacked + DMA_SIZE*8, DMA_SIZE*8);
-
-		// unpack the new packet to the end of the buffer
-		for (i = 0; i < DMA_SIZE; ++i) {
-			/* output one byte for each received symbol (0x00 or 0x01) */
-			for (j = 0; j < 8; ++j) {
-				unpacked[DMA_SIZE*8 + i * 8 + j] = (idle_rxbuf[i] & 0x80) >> 7;
-				idle_rxbuf[i] <<= 1;
-			}
-		}
+		// keep the previous rxbuf in front of the new one
+		memcpy(packed, packed + DMA_SIZE, DMA_SIZE);
+		memcpy(packed + DMA_SIZE, idle_rxbuf, DMA_SIZE);
 
-		int ret = data_cb(unpacked);
+		int ret = data_cb(packed);
 		if (!ret) break;
 
 	rx_continue:
@@ -2000,10 +2011,19 @@ cleanup:
 
 /* low energy connection following
  * follows a known AA around */
-int cb_follow_le() {
+int cb_follow_le(u8 *rxbufs) {
 	int i, j, k;
 	int idx = whitening_index[btle_channel_index(channel-2402)];
 
+	// copy the previously unpacked symbols to the front of the buffer
+	memcpy(unpacked, unpacked + DMA_SIZE*8, DMA_SIZE*8);
+
+	// unpack the new rxbuf to the end of the buffer, one byte for each
+	// received symbol (0x00 or 0x01)
+	for (i = 0; i < DMA_SIZE; ++i)
+		for (j = 0; j < 8; ++j)
+			unpacked[DMA_SIZE*8 + i * 8 + j] = (rxbufs[DMA_SIZE + i] >> (7 - j)) & 1;
+
 	u32 access_address = 0;
 	for (i = 0; i < 31; ++i) {
 		access_address >>= 1;
@@ -2296,74 +2316,20 @@ void see_aa(u32 aa) {
 }
 
 /* le promiscuous mode */
-int cb_le_promisc(char *unpacked) {
-	int i, j, k;
-	int idx;
-
-	// empty data PDU: 01 00
-	char desired[4][16] = {
-		{ 1, 0, 0, 0, 0, 0, 0, 0,
-		  0, 0, 0, 0, 0, 0, 0, 0, },
-		{ 1, 0, 0, 1, 0, 0, 0, 0,
-		  0, 0, 0, 0, 0, 0, 0, 0, },
-		{ 1, 0, 1, 0, 0, 0, 0, 0,
-		  0, 0, 0, 0, 0, 0, 0, 0, },
-		{ 1, 0, 1, 1, 0, 0, 0, 0,
-		  0, 0, 0, 0, 0, 0, 0, 0, },
-	};
-
-	for (i = 0; i < 4; ++i) {
-		idx = whitening_index[btle_channel_index(channel-2402)];
-
-		// whiten the desired data
-		for (j = 0; j < (int)sizeof(desired[i]); ++j) {
-			desired[i][j] ^= whitening[idx];
-			idx = (idx + 1) % sizeof(whitening);
-		}
-	}
-
-	// then look for that bitsream in our receive buffer
-	for (i = 32; i < (DMA_SIZE*8*2 - 32 - 16); i++) {
-		int ok[4] = { 1, 1, 1, 1 };
-		int matching = -1;
-
-		for (j = 0; j < 4; ++j) {
-			for (k = 0; k < (int)sizeof(desired[j]); ++k) {
-				if (unpacked[i+k] != desired[j][k]) {
-					ok[j] = 0;
-					break;
-				}
-			}
-		}
-
-		// see if any match
-		for (j = 0; j < 4; ++j) {
-			if (ok[j]) {
-				matching = j;
-				break;
-			}
-		}
+int cb_le_promisc(u8 *rxbufs) {
+	const le_corr_pattern_t *pat;
+	int i;
 
-		// skip if no match
-		if (matching < 0)
-			continue;
+	pat = &le_corr_patterns[btle_channel_index(channel-2402)];
 
+	// look for a whitened empty data PDU in our receive buffer
+	for (i = 32;
+		 (i = le_corr_search(pat, rxbufs, DMA_SIZE*8*2, i,
+							 DMA_SIZE*8*2 - 32 - 16)) >= 0;
+		 ++i) {
 		// found a match! unwhiten it and send it home
-		idx = whitening_index[btle_channel_index(channel-2402)];
-		for (j = 0; j < 4+3+3; ++j) {
-			u8 byte = 0;
-			for (k = 0; k < 8; k++) {
-				int offset = k + (j * 8) + i - 32;
-				if (offset >= DMA_SIZE*8*2) break;
-				int bit = unpacked[offset];
-				if (j >= 4) { // unwhiten data bytes
-					bit ^= whitening[idx];
-					idx = (idx + 1) % sizeof(whitening);
-				}
-				byte |= bit << k;
-			}
-			idle_rxbuf[j] = byte;
-		}
+		le_corr_extract(rxbufs, DMA_SIZE*8*2, i - 32, pat->whitening_idx,
+						idle_rxbuf, 4+3+3);
 
 		u32 aa = (idle_rxbuf[3] << 24) |
 				 (idle_rxbuf[2] << 16) |
@@ -2372,7 +2338,6 @@ int cb_le_promisc(char *unpacked) {
 		see_aa(aa);
 
 		enqueue(LE_PACKET, idle_rxbuf);
-
 	}
 
 	// once we see an AA 5 times, start following it
@@ -2401,6 +2366,7 @@ void bt_promisc_le() {
 
 		// if the PC hasn't given us AA, determine by listening
 		if (!le.target_set) {
+			le_corr_init();
 			// cs_threshold_req = -80;
 			cs_threshold_calc_and_set();
 			data_cb = cb_le_promisc;
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2015 Project Ubertooth
+ *
+ * This file is part of Project Ubertooth.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "le_correlator.h"
+#include "bluetooth_le.h"
+
+le_corr_pattern_t le_corr_patterns[LE_CORR_CHANNELS];
+
+/* header of an empty data PDU: LLID = 01, length = 0 */
+#define EMPTY_PDU_HEADER 0x0001
+/* SN and NESN may take any value */
+#define EMPTY_PDU_DONT_CARE 0x000c
+
+// precompute the whitened empty PDU header for every channel
+void le_corr_init(void)
+{
+	int c, k, idx, bit;
+	le_corr_pattern_t *pat;
+
+	for (c = 0; c < LE_CORR_CHANNELS; ++c) {
+		pat = &le_corr_patterns[c];
+		pat->pattern = 0;
+		pat->mask = 0;
+		pat->whitening_idx = whitening_index[c];
+
+		idx = whitening_index[c];
+		for (k = 0; k < 16; ++k) {
+			bit = ((EMPTY_PDU_HEADER >> k) & 1) ^ whitening[idx];
+			idx = (idx + 1) % sizeof(whitening);
+			if ((EMPTY_PDU_DONT_CARE >> k) & 1)
+				continue;
+			// first symbol on air ends up in the most significant bit
+			pat->pattern |= bit << (15 - k);
+			pat->mask |= 1 << (15 - k);
+		}
+	}
+}
+
+/*
+ * Find the first empty PDU header starting at a symbol offset in [from, to).
+ *
+ * The buffer is fed into a 32-bit window a byte at a time and each of the
+ * eight alignments ending in that byte is tested with a single masked
+ * compare.  Returns the symbol offset of the header or -1.
+ */
+int le_corr_search(const le_corr_pattern_t *pat, const u8 *buf, int nbits,
+				   int from, int to)
+{
+	u32 window = 0;
+	u32 pattern = pat->pattern;
+	u32 mask = pat->mask;
+	int i, n, s;
+
+	if (to > nbits - 16 + 1)
+		to = nbits - 16 + 1;
+	if (from < 0)
+		from = 0;
+
+	for (n = from >> 3; n < (nbits >> 3); ++n) {
+		window = (window << 8) | buf[n];
+
+		// header whose last symbol is at n*8 + 7 - s
+		for (s = 7; s >= 0; --s) {
+			i = n * 8 + 7 - s - 15;
+			if (i < from)
+				continue;
+			if (i >= to)
+				return -1;
+			if (((window >> s) & mask) == pattern)
+				return i;
+		}
+	}
+
+	return -1;
+}
+
+static u8 reverse8(u8 b)
+{
+	b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+	b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+	b = ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+	return b;
+}
+
+/*
+ * Copy len bytes out of the packed buffer starting at a symbol offset.  The
+ * first four bytes (the AA) are copied as is, the rest are unwhitened.
+ * Output bytes are in air order (first symbol in the LSB); symbols past the
+ * end of the buffer read as zero.
+ */
+void le_corr_extract(const u8 *buf, int nbits, int offset, u8 whitening_idx,
+					 u8 *out, int len)
+{
+	int j, k, n, shift, valid;
+	int idx = whitening_idx;
+	u16 v;
+	u8 byte, whit;
+
+	for (j = 0; j < len; ++j, offset += 8) {
+		valid = nbits - offset;
+		if (valid <= 0) {
+			out[j] = 0;
+			continue;
+		}
+
+		n = offset >> 3;
+		shift = offset & 7;
+		v = buf[n] << 8;
+		if (shift && (n + 1) < (nbits >> 3))
+			v |= buf[n + 1];
+		byte = (v << shift) >> 8;
+		if (valid < 8)
+			byte &= 0xff << (8 - valid);
+		byte = reverse8(byte);
+
+		if (j >= 4) { // unwhiten data bytes
+			whit = 0;
+			for (k = 0; k < 8 && k < valid; ++k) {
+				whit |= whitening[idx] << k;
+				idx = (idx + 1) % sizeof(whitening);
+			}
+			byte ^= whit;
+		}
+
+		out[j] = byte;
+	}
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2015 Project Ubertooth
+ *
+ * This file is part of Project Ubertooth.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Word-level correlator for LE promiscuous mode.
+ *
+ * Searches packed DMA buffers (one symbol per bit, first symbol in the MSB
+ * of each byte) for the whitened header of an empty data PDU.  This file has
+ * no hardware dependencies so it can be built on the host and benchmarked
+ * against recorded buffers (see ../le_correlator_test).
+ */
+
+#ifndef __LE_CORRELATOR_H
+#define __LE_CORRELATOR_H
+
+#include "types.h"
+
+#define LE_CORR_CHANNELS 40
+
+typedef struct _le_corr_pattern_t {
+	u32 pattern;                // whitened header, first symbol in bit 15
+	u32 mask;                   // bits to compare (SN/NESN are don't care)
+	u8 whitening_idx;           // whitening index of the first header bit
+} le_corr_pattern_t;
+
+/* per-channel patterns, indexed by btle_channel_index() */
+extern le_corr_pattern_t le_corr_patterns[LE_CORR_CHANNELS];
+
+void le_corr_init(void);
+int le_corr_search(const le_corr_pattern_t *pat, const u8 *buf, int nbits,
+				   int from, int to);
+void le_corr_extract(const u8 *buf, int nbits, int offset, u8 whitening_idx,
+					 u8 *out, int len);
+
+#endif /* __LE_CORRELATOR_H */
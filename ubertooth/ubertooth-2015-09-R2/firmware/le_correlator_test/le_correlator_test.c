@@ -0,0 +1,292 @@
+/*
+ * Copyright 2015 Project Ubertooth
+ *
+ * This file is part of Project Ubertooth.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "le_correlator.h"
+#include "bluetooth_le.h"
+
+#define NBITS (DMA_SIZE*8*2)
+#define MATCH_LEN (4+3+3)
+#define MAX_MATCHES NBITS
+#define PKT_LEN 64
+#define DUMP_RECORD_LEN (4 + PKT_LEN)
+#define DUMP_DATA_OFFSET 14
+#define ITERATIONS 20
+
+typedef struct {
+	int offset;
+	u8 data[MATCH_LEN];
+} match_t;
+
+/* the symbol-at-a-time search cb_le_promisc() used to do */
+static int reference_search(const char *unpacked, u8 chan_idx, match_t *out)
+{
+	int i, j, k, idx;
+	int count = 0;
+
+	char desired[4][16] = {
+		{ 1, 0, 0, 0, 0, 0, 0, 0,
+		  0, 0, 0, 0, 0, 0, 0, 0, },
+		{ 1, 0, 0, 1, 0, 0, 0, 0,
+		  0, 0, 0, 0, 0, 0, 0, 0, },
+		{ 1, 0, 1, 0, 0, 0, 0, 0,
+		  0, 0, 0, 0, 0, 0, 0, 0, },
+		{ 1, 0, 1, 1, 0, 0, 0, 0,
+		  0, 0, 0, 0, 0, 0, 0, 0, },
+	};
+
+	for (i = 0; i < 4; ++i) {
+		idx = whitening_index[chan_idx];
+		for (j = 0; j < (int)sizeof(desired[i]); ++j) {
+			desired[i][j] ^= whitening[idx];
+			idx = (idx + 1) % sizeof(whitening);
+		}
+	}
+
+	for (i = 32; i < (NBITS - 32 - 16); i++) {
+		int ok[4] = { 1, 1, 1, 1 };
+		int matching = -1;
+
+		for (j = 0; j < 4; ++j) {
+			for (k = 0; k < (int)sizeof(desired[j]); ++k) {
+				if (unpacked[i+k] != desired[j][k]) {
+					ok[j] = 0;
+					break;
+				}
+			}
+		}
+
+		for (j = 0; j < 4; ++j) {
+			if (ok[j]) {
+				matching = j;
+				break;
+			}
+		}
+
+		if (matching < 0)
+			continue;
+
+		idx = whitening_index[chan_idx];
+		for (j = 0; j < MATCH_LEN; ++j) {
+			u8 byte = 0;
+			for (k = 0; k < 8; k++) {
+				int offset = k + (j * 8) + i - 32;
+				if (offset >= NBITS) break;
+				int bit = unpacked[offset];
+				if (j >= 4) {
+					bit ^= whitening[idx];
+					idx = (idx + 1) % sizeof(whitening);
+				}
+				byte |= bit << k;
+			}
+			out[count].data[j] = byte;
+		}
+		out[count++].offset = i;
+	}
+
+	return count;
+}
+
+static int correlator_search(const u8 *packed, u8 chan_idx, match_t *out)
+{
+	const le_corr_pattern_t *pat = &le_corr_patterns[chan_idx];
+	int i, count = 0;
+
+	for (i = 32; (i = le_corr_search(pat, packed, NBITS, i, NBITS - 32 - 16)) >= 0; ++i) {
+		le_corr_extract(packed, NBITS, i - 32, pat->whitening_idx,
+						out[count].data, MATCH_LEN);
+		out[count++].offset = i;
+	}
+
+	return count;
+}
+
+static int same_matches(const match_t *a, const match_t *b, int count)
+{
+	int i;
+	for (i = 0; i < count; ++i)
+		if (a[i].offset != b[i].offset ||
+			memcmp(a[i].data, b[i].data, MATCH_LEN) != 0)
+			return 0;
+	return 1;
+}
+
+static void unpack(const u8 *packed, char *unpacked)
+{
+	int i, j;
+	for (i = 0; i < NBITS / 8; ++i)
+		for (j = 0; j < 8; ++j)
+			unpacked[i * 8 + j] = (packed[i] >> (7 - j)) & 1;
+}
+
+static void put_bit(u8 *stream, int n, int bit)
+{
+	if (bit)
+		stream[n / 8] |= 0x80 >> (n % 8);
+	else
+		stream[n / 8] &= ~(0x80 >> (n % 8));
+}
+
+/* random symbols with whitened empty PDUs sprinkled in */
+static u8 *synthesize(int blocks, u8 chan_idx)
+{
+	int len = blocks * DMA_SIZE;
+	u8 *stream = malloc(len);
+	int i, j, n, idx;
+	u8 pdu[MATCH_LEN];
+
+	for (i = 0; i < len; ++i)
+		stream[i] = rand() & 0xff;
+
+	for (n = rand() % 512; n + MATCH_LEN * 8 < len * 8; n += 200 + rand() % 1024) {
+		for (i = 0; i < MATCH_LEN; ++i)
+			pdu[i] = rand() & 0xff;
+		pdu[4] = 0x01 | (rand() & 0x0c);
+		pdu[5] = 0x00;
+
+		idx = whitening_index[chan_idx];
+		for (i = 0; i < MATCH_LEN; ++i) {
+			for (j = 0; j < 8; ++j) {
+				int bit = (pdu[i] >> j) & 1;
+				if (i >= 4) {
+					bit ^= whitening[idx];
+					idx = (idx + 1) % sizeof(whitening);
+				}
+				put_bit(stream, n + i * 8 + j, bit);
+			}
+		}
+	}
+
+	return stream;
+}
+
+static u8 *load_dump(const char *path, int *blocks, u8 *chan_idx)
+{
+	FILE *f = fopen(path, "rb");
+	u8 record[DUMP_RECORD_LEN];
+	u8 *stream = NULL;
+	int n = 0;
+
+	if (f == NULL) {
+		perror(path);
+		return NULL;
+	}
+
+	while (fread(record, 1, DUMP_RECORD_LEN, f) == DUMP_RECORD_LEN) {
+		stream = realloc(stream, (n + 1) * DMA_SIZE);
+		memcpy(stream + n * DMA_SIZE, record + 4 + DUMP_DATA_OFFSET, DMA_SIZE);
+		// usb_pkt_rx.channel is relative to 2402 MHz
+		*chan_idx = btle_channel_index(record[4 + 2]);
+		++n;
+	}
+	fclose(f);
+
+	*blocks = n;
+	return stream;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(void)
+{
+	printf("le_correlator_test - check and time the LE promiscuous correlator\n");
+	printf("Usage:\n");
+	printf("\t-c <channel> channel index for generated data (default 17)\n");
+	printf("\t-n <blocks> number of generated DMA blocks (default 10000)\n");
+	printf("\t<dumpfile> file written by ubertooth-dump instead of generated data\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, blocks = 10000;
+	u8 chan_idx = 17;
+	u8 *stream;
+	u8 packed[NBITS / 8];
+	char unpacked[NBITS];
+	match_t ref[MAX_MATCHES], corr[MAX_MATCHES];
+	int b, i, nref, ncorr, total = 0, mismatches = 0;
+	double t, ref_time = 0, corr_time = 0;
+
+	while ((opt = getopt(argc, argv, "c:n:h")) != EOF) {
+		switch (opt) {
+		case 'c':
+			chan_idx = atoi(optarg) % LE_CORR_CHANNELS;
+			break;
+		case 'n':
+			blocks = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (optind < argc)
+		stream = load_dump(argv[optind], &blocks, &chan_idx);
+	else
+		stream = synthesize(blocks, chan_idx);
+	if (stream == NULL || blocks < 2)
+		return 1;
+
+	le_corr_init();
+
+	for (b = 1; b < blocks; ++b) {
+		memcpy(packed, stream + (b - 1) * DMA_SIZE, sizeof(packed));
+
+		t = now();
+		for (i = 0; i < ITERATIONS; ++i) {
+			unpack(packed, unpacked);
+			nref = reference_search(unpacked, chan_idx, ref);
+		}
+		ref_time += now() - t;
+
+		t = now();
+		for (i = 0; i < ITERATIONS; ++i)
+			ncorr = correlator_search(packed, chan_idx, corr);
+		corr_time += now() - t;
+
+		if (nref != ncorr || !same_matches(ref, corr, nref)) {
+			printf("block %d: reference found %d, correlator found %d\n",
+				   b, nref, ncorr);
+			++mismatches;
+		}
+		total += nref;
+	}
+
+	printf("%d blocks, %d matches, %d mismatching blocks\n",
+		   blocks - 1, total, mismatches);
+	printf("reference:  %.3f us/block\n", ref_time * 1e6 / ITERATIONS / (blocks - 1));
+	printf("correlator: %.3f us/block\n", corr_time * 1e6 / ITERATIONS / (blocks - 1));
+
+	free(stream);
+	return mismatches ? 1 : 0;
+}
@@ -52,6 +52,7 @@ static uint64_t last_clk100ns = 0;
 static uint64_t clk100ns_upper = 0;
 
 u8 debug = 0;
+u8 quiet = 0; // no per-packet output, for tools that only write captures
 FILE *infile = NULL;
 FILE *dumpfile = NULL;
 int max_ac_errors = 2;
@@ -291,6 +292,16 @@ int stream_rx_usb(struct libusb_device_handle* devh, int xfer_size,
 		}
 		usb_really_full = 0;
 		fflush(stderr);
+
+		/* streamed captures hold packets back; don't let them sit.  A
+		 * failed flush means the reader (such as Wireshark reading an
+		 * extcap FIFO) has gone away, so stop streaming. */
+		if ((h_pcapng_bredr && btbb_pcapng_flush(h_pcapng_bredr, 0) < 0) ||
+		    (h_pcapng_le && lell_pcapng_flush(h_pcapng_le, 0) < 0)) {
+			if(rx_xfer)
+				libusb_cancel_transfer(rx_xfer);
+			return 1;
+		}
 	}
 }
 
@@ -425,6 +436,114 @@ static uint64_t now_ns_from_clk100ns( const usb_pkt_rx *rx )
 		((100ull*clk100ns_upper)<<32);
 }
 
+/* Follow engine for rx_live(). The stream is never torn down: once a
+ * piconet's clock is known the firmware is switched to hopping in
+ * place, and when libbtbb reports that sync was lost it is parked back
+ * on a fixed channel while the clock is reacquired. Targets waiting
+ * for their UAP/clock are served round robin. */
+#define FOLLOW_MAX_TARGETS 8
+#define FOLLOW_ACQUIRE_TIMEOUT 30 // seconds per queued target
+
+enum follow_state {
+	FOLLOW_ACQUIRE,
+	FOLLOW_HOPPING
+};
+
+static struct {
+	struct libusb_device_handle *devh;
+	btbb_piconet *targets[FOLLOW_MAX_TARGETS];
+	int num_targets;
+	int current;
+	enum follow_state state;
+	time_t since;
+	u16 park_channel;
+	btbb_piconet *pending; // preset follow_pn, started once streaming
+} follow;
+
+/* Queue another piconet for the running rx_live() to acquire and follow;
+ * the queue only lasts for one rx_live() call. Returns -1 if the queue is
+ * full. */
+int follow_queue_add(btbb_piconet *pn)
+{
+	int i;
+
+	for (i = 0; i < follow.num_targets; i++)
+		if (follow.targets[i] == pn)
+			return 0;
+	if (follow.num_targets == FOLLOW_MAX_TARGETS)
+		return -1;
+	follow.targets[follow.num_targets++] = pn;
+	return 0;
+}
+
+/* Forget every queued piconet; the caller owns them and may free them once
+ * rx_live() returns */
+static void follow_queue_reset(void)
+{
+	follow.num_targets = 0;
+	follow.current = 0;
+	follow.pending = NULL;
+}
+
+static void follow_start_hopping(btbb_piconet *pn)
+{
+	struct libusb_device_handle *devh = follow.devh;
+	int offset = btbb_piconet_get_clk_offset(pn);
+	int i;
+
+	cmd_set_bdaddr(devh, btbb_piconet_get_bdaddr(pn));
+	/* Hop on the channel map hop reversal worked out */
+	if (btbb_piconet_get_flag(pn, BTBB_IS_AFH)) {
+		btbb_print_afh_map(pn);
+		cmd_set_afh_map(devh, btbb_piconet_get_afh_map(pn));
+	} else {
+		cmd_clear_afh_map(devh);
+	}
+	cmd_start_hopping(devh, offset);
+
+	/* The firmware adds the offset to its clock, so everything we
+	 * know is now relative to the followed piconet. */
+	for (i = 0; i < follow.num_targets; i++)
+		btbb_piconet_shift_clkn(follow.targets[i], offset);
+
+	follow_pn = pn;
+	follow.state = FOLLOW_HOPPING;
+	follow.since = time(NULL);
+}
+
+static void follow_lost(void)
+{
+	printf("Parking on channel %d to reacquire\n", follow.park_channel);
+	cmd_set_channel(follow.devh, follow.park_channel);
+	cmd_rx_syms(follow.devh);
+	follow_pn = NULL;
+	follow.state = FOLLOW_ACQUIRE;
+	follow.since = time(NULL);
+}
+
+static void follow_tick(void)
+{
+	time_t now;
+
+	if (follow.pending) {
+		follow_start_hopping(follow.pending);
+		follow.pending = NULL;
+		return;
+	}
+
+	if (follow.state != FOLLOW_ACQUIRE || follow.num_targets < 2)
+		return;
+
+	now = time(NULL);
+	if (now - follow.since < FOLLOW_ACQUIRE_TIMEOUT)
+		return;
+	follow.current = (follow.current + 1) % follow.num_targets;
+	follow.since = now;
+	if (!quiet && btbb_piconet_get_flag(follow.targets[follow.current], BTBB_LAP_VALID))
+		printf("Acquiring LAP %06x\n",
+		       btbb_piconet_get_lap(follow.targets[follow.current]));
+}
+
 /* Sniff for LAPs. If a piconet is provided, use the given LAP to
  * search for UAP.
  */
@@ -442,6 +561,12 @@ static void cb_br_rx(void* args, usb_pkt_rx *rx, int bank)
 	uint32_t lap = LAP_ANY;
 	uint8_t uap = UAP_ANY;
 
+	/* rx_live() may have moved on to another target */
+	if (follow.devh && follow.num_targets) {
+		follow_tick();
+		pn = follow.targets[follow.current];
+	}
+
 	/* Sanity check */
 	if (rx->channel > (NUM_BREDR_CHANNELS-1))
 		goto out;
@@ -520,16 +645,17 @@ static void cb_br_rx(void* args, usb_pkt_rx *rx, int bank)
 		fflush(dumpfile);
 	}
 
-	printf("systime=%u ch=%2d LAP=%06x err=%u clk100ns=%u clk1=%u s=%d n=%d snr=%d\n",
-	       (int)systime,
-	       btbb_packet_get_channel(pkt),
-	       btbb_packet_get_lap(pkt),
-	       btbb_packet_get_ac_errors(pkt),
-	       rx->clk100ns,
-	       btbb_packet_get_clkn(pkt),
-	       signal_level,
-	       noise_level,
-	       snr);
+	if (!quiet)
+		printf("systime=%u ch=%2d LAP=%06x err=%u clk100ns=%u clk1=%u s=%d n=%d snr=%d\n",
+		       (int)systime,
+		       btbb_packet_get_channel(pkt),
+		       btbb_packet_get_lap(pkt),
+		       btbb_packet_get_ac_errors(pkt),
+		       rx->clk100ns,
+		       btbb_packet_get_clkn(pkt),
+		       signal_level,
+		       noise_level,
+		       snr);
 
 	i = btbb_process_packet(pkt, pn);
 
@@ -547,7 +673,12 @@ static void cb_br_rx(void* args, usb_pkt_rx *rx, int bank)
 					lap, uap, pkt);
 	}
 	
-	if(i < 0) {
+	if (follow.devh && follow.num_targets) {
+		if (i == BTBB_PROCESS_FOLLOW && follow.state == FOLLOW_ACQUIRE)
+			follow_start_hopping(pn);
+		else if (i == BTBB_PROCESS_LOST)
+			follow_lost();
+	} else if (i == BTBB_PROCESS_FOLLOW) {
 		follow_pn = pn;
 		stop_ubertooth = 1;
 	}
@@ -557,10 +688,10 @@ out:
 		btbb_packet_unref(pkt);
 }
 
-/* Receive and process packets. For now, returning from
- * stream_rx_usb() means that UAP and clocks have been found, and that
- * hopping should be started. A more flexible framework would be
- * nice. */
+/* Receive and process packets until stopped. Piconets whose clock
+ * is found are followed without restarting the stream, and reacquired
+ * if sync is lost. pn is served first, followed by anything queued
+ * with follow_queue_add(). */
 void rx_live(struct libusb_device_handle* devh, btbb_piconet* pn, int timeout)
 {
 	int r = btbb_init(max_ac_errors);
@@ -570,24 +701,26 @@ void rx_live(struct libusb_device_handle* devh, btbb_piconet* pn, int timeout)
 	if (timeout)
 		set_timeout(timeout);
 
-	if (follow_pn)
+	follow_queue_reset();
+	follow.devh = devh;
+	follow.state = FOLLOW_ACQUIRE;
+	follow.since = time(NULL);
+	if (pn && follow_queue_add(pn) == 0)
+		while (follow.targets[follow.current] != pn)
+			follow.current++;
+	r = cmd_get_channel(devh);
+	follow.park_channel = r < 0 ? 2441 : r;
+
+	if (follow_pn && follow_queue_add(follow_pn) == 0) {
 		cmd_set_clock(devh, 0);
-	else {
-		stream_rx_usb(devh, XFER_LEN, cb_br_rx, pn);
-		/* Allow pending transfers to finish */
-		sleep(1);
-	}
-	/* Used when follow_pn is preset OR set by stream_rx_usb above
-	 * i.e. This cannot be rolled in to the above if...else
-	 */
-	if (follow_pn) {
-		stop_ubertooth = 0;
-		usb_really_full = 0;
-		cmd_stop(devh);
-		cmd_set_bdaddr(devh, btbb_piconet_get_bdaddr(follow_pn));
-		cmd_start_hopping(devh, btbb_piconet_get_clk_offset(follow_pn));
-		stream_rx_usb(devh, XFER_LEN, cb_br_rx, follow_pn);
+		follow.pending = follow_pn;
+		follow_pn = NULL;
 	}
+
+	stream_rx_usb(devh, XFER_LEN, cb_br_rx, pn);
+
+	follow.devh = NULL;
+	follow_queue_reset();
 }
 
 /* sniff one target LAP until the UAP is determined */
@@ -619,27 +752,29 @@ void cb_btle(void* args, usb_pkt_rx *rx, int bank)
 	if (rx->pkt_type == LE_PROMISC) {
 		u8 state = rx->data[0];
 		void *val = &rx->data[1];
+		/* in quiet mode stdout may be a capture, keep status off it */
+		FILE *out = quiet ? stderr : stdout;
 
-		printf("--------------------\n");
-		printf("LE Promisc - ");
+		fprintf(out, "--------------------\n");
+		fprintf(out, "LE Promisc - ");
 		switch (state) {
 			case 0:
-				printf("Access Address: %08x\n", *(uint32_t *)val);
+				fprintf(out, "Access Address: %08x\n", *(uint32_t *)val);
 				break;
 			case 1:
-				printf("CRC Init: %06x\n", *(uint32_t *)val);
+				fprintf(out, "CRC Init: %06x\n", *(uint32_t *)val);
 				break;
 			case 2:
-				printf("Hop interval: %g ms\n", *(uint16_t *)val * 1.25);
+				fprintf(out, "Hop interval: %g ms\n", *(uint16_t *)val * 1.25);
 				break;
 			case 3:
-				printf("Hop increment: %u\n", *(uint8_t *)val);
+				fprintf(out, "Hop increment: %u\n", *(uint8_t *)val);
 				break;
 			default:
-				printf("Unknown %u\n", state);
+				fprintf(out, "Unknown %u\n", state);
 				break;
 		};
-		printf("\n");
+		fprintf(out, "\n");
 
 		return;
 	}
@@ -694,6 +829,11 @@ void cb_btle(void* args, usb_pkt_rx *rx, int bank)
 					  refAA, pkt);
 	}
 
+	if (quiet) {
+		lell_packet_unref(pkt);
+		return;
+	}
+
 	// rollover
 	u32 rx_ts = rx->clk100ns;
 	if (rx_ts < prev_ts)
@@ -61,6 +61,7 @@ int stream_rx_usb(struct libusb_device_handle* devh, int xfer_size,
 int stream_rx_file(FILE* fp, rx_callback cb, void* cb_args);
 void rx_live(struct libusb_device_handle* devh, btbb_piconet* pn, int timeout);
 void rx_file(FILE* fp, btbb_piconet* pn);
+int follow_queue_add(btbb_piconet *pn);
 void rx_dump(struct libusb_device_handle* devh, int full);
 void rx_btle(struct libusb_device_handle* devh);
 void rx_btle_file(FILE* fp);
@@ -0,0 +1,475 @@
+/*
+ * Copyright 2015 Project Ubertooth
+ *
+ * This file is part of Project Ubertooth.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Wireshark extcap interface.  Every Ubertooth shows up twice, once per
+ * mode, as ubertooth<N>-le and ubertooth<N>-bredr.  Captures are written
+ * as PCAPNG straight into the FIFO Wireshark hands us; packets are
+ * collected into large writes rather than written one at a time.
+ */
+
+#include "ubertooth.h"
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern u8 quiet;
+extern int max_ac_errors;
+
+#define DLT_BLUETOOTH_BREDR_BB        255
+#define DLT_BLUETOOTH_LE_LL_WITH_PHDR 256
+
+/* packets are written to the FIFO once this much is pending ... */
+#define STREAM_BUFFER_SIZE (64*1024)
+/* ... or once the oldest has waited this long */
+#define STREAM_FLUSH_MS 100
+
+enum extcap_mode {
+	MODE_LE,
+	MODE_BREDR,
+};
+
+static const char *mode_names[] = {
+	[MODE_LE]    = "le",
+	[MODE_BREDR] = "bredr",
+};
+
+struct libusb_device_handle *devh = NULL;
+
+enum {
+	OPT_INTERFACES = 1,
+	OPT_DLTS,
+	OPT_CONFIG,
+	OPT_INTERFACE,
+	OPT_CAPTURE,
+	OPT_FIFO,
+	OPT_CHANNEL,
+	OPT_ACCESS_ADDRESS,
+	OPT_TARGET,
+	OPT_AA_ERRORS,
+	OPT_LAP,
+	OPT_UAP,
+	OPT_AC_ERRORS,
+	OPT_HELP,
+};
+
+static const struct option long_options[] = {
+	{ "extcap-interfaces", no_argument,       NULL, OPT_INTERFACES },
+	{ "extcap-dlts",       no_argument,       NULL, OPT_DLTS },
+	{ "extcap-config",     no_argument,       NULL, OPT_CONFIG },
+	{ "extcap-interface",  required_argument, NULL, OPT_INTERFACE },
+	{ "capture",           no_argument,       NULL, OPT_CAPTURE },
+	{ "fifo",              required_argument, NULL, OPT_FIFO },
+	/* names used by older Wireshark releases */
+	{ "list-interfaces",   no_argument,       NULL, OPT_INTERFACES },
+	{ "list-dlts",         no_argument,       NULL, OPT_DLTS },
+	{ "config",            no_argument,       NULL, OPT_CONFIG },
+	{ "interface",         required_argument, NULL, OPT_INTERFACE },
+	/* capture controls, see print_config() */
+	{ "channel",           required_argument, NULL, OPT_CHANNEL },
+	{ "access-address",    required_argument, NULL, OPT_ACCESS_ADDRESS },
+	{ "target",            required_argument, NULL, OPT_TARGET },
+	{ "aa-errors",         required_argument, NULL, OPT_AA_ERRORS },
+	{ "lap",               required_argument, NULL, OPT_LAP },
+	{ "uap",               required_argument, NULL, OPT_UAP },
+	{ "ac-errors",         required_argument, NULL, OPT_AC_ERRORS },
+	{ "help",              no_argument,       NULL, OPT_HELP },
+	{ NULL, 0, NULL, 0 }
+};
+
+static void usage(void)
+{
+	printf("ubertooth-extcap - Wireshark capture interface for Ubertooth\n");
+	printf("Usage:\n");
+	printf("\t--extcap-interfaces list capture interfaces\n");
+	printf("\t--extcap-dlts --extcap-interface <iface> list link types\n");
+	printf("\t--extcap-config --extcap-interface <iface> list capture options\n");
+	printf("\t--capture --extcap-interface <iface> --fifo <path> [options]\n");
+	printf("\n");
+	printf("    LE options (ubertooth<N>-le):\n");
+	printf("\t--channel <37-39> advertising channel (default 37)\n");
+	printf("\t--access-address <aa> follow this access address (8 hex)\n");
+	printf("\t--target <mac> follow connections of this device (example: 22:44:66:88:aa:cc)\n");
+	printf("\t--aa-errors <n> allow n access address offenses (default 32)\n");
+	printf("\n");
+	printf("    BR/EDR options (ubertooth<N>-bredr):\n");
+	printf("\t--channel <0-78> channel to listen on, otherwise keep the current one\n");
+	printf("\t--lap <LAP> to decode (6 hex), otherwise sniff all LAPs\n");
+	printf("\t--uap <UAP> to decode (2 hex), otherwise try to calculate (requires LAP)\n");
+	printf("\t--ac-errors <n> max_ac_errors (default: %d, range: 0-4)\n", max_ac_errors);
+}
+
+/* count attached devices the same way ubertooth_start() numbers them */
+static int count_ubertooths(void)
+{
+	struct libusb_device **usb_list = NULL;
+	struct libusb_device_descriptor desc;
+	int usb_devs, i, ubertooths = 0;
+
+	if (libusb_init(NULL) < 0)
+		return 0;
+
+	usb_devs = libusb_get_device_list(NULL, &usb_list);
+	for (i = 0; i < usb_devs; ++i) {
+		if (libusb_get_device_descriptor(usb_list[i], &desc) < 0)
+			continue;
+		if ((desc.idVendor == TC13_VENDORID && desc.idProduct == TC13_PRODUCTID)
+			|| (desc.idVendor == U0_VENDORID && desc.idProduct == U0_PRODUCTID)
+			|| (desc.idVendor == U1_VENDORID && desc.idProduct == U1_PRODUCTID))
+			ubertooths++;
+	}
+	if (usb_devs >= 0)
+		libusb_free_device_list(usb_list, 1);
+	libusb_exit(NULL);
+
+	return ubertooths;
+}
+
+static void print_interfaces(void)
+{
+	int i, ubertooths = count_ubertooths();
+
+	printf("extcap {version=%s}{help=https://github.com/greatscottgadgets/ubertooth/wiki}\n",
+	       VERSION);
+	for (i = 0; i < ubertooths; ++i) {
+		printf("interface {value=ubertooth%d-%s}{display=Ubertooth %d Bluetooth Low Energy}\n",
+		       i, mode_names[MODE_LE], i);
+		printf("interface {value=ubertooth%d-%s}{display=Ubertooth %d Bluetooth BR/EDR}\n",
+		       i, mode_names[MODE_BREDR], i);
+	}
+}
+
+static void print_dlts(enum extcap_mode mode)
+{
+	if (mode == MODE_LE)
+		printf("dlt {number=%d}{name=BLUETOOTH_LE_LL_WITH_PHDR}{display=Bluetooth Low Energy Link Layer}\n",
+		       DLT_BLUETOOTH_LE_LL_WITH_PHDR);
+	else
+		printf("dlt {number=%d}{name=BLUETOOTH_BREDR_BB}{display=Bluetooth BR/EDR Baseband}\n",
+		       DLT_BLUETOOTH_BREDR_BB);
+}
+
+static void print_config(enum extcap_mode mode)
+{
+	if (mode == MODE_LE) {
+		printf("arg {number=0}{call=--channel}{display=Advertising Channel}{type=selector}\n");
+		printf("value {arg=0}{value=37}{display=37}{default=true}\n");
+		printf("value {arg=0}{value=38}{display=38}{default=false}\n");
+		printf("value {arg=0}{value=39}{display=39}{default=false}\n");
+		printf("arg {number=1}{call=--access-address}{display=Access Address}{type=string}"
+		       "{tooltip=Follow connections with this access address (8 hex digits)}"
+		       "{validation=^[0-9a-fA-F]+$}\n");
+		printf("arg {number=2}{call=--target}{display=Follow Target}{type=string}"
+		       "{tooltip=Follow connections of this device (example: 22:44:66:88:aa:cc)}"
+		       "{validation=^[0-9a-fA-F:]+$}\n");
+		printf("arg {number=3}{call=--aa-errors}{display=Access Address Offenses}{type=integer}"
+		       "{range=0,32}{default=32}\n");
+	} else {
+		printf("arg {number=0}{call=--channel}{display=Channel}{type=integer}"
+		       "{range=0,78}{tooltip=Leave empty to keep the current channel}\n");
+		printf("arg {number=1}{call=--lap}{display=LAP}{type=string}"
+		       "{tooltip=LAP to decode (6 hex digits), otherwise sniff all LAPs}"
+		       "{validation=^[0-9a-fA-F]+$}\n");
+		printf("arg {number=2}{call=--uap}{display=UAP}{type=string}"
+		       "{tooltip=UAP to decode (2 hex digits), requires LAP}"
+		       "{validation=^[0-9a-fA-F]+$}\n");
+		printf("arg {number=3}{call=--ac-errors}{display=Access Code Errors}{type=integer}"
+		       "{range=0,4}{default=%d}\n", max_ac_errors);
+	}
+}
+
+/* ubertooth<N>-<mode> */
+static int parse_interface(const char *iface, int *device, enum extcap_mode *mode)
+{
+	char name[8];
+	unsigned m;
+
+	if (iface == NULL || sscanf(iface, "ubertooth%d-%7s", device, name) != 2)
+		return 0;
+	for (m = 0; m < sizeof(mode_names) / sizeof(mode_names[0]); ++m) {
+		if (strcmp(name, mode_names[m]) == 0) {
+			*mode = m;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int parse_mac_address(const char *s, u8 *mac)
+{
+	unsigned b[6];
+	int i, n = 0;
+
+	if (strlen(s) != 6 * 2 + 5 ||
+	    sscanf(s, "%2x:%2x:%2x:%2x:%2x:%2x%n",
+		   &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &n) != 6 ||
+	    n != 6 * 2 + 5)
+		return 0;
+	for (i = 0; i < 6; ++i)
+		mac[i] = b[i];
+	return 1;
+}
+
+static int open_fifo(const char *fifo)
+{
+	/* a closed FIFO is a write error, not a signal */
+	signal(SIGPIPE, SIG_IGN);
+	return open(fifo, O_WRONLY);
+}
+
+static int capture_le(int device, const char *fifo, int channel,
+		      int have_aa, u32 access_address,
+		      int have_target, u8 *target, btle_options *opts)
+{
+	usb_pkt_rx pkt;
+	int fd, r;
+
+	fd = open_fifo(fifo);
+	if (fd < 0) {
+		perror(fifo);
+		return 1;
+	}
+	if (lell_pcapng_create_stream(fd, "Ubertooth", STREAM_BUFFER_SIZE,
+				      STREAM_FLUSH_MS, &h_pcapng_le)) {
+		fprintf(stderr, "lell_pcapng_create_stream failed\n");
+		return 1;
+	}
+
+	devh = ubertooth_start(device);
+	if (devh == NULL)
+		return 1;
+	register_cleanup_handler(devh);
+
+	cmd_set_modulation(devh, MOD_BT_LOW_ENERGY);
+	if (have_aa)
+		cmd_set_access_address(devh, access_address);
+	if (have_target)
+		cmd_btle_set_target(devh, target);
+	cmd_set_channel(devh, channel == 37 ? 2402 : channel == 38 ? 2426 : 2480);
+	cmd_btle_sniffing(devh, 2);
+
+	/* drain the firmware queue, only sleeping once it is empty */
+	while (1) {
+		r = cmd_poll(devh, &pkt);
+		if (r < 0) {
+			fprintf(stderr, "USB error\n");
+			break;
+		}
+		if (r == sizeof(usb_pkt_rx))
+			cb_btle(opts, &pkt, 0);
+		else
+			usleep(500);
+
+		/* fails once Wireshark closes its end */
+		if (lell_pcapng_flush(h_pcapng_le, 0) < 0)
+			break;
+	}
+
+	ubertooth_stop(devh);
+	return 0;
+}
+
+static int capture_bredr(int device, const char *fifo, int channel,
+			 int have_lap, u32 lap, int have_uap, u8 uap)
+{
+	btbb_piconet *pn = NULL;
+	int fd;
+
+	fd = open_fifo(fifo);
+	if (fd < 0) {
+		perror(fifo);
+		return 1;
+	}
+	if (btbb_pcapng_create_stream(fd, "Ubertooth", STREAM_BUFFER_SIZE,
+				      STREAM_FLUSH_MS, &h_pcapng_bredr)) {
+		fprintf(stderr, "btbb_pcapng_create_stream failed\n");
+		return 1;
+	}
+
+	if (have_lap) {
+		pn = btbb_piconet_new();
+		btbb_init_piconet(pn, lap);
+		if (have_uap)
+			btbb_piconet_set_uap(pn, uap);
+	}
+
+	devh = ubertooth_start(device);
+	if (devh == NULL)
+		return 1;
+	register_cleanup_handler(devh);
+
+	cmd_set_modulation(devh, MOD_BT_BASIC_RATE);
+	if (channel >= 0)
+		cmd_set_channel(devh, 2402 + channel);
+
+	/* stream_rx_usb() flushes the stream as blocks come in */
+	rx_live(devh, pn, 0);
+
+	ubertooth_stop(devh);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	int do_interfaces = 0, do_dlts = 0, do_config = 0, do_capture = 0;
+	char *iface = NULL, *fifo = NULL, *end;
+	int device = 0;
+	enum extcap_mode mode = MODE_LE;
+	int channel = -1;
+	int have_aa = 0, have_target = 0, have_lap = 0, have_uap = 0;
+	u32 access_address = 0, lap = 0;
+	u8 uap = 0;
+	unsigned long val;
+	u8 target[6] = { 0, };
+	btle_options cb_opts = { .allowed_access_address_errors = 32 };
+
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != EOF) {
+		switch (opt) {
+		case OPT_INTERFACES:
+			do_interfaces = 1;
+			break;
+		case OPT_DLTS:
+			do_dlts = 1;
+			break;
+		case OPT_CONFIG:
+			do_config = 1;
+			break;
+		case OPT_INTERFACE:
+			iface = optarg;
+			break;
+		case OPT_CAPTURE:
+			do_capture = 1;
+			break;
+		case OPT_FIFO:
+			fifo = optarg;
+			break;
+		case OPT_CHANNEL:
+			channel = strtol(optarg, &end, 10);
+			if (*end != '\0')
+				channel = -2;
+			break;
+		case OPT_ACCESS_ADDRESS:
+			access_address = strtoul(optarg, &end, 16);
+			if (*optarg == '\0' || *end != '\0') {
+				fprintf(stderr, "Error: access address must be 8 hex digits\n");
+				return 1;
+			}
+			have_aa = 1;
+			break;
+		case OPT_TARGET:
+			if (!parse_mac_address(optarg, target)) {
+				fprintf(stderr, "Error: invalid target MAC address\n");
+				return 1;
+			}
+			have_target = 1;
+			break;
+		case OPT_AA_ERRORS:
+			cb_opts.allowed_access_address_errors = (unsigned) atoi(optarg);
+			if (cb_opts.allowed_access_address_errors > 32) {
+				fprintf(stderr, "Error: can tolerate 0-32 access address bit errors\n");
+				return 1;
+			}
+			break;
+		case OPT_LAP:
+			val = strtoul(optarg, &end, 16);
+			if (*optarg == '\0' || *end != '\0' || val > 0xffffff) {
+				fprintf(stderr, "Error: LAP must be up to 6 hex digits\n");
+				return 1;
+			}
+			lap = val;
+			have_lap = 1;
+			break;
+		case OPT_UAP:
+			val = strtoul(optarg, &end, 16);
+			if (*optarg == '\0' || *end != '\0' || val > 0xff) {
+				fprintf(stderr, "Error: UAP must be up to 2 hex digits\n");
+				return 1;
+			}
+			uap = val;
+			have_uap = 1;
+			break;
+		case OPT_AC_ERRORS:
+			max_ac_errors = atoi(optarg);
+			break;
+		case OPT_HELP:
+		case 'h':
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (do_interfaces) {
+		print_interfaces();
+		return 0;
+	}
+
+	/* everything else is about one interface */
+	if (!parse_interface(iface, &device, &mode)) {
+		fprintf(stderr, "Error: unknown interface %s\n", iface ? iface : "(none)");
+		return 1;
+	}
+
+	if (do_dlts) {
+		print_dlts(mode);
+		return 0;
+	}
+	if (do_config) {
+		print_config(mode);
+		return 0;
+	}
+	if (!do_capture) {
+		usage();
+		return 1;
+	}
+	if (fifo == NULL) {
+		fprintf(stderr, "Error: must specify --fifo\n");
+		return 1;
+	}
+
+	/* the capture goes to the FIFO; nobody reads stdout */
+	quiet = 1;
+
+	if (mode == MODE_LE) {
+		if (channel == -1)
+			channel = 37;
+		if (channel < 37 || channel > 39) {
+			fprintf(stderr, "Error: advertising channel must be 37, 38, or 39\n");
+			return 1;
+		}
+		return capture_le(device, fifo, channel, have_aa, access_address,
+				  have_target, target, &cb_opts);
+	}
+
+	if (channel < -1 || channel > 78) {
+		fprintf(stderr, "Error: channel must be 0-78\n");
+		return 1;
+	}
+	if (have_uap && !have_lap) {
+		fprintf(stderr, "Error: UAP but no LAP specified\n");
+		return 1;
+	}
+	return capture_bredr(device, fifo, channel, have_lap, lap, have_uap, uap);
+}